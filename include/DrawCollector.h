@@ -0,0 +1,88 @@
+#ifndef DRAW_COLLECTOR_H
+#define DRAW_COLLECTOR_H
+
+#include "GeometryPool.h"
+#include "Model.h"
+#include "Shader.h"
+#include <cstddef>
+#include <functional>
+#include <glm/glm.hpp>
+#include <unordered_map>
+#include <vector>
+
+/*
+    Draws of a pass submitted one at a time as a model, a transform and a
+    material index, and drawn grouped: every model at a level of detail
+    becomes a single instanced draw. The material index of every instance
+    goes with its matrices (see InstanceRing), for shaders that pick their
+    maps by instance from texture arrays. Passes that bind the maps of each
+    material instead give a binder, and draw once per material.
+
+    Instances are bucketed into contiguous matrix arrays when the pass is
+    flushed, so a pass of many instances of a few models costs a hash
+    lookup per add and a linear pass at the end. Runs larger than the room
+    left in the InstanceRing of the model are drawn in pieces, recycling
+    the ring in between (see InstanceRing::recycle).
+*/
+class DrawCollector {
+public:
+  // Binds the textures and uniforms of a material before its draws.
+  using MaterialBinder = std::function<void(unsigned int material)>;
+
+  void add(const Model &model, const glm::mat4 &transform,
+           unsigned int material = 0, unsigned int lod = 0);
+  // Draw the instances added since the last flush with shader, which must
+  // be in use, and clear them. Depth only draws ignore the materials.
+  // Returns the number of instanced draws.
+  size_t flush(const Shader &shader, bool depthOnly,
+               const MaterialBinder &bindMaterial = nullptr);
+  // Same through an indirect batch, submitted at the end and before every
+  // material that is bound.
+  size_t flush(IndirectBatch &batch, const GeometryPool &pool,
+               const Shader &shader, bool depthOnly, bool pullVertices,
+               const MaterialBinder &bindMaterial = nullptr);
+  size_t size() const;
+
+private:
+  struct Key {
+    const Model *model;
+    unsigned int lod;
+    unsigned int material;
+    bool operator==(const Key &other) const;
+  };
+  struct KeyHash {
+    size_t operator()(const Key &key) const;
+  };
+  // Instances that share a key, placed at first in the sorted arrays.
+  struct Group {
+    Key key;
+    unsigned int count;
+    unsigned int first;
+  };
+  // One instanced draw: a range of the sorted arrays.
+  struct Run {
+    const Model *model;
+    unsigned int lod;
+    unsigned int material;
+    unsigned int first;
+    unsigned int count;
+  };
+
+  void sortInstances(bool depthOnly, bool byMaterial);
+  void clear();
+
+  std::unordered_map<Key, unsigned int, KeyHash> groupIndices;
+  std::vector<Group> groups;
+  // Consecutive adds usually repeat the key.
+  unsigned int lastGroup = 0;
+  // As added.
+  std::vector<glm::mat4> transforms;
+  std::vector<unsigned int> instanceGroups;
+  // Grouped by flush.
+  std::vector<glm::mat4> models;
+  std::vector<glm::mat3> normMats;
+  std::vector<unsigned int> materials;
+  std::vector<Run> runs;
+};
+
+#endif
@@ -0,0 +1,139 @@
+#ifndef GEOMETRY_POOL_H
+#define GEOMETRY_POOL_H
+
+#include "InstanceRing.h"
+#include "Shader.h"
+#include "structures.h"
+#include <glad/glad.h>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/*
+    Vertices and indices of many meshes suballocated from a few large
+    buffers: a vertex buffer and a position only buffer per vertex
+    format, and one index buffer shared by all of them. Every format has one
+    vertex array for full draws and one for depth only draws, both reading
+    the instance matrices from an InstanceRing, so the meshes in the pool
+    draw without switching vertex arrays and their draws can be collected in
+    an IndirectBatch.
+
+    The buffers can also be read by the vertex pulling shaders
+    (object_pull.vs, shadow_map_pull.vs), which fetch the vertices and the
+    instance matrices from shader storage buffers. Their vertex array only
+    has the index buffer and an instance index attribute, and the compact
+    vertices are numbered after all the full ones, from getCompactBase() on,
+    so meshes of both formats draw together.
+
+    Ranges are allocated one after the other and never freed, the pool holds
+    the geometry of a scene for its whole lifetime. Meshes that do not fit
+    keep their own buffers. The buffers are immutable when
+    ARB_buffer_storage is available.
+*/
+class GeometryPool {
+public:
+  // Where the vertices and indices of a mesh live in the pool.
+  struct Allocation {
+    unsigned int firstVertex = 0;
+    // In bytes, a multiple of 4.
+    size_t indexOffset = 0;
+  };
+
+  GeometryPool(InstanceRing &ring, size_t verticesPerFormat = 1 << 19,
+               size_t indexBytes = 16 << 20);
+  ~GeometryPool();
+  GeometryPool(const GeometryPool &) = delete;
+  GeometryPool &operator=(const GeometryPool &) = delete;
+
+  // Reserve room for numVertices vertices of a format and indexBytes bytes
+  // of indices. False if the pool is full.
+  bool allocate(VertexFormat format, size_t numVertices, size_t indexBytes,
+                Allocation &allocation);
+  // Copy the data of an allocation into the pool, through the active
+  // UploadQueue if there is one. Null data is skipped. Returns the ticket of
+  // the upload, 0 if it is already done.
+  uint64_t upload(VertexFormat format, const Allocation &allocation,
+                  const void *vertices, const void *positions,
+                  size_t numVertices, const void *indices,
+                  size_t indexBytes);
+
+  unsigned int getVertexArray(VertexFormat format) const;
+  unsigned int getDepthVertexArray(VertexFormat format) const;
+  // Vertex array of the vertex pulling shaders, for both formats.
+  unsigned int getPullVertexArray() const;
+  // Bind the vertex buffers, or the position buffers for depth only draws,
+  // and the instance matrices to the bindings of the vertex pulling shaders.
+  void bindStorage(bool depthOnly) const;
+  unsigned int getCompactBase() const;
+  InstanceRing &getInstanceRing() const;
+  // Print how much of every buffer is in use.
+  void printUsage() const;
+
+  // Pool used by the meshes created from now on, none while it is null.
+  static GeometryPool *active();
+  static void setActive(GeometryPool *pool);
+
+private:
+  struct FormatBuffers {
+    unsigned int vertexBuffer = 0;
+    unsigned int positionBuffer = 0;
+    unsigned int vao = 0;
+    unsigned int depthVAO = 0;
+    size_t numVertices = 0;
+  };
+  InstanceRing &ring;
+  size_t verticesPerFormat;
+  std::array<FormatBuffers, 2> formats;
+  unsigned int indexBuffer;
+  unsigned int pullVAO;
+  // 0, 1, 2... read per instance, so the instance index includes the base
+  // instance of the draw.
+  unsigned int instanceIndexBuffer;
+  size_t indexCapacity;
+  size_t indexBytesUsed;
+};
+
+/*
+    Draws of meshes in a GeometryPool collected for one pass, see
+    Mesh::appendDraw. Commands are grouped by vertex format and index type
+    and submit writes them into an indirect buffer and draws each group
+    with a single glMultiDrawElementsIndirect. Only geometry and instances
+    differ between the commands: the textures and uniforms bound when the
+    batch is submitted apply to all of them.
+*/
+class IndirectBatch {
+public:
+  // Layout of GL_DRAW_INDIRECT_BUFFER commands.
+  struct Command {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint baseInstance;
+  };
+
+  IndirectBatch();
+  ~IndirectBatch();
+  IndirectBatch(const IndirectBatch &) = delete;
+  IndirectBatch &operator=(const IndirectBatch &) = delete;
+
+  void add(VertexFormat format, bool shortIndices, const Command &command);
+  // Draw the commands added since the last submit with shader, which must be
+  // in use, through the full or the depth only vertex arrays of the pool,
+  // and clear them. With pullVertices the shader is a vertex pulling one and
+  // both formats are drawn together. Returns the number of draw calls
+  // issued.
+  size_t submit(const Shader &shader, const GeometryPool &pool,
+                bool depthOnly, bool pullVertices = false);
+  size_t size() const;
+
+private:
+  // By 32 or 16-bit indices, then vertex format, so the formats of an index
+  // type are next to each other for the vertex pulling draws.
+  std::array<std::vector<Command>, 4> groups;
+  unsigned int buffer;
+  size_t capacity;
+};
+
+#endif
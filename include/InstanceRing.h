@@ -0,0 +1,95 @@
+#ifndef INSTANCE_RING_H
+#define INSTANCE_RING_H
+
+#include <glad/glad.h>
+#include <cstddef>
+#include <glm/glm.hpp>
+
+/*
+    Per instance model and normal matrices and material indices for the
+    draws of a frame. They live in one persistently mapped buffer split into
+    a region per frame in flight, each region holding an array of model
+    matrices, an array of normal matrices and an array of material indices
+    (texture array layers, read through COL_LOC) indexed by the same
+    instance. Draws allocate a block of instances in the region of the
+    current frame, write the matrices straight into it and draw with the
+    first instance of the block as their base instance, so the vertex arrays
+    point at the ring once and no buffer is reallocated per draw. A fence
+    closes every frame and the region is only written again once the GPU is
+    done with it. Frames that need more instances than a region holds
+    draw what fits, recycle the region and go on, see recycle.
+
+    Needs ARB_buffer_storage, see glext::bufferStorage. Meshes created while
+    no ring is active keep their own instance buffers.
+*/
+class InstanceRing {
+public:
+  static const unsigned int NUM_FRAMES = 3;
+
+  // Instances of one draw. Empty when the frame ran out of room.
+  struct Block {
+    unsigned int first = 0;
+    unsigned int count = 0;
+    glm::mat4 *models = nullptr;
+    glm::mat3 *normMats = nullptr;
+    unsigned int *materials = nullptr;
+  };
+
+  explicit InstanceRing(unsigned int instancesPerFrame = 16384);
+  ~InstanceRing();
+  InstanceRing(const InstanceRing &) = delete;
+  InstanceRing &operator=(const InstanceRing &) = delete;
+
+  // Room for count instances in the current frame, to be written by the
+  // caller before the frame ends.
+  Block allocate(unsigned int count);
+  // Allocate a block and copy the matrices and materials into it. normMats
+  // may be null, null materials are all 0.
+  Block write(unsigned int count, const glm::mat4 *models,
+              const glm::mat3 *normMats,
+              const unsigned int *materials = nullptr);
+  // Point the instanced model matrix attributes, and the normal matrix and
+  // material ones if normals is set, of the bound vertex array at the ring.
+  void bindAttributes(bool normals) const;
+  // Bind the model, normal matrix and material arrays to shader storage
+  // bindings, for shaders that index them by instance.
+  void bindStorage(unsigned int modelBinding, unsigned int normalBinding,
+                   unsigned int materialBinding) const;
+  // Number of instances of all the frames, instances are numbered below it.
+  unsigned int getCapacity() const;
+  // Instances that can still be allocated in the current frame.
+  unsigned int getRoom() const;
+  // Wait for the GPU to finish the commands issued so far and start the
+  // region of the current frame over. Every block allocated before has to
+  // be drawn, or submitted in an indirect batch, first.
+  void recycle();
+  // Fence the current frame and move to the next region, waiting for the
+  // GPU if it still reads it. Call once per frame after its last draw.
+  void endFrame();
+  // Print the bytes written and fence waits per frame since the last call
+  // and start over.
+  void printStats();
+
+  // Ring used by the meshes created from now on, none while it is null.
+  static InstanceRing *active();
+  static void setActive(InstanceRing *ring);
+
+private:
+  unsigned int buffer;
+  unsigned char *mapped;
+  unsigned int instancesPerFrame;
+  // Offsets of the normal matrix and material arrays in the buffer.
+  size_t normalsOffset;
+  size_t materialsOffset;
+  GLsync fences[NUM_FRAMES];
+  unsigned int frame;
+  unsigned int head;
+  // Statistics since the last print.
+  size_t frames;
+  size_t bytesWritten;
+  size_t fenceWaits;
+  size_t recycles;
+  size_t overflows;
+};
+
+#endif
@@ -0,0 +1,36 @@
+#ifndef LOD_STATS_H
+#define LOD_STATS_H
+
+#include <cstddef>
+#include <vector>
+
+/*
+    Per level of detail counters of the draws of a frame. Models record
+    their draws, the render loop closes every frame with its frame time and
+    prints the averages every now and then. The frame time of a level is
+    the average over the frames that drew it. Triangles removed by meshlet
+    culling are counted separately from the ones drawn.
+*/
+class LodStats {
+public:
+  void addDraw(unsigned int level, size_t triangles, size_t culled = 0);
+  // Close the current frame, frameTime is in milliseconds.
+  void endFrame(double frameTime);
+  // Print the averages since the last call and start over.
+  void print();
+
+private:
+  struct Level {
+    size_t draws = 0;
+    size_t triangles = 0;
+    size_t culled = 0;
+    size_t frames = 0;
+    double frameTime = 0.0;
+    bool drawn = false;
+  };
+  std::vector<Level> levels;
+  size_t frames = 0;
+  double frameTime = 0.0;
+};
+
+#endif
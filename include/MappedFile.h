@@ -0,0 +1,25 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <string>
+
+// Read-only memory mapping of a whole file. The mapping is released when the
+// object is destroyed.
+class MappedFile {
+public:
+  MappedFile(const std::string &path);
+  ~MappedFile();
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  bool isOpen() const;
+  const unsigned char *data() const;
+  size_t size() const;
+
+private:
+  void *mapping;
+  size_t length;
+};
+
+#endif
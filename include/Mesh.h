@@ -1,14 +1,25 @@
 #ifndef MESH_H
 #define MESH_H
 
+#include "GeometryPool.h"
+#include "InstanceRing.h"
 #include "Shader.h"
+#include "compact_vertex.h"
+#include "index_buffer.h"
+#include "meshlets.h"
 #include "structures.h"
+#include <cstdint>
 #include <glm/glm.hpp>
 #include <string>
 #include <vector>
 
 // Number of vertex buffers
-const unsigned int NUM_VBS = 4;
+const unsigned int NUM_VBS = 5;
+
+// Point the vertex attributes of the bound vertex array at the vertices, or
+// only the positions, of a format in the bound GL_ARRAY_BUFFER.
+void setupVertexAttributes(VertexFormat format);
+void setupPositionAttribute(VertexFormat format);
 
 class Mesh {
 public:
@@ -20,18 +31,105 @@ public:
   unsigned int simpId;
   // Functions
   Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices,
-       std::vector<Texture> textures, Material material);
+       std::vector<Texture> textures, Material material,
+       std::vector<LodLevel> lods = {},
+       std::vector<Meshlet> meshlets = {},
+       VertexFormat format = VertexFormat::Full);
   void freeMesh();
-  void Draw(Shader shader, unsigned int numInstances, glm::mat4 *models,
-            glm::mat3 *normMats) const;
+  // Draws the given level of detail, clamped to the coarsest one. A single
+  // instance of the finest level only draws the meshlets visible in view,
+  // if it is given. Returns the number of triangles drawn per instance.
+  size_t Draw(Shader shader, unsigned int numInstances, glm::mat4 *models,
+              glm::mat3 *normMats, unsigned int lod = 0,
+              const meshlets::View *view = nullptr) const;
+  // Same for instances from prepareInstances.
+  size_t Draw(Shader shader, const InstanceRing::Block &instances,
+              unsigned int lod = 0,
+              const meshlets::View *view = nullptr) const;
+  // Draws only the positions, from their own tightly packed buffer, for the
+  // depth only passes. The shader only gets the position decoding uniforms
+  // and the model matrices if they are given.
+  size_t DrawDepthOnly(const Shader &shader, unsigned int numInstances,
+                       glm::mat4 *models, unsigned int lod = 0,
+                       const meshlets::View *view = nullptr) const;
+  size_t DrawDepthOnly(const Shader &shader,
+                       const InstanceRing::Block &instances,
+                       unsigned int lod = 0,
+                       const meshlets::View *view = nullptr) const;
+  // Write the matrices and material indices of a draw where the vertex
+  // arrays read them: into the InstanceRing that was active when the mesh
+  // was created, or nowhere yet if there was none, the draw then uploads
+  // them itself. The block is empty if the ring is full. Null matrices are
+  // left as they are, null materials are all 0.
+  InstanceRing::Block
+  prepareInstances(unsigned int numInstances, glm::mat4 *models,
+                   glm::mat3 *normMats,
+                   unsigned int *materials = nullptr) const;
+  // Add the draw to an indirect batch instead of drawing it, with the
+  // position decoding folded into the instance matrices. Does nothing for
+  // meshes outside of a GeometryPool. Returns the number of triangles added
+  // per instance.
+  size_t appendDraw(IndirectBatch &batch, unsigned int numInstances,
+                    const glm::mat4 *models, const glm::mat3 *normMats,
+                    unsigned int lod = 0, const meshlets::View *view = nullptr,
+                    const unsigned int *materials = nullptr) const;
   void getTextureLocations(Shader shader);
+  // True if the geometry lives in a GeometryPool.
+  bool isPooled() const;
+  // Ring the instances are written to, null if the mesh uploads its own.
+  InstanceRing *getInstanceRing() const;
+  // False while the geometry is still being streamed by an UploadQueue.
+  bool isReady() const;
+  VertexFormat getVertexFormat() const;
+  // Size of a vertex in the vertex buffer in bytes.
+  size_t getVertexSize() const;
+  // Size of the vertex buffer in bytes, with the copies made for the index
+  // chunks.
+  size_t getVertexBytes() const;
+  // Size of the position only vertex buffer in bytes.
+  size_t getPositionBytes() const;
+  // Size of the index buffer in bytes.
+  size_t getIndexBytes() const;
+  const indexbuf::Layout &getIndexLayout() const;
+  // Quantization error of the compact format, zero for full vertices.
+  const compact::Error &getCompactError() const;
+  // Levels of detail, finest first. There is always at least one.
+  const std::vector<LodLevel> &getLods() const;
+  size_t getNumMeshlets() const;
 
 private:
   // Render Data
-  unsigned int VAO, EBO;
+  unsigned int VAO, depthVAO, EBO;
   unsigned int VBOs[NUM_VBS];
+  // Ring the instance attributes point at, if any.
+  InstanceRing *instanceRing;
+  // Pool holding the vertices and indices, the vertex arrays are then the
+  // ones of the pool and VBOs is unused.
+  GeometryPool *pool;
+  GeometryPool::Allocation allocation;
+  uint64_t uploadTicket;
+  std::vector<LodLevel> lods;
+  meshlets::Clusters clusters;
+  // Scratch space of the culled draws.
+  mutable std::vector<meshlets::Range> visibleRanges;
+  mutable std::vector<indexbuf::Chunk> parts;
+  mutable std::vector<int> counts;
+  mutable std::vector<const void *> offsets;
+  mutable std::vector<int> baseVertices;
+  indexbuf::Layout indexLayout;
+  VertexFormat format;
+  compact::Bounds bounds;
+  compact::Error compactError;
   // Functions
   void setupMesh();
+  void setupBuffers(const void *indexData, const void *vertexData,
+                    const void *positionData);
+  size_t collectParts(unsigned int numInstances, unsigned int lod,
+                      const meshlets::View *view) const;
+  unsigned int bindInstances(const InstanceRing::Block &instances,
+                             bool normals) const;
+  void drawParts(unsigned int vao, unsigned int numInstances,
+                 unsigned int baseInstance) const;
 };
 
 #endif
\ No newline at end of file
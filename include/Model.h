@@ -1,46 +1,103 @@
 #ifndef MODEL_H
 #define MODEL_H
 
+#include "LodStats.h"
 #include "Mesh.h"
+#include "mesh_lod.h"
 #include <array>
-#include <assimp/scene.h>
 #include <glm/glm.hpp>
 #include <string>
-#include <unordered_map>
 #include <vector>
 
 class Model {
 public:
   std::string directory;
+  // Level of detail selected for one view of the model, kept between
+  // frames for the hysteresis of selectLod.
+  struct LodState {
+    unsigned int level = 0;
+  };
   /*  Functions   */
   Model(std::string path, bool bSRGB = false,
-        std::vector<std::string> cubeMapPaths = {});
+        std::vector<std::string> cubeMapPaths = {},
+        VertexFormat vertexFormat = VertexFormat::Full,
+        meshlod::Settings lodSettings = {});
   ~Model();
+  // Meshlets outside of view are culled from single instance draws of the
+  // finest level, see Mesh::Draw.
   void Draw(const Shader &shader, unsigned int numInstances, glm::mat4 *models,
-            glm::mat3 *normMats) const;
+            glm::mat3 *normMats, unsigned int lod = 0,
+            const meshlets::View *view = nullptr) const;
+  // Positions only, for the depth only passes, see Mesh::DrawDepthOnly.
+  void DrawDepthOnly(const Shader &shader, unsigned int numInstances,
+                     glm::mat4 *models, unsigned int lod = 0,
+                     const meshlets::View *view = nullptr) const;
+  // Instances whose matrices the caller wrote into a block of the active
+  // InstanceRing, shared by all the meshes.
+  void Draw(const Shader &shader, const InstanceRing::Block &instances,
+            unsigned int lod = 0, const meshlets::View *view = nullptr) const;
+  void DrawDepthOnly(const Shader &shader,
+                     const InstanceRing::Block &instances, unsigned int lod = 0,
+                     const meshlets::View *view = nullptr) const;
+  // Add the draws of the meshes in a GeometryPool to an indirect batch, see
+  // Mesh::appendDraw, to be submitted the full or the depth only way. The
+  // other meshes are drawn right away with shader.
+  void appendDraw(IndirectBatch &batch, const Shader &shader, bool depthOnly,
+                  unsigned int numInstances, glm::mat4 *models,
+                  glm::mat3 *normMats, unsigned int lod = 0,
+                  const meshlets::View *view = nullptr,
+                  unsigned int *materials = nullptr) const;
+  // Write the instances of a draw once for all the meshes, see
+  // Mesh::prepareInstances.
+  InstanceRing::Block prepareInstances(unsigned int numInstances,
+                                       glm::mat4 *models, glm::mat3 *normMats,
+                                       unsigned int *materials = nullptr) const;
   void getTextureLocations(Shader shader);
   float getApproxWidth() const;
+  bool isReady() const;
+  // True if every mesh is suballocated from a GeometryPool.
+  bool isPooled() const;
+  // Ring shared by the meshes, null if they upload their own instances.
+  InstanceRing *getInstanceRing() const;
+  size_t getNumMeshes() const;
+  // Coarsest level of detail whose error, projected with the matrices into
+  // a viewport viewportHeight pixels high, stays below a pixel times bias.
+  unsigned int selectLod(LodState &state, const glm::mat4 &projection,
+                         const glm::mat4 &view, const glm::mat4 &model,
+                         float viewportHeight, float bias = 1.0f) const;
+  unsigned int getNumLods() const;
+  // Triangles drawn per instance at a level of detail.
+  size_t getTriangleCount(unsigned int lod) const;
+  size_t getNumMeshlets() const;
+  // Draws are counted in stats if it is set.
+  void setLodStats(LodStats *stats);
 
 private:
   /*  Model Data  */
   float approxWidth;
   bool bSRGB;
+  VertexFormat vertexFormat;
+  meshlod::Settings lodSettings;
+  // Error of every level of detail relative to approxWidth.
+  std::vector<float> lodErrors;
+  LodStats *lodStats;
   std::array<float, 14> boundingVolumeBounds;
   std::vector<Mesh> meshes;
-  std::unordered_map<std::string, Texture> loadedTextures;
   Texture cubeTex;
   unsigned int cubeMapID;
   unsigned int cubeMapLoc;
   /*  Functions   */
-  void buildBoundingVolume();
+  void buildBoundingVolume(const std::vector<MeshData> &meshData);
   void approximateWidth();
   void loadModel(std::string path);
-  void processNode(aiNode *node, const aiScene *scene);
-  Mesh processMesh(aiMesh *mesh, const aiScene *scene);
-  std::vector<Texture> loadMaterialTextures(aiMaterial *mat, aiTextureType type,
-                                            std::string typeName,
-                                            bool srgb = false);
-  Material loadMaterial(aiMaterial *mat);
+  bool importModel(const std::string &path, std::vector<MeshData> &meshData);
+  void createMeshes(std::vector<MeshData> &meshData);
+  void reportMemory() const;
+  void reportVertexFormat() const;
+  void buildLodErrors();
+  void recordDraw(unsigned int numInstances, unsigned int lod,
+                  size_t triangles) const;
+  Texture loadMaterialTexture(const TextureRef &ref);
 };
 
 #endif
\ No newline at end of file
@@ -2,16 +2,20 @@
 #define SHADER_H
 
 #include "Light.h"
-#include <array>
+#include "UniformTable.h"
+#include <chrono>
+#include <cstdint>
+#include <functional>
 #include <glm/glm.hpp>
 #include <map>
+#include <memory>
 #include <string>
+#include <vector>
 
-// Define indices in light arrays
-const unsigned int POS_ID = 0;
-const unsigned int DIR_ID = 1;
-
-// class for a shader program (includes vertex and fragment shaders)
+// class for a shader program (includes vertex and fragment shaders). The
+// uniforms are set through the table of the program (see UniformTable), so
+// they never query the driver and the program does not have to be in use.
+// Copies of a Shader share the table.
 class Shader {
 public:
   // program ID
@@ -22,7 +26,8 @@ public:
          const char *geometryPath = nullptr);
   Shader();
 
-  // initialization function (in case of default constructor)
+  // initialization function (in case of default constructor), builds the
+  // program on its own, see ShaderBatch to build several together
   void initVals(const char *vertexPath, const char *fragmentPath,
                 const char *geometryPath = nullptr);
 
@@ -30,10 +35,15 @@ public:
   void use() const;
 
   // Set the uniform values of a light.
-  void setLight(Light light);
+  void setLight(const Light &light) const;
   void setLightPos(const Light &light, const glm::mat4 &transform) const;
   void setLightDir(const Light &light, const glm::mat3 &dirNormMatrix) const;
 
+  // Typed handle to a uniform, the fastest way to set it in the render loop.
+  template <typename T> Uniform<T> uniform(UniformID name) const {
+    return uniforms->handle<T>(name);
+  }
+
   // utility functions to set the values of uniforms
   int getUnif(const std::string name) const;
   void setUnif(const int location, bool value) const;
@@ -50,26 +60,115 @@ public:
   void setUnif(const int location, glm::mat2 mat) const;
   void setUnif(const int location, glm::mat3 mat) const;
   void setUnif(const int location, glm::mat4 mat) const;
-  // These versions get the location and set the value, but it is slower to use
-  // them in the render loop.
-  void setUnifS(const std::string &name, bool value) const;
-  void setUnifS(const std::string &name, int value) const;
-  void setUnifS(const std::string &name, unsigned int value) const;
-  void setUnifS(const std::string &name, float value) const;
-  void setUnifS(const std::string &name, float xVal, float yVal) const;
-  void setUnifS(const std::string &name, float xVal, float yVal,
-                float zVal) const;
-  void setUnifS(const std::string &name, float xVal, float yVal, float zVal,
+  // These versions look the name up in the uniform table, names hashed at
+  // compile time (constexpr UniformID) skip the hashing.
+  void setUnifS(UniformID name, bool value) const;
+  void setUnifS(UniformID name, int value) const;
+  void setUnifS(UniformID name, unsigned int value) const;
+  void setUnifS(UniformID name, float value) const;
+  void setUnifS(UniformID name, float xVal, float yVal) const;
+  void setUnifS(UniformID name, float xVal, float yVal, float zVal) const;
+  void setUnifS(UniformID name, float xVal, float yVal, float zVal,
                 float wVal) const;
-  void setUnifS(const std::string &name, glm::vec2 vec) const;
-  void setUnifS(const std::string &name, glm::vec3 vec) const;
-  void setUnifS(const std::string &name, glm::vec4 vec) const;
-  void setUnifS(const std::string &name, glm::mat2 mat) const;
-  void setUnifS(const std::string &name, glm::mat3 mat) const;
-  void setUnifS(const std::string &name, glm::mat4 mat) const;
+  void setUnifS(UniformID name, glm::vec2 vec) const;
+  void setUnifS(UniformID name, glm::vec3 vec) const;
+  void setUnifS(UniformID name, glm::vec4 vec) const;
+  void setUnifS(UniformID name, glm::mat2 mat) const;
+  void setUnifS(UniformID name, glm::mat3 mat) const;
+  void setUnifS(UniformID name, glm::mat4 mat) const;
+
+private:
+  friend class ShaderBatch;
+
+  std::shared_ptr<UniformTable> uniforms = std::make_shared<UniformTable>();
+};
+
+// Shader programs built together. add submits the compilation and link of a
+// program without checking the results, so with KHR_parallel_shader_compile
+// the driver compiles all of them on its own threads while the caller loads
+// other assets, and finish checks them once the programs are needed. A
+// program must not be used before finish, the destructor finishes the batch
+// if it was not.
+class ShaderBatch {
+public:
+  ShaderBatch();
+  ~ShaderBatch();
+  ShaderBatch(const ShaderBatch &) = delete;
+  ShaderBatch &operator=(const ShaderBatch &) = delete;
+
+  // Build the program of shader from the stages at the paths, with the
+  // defines inserted in every stage (see shadersource::load). If a stage or
+  // one of its includes cannot be read nothing is compiled and the ID of
+  // shader is 0.
+  void add(Shader &shader, const char *vertexPath, const char *fragmentPath,
+           const char *geometryPath = nullptr,
+           const std::vector<std::string> &defines = {});
+  // True once every program has been compiled and linked, without blocking.
+  // Always true without KHR_parallel_shader_compile.
+  bool isReady() const;
+  // Wait for the programs, print the errors and the build times, read the
+  // uniform tables and store the new programs in the program cache.
+  void finish();
 
 private:
-  std::map<std::string, std::array<int, 2>> lightIDs;
+  struct Program {
+    Shader *shader;
+    std::vector<std::string> paths;
+    std::vector<std::string> defines;
+    // Of every stage, with its includes.
+    std::vector<std::vector<std::string>> files;
+    std::vector<unsigned int> stages;
+    std::string cachePath;
+    uint64_t cacheKey;
+    bool cached;
+    std::chrono::duration<double, std::milli> submitTime;
+  };
+  std::vector<Program> programs;
+  std::chrono::steady_clock::time_point start;
+};
+
+// Variants of a program built from the same stages with different options,
+// every option a #define in all of the stages, so each variant only has the
+// code it needs. A variant is keyed by the bits of its options and is only
+// compiled the first time it is requested. The init function runs once on
+// every variant before it is first returned, to set the uniforms that do not
+// change.
+class ShaderVariants {
+public:
+  using Init = std::function<void(Shader &shader)>;
+
+  ShaderVariants(const char *vertexPath, const char *fragmentPath,
+                 const std::vector<std::string> &options);
+  ShaderVariants(const ShaderVariants &) = delete;
+  ShaderVariants &operator=(const ShaderVariants &) = delete;
+
+  // Bit of an option in the keys, 0 if it is not one of the options.
+  unsigned int bit(const std::string &option) const;
+  void setInit(Init init);
+  // Add the variant of key to batch unless it was built already, so several
+  // variants compile together. It must not be used before batch finishes.
+  void request(ShaderBatch &batch, unsigned int key);
+  // The program of the variant of key, compiled now if it was not requested
+  // before.
+  Shader &get(unsigned int key);
+  // Number of variants built.
+  size_t size() const;
+  // The options of key, separated by spaces.
+  std::string describe(unsigned int key) const;
+
+private:
+  struct Variant {
+    Shader shader;
+    bool initialized = false;
+  };
+
+  std::vector<std::string> definesOf(unsigned int key) const;
+
+  std::string vertexPath;
+  std::string fragmentPath;
+  std::vector<std::string> options;
+  Init init;
+  std::map<unsigned int, Variant> variants;
 };
 
 #endif
\ No newline at end of file
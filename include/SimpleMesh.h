@@ -1,8 +1,11 @@
 #pragma once
 
+#include "GeometryPool.h"
+#include "InstanceRing.h"
 #include "Shader.h"
 #include "structures.h"
 #include <glad/glad.h>
+#include <cstdint>
 #include <glm/glm.hpp>
 #include <string>
 #include <vector>
@@ -22,6 +25,8 @@ public:
   void Draw(Shader shader, unsigned int numInstances, glm::mat4 *models,
             glm::mat3 *normMats);
   void getTextureLocations(Shader shader);
+  // False while the vertices are still being streamed by an UploadQueue.
+  bool isReady() const;
 
 private:
   // Render data
@@ -29,6 +34,13 @@ private:
   unsigned int VAO;
   unsigned int VBOs[SIMP_NUM_VBS];
   bool bSRGB;
+  // Ring the instance attributes point at, if any.
+  InstanceRing *instanceRing;
+  // Pool holding the vertices if they have the layout of full Mesh vertices,
+  // VAO is then the one of the pool.
+  GeometryPool *pool;
+  unsigned int firstVertex;
+  uint64_t uploadTicket;
   std::vector<Texture> loadTextures(std::vector<std::string> texturePaths,
                                     std::vector<GLenum> texParams = {});
   Texture loadCubeMaps(std::vector<std::string> texturePaths);
@@ -0,0 +1,33 @@
+#ifndef SUBMIT_STATS_H
+#define SUBMIT_STATS_H
+
+#include <cstddef>
+
+/*
+    Draw calls issued per frame and the CPU time spent submitting them, to
+    compare the direct and the indirect draw paths. Meshes and batches count
+    their calls in the active instance, the render loop adds the time of
+    its passes, closes every frame and prints the averages every now and
+    then.
+*/
+class SubmitStats {
+public:
+  void addCalls(size_t calls);
+  // Time in milliseconds.
+  void addTime(double time);
+  void endFrame();
+  // Print the averages since the last call, labelled with the draw path,
+  // and start over.
+  void print(const char *path);
+
+  // Counters the draws are recorded in, none while it is null.
+  static SubmitStats *active();
+  static void setActive(SubmitStats *stats);
+
+private:
+  size_t frames = 0;
+  size_t calls = 0;
+  double time = 0.0;
+};
+
+#endif
@@ -0,0 +1,63 @@
+#ifndef TEXTURE_REGISTRY_H
+#define TEXTURE_REGISTRY_H
+
+#include "texture_loader.h"
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/*
+    Process-wide registry of loaded textures. Textures are keyed by their
+    normalized path plus every load parameter, and optionally by a hash of
+    the file contents, so a texture requested twice is decoded and uploaded
+    only once. Every acquire adds a reference to the returned texture ID and
+    every release drops one; the GL texture is deleted with the last
+    reference. Only use it from the GL thread.
+*/
+class TextureRegistry {
+public:
+  static TextureRegistry &instance();
+
+  unsigned int acquire(const TextureRequest &request);
+  // Decode every texture that is not loaded yet in parallel. The IDs are in
+  // request order and each holds one reference.
+  std::vector<unsigned int>
+  acquire(const std::vector<TextureRequest> &requests);
+  // Look up a texture by an arbitrary key and create it if it is missing.
+  unsigned int acquire(const std::string &key,
+                       const std::function<unsigned int()> &create);
+
+  void retain(unsigned int id);
+  void release(unsigned int id);
+
+  // Also match textures by file contents, not only by path and parameters.
+  void setContentHashing(bool enabled);
+
+  size_t size() const;
+  unsigned int hits() const;
+  unsigned int misses() const;
+
+  static std::string makeKey(const TextureRequest &request);
+
+private:
+  struct Entry {
+    unsigned int refCount;
+    std::vector<std::string> keys;
+    uint64_t contentHash;
+  };
+
+  std::unordered_map<std::string, unsigned int> byKey;
+  std::unordered_map<uint64_t, unsigned int> byContent;
+  std::unordered_map<unsigned int, Entry> entries;
+  bool contentHashing;
+  unsigned int numHits;
+  unsigned int numMisses;
+
+  TextureRegistry();
+  unsigned int addReference(unsigned int id, const std::string &key);
+  void insert(unsigned int id, const std::string &key, uint64_t contentHash);
+};
+
+#endif
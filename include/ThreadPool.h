@@ -0,0 +1,57 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+// Fixed-size pool of worker threads for CPU-side loading work. Tasks must not
+// make GL calls, the GL context only lives on the main thread.
+class ThreadPool {
+public:
+  ThreadPool(unsigned int numThreads = std::thread::hardware_concurrency());
+  ~ThreadPool();
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  // Queue a task, the returned future holds its result.
+  template <typename F>
+  auto submit(F task) -> std::future<decltype(task())> {
+    using Result = decltype(task());
+    auto packaged =
+        std::make_shared<std::packaged_task<Result()>>(std::move(task));
+    std::future<Result> result = packaged->get_future();
+    {
+      std::lock_guard<std::mutex> lock(queueMutex);
+      tasks.emplace([packaged]() { (*packaged)(); });
+    }
+    condition.notify_one();
+    return result;
+  }
+
+  // Split [0, count) into chunks and run body(begin, end) on them, returning
+  // once every chunk is done. Must not be called from inside a pool task.
+  void parallelFor(size_t count,
+                   const std::function<void(size_t, size_t)> &body);
+
+  unsigned int size() const;
+
+  // Pool shared by the loaders, sized to the number of hardware threads.
+  static ThreadPool &shared();
+
+private:
+  std::vector<std::thread> workers;
+  std::queue<std::function<void()>> tasks;
+  std::mutex queueMutex;
+  std::condition_variable condition;
+  bool stopping;
+
+  void workerLoop();
+};
+
+#endif
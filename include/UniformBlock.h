@@ -0,0 +1,31 @@
+#ifndef UNIFORM_BLOCK_H
+#define UNIFORM_BLOCK_H
+
+#include <cstddef>
+
+/*
+    Uniform buffer of a block shared by every program that declares it,
+    bound to a fixed binding point, so its values are written once however
+    many programs read them. The whole block is replaced at once, at most
+    once per frame, with a single mapped write into storage orphaned from
+    the previous frame, so the write does not wait for the draws still
+    reading the old values.
+*/
+class UniformBlock {
+public:
+  UniformBlock(unsigned int binding, size_t size);
+  ~UniformBlock();
+  UniformBlock(const UniformBlock &) = delete;
+  UniformBlock &operator=(const UniformBlock &) = delete;
+
+  // Replace the contents of the block with the size bytes at data, usually
+  // one of the structs of uniform_blocks.h.
+  void write(const void *data);
+
+private:
+  unsigned int buffer;
+  unsigned int binding;
+  size_t size;
+};
+
+#endif
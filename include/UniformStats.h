@@ -0,0 +1,37 @@
+#ifndef UNIFORM_STATS_H
+#define UNIFORM_STATS_H
+
+#include <cstddef>
+
+/*
+    Uniform uploads per frame, the redundant ones that were skipped because
+    the program already had the value, and the bytes written to uniform
+    blocks. Uniform tables and blocks count their writes in the active
+    instance, the render loop closes every frame and prints the averages
+    every now and then.
+*/
+class UniformStats {
+public:
+  void addUpload() { ++uploads; }
+  void addSkipped() { ++skipped; }
+  void addBlockWrite(size_t bytes) {
+    ++blockWrites;
+    blockBytes += bytes;
+  }
+  void endFrame();
+  // Print the averages since the last call and start over.
+  void print();
+
+  // Counters the uniform sets are recorded in, none while it is null.
+  static UniformStats *active();
+  static void setActive(UniformStats *stats);
+
+private:
+  size_t frames = 0;
+  size_t uploads = 0;
+  size_t skipped = 0;
+  size_t blockWrites = 0;
+  size_t blockBytes = 0;
+};
+
+#endif
@@ -0,0 +1,165 @@
+#ifndef UNIFORM_TABLE_H
+#define UNIFORM_TABLE_H
+
+#include "UniformStats.h"
+#include "hashing.h"
+#include <cstdint>
+#include <cstring>
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+
+// Name of a uniform, hashed with FNV-1a. Names known at compile time are
+// hashed by the compiler when the UniformID is constexpr:
+//   constexpr UniformID VIEW_UNIF("view");
+struct UniformID {
+  constexpr UniformID(const char *name) : hash(fnv1a64Str(name)) {}
+  UniformID(const std::string &name)
+      : hash(fnv1a64(name.data(), name.size())) {}
+
+  // The ID of this name followed by suffix, such as a struct member
+  // (".position"), without building the string.
+  constexpr UniformID append(const char *suffix) const {
+    return UniformID(fnv1a64Str(suffix, hash));
+  }
+
+  uint64_t hash;
+
+private:
+  explicit constexpr UniformID(uint64_t hash) : hash(hash) {}
+};
+
+class UniformTable;
+
+// Typed handle to a uniform of a program. set skips the upload when the
+// program already has the value. An inactive handle (a uniform the program
+// does not have, or of another type) ignores the values. Valid as long as a
+// Shader of the program is.
+template <typename T> class Uniform {
+public:
+  Uniform() = default;
+
+  void set(const T &value) const;
+  bool isActive() const { return table != nullptr; }
+
+private:
+  friend class UniformTable;
+  Uniform(UniformTable *table, int index) : table(table), index(index) {}
+
+  UniformTable *table = nullptr;
+  int index = -1;
+};
+
+/*
+    The active uniforms of a linked program, read once with
+    glGetActiveUniform so the render loop never asks the driver for a
+    location. Every uniform keeps a copy of the value the program has,
+    initialized from the program, and sets of the same value are skipped.
+    Values are uploaded with glProgramUniform, so the program does not have
+    to be in use. Members of arrays are separate uniforms ("name[1]"),
+    "name" is the first one. Uniforms of blocks are not in the table.
+*/
+class UniformTable {
+public:
+  // Read the uniforms of program, which must be linked, and drop the old
+  // ones.
+  void build(unsigned int program);
+
+  // Index of the uniform, -1 if the program has no such active uniform.
+  int find(UniformID name) const;
+  // Index of the uniform at location, -1 if there is none.
+  int findLocation(int location) const;
+
+  // Handle to the uniform, inactive if there is no such uniform of type T.
+  template <typename T> Uniform<T> handle(UniformID name);
+
+  // Set the uniform at index, unless it already has value.
+  template <typename T> void set(int index, const T &value);
+  // Set the uniform at location, uploaded directly if it is not in the
+  // table.
+  template <typename T> void setLocation(int location, const T &value);
+
+private:
+  struct Entry {
+    uint64_t hash;
+    int location;
+    unsigned int type;
+    // Of the copy of the value in values, in bytes.
+    size_t offset;
+    size_t size;
+    std::string name;
+  };
+
+  static void upload(unsigned int program, int location, int value);
+  static void upload(unsigned int program, int location, float value);
+  static void upload(unsigned int program, int location, const glm::vec2 &vec);
+  static void upload(unsigned int program, int location, const glm::vec3 &vec);
+  static void upload(unsigned int program, int location, const glm::vec4 &vec);
+  static void upload(unsigned int program, int location, const glm::mat2 &mat);
+  static void upload(unsigned int program, int location, const glm::mat3 &mat);
+  static void upload(unsigned int program, int location, const glm::mat4 &mat);
+  // Size of a value of a uniform of type, 0 if it cannot be set.
+  static size_t typeSize(unsigned int type);
+  // Print the error of a handle to a uniform of another type.
+  static void typeMismatch(const std::string &name);
+
+  unsigned int program = 0;
+  // Sorted by hash.
+  std::vector<Entry> entries;
+  // Index in entries of every location, -1 for the unused ones.
+  std::vector<int> locations;
+  std::vector<unsigned char> values;
+};
+
+template <typename T> void Uniform<T>::set(const T &value) const {
+  if (table != nullptr)
+    table->set(index, value);
+}
+
+template <typename T> Uniform<T> UniformTable::handle(UniformID name) {
+  int index = find(name);
+  if (index < 0)
+    return Uniform<T>();
+  if (entries[index].size != sizeof(T)) {
+    typeMismatch(entries[index].name);
+    return Uniform<T>();
+  }
+  return Uniform<T>(this, index);
+}
+
+template <typename T> void UniformTable::set(int index, const T &value) {
+  if (index < 0)
+    return;
+  const Entry &entry = entries[index];
+  UniformStats *stats = UniformStats::active();
+  // A value of another type is uploaded anyway for the driver to report,
+  // and is not kept since the program rejects it.
+  if (entry.size == sizeof(T)) {
+    unsigned char *copy = values.data() + entry.offset;
+    if (std::memcmp(copy, &value, sizeof(T)) == 0) {
+      if (stats)
+        stats->addSkipped();
+      return;
+    }
+    std::memcpy(copy, &value, sizeof(T));
+  }
+  if (stats)
+    stats->addUpload();
+  upload(program, entry.location, value);
+}
+
+template <typename T>
+void UniformTable::setLocation(int location, const T &value) {
+  if (location < 0)
+    return;
+  int index = findLocation(location);
+  if (index >= 0) {
+    set(index, value);
+    return;
+  }
+  if (UniformStats *stats = UniformStats::active())
+    stats->addUpload();
+  upload(program, location, value);
+}
+
+#endif
@@ -0,0 +1,104 @@
+#ifndef UPLOAD_QUEUE_H
+#define UPLOAD_QUEUE_H
+
+#include <glad/glad.h>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+/*
+    Streams texture and buffer data to the GPU through a staging ring buffer.
+    Uploads are queued with their destination already allocated, and every
+    frame processFrame() copies at most frameBudget bytes into the ring and
+    issues the GL copies from it, so large assets are spread over several
+    frames instead of stalling one. Completion is tracked with fences: each
+    upload returns a ticket which becomes ready once the fence of the frame
+    that submitted its last chunk has signaled. Chunks are at most half of
+    the ring, texture rows wider than that are split into pieces of a row.
+    An upload that still cannot fit, in a ring too small for a single
+    pixel, is dropped with an error and its ticket reported ready.
+
+    The staging buffer is persistently mapped when ARB_buffer_storage is
+    available and mapped unsynchronized per chunk otherwise. The queue only
+    uses GL, no window system calls, so it runs under a headless software
+    context as well.
+*/
+class UploadQueue {
+public:
+  UploadQueue(size_t stagingSize = 32 << 20, size_t frameBudget = 8 << 20);
+  ~UploadQueue();
+  UploadQueue(const UploadQueue &) = delete;
+  UploadQueue &operator=(const UploadQueue &) = delete;
+
+  // Queue a level of a 2D texture whose storage already exists. The pixels
+  // are tightly packed rows of GL_UNSIGNED_BYTE.
+  uint64_t queueTexture(unsigned int texture, GLint level, int width,
+                        int height, GLenum format, int nrComponents,
+                        std::shared_ptr<const unsigned char> pixels,
+                        bool generateMips);
+  // Queue a copy into an existing buffer object. The data is copied.
+  uint64_t queueBuffer(unsigned int buffer, size_t offset, const void *data,
+                       size_t size);
+
+  // Retire finished frames and submit the next chunks. Call once per frame.
+  void processFrame();
+  // Submit everything that is queued and wait for the GPU to consume it.
+  void finish();
+
+  bool isReady(uint64_t ticket);
+  bool isTextureReady(unsigned int texture);
+  size_t pendingBytes() const;
+
+  // Queue used by the loaders, uploads are synchronous while none is set.
+  static UploadQueue *active();
+  static void setActive(UploadQueue *queue);
+
+private:
+  struct Job {
+    uint64_t ticket;
+    bool isTexture;
+    unsigned int object;
+    GLint level;
+    size_t dstOffset;
+    int width;
+    int height;
+    GLenum format;
+    size_t rowSize;
+    bool generateMips;
+    std::shared_ptr<const unsigned char> data;
+    size_t size;
+    size_t submitted;
+  };
+  struct Frame {
+    GLsync fence;
+    uint64_t lastTicket;
+    size_t end;
+    size_t bytes;
+  };
+
+  unsigned int staging;
+  unsigned char *mapped;
+  size_t capacity;
+  size_t head;
+  size_t tail;
+  size_t used;
+  size_t frameBudget;
+  size_t frameBytes;
+  uint64_t nextTicket;
+  uint64_t completedTicket;
+  uint64_t submittedTicket;
+  std::deque<Job> jobs;
+  std::deque<Frame> frames;
+  std::unordered_map<unsigned int, uint64_t> textureTickets;
+
+  void retireFrames(bool wait);
+  bool submitChunk(Job &job, size_t budget);
+  // Drop the first job, which does not fit in the empty ring.
+  void rejectJob();
+  bool allocateStaging(size_t size, size_t &offset);
+  void writeStaging(size_t offset, const unsigned char *src, size_t size);
+};
+
+#endif
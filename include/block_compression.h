@@ -0,0 +1,38 @@
+#ifndef BLOCK_COMPRESSION_H
+#define BLOCK_COMPRESSION_H
+
+#include <cstddef>
+#include <vector>
+
+/*
+    CPU encoders for the BCn block compressed formats. Every encoder takes a
+    4x4 block of RGBA8 pixels (64 bytes, row-major) and writes one compressed
+    block. The encoders favour speed over quality: endpoints are fitted along
+    the principal axis of the block and every pixel takes the closest palette
+    entry.
+*/
+namespace bc {
+
+enum class Format { BC1, BC4, BC5, BC7 };
+
+// BC1: opaque RGB, 8 bytes per block.
+void encodeBC1(const unsigned char *block, unsigned char *out);
+// BC4: one channel, 8 bytes per block.
+void encodeBC4(const unsigned char *block, int channel, unsigned char *out);
+// BC5: red and green channels, 16 bytes per block.
+void encodeBC5(const unsigned char *block, unsigned char *out);
+// BC7 (mode 6 only): RGBA, 16 bytes per block.
+void encodeBC7(const unsigned char *block, unsigned char *out);
+
+size_t blockSize(Format format);
+size_t compressedSize(Format format, int width, int height);
+
+// Compress a whole RGBA8 image. Partial blocks at the right and bottom edges
+// repeat the last column and row. Block rows are encoded in parallel on the
+// shared thread pool.
+std::vector<unsigned char> compressImage(const unsigned char *rgba, int width,
+                                         int height, Format format);
+
+} // namespace bc
+
+#endif
@@ -0,0 +1,56 @@
+#ifndef COMPACT_VERTEX_H
+#define COMPACT_VERTEX_H
+
+#include "structures.h"
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <vector>
+
+/*
+    Encoding of the compact vertex format, 20 bytes per vertex instead of
+    the 44 of Vertex. Positions are 16-bit unsigned normalized values within
+    the bounds of the mesh, the vertex shaders scale them back with the
+    posScale and posOffset uniforms. Normals and tangents are octahedral
+    encoded into the x and y fields of a GL_INT_2_10_10_10_REV value with
+    w = 0, float normals are vec3 attributes which read w = 1, so the
+    shaders tell both formats apart without a uniform. Texture coordinates
+    are half floats.
+*/
+namespace compact {
+
+// Maps the normalized positions back to object space.
+struct Bounds {
+  glm::vec3 scale = glm::vec3(1.0f);
+  glm::vec3 offset = glm::vec3(0.0f);
+};
+
+Bounds computeBounds(const std::vector<Vertex> &vertices);
+
+uint32_t encodeDirection(glm::vec3 direction);
+glm::vec3 decodeDirection(uint32_t packed);
+
+CompactVertex encode(const Vertex &vertex, const Bounds &bounds);
+// Decode a vertex the way GL does, for error measurements.
+Vertex decode(const CompactVertex &vertex, const Bounds &bounds);
+std::vector<CompactVertex> encode(const std::vector<Vertex> &vertices,
+                                  const Bounds &bounds);
+
+// Largest errors of the compact format.
+struct Error {
+  // In object space units and as a fraction of the largest mesh extent.
+  float position = 0.0f;
+  float relativePosition = 0.0f;
+  float normalDegrees = 0.0f;
+  float tangentDegrees = 0.0f;
+  float texCoord = 0.0f;
+
+  void merge(const Error &other);
+};
+
+Error measureError(const std::vector<Vertex> &vertices,
+                   const std::vector<CompactVertex> &encoded,
+                   const Bounds &bounds);
+
+} // namespace compact
+
+#endif
@@ -0,0 +1,83 @@
+#ifndef DDS_H
+#define DDS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+    Reading and writing of the DDS files made by the texture baker and the
+    mip cache of the loader. Only 2D textures with a DX10 header are
+    supported. The rows are stored in the order GL expects them (bottom row
+    first when the image was flipped) and the transforms applied to the
+    source are recorded in the reserved header fields, so the loader can
+    tell whether a file matches a load request.
+*/
+namespace dds {
+
+// DXGI formats written by the baker and the mip cache.
+const uint32_t FORMAT_RGBA8_UNORM = 28;
+const uint32_t FORMAT_RGBA8_UNORM_SRGB = 29;
+const uint32_t FORMAT_RG8_UNORM = 49;
+const uint32_t FORMAT_R8_UNORM = 61;
+const uint32_t FORMAT_BC1_UNORM = 71;
+const uint32_t FORMAT_BC1_UNORM_SRGB = 72;
+const uint32_t FORMAT_BC4_UNORM = 80;
+const uint32_t FORMAT_BC5_UNORM = 83;
+const uint32_t FORMAT_BC7_UNORM = 98;
+const uint32_t FORMAT_BC7_UNORM_SRGB = 99;
+
+// Flags describing how the source image was transformed.
+const uint32_t BAKE_FLIP = 1 << 0;
+const uint32_t BAKE_FLIP_GREEN = 1 << 1;
+// The mips were filtered in linear space.
+const uint32_t BAKE_SRGB = 1 << 2;
+// The mips were renormalized as normal vectors.
+const uint32_t BAKE_NORMAL_MAP = 1 << 3;
+// Bits 4-6 hold the extracted channel plus one, 0 if all were kept.
+const int BAKE_CHANNEL_SHIFT = 4;
+// The mips were filtered with clamped instead of wrapping edges.
+const uint32_t BAKE_CLAMP = 1 << 7;
+
+uint32_t bakeFlags(bool flip, bool flipGreen, bool srgb, bool normalMap,
+                   bool clamp, int channel);
+
+struct MipLevel {
+  int width;
+  int height;
+  size_t offset;
+  size_t size;
+};
+
+struct Description {
+  uint32_t format = 0;
+  int width = 0;
+  int height = 0;
+  uint32_t bakeFlags = 0;
+  std::vector<MipLevel> levels;
+};
+
+// Path of the baked file for a source image: the extension is replaced by
+// .dds.
+std::string bakedPath(const std::string &source);
+
+// Path of the mip cache the loader writes for a source image loaded with
+// the given bake flags.
+std::string cachePath(const std::string &source, uint32_t flags);
+
+bool isCompressed(uint32_t format);
+// Bytes in one mip level, 0 if the format is unknown.
+size_t levelSize(uint32_t format, int width, int height);
+
+// Read a baked file. The level data is returned in a buffer allocated with
+// malloc, nullptr if the file is missing or not supported.
+unsigned char *read(const std::string &path, Description &desc);
+
+// Write the levels in desc.levels, which point into data.
+bool write(const std::string &path, const Description &desc,
+           const unsigned char *data);
+
+} // namespace dds
+
+#endif
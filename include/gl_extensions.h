@@ -0,0 +1,47 @@
+#ifndef GL_EXTENSIONS_H
+#define GL_EXTENSIONS_H
+
+#include <glad/glad.h>
+
+/*
+    Entry points and tokens that are not part of the generated GL 4.3 core
+    loader. They are loaded at runtime and each group has a flag telling
+    whether the driver supports it, callers must fall back when it is false.
+*/
+namespace glext {
+
+// ARB_buffer_storage (core in GL 4.4).
+const GLbitfield MAP_PERSISTENT_BIT = 0x0040;
+const GLbitfield MAP_COHERENT_BIT = 0x0080;
+const GLbitfield DYNAMIC_STORAGE_BIT = 0x0100;
+const GLbitfield CLIENT_STORAGE_BIT = 0x0200;
+typedef void(APIENTRYP PFNGLBUFFERSTORAGEPROC)(GLenum target, GLsizeiptr size,
+                                              const void *data,
+                                              GLbitfield flags);
+extern bool bufferStorage;
+extern PFNGLBUFFERSTORAGEPROC BufferStorage;
+
+// EXT_texture_compression_s3tc and the sRGB variant from EXT_texture_sRGB.
+const GLenum COMPRESSED_RGB_S3TC_DXT1 = 0x83F0;
+const GLenum COMPRESSED_SRGB_S3TC_DXT1 = 0x8C4C;
+extern bool textureCompressionS3TC;
+
+// KHR_parallel_shader_compile, or the ARB version of it.
+const GLenum MAX_SHADER_COMPILER_THREADS = 0x91B0;
+const GLenum COMPLETION_STATUS = 0x91B1;
+typedef void(APIENTRYP PFNGLMAXSHADERCOMPILERTHREADSPROC)(GLuint count);
+extern bool parallelShaderCompile;
+extern PFNGLMAXSHADERCOMPILERTHREADSPROC MaxShaderCompilerThreads;
+
+// Load the entry points with the same loader that was given to GLAD. Needs a
+// current context.
+void load(GLADloadproc loader);
+
+bool hasExtension(const char *name);
+
+// True if the context version is at least major.minor.
+bool hasVersion(int major, int minor);
+
+} // namespace glext
+
+#endif
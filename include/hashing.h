@@ -0,0 +1,43 @@
+#ifndef HASHING_H
+#define HASHING_H
+
+#include <cstddef>
+#include <cstdint>
+
+// 64-bit FNV-1a, used to key on-disk caches by content and to look up
+// uniforms by name.
+const uint64_t FNV_OFFSET_BASIS = 14695981039346656037ULL;
+const uint64_t FNV_PRIME = 1099511628211ULL;
+
+constexpr uint64_t fnv1a64(const char *data, size_t size,
+                           uint64_t seed = FNV_OFFSET_BASIS) {
+  uint64_t hash = seed;
+  for (size_t i = 0; i < size; ++i) {
+    hash ^= static_cast<uint8_t>(data[i]);
+    hash *= FNV_PRIME;
+  }
+  return hash;
+}
+
+// Hash of a NUL terminated string, without the terminator.
+constexpr uint64_t fnv1a64Str(const char *str,
+                              uint64_t seed = FNV_OFFSET_BASIS) {
+  uint64_t hash = seed;
+  for (; *str != '\0'; ++str) {
+    hash ^= static_cast<uint8_t>(*str);
+    hash *= FNV_PRIME;
+  }
+  return hash;
+}
+
+inline uint64_t fnv1a64(const void *data, size_t size,
+                        uint64_t seed = FNV_OFFSET_BASIS) {
+  return fnv1a64(static_cast<const char *>(data), size, seed);
+}
+
+// Mix a plain value into a running hash.
+template <typename T> inline uint64_t hashValue(const T &value, uint64_t seed) {
+  return fnv1a64(&value, sizeof(T), seed);
+}
+
+#endif
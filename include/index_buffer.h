@@ -0,0 +1,55 @@
+#ifndef INDEX_BUFFER_H
+#define INDEX_BUFFER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/*
+    Layout of the index buffers on the GPU. Meshes with up to 65536
+    vertices store 16-bit indices. Larger meshes are cut into chunks of
+    consecutive triangles that are drawn with their own base vertex. When
+    the vertices of a chunk lie within 65536 of each other its indices are
+    relative to the smallest one; otherwise, as for the levels of detail
+    which use vertices from all over the mesh, its vertices are copied to
+    the end of the vertex buffer in the order it uses them. Meshes for which
+    the copies would cost more than the 16-bit indices save keep 32-bit
+    indices in a single chunk.
+*/
+namespace indexbuf {
+
+const size_t MAX_SHORT_VERTICES = 65536;
+// Smallest chunk that refers to the vertices in place, shorter runs of
+// nearby vertices go into a chunk with copied vertices.
+const size_t MIN_CHUNK_TRIANGLES = 1024;
+
+// Part of the index buffer, its indices are relative to baseVertex.
+struct Chunk {
+  unsigned int firstIndex;
+  unsigned int numIndices;
+  unsigned int baseVertex;
+};
+
+struct Layout {
+  bool shortIndices = false;
+  // Cover the whole index buffer in order.
+  std::vector<Chunk> chunks;
+  // Vertices copied after the mesh vertices in the vertex buffer.
+  std::vector<unsigned int> extraVertices;
+
+  size_t indexSize() const;
+};
+
+// Pick the layout of indices with vertices of vertexSize bytes, shorts is
+// set to the 16-bit indices if it uses them.
+Layout plan(const std::vector<unsigned int> &indices, size_t numVertices,
+            size_t vertexSize, std::vector<uint16_t> &shorts);
+
+// Append the parts of the indices [firstIndex, firstIndex + numIndices) in
+// every chunk they cross.
+void splitRange(const Layout &layout, unsigned int firstIndex,
+                unsigned int numIndices, std::vector<Chunk> &parts);
+
+} // namespace indexbuf
+
+#endif
@@ -0,0 +1,37 @@
+#ifndef MESH_CACHE_H
+#define MESH_CACHE_H
+
+#include "structures.h"
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+    Binary cache of imported models. A cache file is written next to the
+    source file and stores the final vertex and index arrays with their
+    levels of detail and meshlets, the material data and the bounding
+    volume of the model. It is only used when its key (format version,
+    source content hash and import flags) matches.
+*/
+namespace meshcache {
+
+// Bump whenever the layout of the cache or of the cached data changes.
+const uint32_t VERSION = 4;
+
+std::string cachePath(const std::string &sourcePath);
+
+// Key of a source file for the given import flags. Returns 0 if the file
+// could not be read.
+uint64_t computeKey(const std::string &sourcePath, uint32_t importFlags);
+
+bool read(const std::string &sourcePath, uint64_t key,
+          std::vector<MeshData> &meshes, std::array<float, 14> &bounds);
+
+bool write(const std::string &sourcePath, uint64_t key,
+           const std::vector<MeshData> &meshes,
+           const std::array<float, 14> &bounds);
+
+} // namespace meshcache
+
+#endif
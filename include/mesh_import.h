@@ -0,0 +1,29 @@
+#ifndef MESH_IMPORT_H
+#define MESH_IMPORT_H
+
+#include "structures.h"
+#include <assimp/scene.h>
+#include <vector>
+
+class ThreadPool;
+
+/*
+    Conversion of imported Assimp scenes into MeshData. Only the CPU side is
+    done here, no GL calls, so the meshes of a scene can be converted in
+    parallel and the GL buffers created afterwards on the GL thread. The
+    vertex and index arrays are sized up front and filled in place.
+*/
+namespace meshimport {
+
+// Convert a single mesh. Diffuse textures are marked as sRGB if srgb is set.
+MeshData convertMesh(const aiMesh *mesh, const aiScene *scene, bool srgb);
+
+// Convert every mesh referenced by the node tree, in the order of a depth
+// first walk. The meshes are split over the pool if one is given, it must
+// not be called from inside a task of that pool.
+std::vector<MeshData> convertScene(const aiScene *scene, bool srgb,
+                                   ThreadPool *pool = nullptr);
+
+} // namespace meshimport
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef MESH_LOD_H
+#define MESH_LOD_H
+
+#include "structures.h"
+#include <cstddef>
+#include <vector>
+
+/*
+    Level of detail generation for imported meshes. Coarser levels are made
+    by collapsing edges in the order of their quadric error (Garland and
+    Heckbert 1997), always moving a vertex onto one of its neighbours so
+    every level indexes the vertices of the original mesh. The levels are
+    appended to the index buffer of the mesh and described by MeshData::lods,
+    so all of them share one vertex and one index buffer. Vertices on open
+    borders and on attribute seams (split vertices with the same position)
+    are never moved.
+*/
+namespace meshlod {
+
+struct Settings {
+  // Number of levels including the original mesh, 1 disables the chain.
+  unsigned int numLevels = 4;
+  // Fraction of the triangles of the previous level each level aims for.
+  float reduction = 0.5f;
+  // Largest error of a level, relative to the largest extent of the mesh.
+  float maxError = 0.05f;
+};
+
+// Collapse edges until at most targetIndexCount indices are left or the
+// next collapse would move the surface further than maxError. The largest
+// error of the collapses done is stored in error if it is given.
+std::vector<unsigned int> simplify(const std::vector<Vertex> &vertices,
+                                   const std::vector<unsigned int> &indices,
+                                   size_t targetIndexCount, float maxError,
+                                   float *error = nullptr);
+
+// Append the coarser levels to mesh.indices and describe every level,
+// including the original one, in mesh.lods. The chain ends early once a
+// level cannot be reduced much further within the error limit.
+void buildChain(MeshData &mesh, const Settings &settings);
+
+} // namespace meshlod
+
+#endif
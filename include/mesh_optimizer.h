@@ -0,0 +1,74 @@
+#ifndef MESH_OPTIMIZER_H
+#define MESH_OPTIMIZER_H
+
+#include "structures.h"
+#include <cstddef>
+#include <vector>
+
+/*
+    Reordering of imported meshes for the GPU, run once at import time so
+    the result ends up in the mesh cache. The triangles are first ordered
+    for the post-transform vertex cache with Tipsify (Sander et al. 2007),
+    the clusters it produces are then sorted so that outward facing parts
+    of the mesh are drawn first to reduce overdraw, and finally the vertices
+    are renumbered in the order the indices first use them so the vertex
+    fetches are sequential. Only triangle lists are reordered.
+*/
+namespace meshopt {
+
+// Size of the simulated FIFO post-transform cache.
+const unsigned int CACHE_SIZE = 16;
+
+// Result of running an index buffer through the cache simulator. The
+// counts are kept so the statistics of several meshes can be summed.
+struct CacheStats {
+  size_t triangles = 0;
+  size_t vertices = 0;
+  size_t misses = 0;
+
+  // Average cache miss ratio, transformed vertices per triangle.
+  float acmr() const;
+  // Average transform to vertex ratio, 1 is ideal.
+  float atvr() const;
+  void add(const CacheStats &other);
+};
+
+struct Report {
+  CacheStats before;
+  CacheStats after;
+
+  void add(const Report &other);
+};
+
+CacheStats simulateCache(const std::vector<unsigned int> &indices,
+                         size_t numVertices,
+                         unsigned int cacheSize = CACHE_SIZE);
+
+// Reorder the triangles for the vertex cache. The first triangle of every
+// cluster, delimited where Tipsify ran into a dead end, is returned in
+// clusters if it is given.
+void optimizeVertexCache(std::vector<unsigned int> &indices,
+                         size_t numVertices,
+                         std::vector<size_t> *clusters = nullptr,
+                         unsigned int cacheSize = CACHE_SIZE);
+
+// Sort the clusters of a cache optimized index buffer by how much of the
+// mesh they are likely to occlude. Clusters are split further as long as
+// the ACMR stays within threshold times that of the original order.
+void optimizeOverdraw(std::vector<unsigned int> &indices,
+                      const std::vector<Vertex> &vertices,
+                      const std::vector<size_t> &clusters,
+                      float threshold = 1.05f,
+                      unsigned int cacheSize = CACHE_SIZE);
+
+// Renumber the vertices in the order of their first use. Unreferenced
+// vertices are moved to the end.
+void optimizeVertexFetch(std::vector<Vertex> &vertices,
+                         std::vector<unsigned int> &indices);
+
+// Run all of the above on a mesh.
+Report optimize(MeshData &mesh);
+
+} // namespace meshopt
+
+#endif
@@ -0,0 +1,72 @@
+#ifndef MESHLETS_H
+#define MESHLETS_H
+
+#include "structures.h"
+#include <cstddef>
+#include <glm/glm.hpp>
+#include <vector>
+
+/*
+    Splits meshes into meshlets, clusters of at most MAX_VERTICES vertices
+    and MAX_TRIANGLES triangles, and culls them on the CPU before drawing.
+    Each meshlet is grown from the first triangle left in the index buffer
+    over its neighbours, preferring the ones that add no vertices and face
+    the same way, which keeps the normal cones narrow. The triangles are
+    then rewritten meshlet by meshlet, so every meshlet is a contiguous
+    range of the index buffer and the visible ones are drawn with a single
+    glMultiDrawElements. A meshlet is culled when its bounding sphere is
+    outside the view frustum or when its normal cone shows that every one
+    of its triangles faces away from the eye. The tests run on four
+    meshlets at a time with SSE on x86.
+*/
+namespace meshlets {
+
+const unsigned int MAX_VERTICES = 64;
+const unsigned int MAX_TRIANGLES = 124;
+
+// Split the triangles of indices [firstIndex, firstIndex + numIndices),
+// reordering them so that every meshlet is contiguous.
+std::vector<Meshlet> build(const std::vector<Vertex> &vertices,
+                           std::vector<unsigned int> &indices,
+                           size_t firstIndex, size_t numIndices);
+
+// Bounds of the meshlets as a structure of arrays, padded to a multiple of
+// four meshlets.
+struct Clusters {
+  size_t count = 0;
+  std::vector<float> centerX, centerY, centerZ, radius;
+  std::vector<float> axisX, axisY, axisZ, cutoff;
+  std::vector<unsigned int> firstIndex, numIndices;
+};
+
+Clusters prepare(const std::vector<Meshlet> &meshlets);
+
+// What to cull against, in the object space of the mesh.
+struct View {
+  // Frustum planes, the inside has dot(plane, (p, 1)) >= 0.
+  glm::vec4 planes[6];
+  glm::vec3 eye;
+  // Cull back facing meshlets. Only valid with perspective projections and
+  // when the back faces are culled.
+  bool cones;
+};
+
+View makeView(const glm::mat4 &projection, const glm::mat4 &view,
+              const glm::mat4 &model, bool cones);
+
+struct Range {
+  unsigned int firstIndex;
+  unsigned int numIndices;
+};
+
+// Replace ranges with the index ranges of the visible meshlets, merging
+// neighbours. Returns the number of indices left.
+size_t cull(const Clusters &clusters, const View &view,
+            std::vector<Range> &ranges);
+// Scalar version of cull, for comparisons.
+size_t cullScalar(const Clusters &clusters, const View &view,
+                  std::vector<Range> &ranges);
+
+} // namespace meshlets
+
+#endif
@@ -0,0 +1,43 @@
+#ifndef MIP_GENERATOR_H
+#define MIP_GENERATOR_H
+
+#include "dds.h"
+#include <vector>
+
+class ThreadPool;
+
+/*
+    Generates mip chains of 8-bit images on the CPU. Each level is filtered
+    from the floating point version of the previous one with a separable
+    filter, so rounding errors don't build up along the chain. sRGB images
+    are filtered in linear space and normal maps are renormalized after
+    every level.
+*/
+namespace mips {
+
+enum class Filter { Box, Kaiser };
+
+struct Options {
+  Filter filter = Filter::Kaiser;
+  // The color channels are sRGB encoded, alpha is always linear.
+  bool srgb = false;
+  // The first three channels hold a normal mapped to [0, 1].
+  bool normalMap = false;
+  // Wrap around the edges instead of clamping, for tiling textures.
+  bool wrap = true;
+  // Split every level over this pool. Leave it null when already running
+  // inside a pool task.
+  ThreadPool *pool = nullptr;
+};
+
+int numLevels(int width, int height);
+
+// Generate the full mip chain of an image with nrComponents channels, level
+// 0 included. The levels are packed into one buffer allocated with malloc.
+unsigned char *generate(const unsigned char *image, int width, int height,
+                        int nrComponents, const Options &options,
+                        std::vector<dds::MipLevel> &levels);
+
+} // namespace mips
+
+#endif
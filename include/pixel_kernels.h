@@ -0,0 +1,47 @@
+#ifndef PIXEL_KERNELS_H
+#define PIXEL_KERNELS_H
+
+#include <cstddef>
+
+/*
+    Vectorized kernels for processing decoded 8-bit images. On x86 every
+    kernel has an SSE2 and, where it pays off, an AVX2 version that is picked
+    at runtime from the CPU features; other targets use the scalar versions.
+    Pixels are tightly packed with nrComponents channels of one byte each.
+*/
+namespace pixels {
+
+enum class Isa { Scalar, SSE2, AVX2 };
+
+// Best instruction set supported by the CPU.
+Isa bestIsa();
+Isa activeIsa();
+// Select the kernels used by every thread, fails if the CPU lacks the
+// instruction set. Meant for benchmarks and tests.
+bool setIsa(Isa isa);
+const char *isaName(Isa isa);
+
+// Invert one channel in place, e.g. the green channel of DirectX normal maps.
+void flipChannel(unsigned char *data, size_t numPixels, int nrComponents,
+                 int channel);
+
+// Expand RGB pixels to RGBA with an opaque alpha.
+void expandRGBToRGBA(const unsigned char *src, unsigned char *dst,
+                     size_t numPixels);
+
+// Reorder RGBA pixels, channel c of dst is channel order[c] of src.
+void swizzleRGBA(const unsigned char *src, unsigned char *dst,
+                 size_t numPixels, const int order[4]);
+
+// Copy one channel of every pixel into a single channel image.
+void extractChannel(const unsigned char *src, unsigned char *dst,
+                    size_t numPixels, int nrComponents, int channel);
+
+// Convert between 8-bit sRGB encoded values and linear floats in [0, 1].
+// Both directions are exact for the round trip of 8-bit values.
+void srgbToLinear(const unsigned char *src, float *dst, size_t count);
+void linearToSrgb(const float *src, unsigned char *dst, size_t count);
+
+} // namespace pixels
+
+#endif
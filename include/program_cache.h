@@ -0,0 +1,41 @@
+#ifndef PROGRAM_CACHE_H
+#define PROGRAM_CACHE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+    Cache of linked shader programs as driver binaries
+    (glGetProgramBinary), so a program does not have to be compiled again
+    on every launch. A cache file is written next to the vertex shader for
+    every combination of stages and defines. It is only used when its key
+    (format version, source of every stage and the vendor, renderer and
+    version of the driver) matches, and the driver can still reject the
+    binary, in which case the program is compiled from source again.
+*/
+namespace programcache {
+
+// Bump whenever the layout of the cache changes.
+const uint32_t VERSION = 1;
+
+// Cache file of the program linked from the stages at paths, the vertex
+// shader first, compiled with defines.
+std::string cachePath(const std::vector<std::string> &paths,
+                      const std::vector<std::string> &defines = {});
+
+// Key of a program linked from sources with the current driver. Returns 0 if
+// the driver supports no binary formats. Needs a current context.
+uint64_t computeKey(const std::vector<std::string> &sources);
+
+// Create a program from the cached binary. Returns 0 if there is no cache
+// with this key or the driver rejects it.
+unsigned int read(const std::string &path, uint64_t key);
+
+// Store the binary of program, which must be linked and have been created
+// with GL_PROGRAM_BINARY_RETRIEVABLE_HINT.
+bool write(const std::string &path, uint64_t key, unsigned int program);
+
+} // namespace programcache
+
+#endif
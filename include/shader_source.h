@@ -0,0 +1,34 @@
+#ifndef SHADER_SOURCE_H
+#define SHADER_SOURCE_H
+
+#include <string>
+#include <vector>
+
+/*
+    Loading of GLSL stages through a small preprocessor. Lines of the form
+    #include "file" are replaced by the file, relative to the directory of
+    the file including it, and every file is included once per stage, so
+    shared blocks can include what they need. The defines are inserted
+    right after the #version line as "#define NAME", or "#define NAME VALUE"
+    for entries written as NAME=VALUE.
+
+    #line directives keep the line numbers of compile errors right, their
+    source string number is the index of the file in Source::files.
+*/
+namespace shadersource {
+
+struct Source {
+  std::string code;
+  // The stage first, then its includes in the order they were found.
+  std::vector<std::string> files;
+  // False if the stage or one of its includes could not be read, the code
+  // must not be compiled then.
+  bool complete = true;
+};
+
+Source load(const std::string &path,
+            const std::vector<std::string> &defines = {});
+
+} // namespace shadersource
+
+#endif
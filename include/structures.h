@@ -1,22 +1,48 @@
 #pragma once
 
+#include <cstdint>
 #include <glm/glm.hpp>
 #include <string>
+#include <vector>
 
 // Buffer indices
 const unsigned int POS_NORM_TEX_TAN_VB = 0;
 const unsigned int MOD_VB = 1;
 const unsigned int NORM_M_VB = 2;
 const unsigned int COL_VB = 3;
+const unsigned int POS_VB = 4;
 
 // Attribute locations (objects)
 const unsigned int POS_LOC = 0;
 const unsigned int NORM_LOC = 1;
 const unsigned int TEX_LOC = 2;
 const unsigned int TAN_LOC = 3;
+// Per instance material index, the layer of the material texture arrays.
 const unsigned int COL_LOC = 4;
 const unsigned int MOD_LOC = 5;
 const unsigned int NORM_M_LOC = 9;
+// Instance index of the vertex pulling shaders.
+const unsigned int INST_LOC = 12;
+
+// Uniform locations of the position decoding (objects)
+const unsigned int POS_SCALE_UNIF = 20;
+const unsigned int POS_OFFSET_UNIF = 21;
+// First vertex index of the compact vertices in the vertex pulling shaders.
+const unsigned int COMPACT_BASE_UNIF = 22;
+
+// Shader storage bindings of the vertex pulling shaders (objects)
+const unsigned int FULL_VERTEX_SSBO = 1;
+const unsigned int COMPACT_VERTEX_SSBO = 2;
+const unsigned int FULL_POSITION_SSBO = 3;
+const unsigned int COMPACT_POSITION_SSBO = 4;
+const unsigned int MOD_SSBO = 5;
+const unsigned int NORM_M_SSBO = 6;
+const unsigned int MAT_SSBO = 7;
+
+// Uniform buffer bindings of the blocks shared by the programs
+const unsigned int SHADOW_UBO = 0;
+const unsigned int FRAME_UBO = 1;
+const unsigned int LIGHT_UBO = 2;
 
 // Material color indices
 const unsigned int AMB = 0;
@@ -30,6 +56,20 @@ struct Vertex {
   glm::vec3 tangent;
 };
 
+// Quantized vertex of the compact format, see compact_vertex.h.
+struct CompactVertex {
+  // Unsigned normalized within the mesh bounds, w is padding.
+  uint16_t position[4];
+  // Octahedral encoded, GL_INT_2_10_10_10_REV.
+  uint32_t normal;
+  // Half floats.
+  uint16_t texCoord[2];
+  // Octahedral encoded, GL_INT_2_10_10_10_REV.
+  uint32_t tangent;
+};
+
+enum class VertexFormat { Full, Compact };
+
 struct Texture {
   unsigned int id;
   unsigned int location;
@@ -48,4 +88,45 @@ struct Material {
   unsigned int specId;
   unsigned int emisId;
   unsigned int shinId;
+};
+
+// A texture referenced by a model material, relative to the model directory.
+struct TextureRef {
+  std::string type;
+  std::string path;
+  bool srgb;
+};
+
+// Part of the index buffer drawn for one level of detail.
+struct LodLevel {
+  unsigned int firstIndex;
+  unsigned int numIndices;
+  // Largest distance of the simplified surface from the original one, in
+  // object space units.
+  float error;
+};
+
+// Cluster of a few neighbouring triangles, a contiguous part of the index
+// buffer of the finest level of detail. See meshlets.h.
+struct Meshlet {
+  // Bounding sphere.
+  glm::vec3 center;
+  float radius;
+  // Every triangle normal is within the cone around coneAxis, coneCutoff
+  // is the sine of its half angle, or 1 if the cone is too wide to use.
+  glm::vec3 coneAxis;
+  float coneCutoff;
+  unsigned int firstIndex;
+  unsigned int numIndices;
+};
+
+// CPU-side mesh data, either converted from Assimp or read from a mesh cache.
+struct MeshData {
+  std::vector<Vertex> vertices;
+  std::vector<unsigned int> indices;
+  std::vector<TextureRef> textureRefs;
+  Material material;
+  // Levels of detail, finest first. Empty if indices is a single level.
+  std::vector<LodLevel> lods;
+  std::vector<Meshlet> meshlets;
 };
\ No newline at end of file
@@ -3,19 +3,98 @@
 
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
+#include "dds.h"
+#include <cstdlib>
+#include <memory>
 #include <string>
 #include <vector>
 
+// Parameters of a single 2D texture load.
+struct TextureRequest {
+  std::string path;
+  bool srgb = false;
+  bool flip = true;
+  bool flipGreen = false;
+  GLenum sWrap = GL_REPEAT;
+  GLenum tWrap = GL_REPEAT;
+  GLenum minFilter = GL_LINEAR_MIPMAP_LINEAR;
+  GLenum magFilter = GL_LINEAR;
+  // Only keep this channel as a single channel texture, -1 keeps them all.
+  int channel = -1;
+  // The image holds normals, its mip levels are renormalized.
+  bool normalMap = false;
+};
+
+// An image decoded on the CPU, ready to be handed to GL.
+struct DecodedImage {
+  int width = 0;
+  int height = 0;
+  int nrComponents = 0;
+  GLenum internalFormat = GL_RGB;
+  GLenum format = GL_RGB;
+  std::unique_ptr<unsigned char, void (*)(void *)> data{nullptr, free};
+  // The full mip chain, all levels in data. Empty if only level 0 was
+  // decoded and GL has to generate the mipmaps.
+  std::vector<dds::MipLevel> levels;
+  // The levels are block compressed and internalFormat is the compressed
+  // format.
+  bool compressed = false;
+};
+
+// Decode an image file. Safe to call from any thread (no GL calls), the
+// vertical flip only affects this call. If the texture baker wrote an up to
+// date .dds file next to the image with the same flips, its compressed mip
+// chain is loaded instead. RGB images are expanded to RGBA.
+//
+// When the min filter samples mipmaps the mip chain is generated on the CPU
+// (see mip_generator.h) and cached in a .dds file next to the image, so
+// later loads read every level from the cache.
+DecodedImage decodeImage(const TextureRequest &request);
+
+// Create a GL texture from a decoded image. Must run on the GL thread. If an
+// UploadQueue is active the pixels are streamed in through it and the
+// texture is only complete once isTextureReady returns true.
+unsigned int uploadTexture(DecodedImage image, const TextureRequest &request);
+
+bool isTextureReady(unsigned int texture);
+
+// Copy 2D textures into the layers of a new GL_TEXTURE_2D_ARRAY, every mip
+// level on the GPU. The textures have to be ready and share their size,
+// internal format and number of levels, otherwise no array is created and
+// 0 is returned, as it is if GL fails to create or fill the array. The
+// array samples like the first texture. The caller owns the array and
+// deletes it with glDeleteTextures.
+unsigned int createTextureArray(const std::vector<unsigned int> &textures);
+
+/*
+    The load functions below go through the TextureRegistry: a texture that
+    is already loaded with the same parameters is shared instead of decoded
+    again. Each returned ID holds a reference that has to be given back with
+    releaseTexture instead of calling glDeleteTextures.
+*/
 unsigned int loadTexture(std::string path, bool srgb = false, bool flip = true,
                          bool flipGreen = false, GLenum sWrap = GL_REPEAT,
                          GLenum tWrap = GL_REPEAT,
                          GLenum minFilter = GL_LINEAR_MIPMAP_LINEAR,
                          GLenum magFilter = GL_LINEAR);
 
+// Load a list of textures, decoding the ones that are not loaded yet in
+// parallel. The returned texture IDs are in the same order as the requests.
+std::vector<unsigned int>
+loadTextureBatch(const std::vector<TextureRequest> &requests);
+
 unsigned int loadCubeMap(std::vector<std::string> paths, bool flip = true,
                          GLenum sWrap = GL_CLAMP_TO_EDGE,
                          GLenum tWrap = GL_CLAMP_TO_EDGE,
                          GLenum rWrap = GL_CLAMP_TO_EDGE,
                          GLenum minFilter = GL_LINEAR,
                          GLenum magFilter = GL_LINEAR);
+
+void retainTexture(unsigned int texture);
+void releaseTexture(unsigned int texture);
+
+// Decode all requests in parallel on the shared thread pool and upload them
+// on the calling (GL) thread as they finish, bypassing the registry.
+std::vector<unsigned int>
+createTextures(const std::vector<TextureRequest> &requests);
 #endif
\ No newline at end of file
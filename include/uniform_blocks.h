@@ -0,0 +1,63 @@
+#ifndef UNIFORM_BLOCKS_H
+#define UNIFORM_BLOCKS_H
+
+#include "Light.h"
+#include <glm/glm.hpp>
+
+/*
+    C++ mirrors of the uniform blocks shared by the programs, written as a
+    whole into their UniformBlock buffers (bindings in structures.h).
+*/
+
+// std140 layout of frameBlock (shaders/frame_block.glsl).
+struct FrameBlock {
+  glm::mat4 view{1.0f};
+  glm::mat4 projection{1.0f};
+  glm::mat4 dirSpaceMat{1.0f};
+  glm::mat4 spotSpaceMat{1.0f};
+  glm::mat4 tubeSpaceMat{1.0f};
+  // w is padding.
+  glm::vec4 viewPos{0.0f};
+};
+
+// std140 layout of the Light struct of shaders/light_block.glsl.
+struct LightData {
+  LightData() = default;
+  explicit LightData(const Light &light)
+      : position(light.position), cutOff(light.cutOff),
+        direction(light.direction), outerCutOff(light.outerCutOff),
+        cLight(light.cLight), width(light.width), len(light.length),
+        constant(light.falloffConstant), linear(light.falloffLinear),
+        quadratic(light.falloffQuadratic),
+        directional(light.directional ? 1 : 0) {}
+
+  glm::vec3 position{0.0f};
+  float cutOff = -1.0f;
+  glm::vec3 direction{0.0f};
+  float outerCutOff = -1.0f;
+  glm::vec3 cLight{0.0f};
+  float width = 0.0f;
+  float len = 0.0f;
+  float constant = 1.0f;
+  float linear = 1.0f;
+  float quadratic = 1.0f;
+  // GLSL bools are 4 bytes.
+  int directional = 0;
+  float padding[3] = {};
+};
+
+// std140 layout of lightBlock (shaders/light_block.glsl).
+struct LightBlock {
+  LightData dirLight;
+  LightData spotLight;
+  LightData tubeLight;
+  // w is padding.
+  glm::vec4 tubeP0{0.0f};
+  glm::vec4 tubeP1{0.0f};
+};
+
+static_assert(sizeof(FrameBlock) == 336, "FrameBlock must match std140");
+static_assert(sizeof(LightData) == 80, "LightData must match std140");
+static_assert(sizeof(LightBlock) == 272, "LightBlock must match std140");
+
+#endif
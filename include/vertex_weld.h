@@ -0,0 +1,53 @@
+#ifndef VERTEX_WELD_H
+#define VERTEX_WELD_H
+
+#include "structures.h"
+#include <cstddef>
+#include <vector>
+
+class ThreadPool;
+
+/*
+    Welding of duplicated vertices. Assimp splits vertices per face for
+    some formats (OBJ in particular), so imported meshes can hold many
+    copies of the same vertex. Every attribute is rounded to a multiple of
+    its epsilon and vertices with the same rounded attributes are merged
+    into the first of them, found through a hash table. The indices are
+    remapped and triangles that end up with a repeated vertex are dropped.
+    Large meshes hash their vertices in parallel and split the table over
+    the pool by hash.
+*/
+namespace weld {
+
+struct Epsilons {
+  // Relative to the largest extent of the mesh.
+  float position = 1e-5f;
+  float normal = 1e-3f;
+  float texCoord = 1e-5f;
+  float tangent = 1e-3f;
+};
+
+struct Report {
+  size_t verticesBefore = 0;
+  size_t verticesAfter = 0;
+  size_t trianglesRemoved = 0;
+
+  void add(const Report &other);
+};
+
+// Meshes with at least this many vertices are welded over the pool.
+const size_t PARALLEL_VERTICES = 65536;
+
+// Weld a single mesh, over the pool if one is given.
+Report weldMesh(MeshData &mesh, const Epsilons &epsilons = {},
+                ThreadPool *pool = nullptr);
+
+// Weld every mesh, the large ones one after the other over the pool and the
+// others in parallel. The pool must not be called from inside one of its
+// tasks.
+Report weldMeshes(std::vector<MeshData> &meshes, const Epsilons &epsilons = {},
+                  ThreadPool *pool = nullptr);
+
+} // namespace weld
+
+#endif
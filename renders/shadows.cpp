@@ -1,9 +1,11 @@
 #include "glad/glad.h"
 #include <GLFW/glfw3.h>
+#include <algorithm>
 #include <array>
 #include <chrono>
 #include <filesystem>
 #include <iostream>
+#include <memory>
 #include <random>
 #include <string>
 #include <vector>
@@ -18,12 +20,22 @@
 #include "stb_image.h"
 
 #include "Camera.h" // Camera class
+#include "DrawCollector.h" // Instanced draws of repeated models
+#include "GeometryPool.h" // Shared vertex and index buffers, indirect draws
+#include "InstanceRing.h" // Per instance matrices in mapped memory
 #include "Light.h"  // Light class
+#include "LodStats.h"
 #include "Model.h"  // Model class
 #include "Shader.h" // Shader class
 #include "SimpleMesh.h"
+#include "SubmitStats.h"
+#include "UniformBlock.h" // Uniform buffers shared by the programs
+#include "UniformStats.h"
+#include "UploadQueue.h" // Streams textures and meshes to the GPU
+#include "gl_extensions.h"
 #include "misc_sources.h" // framebuffer size callback and input processing
 #include "texture_loader.h" // Utility function for loading textures (generates texture)
+#include "uniform_blocks.h"
 
 namespace fs = std::filesystem;
 fs::path shaderPath(fs::current_path() / "shaders");
@@ -60,6 +72,13 @@ const float SHADOW_MULT = 0.5;
 const unsigned int NUM_SEARCH_SAMPLES = 16;
 const unsigned int NUM_PCF_SAMPLES = 32;
 const unsigned int NUM_SPHERES = 4;
+// Shadow maps tolerate coarser levels of detail than the camera view.
+const float SHADOW_LOD_BIAS = 4.0f;
+// Seconds between two prints of the LOD statistics.
+const double LOD_STATS_INTERVAL = 5.0;
+
+// Set for every shadow map, its name hashed at compile time.
+constexpr UniformID LIGHT_SPACE_UNIF("lightSpaceMatrix");
 
 namespace toggles { // Only changed by input processing
 bool bKeyPressed = false;
@@ -67,11 +86,17 @@ bool nKeyPressed = false;
 bool lKeyPressed = false;
 bool pKeyPressed = false;
 bool tKeyPressed = false;
+bool iKeyPressed = false;
+bool vKeyPressed = false;
+bool mKeyPressed = false;
 
 bool g_showNorms{false};
 bool g_wireframe{false};
 bool g_areaLights{true};
 bool g_showTube{false};
+bool g_indirect{true};
+bool g_pullVertices{false};
+bool g_materialArrays{true};
 } // namespace toggles
 
 int main() {
@@ -100,6 +125,7 @@ int main() {
     std::cout << "Failed to initialize GLAD" << std::endl;
     return -1;
   }
+  glext::load(reinterpret_cast<GLADloadproc>(glfwGetProcAddress));
 
   // Check if negative swap interval values are supported, and activate v-sync
   bool supported =
@@ -143,23 +169,62 @@ int main() {
   // Define lifetime of objects so arrays and buffers are freed before
   // glfwTerminate is called.
   {
-    // compile and link the shader programs
-    Shader sProg((shaderPath / "object.vs").c_str(),
-                 (shaderPath / "object.fs").c_str());
-    Shader floorProg((shaderPath / "floor.vs").c_str(),
-                     (shaderPath / "object.fs").c_str());
-    Shader lightProg((shaderPath / "light_sphere.vs").c_str(),
-                     (shaderPath / "light_sphere.fs").c_str());
-    Shader shadowProg((shaderPath / "shadow_map.vs").c_str(),
-                      (shaderPath / "shadow_map.fs").c_str());
-
-    // Get the uniform IDs in the vertex shader
-    const int sViewID = sProg.getUnif("view");
-    const int sProjID = sProg.getUnif("projection");
-    const int floorViewID = floorProg.getUnif("view");
-    const int floorProjID = floorProg.getUnif("projection");
-    const int lightViewID = lightProg.getUnif("view");
-    const int lightProjID = lightProg.getUnif("projection");
+    // Stream texture and mesh data in over several frames.
+    UploadQueue uploadQueue;
+    UploadQueue::setActive(&uploadQueue);
+    // Write the instance matrices of the meshes created below into a
+    // persistently mapped ring if the driver can map one.
+    std::unique_ptr<InstanceRing> instanceRing;
+    if (glext::bufferStorage) {
+      instanceRing.reset(new InstanceRing());
+      InstanceRing::setActive(instanceRing.get());
+    }
+    // Suballocate the meshes from shared buffers so the passes can be drawn
+    // with multi draw indirect, which needs the ring for its instances.
+    std::unique_ptr<GeometryPool> geometryPool;
+    if (instanceRing) {
+      geometryPool.reset(new GeometryPool(*instanceRing));
+      GeometryPool::setActive(geometryPool.get());
+    }
+
+    // Submit the shader programs, the driver compiles them while the
+    // textures and models below load.
+    // The lit programs are variants of object.fs, one per combination of its
+    // options in use. The variants of the initial toggles are built now, the
+    // others when they are first drawn with.
+    const std::vector<std::string> litOptions = {
+        "AREA_LIGHTS", "TUBE_LIGHT", "MATERIAL_ARRAYS", "PARALLAX_OCCLUSION"};
+    ShaderVariants sVariants((shaderPath / "object.vs").c_str(),
+                             (shaderPath / "object.fs").c_str(), litOptions);
+    ShaderVariants floorVariants((shaderPath / "floor.vs").c_str(),
+                                 (shaderPath / "object.fs").c_str(),
+                                 litOptions);
+    // Versions of the sphere programs and shadowProg fetching their vertices
+    // from the geometry pool by index.
+    ShaderVariants sPullVariants((shaderPath / "object_pull.vs").c_str(),
+                                 (shaderPath / "object.fs").c_str(),
+                                 litOptions);
+    const unsigned int areaLightsBit = sVariants.bit("AREA_LIGHTS");
+    const unsigned int tubeLightBit = sVariants.bit("TUBE_LIGHT");
+    const unsigned int materialArraysBit = sVariants.bit("MATERIAL_ARRAYS");
+    auto litKey = [&]() {
+      return (toggles::g_areaLights ? areaLightsBit : 0u) |
+             (toggles::g_showTube ? tubeLightBit : 0u);
+    };
+    Shader lightProg, shadowProg, shadowPullProg;
+    ShaderBatch shaderBatch;
+    for (ShaderVariants *variants : {&sVariants, &sPullVariants}) {
+      variants->request(shaderBatch, litKey());
+      variants->request(shaderBatch, litKey() | materialArraysBit);
+    }
+    floorVariants.request(shaderBatch, litKey());
+    shaderBatch.add(lightProg, (shaderPath / "light_sphere.vs").c_str(),
+                    (shaderPath / "light_sphere.fs").c_str());
+    shaderBatch.add(shadowProg, (shaderPath / "shadow_map.vs").c_str(),
+                    (shaderPath / "shadow_map.fs").c_str());
+    shaderBatch.add(shadowPullProg,
+                    (shaderPath / "shadow_map_pull.vs").c_str(),
+                    (shaderPath / "shadow_map.fs").c_str());
 
     // Create shadow map generation framebuffer
     unsigned int shadowFBO;
@@ -245,9 +310,49 @@ int main() {
     glBufferSubData(GL_UNIFORM_BUFFER,
                     32 * sizeof(glm::vec4) + sizeof(glm::vec2) + 8, 4,
                     &SHADOW_MULT);
-    glBindBufferBase(GL_UNIFORM_BUFFER, 0, shadowUBO);
+    glBindBufferBase(GL_UNIFORM_BUFFER, SHADOW_UBO, shadowUBO);
     glBindBuffer(GL_UNIFORM_BUFFER, 0);
 
+    // The camera and light space matrices and the lights, read by the lit
+    // programs and the light program and written once per frame.
+    UniformBlock frameBlock(FRAME_UBO, sizeof(FrameBlock));
+    UniformBlock lightBlock(LIGHT_UBO, sizeof(LightBlock));
+
+    // Queue every PBR map so they are decoded in parallel, the IDs are
+    // written back once the whole batch has been uploaded.
+    std::vector<TextureRequest> texRequests;
+    std::vector<unsigned int *> texTargets;
+    auto queueTexture = [&](unsigned int *target, const std::string &file,
+                            bool flip = true, bool flipGreen = false) {
+      TextureRequest request;
+      request.path = (pbrTexturePath / file).string();
+      request.flip = flip;
+      request.flipGreen = flipGreen;
+      texRequests.push_back(request);
+      texTargets.push_back(target);
+    };
+    // Metallic, roughness, AO and height maps are grayscale and only their
+    // red channel is sampled, so they are loaded as single channel textures.
+    auto queueMask = [&](unsigned int *target, const std::string &file,
+                         bool flip = true) {
+      queueTexture(target, file, flip);
+      texRequests.back().channel = 0;
+    };
+    // Albedo maps are sRGB encoded, their mips are filtered in linear space
+    // and the shader samples linear colors.
+    auto queueColor = [&](unsigned int *target, const std::string &file,
+                          bool flip = true) {
+      queueTexture(target, file, flip);
+      texRequests.back().srgb = true;
+    };
+    // Normals are renormalized in every mip level. Most of the maps are made
+    // for DirectX and need their green channel flipped.
+    auto queueNormal = [&](unsigned int *target, const std::string &file,
+                           bool flip = true, bool flipGreen = true) {
+      queueTexture(target, file, flip, flipGreen);
+      texRequests.back().normalMap = true;
+    };
+
     // Load Sphere PBR maps.
     unsigned int albedoMaps[NUM_SPHERES];
     unsigned int normalMaps[NUM_SPHERES];
@@ -257,83 +362,63 @@ int main() {
     unsigned int heightMaps[NUM_SPHERES];
     // Rusted iron sphere.
     std::string prefix = "rustediron1-alt2-Unreal-Engine/rustediron2_";
-    albedoMaps[0] =
-        loadTexture((pbrTexturePath / (prefix + "basecolor.png")).string());
-    normalMaps[0] = loadTexture(
-        (pbrTexturePath / (prefix + "normal.png")).string(), false, true, true);
-    metallicMaps[0] =
-        loadTexture((pbrTexturePath / (prefix + "metallic.png")).string());
-    roughnessMaps[0] =
-        loadTexture((pbrTexturePath / (prefix + "roughness.png")).string());
-    aoMaps[0] = loadTexture(
-        (pbrTexturePath / "streaky-metal1-ue/streaky-metal1_ao.png").string());
+    queueColor(&albedoMaps[0], prefix + "basecolor.png");
+    queueNormal(&normalMaps[0], prefix + "normal.png");
+    queueMask(&metallicMaps[0], prefix + "metallic.png");
+    queueMask(&roughnessMaps[0], prefix + "roughness.png");
+    queueMask(&aoMaps[0], "streaky-metal1-ue/streaky-metal1_ao.png");
     // Streaky metal sphere.
     prefix = "streaky-metal1-ue/streaky-metal1_";
-    albedoMaps[1] =
-        loadTexture((pbrTexturePath / (prefix + "albedo.png")).string());
-    normalMaps[1] =
-        loadTexture((pbrTexturePath / (prefix + "normal-dx.png")).string(),
-                    false, true, true);
-    metallicMaps[1] =
-        loadTexture((pbrTexturePath / (prefix + "metallic.png")).string());
-    roughnessMaps[1] =
-        loadTexture((pbrTexturePath / (prefix + "roughness.png")).string());
-    aoMaps[1] = loadTexture((pbrTexturePath / (prefix + "ao.png")).string());
+    queueColor(&albedoMaps[1], prefix + "albedo.png");
+    queueNormal(&normalMaps[1], prefix + "normal-dx.png");
+    queueMask(&metallicMaps[1], prefix + "metallic.png");
+    queueMask(&roughnessMaps[1], prefix + "roughness.png");
+    queueMask(&aoMaps[1], prefix + "ao.png");
     // Worn metal sphere.
     prefix = "worn-metal4-ue/worn_metal4_";
-    albedoMaps[2] =
-        loadTexture((pbrTexturePath / (prefix + "albedo.png")).string());
-    normalMaps[2] =
-        loadTexture((pbrTexturePath / (prefix + "Normal-dx.png")).string(),
-                    false, true, true);
-    metallicMaps[2] =
-        loadTexture((pbrTexturePath / (prefix + "Metallic.png")).string());
-    roughnessMaps[2] =
-        loadTexture((pbrTexturePath / (prefix + "Roughness.png")).string());
-    aoMaps[2] = loadTexture((pbrTexturePath / (prefix + "ao.png")).string());
-    heightMaps[2] =
-        loadTexture((pbrTexturePath / (prefix + "Height.png")).string());
+    queueColor(&albedoMaps[2], prefix + "albedo.png");
+    queueNormal(&normalMaps[2], prefix + "Normal-dx.png");
+    queueMask(&metallicMaps[2], prefix + "Metallic.png");
+    queueMask(&roughnessMaps[2], prefix + "Roughness.png");
+    queueMask(&aoMaps[2], prefix + "ao.png");
+    queueMask(&heightMaps[2], prefix + "Height.png");
     // Gray granite sphere.
     prefix = "gray-granite-flecks-ue/gray-granite-flecks-";
-    albedoMaps[3] =
-        loadTexture((pbrTexturePath / (prefix + "albedo.png")).string());
-    normalMaps[3] =
-        loadTexture((pbrTexturePath / (prefix + "Normal-dx.png")).string(),
-                    false, true, true);
-    metallicMaps[3] =
-        loadTexture((pbrTexturePath / (prefix + "Metallic.png")).string());
-    roughnessMaps[3] =
-        loadTexture((pbrTexturePath / (prefix + "Roughness.png")).string());
-    aoMaps[3] = loadTexture((pbrTexturePath / (prefix + "ao.png")).string());
+    queueColor(&albedoMaps[3], prefix + "albedo.png");
+    queueNormal(&normalMaps[3], prefix + "Normal-dx.png");
+    queueMask(&metallicMaps[3], prefix + "Metallic.png");
+    queueMask(&roughnessMaps[3], prefix + "Roughness.png");
+    queueMask(&aoMaps[3], prefix + "ao.png");
 
     // Load floor PBR maps.
     prefix = "rich-brown-tile-variation-ue/rich-brown-tile-variation_";
-    unsigned int floorAlbedo =
-        loadTexture((pbrTexturePath / (prefix + "albedo.png")).string());
-    unsigned int floorNormal =
-        loadTexture((pbrTexturePath / (prefix + "normal-dx.png")).string(),
-                    false, true, true);
-    unsigned int floorMetallic =
-        loadTexture((pbrTexturePath / (prefix + "metallic.png")).string());
-    unsigned int floorRoughness =
-        loadTexture((pbrTexturePath / (prefix + "roughness.png")).string());
-    unsigned int floorAO =
-        loadTexture((pbrTexturePath / (prefix + "ao.png")).string());
-    unsigned int floorHeight =
-        loadTexture((pbrTexturePath / (prefix + "height.png")).string());
+    unsigned int floorAlbedo, floorNormal, floorMetallic, floorRoughness,
+        floorAO, floorHeight;
+    queueColor(&floorAlbedo, prefix + "albedo.png");
+    queueNormal(&floorNormal, prefix + "normal-dx.png");
+    queueMask(&floorMetallic, prefix + "metallic.png");
+    queueMask(&floorRoughness, prefix + "roughness.png");
+    queueMask(&floorAO, prefix + "ao.png");
+    queueMask(&floorHeight, prefix + "height.png");
 
     // Load boulder PBR maps.
     prefix = "sharp-boulder2-bl/sharp-boulder2-";
-    unsigned int boulderAlbedo = loadTexture(
-        (pbrTexturePath / (prefix + "albedo.png")).string(), false, false);
-    unsigned int boulderNormal = loadTexture(
-        (pbrTexturePath / (prefix + "normal_ogl.png")).string(), false, false);
-    unsigned int boulderMetallic = loadTexture(
-        (pbrTexturePath / (prefix + "metallic.png")).string(), false, false);
-    unsigned int boulderRoughness = loadTexture(
-        (pbrTexturePath / (prefix + "roughness.png")).string(), false, false);
-    unsigned int boulderAO = loadTexture(
-        (pbrTexturePath / (prefix + "ao.png")).string(), false, false);
+    unsigned int boulderAlbedo, boulderNormal, boulderMetallic,
+        boulderRoughness, boulderAO;
+    queueColor(&boulderAlbedo, prefix + "albedo.png", false);
+    queueNormal(&boulderNormal, prefix + "normal_ogl.png", false, false);
+    queueMask(&boulderMetallic, prefix + "metallic.png", false);
+    queueMask(&boulderRoughness, prefix + "roughness.png", false);
+    queueMask(&boulderAO, prefix + "ao.png", false);
+
+    auto texStart = std::chrono::steady_clock::now();
+    std::vector<unsigned int> texIDs = loadTextureBatch(texRequests);
+    for (size_t i = 0; i < texIDs.size(); ++i)
+      *texTargets[i] = texIDs[i];
+    std::chrono::duration<double, std::milli> texTime =
+        std::chrono::steady_clock::now() - texStart;
+    std::cout << "Loaded " << texIDs.size() << " textures in "
+              << texTime.count() << " ms\n";
 
     // Load the floor model.
     SimpleMesh floor(sources::quadVertices, 6, std::vector<std::string>(),
@@ -343,14 +428,10 @@ int main() {
     floorModel = glm::rotate(floorModel, -glm::radians(90.0f),
                              glm::vec3(1.0f, 0.0f, 0.0f));
     floorModel = glm::scale(floorModel, glm::vec3(20.0f, 20.0f, 1.0f));
-    floorProg.use();
-    floorProg.setUnifS("model", floorModel);
-    floorProg.setUnifS("normMat",
-                       glm::mat3(glm::transpose(glm::inverse(floorModel))));
 
     // Load the sphere model.
     fs::path spherePath((resourcePath / "sphere2.obj").c_str());
-    Model sphere(spherePath, false);
+    Model sphere(spherePath, false, {}, VertexFormat::Compact);
     float wSphere = sphere.getApproxWidth();
     float lightSphereScaling = 0.6f;
     float pbrSphereScaling = 0.4f;
@@ -362,26 +443,60 @@ int main() {
         glm::vec3(0.0f, 1.0f, -1.0f),
     };
     glm::mat4 sphereModelMats[NUM_SPHERES];
-    glm::mat3 sphereNormMats[NUM_SPHERES];
-    // Set the model matrices for the spheres.
+    // Set the model matrices for the spheres, the collector derives the
+    // normal matrices.
     for (unsigned int i = 0; i < NUM_SPHERES; ++i) {
       sphereModelMats[i] = glm::translate(glm::mat4(1.0f), spherePos[i]);
       sphereModelMats[i] =
           glm::scale(sphereModelMats[i], glm::vec3(pbrSphereScaling));
-      sphereNormMats[i] =
-          glm::mat3(glm::transpose(glm::inverse(sphereModelMats[i])));
     }
 
     // Load the boulder model.
     fs::path boulderPath(
         (pbrTexturePath / "sharp-boulder2-bl/sharp-boulder2.obj").c_str());
-    Model boulder(boulderPath, false);
+    Model boulder(boulderPath, false, {}, VertexFormat::Compact);
     // Set boulder position.
     glm::mat4 boulderModelMat =
         glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 2.0f, 0.0f));
     glm::mat3 boulderNormMat =
         glm::mat3(glm::transpose(glm::inverse(boulderModelMat)));
 
+    // The programs are used from here on.
+    if (!shaderBatch.isReady())
+      std::cout << "Waiting for the shader programs\n";
+    shaderBatch.finish();
+
+    // Handles to the uniforms of the light program
+    Uniform<glm::mat4> lightModelUnif = lightProg.uniform<glm::mat4>("model");
+    Uniform<glm::vec3> lightColorUnif = lightProg.uniform<glm::vec3>("color");
+
+    // Level of detail selection of every object, for the three shadow maps
+    // and the camera.
+    LodStats lodStats;
+    sphere.setLodStats(&lodStats);
+    boulder.setLodStats(&lodStats);
+    Model::LodState sphereLods[4][NUM_SPHERES];
+    Model::LodState boulderLods[4];
+    Model::LodState lightSphereLod;
+    double lastLodStats = glfwGetTime();
+    if (geometryPool)
+      geometryPool->printUsage();
+
+    // Draw calls and submission time of the direct, indirect and vertex
+    // pulling paths, I and V switch between them.
+    SubmitStats submitStats;
+    SubmitStats::setActive(&submitStats);
+    // Uniform uploads, and the redundant ones the uniform tables skip.
+    UniformStats uniformStats;
+    UniformStats::setActive(&uniformStats);
+    IndirectBatch batch;
+    // Groups the draws of the spheres into instanced ones.
+    DrawCollector collector;
+    auto drawPath = [&](bool indirect, bool pulling) {
+      return pulling ? "vertex pulling" : indirect ? "indirect" : "direct";
+    };
+    const char *lastPath = drawPath(false, false);
+
     // Declare the model, view and projection matrices.
     glm::mat4 view;
     glm::mat4 projection;
@@ -440,66 +555,81 @@ int main() {
                                      glm::vec3(0.0f, 1.0f, 0.0f));
     glm::mat4 tubeSpaceMat = tubeProjection * tubeView;
 
-    // Set light uniforms in shaders.
-    sProg.setLight(dirLight);
-    sProg.setLight(spotLight);
-    sProg.setLight(tubeLight);
-    floorProg.setLight(dirLight);
-    floorProg.setLight(spotLight);
-    floorProg.setLight(tubeLight);
-
-    // Set indices for textures.
-    sProg.use();
-    sProg.setUnifS("shadowMap", 0);
-    sProg.setUnifS("spotShadowMap", 1);
-    sProg.setUnifS("tubeShadowMap", 2);
-    sProg.setUnifS("randomAngles", 3);
-    sProg.setUnifS("albedoMap", 4);
-    sProg.setUnifS("normalMap", 5);
-    sProg.setUnifS("metallicMap", 6);
-    sProg.setUnifS("roughnessMap", 7);
-    sProg.setUnifS("aoMap", 8);
-    sProg.setUnifS("heightMap", 9);
-    // Set positions and directions for normal mapping.
-    sProg.setUnifS("dirLightDir", dirLight.direction);
-    sProg.setUnifS("spotLightPos", spotLight.position);
-    sProg.setUnifS("spotLightDir", spotLight.direction);
-    sProg.setUnifS("tubeLightPos", tubeLight.position);
-    sProg.setUnifS("tubeP0", tubeP0);
-    sProg.setUnifS("tubeP1", tubeP1);
-
-    floorProg.use();
-    floorProg.setUnifS("shadowMap", 0);
-    floorProg.setUnifS("spotShadowMap", 1);
-    floorProg.setUnifS("tubeShadowMap", 2);
-    floorProg.setUnifS("randomAngles", 3);
-    floorProg.setUnifS("albedoMap", 4);
-    floorProg.setUnifS("normalMap", 5);
-    floorProg.setUnifS("metallicMap", 6);
-    floorProg.setUnifS("roughnessMap", 7);
-    floorProg.setUnifS("aoMap", 8);
-    floorProg.setUnifS("heightMap", 9);
-    floorProg.setUnifS("dirLightDir", dirLight.direction);
-    floorProg.setUnifS("spotLightPos", spotLight.position);
-    floorProg.setUnifS("spotLightDir", spotLight.direction);
-    floorProg.setUnifS("tubeLightPos", tubeLight.position);
-    floorProg.setUnifS("tubeP0", tubeP0);
-    floorProg.setUnifS("tubeP1", tubeP1);
+    // Set the texture units of the lit programs, the lights are in the
+    // light block.
+    auto setupLitProgram = [&](Shader &prog) {
+      prog.setUnifS("shadowMap", 0);
+      prog.setUnifS("spotShadowMap", 1);
+      prog.setUnifS("tubeShadowMap", 2);
+      prog.setUnifS("randomAngles", 3);
+      prog.setUnifS("albedoMap", 4);
+      prog.setUnifS("normalMap", 5);
+      prog.setUnifS("metallicMap", 6);
+      prog.setUnifS("roughnessMap", 7);
+      prog.setUnifS("aoMap", 8);
+      prog.setUnifS("heightMap", 9);
+    };
+    sVariants.setInit(setupLitProgram);
+    sPullVariants.setInit(setupLitProgram);
+    floorVariants.setInit([&](Shader &prog) {
+      setupLitProgram(prog);
+      prog.setUnifS("model", floorModel);
+      prog.setUnifS("normMat",
+                    glm::mat3(glm::transpose(glm::inverse(floorModel))));
+    });
+
+    // The sphere maps packed into texture arrays, layer i for sphere i, once
+    // they are all on the GPU. They stay bound to the array targets of units
+    // 4 to 8, read by the MATERIAL_ARRAYS variants in place of the 2D maps,
+    // so all the spheres draw at once without binding textures. M switches
+    // back to binding the maps of every sphere.
+    std::array<unsigned int, 5> sphereMapArrays{};
+    bool sphereMapsReady = false;
+    bool sphereMapsPacked = false;
+    auto packSphereMaps = [&]() {
+      const unsigned int *maps[5] = {albedoMaps, normalMaps, metallicMaps,
+                                     roughnessMaps, aoMaps};
+      for (const unsigned int *map : maps) {
+        for (unsigned int i = 0; i < NUM_SPHERES; ++i) {
+          if (!isTextureReady(map[i]))
+            return false;
+        }
+      }
+      for (size_t m = 0; m < sphereMapArrays.size(); ++m) {
+        sphereMapArrays[m] = createTextureArray(
+            std::vector<unsigned int>(maps[m], maps[m] + NUM_SPHERES));
+        glActiveTexture(GL_TEXTURE4 + static_cast<GLenum>(m));
+        glBindTexture(GL_TEXTURE_2D_ARRAY, sphereMapArrays[m]);
+      }
+      glActiveTexture(GL_TEXTURE0);
+      sphereMapsPacked =
+          std::count(sphereMapArrays.begin(), sphereMapArrays.end(), 0u) == 0;
+      if (!sphereMapsPacked)
+        std::cout << "The sphere maps differ in size or format, they are "
+                     "bound per sphere\n";
+      return true;
+    };
 
-    /*
-    Set light directions and positions. Should be inside the render loop if
-    lights could move around.
-    */
-    sProg.use();
-    sProg.setLightDir(dirLight, glm::mat4(1.0f));
-    sProg.setLightPos(spotLight, glm::mat4(1.0f));
-    sProg.setLightDir(spotLight, glm::mat4(1.0f));
-    sProg.setLightPos(tubeLight, glm::mat4(1.0f));
-    floorProg.use();
-    floorProg.setLightDir(dirLight, glm::mat4(1.0f));
-    floorProg.setLightPos(spotLight, glm::mat4(1.0f));
-    floorProg.setLightDir(spotLight, glm::mat4(1.0f));
-    floorProg.setLightPos(tubeLight, glm::mat4(1.0f));
+    // Write the blocks shared by the programs, once per frame however many
+    // programs read them.
+    auto writeUniformBlocks = [&]() {
+      FrameBlock frame;
+      frame.view = view;
+      frame.projection = projection;
+      frame.dirSpaceMat = dirSpaceMat;
+      frame.spotSpaceMat = spotSpaceMat;
+      frame.tubeSpaceMat = tubeSpaceMat;
+      frame.viewPos = glm::vec4(cam.Position, 1.0f);
+      frameBlock.write(&frame);
+
+      LightBlock lights;
+      lights.dirLight = LightData(dirLight);
+      lights.spotLight = LightData(spotLight);
+      lights.tubeLight = LightData(tubeLight);
+      lights.tubeP0 = glm::vec4(tubeP0, 1.0f);
+      lights.tubeP1 = glm::vec4(tubeP1, 1.0f);
+      lightBlock.write(&lights);
+    };
 
     while (!glfwWindowShouldClose(window)) {
 
@@ -507,6 +637,10 @@ int main() {
       deltaTime = currentFrame - lastFrame;
       lastFrame = currentFrame;
 
+      uploadQueue.processFrame();
+      if (!sphereMapsReady)
+        sphereMapsReady = packSphereMaps();
+
       // Switch between wireframe
       if (toggles::g_wireframe)
         glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
@@ -528,6 +662,22 @@ int main() {
       // Update the projection matrix
       projection = glm::perspective(glm::radians(cam.Zoom), 800.0f / 600.0f,
                                     0.1f, 100.0f);
+      writeUniformBlocks();
+
+      // Draws of the passes are collected into the indirect batch, or drawn
+      // one by one. Vertex pulling needs every mesh in the pool, since the
+      // batch draws meshes outside of it directly with the same program.
+      bool indirect = toggles::g_indirect && geometryPool;
+      bool pulling = indirect && toggles::g_pullVertices &&
+                     sphere.isPooled() && boulder.isPooled();
+      ShaderVariants &objectVariants = pulling ? sPullVariants : sVariants;
+      const Shader &casterProg = pulling ? shadowPullProg : shadowProg;
+      const char *path = drawPath(indirect, pulling);
+      if (path != lastPath) {
+        submitStats.print(lastPath);
+        lastPath = path;
+      }
+      auto submitStart = std::chrono::steady_clock::now();
 
       // Do a first pass to obtain the shadow maps
       {
@@ -536,42 +686,55 @@ int main() {
 
         glCullFace(GL_FRONT);
 
+        // The spheres sharing a level of detail are one instanced draw. Only
+        // the frustum culls the meshlets of the boulder, the front faces are
+        // culled.
+        auto drawShadowCasters = [&](unsigned int pass,
+                                     const glm::mat4 &lightProjection,
+                                     const glm::mat4 &lightView) {
+          for (unsigned int i = 0; i < NUM_SPHERES; ++i) {
+            unsigned int lod = sphere.selectLod(
+                sphereLods[pass][i], lightProjection, lightView,
+                sphereModelMats[i], SHADOW_HEIGHT, SHADOW_LOD_BIAS);
+            collector.add(sphere, sphereModelMats[i], i, lod);
+          }
+          if (indirect)
+            collector.flush(batch, *geometryPool, casterProg, true, pulling);
+          else
+            collector.flush(shadowProg, true);
+          unsigned int lod = boulder.selectLod(
+              boulderLods[pass], lightProjection, lightView, boulderModelMat,
+              SHADOW_HEIGHT, SHADOW_LOD_BIAS);
+          meshlets::View cullView = meshlets::makeView(
+              lightProjection, lightView, boulderModelMat, false);
+          if (indirect) {
+            boulder.appendDraw(batch, casterProg, true, 1, &boulderModelMat,
+                               nullptr, lod, &cullView);
+            batch.submit(casterProg, *geometryPool, true, pulling);
+          } else {
+            boulder.DrawDepthOnly(shadowProg, 1, &boulderModelMat, lod,
+                                  &cullView);
+          }
+        };
+
         glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
                                GL_TEXTURE_2D, shadowMaps[0], 0);
         glClear(GL_DEPTH_BUFFER_BIT);
-        shadowProg.use();
-        shadowProg.setUnifS("lightSpaceMatrix", dirSpaceMat);
-
-        for (unsigned int i = 0; i < NUM_SPHERES; ++i) {
-          shadowProg.setUnifS("model", sphereModelMats[i]);
-          sphere.Draw(shadowProg, 1, nullptr, nullptr);
-        }
-        shadowProg.setUnifS("model", boulderModelMat);
-        boulder.Draw(shadowProg, 1, nullptr, nullptr);
+        casterProg.use();
+        casterProg.setUnifS(LIGHT_SPACE_UNIF, dirSpaceMat);
+        drawShadowCasters(0, dirProjection, dirView);
 
         glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
                                GL_TEXTURE_2D, shadowMaps[1], 0);
         glClear(GL_DEPTH_BUFFER_BIT);
-        shadowProg.setUnifS("lightSpaceMatrix", spotSpaceMat);
-
-        for (unsigned int i = 0; i < NUM_SPHERES; ++i) {
-          shadowProg.setUnifS("model", sphereModelMats[i]);
-          sphere.Draw(shadowProg, 1, nullptr, nullptr);
-        }
-        shadowProg.setUnifS("model", boulderModelMat);
-        boulder.Draw(shadowProg, 1, nullptr, nullptr);
+        casterProg.setUnifS(LIGHT_SPACE_UNIF, spotSpaceMat);
+        drawShadowCasters(1, spotProjection, spotView);
 
         glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
                                GL_TEXTURE_2D, shadowMaps[2], 0);
         glClear(GL_DEPTH_BUFFER_BIT);
-        shadowProg.setUnifS("lightSpaceMatrix", tubeSpaceMat);
-
-        for (unsigned int i = 0; i < NUM_SPHERES; ++i) {
-          shadowProg.setUnifS("model", sphereModelMats[i]);
-          sphere.Draw(shadowProg, 1, nullptr, nullptr);
-        }
-        shadowProg.setUnifS("model", boulderModelMat);
-        boulder.Draw(shadowProg, 1, nullptr, nullptr);
+        casterProg.setUnifS(LIGHT_SPACE_UNIF, tubeSpaceMat);
+        drawShadowCasters(2, tubeProjection, tubeView);
 
         glCullFace(GL_BACK);
       }
@@ -584,19 +747,14 @@ int main() {
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT |
                 GL_STENCIL_BUFFER_BIT);
 
+        // The area or point light and the spot or tube light are options of
+        // the lit programs.
+        unsigned int key = litKey();
+
         // Render the floor.
         {
+          Shader &floorProg = floorVariants.get(key);
           floorProg.use();
-          floorProg.setUnifS("viewPos", cam.Position);
-          floorProg.setUnif(floorViewID, view);
-          floorProg.setUnif(floorProjID, projection);
-          floorProg.setUnifS("dirSpaceMat", dirSpaceMat);
-          floorProg.setUnifS("spotSpaceMat", spotSpaceMat);
-          floorProg.setUnifS("tubeSpaceMat", tubeSpaceMat);
-
-          // Draw area or point light.
-          floorProg.setUnifS("areaLights", toggles::g_areaLights);
-          floorProg.setUnifS("showTube", toggles::g_showTube);
 
           // Floor Maps
           glActiveTexture(GL_TEXTURE0);
@@ -625,17 +783,14 @@ int main() {
 
         // Use the program and set all uniform values before draw call.
         {
-          sProg.use();
-          sProg.setUnifS("viewPos", cam.Position);
-          sProg.setUnif(sViewID, view);
-          sProg.setUnif(sProjID, projection);
-          sProg.setUnifS("dirSpaceMat", dirSpaceMat);
-          sProg.setUnifS("spotSpaceMat", spotSpaceMat);
-          sProg.setUnifS("tubeSpaceMat", tubeSpaceMat);
-
-          // Draw area or point light.
-          sProg.setUnifS("areaLights", toggles::g_areaLights);
-          sProg.setUnifS("showTube", toggles::g_showTube);
+          // Draw the spheres. Their maps are either layers of the arrays,
+          // picked by the material index of every instance, or bound by the
+          // collector between the draws of each sphere.
+          bool materialArrays = toggles::g_materialArrays && sphereMapsPacked;
+          Shader &sphereProg = objectVariants.get(
+              materialArrays ? key | materialArraysBit : key);
+          Shader &boulderProg = objectVariants.get(key);
+          sphereProg.use();
 
           glActiveTexture(GL_TEXTURE0);
           glBindTexture(GL_TEXTURE_2D, shadowMaps[0]);
@@ -646,8 +801,7 @@ int main() {
           glActiveTexture(GL_TEXTURE3);
           glBindTexture(GL_TEXTURE_2D, randomTexture);
 
-          // Draw the spheres.
-          for (unsigned int i = 0; i < NUM_SPHERES; ++i) {
+          auto bindMaps = [&](unsigned int i) {
             glActiveTexture(GL_TEXTURE4);
             glBindTexture(GL_TEXTURE_2D, albedoMaps[i]);
             glActiveTexture(GL_TEXTURE5);
@@ -662,11 +816,25 @@ int main() {
               glActiveTexture(GL_TEXTURE9);
               glBindTexture(GL_TEXTURE_2D, heightMaps[i]);
             }
-            // Call the model draw function for the spheres.
-            sphere.Draw(sProg, 1, &sphereModelMats[i], &sphereNormMats[i]);
+          };
+          DrawCollector::MaterialBinder bindSphereMaps;
+          if (!materialArrays)
+            bindSphereMaps = bindMaps;
+          for (unsigned int i = 0; i < NUM_SPHERES; ++i) {
+            unsigned int lod =
+                sphere.selectLod(sphereLods[3][i], projection, view,
+                                 sphereModelMats[i], SCR_HEIGHT);
+            collector.add(sphere, sphereModelMats[i], i, lod);
           }
+          if (indirect)
+            collector.flush(batch, *geometryPool, sphereProg, false, pulling,
+                            bindSphereMaps);
+          else
+            collector.flush(sphereProg, false, bindSphereMaps);
 
           // Draw the boulder.
+          if (&boulderProg != &sphereProg)
+            boulderProg.use();
           glActiveTexture(GL_TEXTURE4);
           glBindTexture(GL_TEXTURE_2D, boulderAlbedo);
           glActiveTexture(GL_TEXTURE5);
@@ -677,16 +845,46 @@ int main() {
           glBindTexture(GL_TEXTURE_2D, boulderRoughness);
           glActiveTexture(GL_TEXTURE8);
           glBindTexture(GL_TEXTURE_2D, boulderAO);
-          boulder.Draw(sProg, 1, &boulderModelMat, &boulderNormMat);
+          unsigned int lod = boulder.selectLod(
+              boulderLods[3], projection, view, boulderModelMat, SCR_HEIGHT);
+          meshlets::View cullView =
+              meshlets::makeView(projection, view, boulderModelMat, true);
+          if (indirect) {
+            boulder.appendDraw(batch, boulderProg, false, 1, &boulderModelMat,
+                               &boulderNormMat, lod, &cullView);
+            batch.submit(boulderProg, *geometryPool, false, pulling);
+          } else {
+            boulder.Draw(boulderProg, 1, &boulderModelMat, &boulderNormMat,
+                         lod, &cullView);
+          }
         }
 
         // Draw the lights.
         lightProg.use();
-        lightProg.setUnif(lightViewID, view);
-        lightProg.setUnif(lightProjID, projection);
-        lightProg.setUnifS("model", lightSphereModel);
-        lightProg.setUnifS("color", spotLight.cLight);
-        sphere.Draw(lightProg, 1, nullptr, nullptr);
+        lightModelUnif.set(lightSphereModel);
+        lightColorUnif.set(spotLight.cLight);
+        unsigned int lod = sphere.selectLod(lightSphereLod, projection, view,
+                                            lightSphereModel, SCR_HEIGHT);
+        meshlets::View cullView =
+            meshlets::makeView(projection, view, lightSphereModel, true);
+        sphere.Draw(lightProg, 1, nullptr, nullptr, lod, &cullView);
+      }
+      std::chrono::duration<double, std::milli> submitTime =
+          std::chrono::steady_clock::now() - submitStart;
+      submitStats.addTime(submitTime.count());
+      submitStats.endFrame();
+      uniformStats.endFrame();
+
+      if (instanceRing)
+        instanceRing->endFrame();
+      lodStats.endFrame(deltaTime * 1000.0);
+      if (currentFrame - lastLodStats >= LOD_STATS_INTERVAL) {
+        lodStats.print();
+        if (instanceRing)
+          instanceRing->printStats();
+        submitStats.print(path);
+        uniformStats.print();
+        lastLodStats = currentFrame;
       }
 
       // buffer swap and event poll
@@ -697,6 +895,8 @@ int main() {
     glDeleteTextures(2, shadowMaps);
     glDeleteFramebuffers(1, &shadowFBO);
     glDeleteTextures(1, &randomTexture);
+    glDeleteTextures(static_cast<GLsizei>(sphereMapArrays.size()),
+                     sphereMapArrays.data());
     glDeleteBuffers(1, &shadowUBO);
   }
 
@@ -782,4 +982,28 @@ void processInput(GLFWwindow *window) {
   if (glfwGetKey(window, GLFW_KEY_T) == GLFW_RELEASE) {
     toggles::tKeyPressed = false;
   }
+
+  if (glfwGetKey(window, GLFW_KEY_I) == GLFW_PRESS && !toggles::iKeyPressed) {
+    toggles::g_indirect = !toggles::g_indirect;
+    toggles::iKeyPressed = true;
+  }
+  if (glfwGetKey(window, GLFW_KEY_I) == GLFW_RELEASE) {
+    toggles::iKeyPressed = false;
+  }
+
+  if (glfwGetKey(window, GLFW_KEY_V) == GLFW_PRESS && !toggles::vKeyPressed) {
+    toggles::g_pullVertices = !toggles::g_pullVertices;
+    toggles::vKeyPressed = true;
+  }
+  if (glfwGetKey(window, GLFW_KEY_V) == GLFW_RELEASE) {
+    toggles::vKeyPressed = false;
+  }
+
+  if (glfwGetKey(window, GLFW_KEY_M) == GLFW_PRESS && !toggles::mKeyPressed) {
+    toggles::g_materialArrays = !toggles::g_materialArrays;
+    toggles::mKeyPressed = true;
+  }
+  if (glfwGetKey(window, GLFW_KEY_M) == GLFW_RELEASE) {
+    toggles::mKeyPressed = false;
+  }
 }
\ No newline at end of file
@@ -0,0 +1,11 @@
+// Per frame data shared by every program, written once per frame into the
+// uniform buffer at binding 1 (FrameBlock in uniform_blocks.h).
+layout(std140, binding = 1) uniform frameBlock {
+  mat4 view;
+  mat4 projection;
+  // World space to the clip space of every light.
+  mat4 dirSpaceMat;
+  mat4 spotSpaceMat;
+  mat4 tubeSpaceMat;
+  vec3 viewPos;
+};
\ No newline at end of file
@@ -0,0 +1,24 @@
+// The lights, written once per frame into the uniform buffer at binding 2
+// (LightBlock in uniform_blocks.h).
+struct Light {
+  vec3 position;
+  float cutOff; // max angle at which it gives full light
+  vec3 direction;
+  float outerCutOff; // max angle at which it gives any light
+  vec3 cLight;
+  float width;
+  float len;
+  float constant;
+  float linear;
+  float quadratic;
+  bool directional;
+};
+
+layout(std140, binding = 2) uniform lightBlock {
+  Light dirLight;
+  Light spotLight;
+  Light tubeLight;
+  // End points of the tube light.
+  vec3 tubeP0;
+  vec3 tubeP1;
+};
\ No newline at end of file
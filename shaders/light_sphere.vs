@@ -1,8 +1,15 @@
 #version 430 core
 layout(location = 0) in vec3 aPos;
 
+// Compact meshes store positions normalized within their bounds.
+layout(location = 20) uniform vec3 posScale;
+layout(location = 21) uniform vec3 posOffset;
+
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
 
-void main() { gl_Position = projection * view * model * vec4(aPos, 1.0f); }
\ No newline at end of file
+#include "frame_block.glsl"
+
+void main() {
+  vec3 pos = posOffset + posScale * aPos;
+  gl_Position = projection * view * model * vec4(pos, 1.0f);
+}
\ No newline at end of file
@@ -0,0 +1,18 @@
+// Members of the VS_OUT block from the vertex shaders to object.fs.
+vec3 worldFragPos;
+vec2 texCoords;
+
+vec3 frenetFragPos;
+vec3 frenetViewPos;
+vec3 frenetLightDir;
+vec3 frenetSpotPos;
+vec3 frenetSpotDir;
+vec3 frenetTubePos;
+vec3 frenetP0;
+vec3 frenetP1;
+
+vec4 fragPosDirSpace;
+vec4 fragPosSpotSpace;
+vec4 fragPosTubeSpace;
+
+flat uint materialLayer;
\ No newline at end of file
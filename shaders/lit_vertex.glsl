@@ -0,0 +1,38 @@
+// Outputs of the vertex shaders of object.fs: the fragment position in the
+// view space of every light and the lights in tangent space.
+#include "frame_block.glsl"
+#include "light_block.glsl"
+
+out VS_OUT {
+#include "lit_varyings.glsl"
+}
+vs_out;
+
+// Write the outputs that depend on the world space position, normal and
+// tangent of the vertex.
+void writeLitOutputs(vec3 worldPos, vec3 normal, vec3 tangent) {
+  vs_out.worldFragPos = worldPos;
+
+  // Fragment position in the view space of the lights.
+  vs_out.fragPosDirSpace = dirSpaceMat * vec4(worldPos, 1.0);
+  vs_out.fragPosSpotSpace = spotSpaceMat * vec4(worldPos, 1.0);
+  vs_out.fragPosTubeSpace = tubeSpaceMat * vec4(worldPos, 1.0);
+
+  // Construct tangent space matrix for normal mapping.
+  vec3 T = normalize(tangent);
+  vec3 N = normalize(normal);
+  // Use Gram-Schmidt to re-orthogonalize.
+  T = normalize(T - dot(T, N) * N);
+  vec3 B = cross(N, T);
+  mat3 TBN = transpose(mat3(T, B, N));
+
+  // Send Frenet frame coordinate positions.
+  vs_out.frenetFragPos = TBN * worldPos;
+  vs_out.frenetViewPos = TBN * viewPos;
+  vs_out.frenetLightDir = TBN * dirLight.direction;
+  vs_out.frenetSpotPos = TBN * spotLight.position;
+  vs_out.frenetSpotDir = TBN * spotLight.direction;
+  vs_out.frenetTubePos = TBN * tubeLight.position;
+  vs_out.frenetP0 = TBN * tubeP0;
+  vs_out.frenetP1 = TBN * tubeP1;
+}
\ No newline at end of file
@@ -1,42 +1,18 @@
 #version 430 core
+// Options, defined by ShaderVariants:
+//   TUBE_LIGHT          light with the tube light instead of the spot light
+//   AREA_LIGHTS         light with the spot light as a sphere light instead
+//                       of a point light
+//   MATERIAL_ARRAYS     the maps are texture arrays, sampled at the layer of
+//                       the instance
+//   PARALLAX_OCCLUSION  offset the texture coordinates with heightMap
 
 in VS_OUT {
-  vec3 worldFragPos;
-  vec2 texCoords;
-
-  vec3 frenetFragPos;
-  vec3 frenetViewPos;
-  vec3 frenetLightDir;
-  vec3 frenetSpotPos;
-  vec3 frenetSpotDir;
-  vec3 frenetTubePos;
-  vec3 frenetP0;
-  vec3 frenetP1;
-
-  vec4 fragPosDirSpace;
-  vec4 fragPosSpotSpace;
-  vec4 fragPosTubeSpace;
+#include "lit_varyings.glsl"
 }
 fs_in;
 
-struct Light {
-  vec3 position;
-  vec3 direction;
-  float cutOff;      // max angle at which it gives full light
-  float outerCutOff; // max angle at which it gives any light
-  bool directional;
-  float width;
-  float len;
-
-  vec3 cLight;
-  vec3 ambient;
-  vec3 diffuse;
-  vec3 specular;
-
-  float constant;
-  float linear;
-  float quadratic;
-};
+#include "light_block.glsl"
 
 layout(std140, binding = 0) uniform shadowBlock {
   vec2 poissonDisk[32];
@@ -46,28 +22,28 @@ layout(std140, binding = 0) uniform shadowBlock {
   float shadowMult;
 };
 
-uniform Light dirLight;
-uniform Light spotLight;
-uniform Light tubeLight;
 uniform sampler2D shadowMap;
 uniform sampler2D spotShadowMap;
 uniform sampler2D tubeShadowMap;
 uniform sampler2D randomAngles;
 
-// PBR textures.
-uniform sampler2D albedoMap;
-uniform sampler2D normalMap;
-uniform sampler2D metallicMap;
-uniform sampler2D roughnessMap;
-uniform sampler2D aoMap;
-
+// PBR textures, or the same maps of several materials in texture arrays.
+#ifdef MATERIAL_ARRAYS
+#define MATERIAL_SAMPLER sampler2DArray
+#else
+#define MATERIAL_SAMPLER sampler2D
+#endif
+uniform MATERIAL_SAMPLER albedoMap;
+uniform MATERIAL_SAMPLER normalMap;
+uniform MATERIAL_SAMPLER metallicMap;
+uniform MATERIAL_SAMPLER roughnessMap;
+uniform MATERIAL_SAMPLER aoMap;
+
+#ifdef PARALLAX_OCCLUSION
 // For Parallax Occlusion Mapping
 uniform float heightScale;
 uniform sampler2D heightMap;
-
-// Choose whether to draw area lights.
-uniform bool areaLights;
-uniform bool showTube;
+#endif
 
 const float PI = 3.1415926538;
 const int MAX_NUM_SAMPLES = 64;
@@ -472,6 +448,7 @@ float shadowCalculation(vec4 pos, float ndotl, sampler2D map, Light light) {
   return shadow;
 }
 
+#ifdef PARALLAX_OCCLUSION
 vec2 parallaxOcclusion(vec2 texCoords, vec3 v) {
   const float minLayers = 8.0;
   const float maxLayers = 32.0;
@@ -505,22 +482,35 @@ vec2 parallaxOcclusion(vec2 texCoords, vec3 v) {
 
   return finalUV;
 }
+#endif
+
+vec4 sampleMaterial(sampler2D map, vec2 uv) { return texture(map, uv); }
+
+vec4 sampleMaterial(sampler2DArray maps, vec2 uv) {
+  return texture(maps, vec3(uv, float(fs_in.materialLayer)));
+}
 
 void main() {
   vec3 v = normalize(fs_in.frenetViewPos - fs_in.frenetFragPos);
-  vec2 texCoords = parallaxOcclusion(fs_in.texCoords, v);
+#ifdef PARALLAX_OCCLUSION
+  vec2 uv = parallaxOcclusion(fs_in.texCoords, v);
+#else
+  vec2 uv = fs_in.texCoords;
+#endif
 
   const float gamma = 2.2;
 
-  // Load PBR values.
-  vec3 albedo = pow(texture(albedoMap, fs_in.texCoords).rgb, vec3(gamma));
-  vec3 normal = texture(normalMap, fs_in.texCoords).rgb;
-  float metallic = texture(metallicMap, fs_in.texCoords).r;
-  float roughness = texture(roughnessMap, fs_in.texCoords).r;
-  float ao = pow(texture(aoMap, fs_in.texCoords).r, gamma);
+  // Load PBR values. Albedo maps are sRGB textures, GL returns linear colors.
+  vec3 albedo = sampleMaterial(albedoMap, uv).rgb;
+  // Only x and y are read so two channel (BC5) normal maps work as well.
+  vec2 normalXY = sampleMaterial(normalMap, uv).rg * 2.0 - 1.0;
+  float metallic = sampleMaterial(metallicMap, uv).r;
+  float roughness = sampleMaterial(roughnessMap, uv).r;
+  float ao = pow(sampleMaterial(aoMap, uv).r, gamma);
 
-  // Transform the normal to the [-1,1] range.
-  normal = normalize(normal * 2.0 - 1.0);
+  // Reconstruct z from the unit length normal.
+  vec3 normal = vec3(
+      normalXY, sqrt(max(1.0 - dot(normalXY, normalXY), 0.0)));
 
   float ndotv = max(dot(normal, v), 0.0);
 
@@ -529,46 +519,43 @@ void main() {
 
   vec3 Lo = vec3(0.0);
 
-  // Lo from directional light.
+  // The directional light does not light the objects, so its shadow map is
+  // not sampled either.
+  /*
   vec3 l = normalize(-fs_in.frenetLightDir);
   float ndotl = max(dot(l, normal), 0.0);
   float shadow =
       shadowCalculation(fs_in.fragPosDirSpace, ndotl, shadowMap, dirLight);
-  /*
   Lo += shadow * calcLight(dirLight, fs_in.frenetLightDir, normal, v, l, F0,
                            albedo, metallic, roughness, ndotl, ndotv);
   */
 
-  // Lo from spot light.
-  l = normalize(fs_in.frenetSpotPos - fs_in.frenetFragPos);
-  ndotl = max(dot(l, normal), 0.0);
-  shadow = shadowCalculation(fs_in.fragPosSpotSpace, ndotl, spotShadowMap,
-                             spotLight);
-  if (showTube == false) {
-    if (areaLights == true) {
-      vec3 LoSphere =
-          calcSphereGlossy(spotLight, fs_in.frenetSpotDir, fs_in.frenetSpotPos,
-                           normal, v, F0, roughness, albedo, metallic, ndotv);
-      LoSphere *= shadow;
-      Lo += LoSphere;
-    } else {
-      Lo += shadow * calcLight(spotLight, fs_in.frenetSpotDir, normal, v, l, F0,
-                               albedo, metallic, roughness, ndotl, ndotv);
-    }
-  }
-
+#ifdef TUBE_LIGHT
   // Lo from tube light.
-  l = normalize(fs_in.frenetTubePos - fs_in.frenetFragPos);
-  ndotl = max(dot(l, normal), 0.0);
-  shadow = shadowCalculation(fs_in.fragPosTubeSpace, ndotl, tubeShadowMap,
-                             tubeLight);
-  if (showTube == true) {
-    vec3 LoTube =
-        calcTubeGlossy(tubeLight, fs_in.frenetP0, fs_in.frenetP1, normal, v, F0,
-                       roughness, albedo, metallic, ndotv);
-    LoTube *= shadow;
-    Lo += LoTube;
-  }
+  vec3 l = normalize(fs_in.frenetTubePos - fs_in.frenetFragPos);
+  float ndotl = max(dot(l, normal), 0.0);
+  float shadow = shadowCalculation(fs_in.fragPosTubeSpace, ndotl,
+                                   tubeShadowMap, tubeLight);
+  vec3 LoTube =
+      calcTubeGlossy(tubeLight, fs_in.frenetP0, fs_in.frenetP1, normal, v, F0,
+                     roughness, albedo, metallic, ndotv);
+  Lo += shadow * LoTube;
+#else
+  // Lo from spot light.
+  vec3 l = normalize(fs_in.frenetSpotPos - fs_in.frenetFragPos);
+  float ndotl = max(dot(l, normal), 0.0);
+  float shadow = shadowCalculation(fs_in.fragPosSpotSpace, ndotl,
+                                   spotShadowMap, spotLight);
+#ifdef AREA_LIGHTS
+  vec3 LoSphere =
+      calcSphereGlossy(spotLight, fs_in.frenetSpotDir, fs_in.frenetSpotPos,
+                       normal, v, F0, roughness, albedo, metallic, ndotv);
+  Lo += shadow * LoSphere;
+#else
+  Lo += shadow * calcLight(spotLight, fs_in.frenetSpotDir, normal, v, l, F0,
+                           albedo, metallic, roughness, ndotl, ndotv);
+#endif
+#endif
 
   vec3 ambient = vec3(0.04) * albedo * ao;
   vec3 color = ambient + Lo;
@@ -1,70 +1,37 @@
 #version 430 core
 layout(location = 0) in vec3 aPos;
-layout(location = 1) in vec3 aNorm;
+layout(location = 1) in vec4 aNorm;
 layout(location = 2) in vec2 aTexCoords;
-layout(location = 3) in vec3 aTangent;
+layout(location = 3) in vec4 aTangent;
+// Layer of the material texture arrays.
+layout(location = 4) in uint aMaterial;
 layout(location = 5) in mat4 aModel;
 layout(location = 9) in mat3 aNormMat;
 
-uniform vec3 viewPos;
-uniform vec3 dirLightDir;
-uniform vec3 spotLightPos;
-uniform vec3 spotLightDir;
-uniform vec3 tubeLightPos;
-uniform vec3 tubeP0;
-uniform vec3 tubeP1;
-
-uniform mat4 view;
-uniform mat4 projection;
-uniform mat4 dirSpaceMat;
-uniform mat4 spotSpaceMat;
-uniform mat4 tubeSpaceMat;
-
-out VS_OUT {
-  vec3 worldFragPos;
-  vec2 texCoords;
-
-  vec3 frenetFragPos;
-  vec3 frenetViewPos;
-  vec3 frenetLightDir;
-  vec3 frenetSpotPos;
-  vec3 frenetSpotDir;
-  vec3 frenetTubePos;
-  vec3 frenetP0;
-  vec3 frenetP1;
-
-  vec4 fragPosDirSpace;
-  vec4 fragPosSpotSpace;
-  vec4 fragPosTubeSpace;
+// Compact meshes store positions normalized within their bounds.
+layout(location = 20) uniform vec3 posScale;
+layout(location = 21) uniform vec3 posOffset;
+
+#include "lit_vertex.glsl"
+
+// Compact normals and tangents are octahedral encoded with w = 0, float ones
+// are vec3 attributes and read w = 1.
+vec3 decodeDirection(vec4 v) {
+  if (v.w != 0.0)
+    return v.xyz;
+  vec3 n = vec3(v.xy, 1.0 - abs(v.x) - abs(v.y));
+  float t = max(-n.z, 0.0);
+  n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+  return normalize(n);
 }
-vs_out;
 
 void main() {
-  gl_Position = projection * view * aModel * vec4(aPos, 1.0);
+  vec3 pos = posOffset + posScale * aPos;
+  vec4 worldPos = aModel * vec4(pos, 1.0);
+  gl_Position = projection * view * worldPos;
 
-  vs_out.worldFragPos = vec3(aModel * vec4(aPos, 1.0));
   vs_out.texCoords = aTexCoords;
-
-  // Fragment position in the view space of the lights.
-  vs_out.fragPosDirSpace = dirSpaceMat * vec4(vs_out.worldFragPos, 1.0);
-  vs_out.fragPosSpotSpace = spotSpaceMat * vec4(vs_out.worldFragPos, 1.0);
-  vs_out.fragPosTubeSpace = tubeSpaceMat * vec4(vs_out.worldFragPos, 1.0);
-
-  // Construct tangent space matrix for normal mapping.
-  vec3 T = normalize(aNormMat * aTangent);
-  vec3 N = normalize(aNormMat * aNorm);
-  // Use Gram-Schmidt to re-orthogonalize.
-  T = normalize(T - dot(T, N) * N);
-  vec3 B = cross(N, T);
-  mat3 TBN = transpose(mat3(T, B, N));
-
-  // Send Frenet frame coordinate positions.
-  vs_out.frenetFragPos = TBN * vec3(aModel * vec4(aPos, 1.0));
-  vs_out.frenetViewPos = TBN * viewPos;
-  vs_out.frenetLightDir = TBN * dirLightDir;
-  vs_out.frenetSpotPos = TBN * spotLightPos;
-  vs_out.frenetSpotDir = TBN * spotLightDir;
-  vs_out.frenetTubePos = TBN * tubeLightPos;
-  vs_out.frenetP0 = TBN * tubeP0;
-  vs_out.frenetP1 = TBN * tubeP1;
+  vs_out.materialLayer = aMaterial;
+  writeLitOutputs(worldPos.xyz, aNormMat * decodeDirection(aNorm),
+                  aNormMat * decodeDirection(aTangent));
 }
\ No newline at end of file
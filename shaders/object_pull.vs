@@ -0,0 +1,77 @@
+#version 430 core
+// Vertex pulling version of object.vs. The vertices and instance matrices
+// are read from shader storage buffers, the only attribute is the instance
+// index, which unlike gl_InstanceID includes the base instance.
+layout(location = 12) in uint aInstance;
+
+// Compact meshes store positions normalized within their bounds.
+layout(location = 20) uniform vec3 posScale;
+layout(location = 21) uniform vec3 posOffset;
+// Vertices from this index on are compact ones, see GeometryPool.
+layout(location = 22) uniform int compactBase;
+
+layout(std430, binding = 1) readonly buffer FullVertices {
+  float fullVertices[];
+};
+layout(std430, binding = 2) readonly buffer CompactVertices {
+  uint compactVertices[];
+};
+layout(std430, binding = 5) readonly buffer ModelMatrices { mat4 models[]; };
+// Tightly packed mat3s.
+layout(std430, binding = 6) readonly buffer NormalMatrices {
+  float normMats[];
+};
+// Layers of the material texture arrays.
+layout(std430, binding = 7) readonly buffer Materials { uint materials[]; };
+
+#include "lit_vertex.glsl"
+
+// Octahedral direction in the x and y fields of a 2_10_10_10 value.
+vec3 decodeDirection(uint packed) {
+  vec2 p = vec2(bitfieldExtract(int(packed), 0, 10),
+                bitfieldExtract(int(packed), 10, 10));
+  p = max(p / 511.0, -1.0);
+  vec3 n = vec3(p, 1.0 - abs(p.x) - abs(p.y));
+  float t = max(-n.z, 0.0);
+  n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+  return normalize(n);
+}
+
+vec3 readVec3(int i) {
+  return vec3(fullVertices[i], fullVertices[i + 1], fullVertices[i + 2]);
+}
+
+void main() {
+  // gl_VertexID includes the base vertex of the draw.
+  vec3 aPos, aNorm, aTangent;
+  vec2 aTexCoords;
+  if (gl_VertexID >= compactBase) {
+    // 20 byte CompactVertex.
+    int i = 5 * (gl_VertexID - compactBase);
+    aPos = vec3(unpackUnorm2x16(compactVertices[i]),
+                unpackUnorm2x16(compactVertices[i + 1]).x);
+    aNorm = decodeDirection(compactVertices[i + 2]);
+    aTexCoords = unpackHalf2x16(compactVertices[i + 3]);
+    aTangent = decodeDirection(compactVertices[i + 4]);
+  } else {
+    // 44 byte Vertex.
+    int i = 11 * gl_VertexID;
+    aPos = readVec3(i);
+    aNorm = readVec3(i + 3);
+    aTexCoords = vec2(fullVertices[i + 6], fullVertices[i + 7]);
+    aTangent = readVec3(i + 8);
+  }
+  mat4 aModel = models[aInstance];
+  int m = 9 * int(aInstance);
+  mat3 aNormMat = mat3(normMats[m], normMats[m + 1], normMats[m + 2],
+                       normMats[m + 3], normMats[m + 4], normMats[m + 5],
+                       normMats[m + 6], normMats[m + 7], normMats[m + 8]);
+
+  vec3 pos = posOffset + posScale * aPos;
+  vec4 worldPos = aModel * vec4(pos, 1.0);
+  gl_Position = projection * view * worldPos;
+
+  vs_out.texCoords = aTexCoords;
+  vs_out.materialLayer = materials[aInstance];
+  writeLitOutputs(worldPos.xyz, aNormMat * aNorm, aNormMat * aTangent);
+}
\ No newline at end of file
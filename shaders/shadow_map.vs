@@ -1,7 +1,14 @@
 #version 430 core
 layout(location = 0) in vec3 aPos;
+layout(location = 5) in mat4 aModel;
+
+// Compact meshes store positions normalized within their bounds.
+layout(location = 20) uniform vec3 posScale;
+layout(location = 21) uniform vec3 posOffset;
 
 uniform mat4 lightSpaceMatrix;
-uniform mat4 model;
 
-void main() { gl_Position = lightSpaceMatrix * model * vec4(aPos, 1.0); }
\ No newline at end of file
+void main() {
+  vec3 pos = posOffset + posScale * aPos;
+  gl_Position = lightSpaceMatrix * aModel * vec4(pos, 1.0);
+}
\ No newline at end of file
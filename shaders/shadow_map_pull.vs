@@ -0,0 +1,37 @@
+#version 430 core
+// Vertex pulling version of shadow_map.vs, the positions and model matrices
+// are read from shader storage buffers by vertex and instance index.
+layout(location = 12) in uint aInstance;
+
+// Compact meshes store positions normalized within their bounds.
+layout(location = 20) uniform vec3 posScale;
+layout(location = 21) uniform vec3 posOffset;
+// Vertices from this index on are compact ones, see GeometryPool.
+layout(location = 22) uniform int compactBase;
+
+// Tightly packed vec3s.
+layout(std430, binding = 3) readonly buffer FullPositions {
+  float fullPositions[];
+};
+// Four 16-bit values per vertex.
+layout(std430, binding = 4) readonly buffer CompactPositions {
+  uint compactPositions[];
+};
+layout(std430, binding = 5) readonly buffer ModelMatrices { mat4 models[]; };
+
+uniform mat4 lightSpaceMatrix;
+
+void main() {
+  // gl_VertexID includes the base vertex of the draw.
+  vec3 aPos;
+  if (gl_VertexID >= compactBase) {
+    int i = 2 * (gl_VertexID - compactBase);
+    aPos = vec3(unpackUnorm2x16(compactPositions[i]),
+                unpackUnorm2x16(compactPositions[i + 1]).x);
+  } else {
+    int i = 3 * gl_VertexID;
+    aPos = vec3(fullPositions[i], fullPositions[i + 1], fullPositions[i + 2]);
+  }
+  vec3 pos = posOffset + posScale * aPos;
+  gl_Position = lightSpaceMatrix * models[aInstance] * vec4(pos, 1.0);
+}
\ No newline at end of file
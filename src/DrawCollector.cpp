@@ -0,0 +1,179 @@
+#include "DrawCollector.h"
+#include "hashing.h"
+#include <algorithm>
+#include <numeric>
+
+using namespace std;
+
+namespace {
+// Instances, slots ring entries each, that fit in the room left in the
+// current frame of ring. All of them if not even one does, the ring then
+// counts the overflow.
+unsigned int fitInstances(const InstanceRing *ring, unsigned int count,
+                          unsigned int slots) {
+  if (ring == nullptr || ring->getRoom() < slots)
+    return count;
+  return min(count, ring->getRoom() / slots);
+}
+} // namespace
+
+bool DrawCollector::Key::operator==(const Key &other) const {
+  return model == other.model && lod == other.lod &&
+         material == other.material;
+}
+
+size_t DrawCollector::KeyHash::operator()(const Key &key) const {
+  uint64_t hash = hashValue(key.model, FNV_OFFSET_BASIS);
+  hash = hashValue(key.lod, hash);
+  return static_cast<size_t>(hashValue(key.material, hash));
+}
+
+void DrawCollector::add(const Model &model, const glm::mat4 &transform,
+                        unsigned int material, unsigned int lod) {
+  Key key{&model, lod, material};
+  if (groups.empty() || !(groups[lastGroup].key == key)) {
+    auto inserted = groupIndices.emplace(
+        key, static_cast<unsigned int>(groups.size()));
+    if (inserted.second)
+      groups.push_back({key, 0, 0});
+    lastGroup = inserted.first->second;
+  }
+  groups[lastGroup].count++;
+  transforms.push_back(transform);
+  instanceGroups.push_back(lastGroup);
+}
+
+size_t DrawCollector::flush(const Shader &shader, bool depthOnly,
+                            const MaterialBinder &bindMaterial) {
+  bool byMaterial = !depthOnly && bindMaterial;
+  sortInstances(depthOnly, byMaterial);
+  size_t numDraws = 0;
+  for (size_t i = 0; i < runs.size(); ++i) {
+    const Run &run = runs[i];
+    if (byMaterial && (i == 0 || runs[i - 1].material != run.material))
+      bindMaterial(run.material);
+    // The instances are written once for all the meshes.
+    InstanceRing *ring = run.model->getInstanceRing();
+    unsigned int end = run.first + run.count;
+    for (unsigned int first = run.first; first < end; ++numDraws) {
+      // Everything drawn so far is done with the ring.
+      if (ring != nullptr && ring->getRoom() == 0)
+        ring->recycle();
+      unsigned int count = fitInstances(ring, end - first, 1);
+      if (depthOnly) {
+        run.model->DrawDepthOnly(shader, count, &models[first], run.lod);
+      } else {
+        run.model->Draw(shader,
+                        run.model->prepareInstances(count, &models[first],
+                                                    &normMats[first],
+                                                    &materials[first]),
+                        run.lod);
+      }
+      first += count;
+    }
+  }
+  clear();
+  return numDraws;
+}
+
+size_t DrawCollector::flush(IndirectBatch &batch, const GeometryPool &pool,
+                            const Shader &shader, bool depthOnly,
+                            bool pullVertices,
+                            const MaterialBinder &bindMaterial) {
+  bool byMaterial = !depthOnly && bindMaterial;
+  sortInstances(depthOnly, byMaterial);
+  size_t numDraws = 0;
+  for (size_t i = 0; i < runs.size(); ++i) {
+    const Run &run = runs[i];
+    if (byMaterial && (i == 0 || runs[i - 1].material != run.material)) {
+      // The commands collected so far use the previous material.
+      batch.submit(shader, pool, depthOnly, pullVertices);
+      bindMaterial(run.material);
+    }
+    // Every mesh writes its own instances.
+    InstanceRing *ring = run.model->getInstanceRing();
+    unsigned int slots =
+        max(static_cast<unsigned int>(run.model->getNumMeshes()), 1u);
+    unsigned int end = run.first + run.count;
+    for (unsigned int first = run.first; first < end; ++numDraws) {
+      if (ring != nullptr && ring->getRoom() < slots) {
+        // The commands collected so far read the instances to overwrite.
+        batch.submit(shader, pool, depthOnly, pullVertices);
+        ring->recycle();
+      }
+      unsigned int count = fitInstances(ring, end - first, slots);
+      if (depthOnly) {
+        run.model->appendDraw(batch, shader, true, count, &models[first],
+                              nullptr, run.lod);
+      } else {
+        run.model->appendDraw(batch, shader, false, count, &models[first],
+                              &normMats[first], run.lod, nullptr,
+                              &materials[first]);
+      }
+      first += count;
+    }
+  }
+  batch.submit(shader, pool, depthOnly, pullVertices);
+  clear();
+  return numDraws;
+}
+
+size_t DrawCollector::size() const { return transforms.size(); }
+
+// Order the groups, by material first if the materials are bound, scatter
+// the instances into contiguous ranges in that order and merge neighbouring
+// groups into runs where the material does not matter.
+void DrawCollector::sortInstances(bool depthOnly, bool byMaterial) {
+  vector<unsigned int> order(groups.size());
+  iota(order.begin(), order.end(), 0u);
+  sort(order.begin(), order.end(), [&](unsigned int a, unsigned int b) {
+    const Key &x = groups[a].key;
+    const Key &y = groups[b].key;
+    if (byMaterial && x.material != y.material)
+      return x.material < y.material;
+    if (x.model != y.model)
+      return less<const Model *>()(x.model, y.model);
+    if (x.lod != y.lod)
+      return x.lod < y.lod;
+    return x.material < y.material;
+  });
+
+  runs.clear();
+  unsigned int first = 0;
+  for (unsigned int index : order) {
+    Group &group = groups[index];
+    group.first = first;
+    first += group.count;
+    if (!runs.empty() && runs.back().model == group.key.model &&
+        runs.back().lod == group.key.lod &&
+        (!byMaterial || runs.back().material == group.key.material)) {
+      runs.back().count += group.count;
+    } else {
+      runs.push_back({group.key.model, group.key.lod, group.key.material,
+                      group.first, group.count});
+    }
+  }
+
+  size_t numInstances = transforms.size();
+  models.resize(numInstances);
+  materials.resize(numInstances);
+  if (!depthOnly)
+    normMats.resize(numInstances);
+  for (size_t i = 0; i < numInstances; ++i) {
+    Group &group = groups[instanceGroups[i]];
+    // Used as the cursor of the group, reset by clear.
+    unsigned int slot = group.first++;
+    models[slot] = transforms[i];
+    materials[slot] = group.key.material;
+    if (!depthOnly)
+      normMats[slot] = glm::transpose(glm::inverse(glm::mat3(transforms[i])));
+  }
+}
+
+void DrawCollector::clear() {
+  groupIndices.clear();
+  groups.clear();
+  lastGroup = 0;
+  transforms.clear();
+  instanceGroups.clear();
+}
@@ -0,0 +1,290 @@
+#include "GeometryPool.h"
+#include "Mesh.h"
+#include "SubmitStats.h"
+#include "UploadQueue.h"
+#include "gl_extensions.h"
+#include <iostream>
+
+using namespace std;
+
+namespace {
+GeometryPool *activePool = nullptr;
+
+size_t vertexSize(VertexFormat format) {
+  return format == VertexFormat::Compact ? sizeof(CompactVertex)
+                                         : sizeof(Vertex);
+}
+
+size_t positionSize(VertexFormat format) {
+  return format == VertexFormat::Compact ? 4 * sizeof(uint16_t)
+                                         : sizeof(glm::vec3);
+}
+
+// Storage that is only written through glBufferSubData and copies.
+unsigned int createBuffer(size_t size) {
+  unsigned int buffer;
+  glGenBuffers(1, &buffer);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+  if (glext::bufferStorage)
+    glext::BufferStorage(GL_COPY_WRITE_BUFFER, size, nullptr,
+                         glext::DYNAMIC_STORAGE_BIT);
+  else
+    glBufferData(GL_COPY_WRITE_BUFFER, size, nullptr, GL_STATIC_DRAW);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+  return buffer;
+}
+
+void copyToBuffer(unsigned int buffer, size_t offset, const void *data,
+                  size_t size, uint64_t &ticket) {
+  if (data == nullptr || size == 0)
+    return;
+  UploadQueue *uploader = UploadQueue::active();
+  if (uploader != nullptr) {
+    ticket = max(ticket, uploader->queueBuffer(buffer, offset, data, size));
+  } else {
+    glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, offset, size, data);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+  }
+}
+
+size_t groupIndex(VertexFormat format, bool shortIndices) {
+  return (shortIndices ? 2 : 0) + static_cast<size_t>(format);
+}
+} // namespace
+
+GeometryPool::GeometryPool(InstanceRing &ring, size_t verticesPerFormat,
+                           size_t indexBytes)
+    : ring(ring), verticesPerFormat(verticesPerFormat),
+      indexCapacity(indexBytes), indexBytesUsed(0) {
+  indexBuffer = createBuffer(indexCapacity);
+
+  for (VertexFormat format : {VertexFormat::Full, VertexFormat::Compact}) {
+    FormatBuffers &buffers = formats[static_cast<size_t>(format)];
+    buffers.vertexBuffer = createBuffer(verticesPerFormat * vertexSize(format));
+    buffers.positionBuffer =
+        createBuffer(verticesPerFormat * positionSize(format));
+
+    glGenVertexArrays(1, &buffers.vao);
+    glBindVertexArray(buffers.vao);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, buffers.vertexBuffer);
+    setupVertexAttributes(format);
+    ring.bindAttributes(true);
+
+    glGenVertexArrays(1, &buffers.depthVAO);
+    glBindVertexArray(buffers.depthVAO);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, buffers.positionBuffer);
+    setupPositionAttribute(format);
+    ring.bindAttributes(false);
+    glBindVertexArray(0);
+  }
+
+  // The vertex pulling shaders only need the indices and the instance
+  // index.
+  vector<GLuint> instanceIndices(ring.getCapacity());
+  for (size_t i = 0; i < instanceIndices.size(); ++i)
+    instanceIndices[i] = static_cast<GLuint>(i);
+  glGenBuffers(1, &instanceIndexBuffer);
+  glBindBuffer(GL_ARRAY_BUFFER, instanceIndexBuffer);
+  glBufferData(GL_ARRAY_BUFFER, instanceIndices.size() * sizeof(GLuint),
+               instanceIndices.data(), GL_STATIC_DRAW);
+  glGenVertexArrays(1, &pullVAO);
+  glBindVertexArray(pullVAO);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+  glEnableVertexAttribArray(INST_LOC);
+  glVertexAttribIPointer(INST_LOC, 1, GL_UNSIGNED_INT, sizeof(GLuint),
+                         (void *)0);
+  glVertexAttribDivisor(INST_LOC, 1);
+  glBindVertexArray(0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+  unsigned int err;
+  while ((err = glGetError()) != GL_NO_ERROR) {
+    cout << "Geometry pool error: " << hex << err << dec << '\n';
+  }
+}
+
+GeometryPool::~GeometryPool() {
+  for (FormatBuffers &buffers : formats) {
+    glDeleteVertexArrays(1, &buffers.vao);
+    glDeleteVertexArrays(1, &buffers.depthVAO);
+    glDeleteBuffers(1, &buffers.vertexBuffer);
+    glDeleteBuffers(1, &buffers.positionBuffer);
+  }
+  glDeleteBuffers(1, &indexBuffer);
+  glDeleteVertexArrays(1, &pullVAO);
+  glDeleteBuffers(1, &instanceIndexBuffer);
+  if (activePool == this)
+    activePool = nullptr;
+}
+
+bool GeometryPool::allocate(VertexFormat format, size_t numVertices,
+                            size_t indexBytes, Allocation &allocation) {
+  FormatBuffers &buffers = formats[static_cast<size_t>(format)];
+  // Keep the offsets aligned for 32-bit indices.
+  size_t alignedBytes = (indexBytes + 3) & ~static_cast<size_t>(3);
+  if (numVertices > verticesPerFormat - buffers.numVertices ||
+      alignedBytes > indexCapacity - indexBytesUsed)
+    return false;
+  allocation.firstVertex = static_cast<unsigned int>(buffers.numVertices);
+  allocation.indexOffset = indexBytesUsed;
+  buffers.numVertices += numVertices;
+  indexBytesUsed += alignedBytes;
+  return true;
+}
+
+uint64_t GeometryPool::upload(VertexFormat format,
+                              const Allocation &allocation,
+                              const void *vertices, const void *positions,
+                              size_t numVertices, const void *indices,
+                              size_t indexBytes) {
+  const FormatBuffers &buffers = formats[static_cast<size_t>(format)];
+  uint64_t ticket = 0;
+  copyToBuffer(buffers.vertexBuffer,
+               allocation.firstVertex * vertexSize(format), vertices,
+               numVertices * vertexSize(format), ticket);
+  copyToBuffer(buffers.positionBuffer,
+               allocation.firstVertex * positionSize(format), positions,
+               numVertices * positionSize(format), ticket);
+  copyToBuffer(indexBuffer, allocation.indexOffset, indices, indexBytes,
+               ticket);
+  return ticket;
+}
+
+unsigned int GeometryPool::getVertexArray(VertexFormat format) const {
+  return formats[static_cast<size_t>(format)].vao;
+}
+
+unsigned int GeometryPool::getDepthVertexArray(VertexFormat format) const {
+  return formats[static_cast<size_t>(format)].depthVAO;
+}
+
+unsigned int GeometryPool::getPullVertexArray() const { return pullVAO; }
+
+void GeometryPool::bindStorage(bool depthOnly) const {
+  const FormatBuffers &full = formats[static_cast<size_t>(VertexFormat::Full)];
+  const FormatBuffers &compact =
+      formats[static_cast<size_t>(VertexFormat::Compact)];
+  if (depthOnly) {
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, FULL_POSITION_SSBO,
+                     full.positionBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, COMPACT_POSITION_SSBO,
+                     compact.positionBuffer);
+  } else {
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, FULL_VERTEX_SSBO,
+                     full.vertexBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, COMPACT_VERTEX_SSBO,
+                     compact.vertexBuffer);
+  }
+  ring.bindStorage(MOD_SSBO, NORM_M_SSBO, MAT_SSBO);
+}
+
+unsigned int GeometryPool::getCompactBase() const {
+  return static_cast<unsigned int>(verticesPerFormat);
+}
+
+InstanceRing &GeometryPool::getInstanceRing() const { return ring; }
+
+void GeometryPool::printUsage() const {
+  cout << "Geometry pool: " << formats[0].numVertices << " full and "
+       << formats[1].numVertices << " compact vertices of "
+       << verticesPerFormat << " each, " << indexBytesUsed / 1024.0 << " of "
+       << indexCapacity / 1024.0 << " KB of indices\n";
+}
+
+GeometryPool *GeometryPool::active() { return activePool; }
+
+void GeometryPool::setActive(GeometryPool *pool) { activePool = pool; }
+
+IndirectBatch::IndirectBatch() : capacity(0) { glGenBuffers(1, &buffer); }
+
+IndirectBatch::~IndirectBatch() { glDeleteBuffers(1, &buffer); }
+
+void IndirectBatch::add(VertexFormat format, bool shortIndices,
+                        const Command &command) {
+  groups[groupIndex(format, shortIndices)].push_back(command);
+}
+
+size_t IndirectBatch::submit(const Shader &shader, const GeometryPool &pool,
+                             bool depthOnly, bool pullVertices) {
+  size_t numCommands = size();
+  if (numCommands == 0)
+    return 0;
+
+  // Orphan the buffer so the draws of the previous submit keep theirs.
+  if (pullVertices) {
+    // The compact vertices are read after the full ones.
+    for (size_t i = 0; i < groups.size(); ++i) {
+      if (static_cast<VertexFormat>(i % 2) != VertexFormat::Compact)
+        continue;
+      for (Command &command : groups[i])
+        command.baseVertex += static_cast<GLint>(pool.getCompactBase());
+    }
+  }
+
+  glBindBuffer(GL_DRAW_INDIRECT_BUFFER, buffer);
+  capacity = max(capacity, numCommands * sizeof(Command));
+  glBufferData(GL_DRAW_INDIRECT_BUFFER, capacity, nullptr, GL_STREAM_DRAW);
+  size_t offset = 0;
+  for (const vector<Command> &commands : groups) {
+    glBufferSubData(GL_DRAW_INDIRECT_BUFFER, offset,
+                    commands.size() * sizeof(Command), commands.data());
+    offset += commands.size() * sizeof(Command);
+  }
+
+  // The commands carry the compact position decoding in their instance
+  // matrices, see Mesh::appendDraw.
+  shader.setUnif(POS_SCALE_UNIF, glm::vec3(1.0f));
+  shader.setUnif(POS_OFFSET_UNIF, glm::vec3(0.0f));
+
+  size_t calls = 0;
+  offset = 0;
+  if (pullVertices) {
+    shader.setUnif(COMPACT_BASE_UNIF,
+                   static_cast<int>(pool.getCompactBase()));
+    pool.bindStorage(depthOnly);
+    glBindVertexArray(pool.getPullVertexArray());
+    // One draw per index type, both formats in each.
+    for (size_t i = 0; i < groups.size(); i += 2) {
+      size_t numTypeCommands = groups[i].size() + groups[i + 1].size();
+      if (numTypeCommands == 0)
+        continue;
+      GLenum indexType = i >= 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+      glMultiDrawElementsIndirect(GL_TRIANGLES, indexType, (void *)offset,
+                                  static_cast<GLsizei>(numTypeCommands), 0);
+      offset += numTypeCommands * sizeof(Command);
+      groups[i].clear();
+      groups[i + 1].clear();
+      calls++;
+    }
+  }
+  for (size_t i = 0; i < groups.size(); ++i) {
+    vector<Command> &commands = groups[i];
+    if (commands.empty())
+      continue;
+    VertexFormat format = static_cast<VertexFormat>(i % 2);
+    GLenum indexType = i >= 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+    glBindVertexArray(depthOnly ? pool.getDepthVertexArray(format)
+                                : pool.getVertexArray(format));
+    glMultiDrawElementsIndirect(GL_TRIANGLES, indexType, (void *)offset,
+                                static_cast<GLsizei>(commands.size()), 0);
+    offset += commands.size() * sizeof(Command);
+    commands.clear();
+    calls++;
+  }
+  glBindVertexArray(0);
+  glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+  if (SubmitStats *stats = SubmitStats::active())
+    stats->addCalls(calls);
+  return calls;
+}
+
+size_t IndirectBatch::size() const {
+  size_t count = 0;
+  for (const vector<Command> &commands : groups)
+    count += commands.size();
+  return count;
+}
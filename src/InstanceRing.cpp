@@ -0,0 +1,192 @@
+#include "InstanceRing.h"
+#include "gl_extensions.h"
+#include "structures.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+using namespace std;
+
+namespace {
+InstanceRing *activeRing = nullptr;
+
+// Largest shader storage offset alignment GL allows, so every array can be
+// bound on its own.
+const size_t ARRAY_ALIGNMENT = 256;
+
+size_t alignArray(size_t offset) {
+  return (offset + ARRAY_ALIGNMENT - 1) & ~(ARRAY_ALIGNMENT - 1);
+}
+} // namespace
+
+InstanceRing::InstanceRing(unsigned int instancesPerFrame)
+    : mapped(nullptr), instancesPerFrame(max(instancesPerFrame, 1u)),
+      fences(), frame(0), head(0), frames(0), bytesWritten(0), fenceWaits(0),
+      recycles(0), overflows(0) {
+  size_t numInstances = static_cast<size_t>(getCapacity());
+  normalsOffset = alignArray(numInstances * sizeof(glm::mat4));
+  materialsOffset =
+      alignArray(normalsOffset + numInstances * sizeof(glm::mat3));
+  size_t size = materialsOffset + numInstances * sizeof(unsigned int);
+  glGenBuffers(1, &buffer);
+  glBindBuffer(GL_ARRAY_BUFFER, buffer);
+  if (glext::bufferStorage) {
+    GLbitfield flags =
+        GL_MAP_WRITE_BIT | glext::MAP_PERSISTENT_BIT | glext::MAP_COHERENT_BIT;
+    glext::BufferStorage(GL_ARRAY_BUFFER, size, nullptr, flags);
+    mapped = static_cast<unsigned char *>(
+        glMapBufferRange(GL_ARRAY_BUFFER, 0, size, flags));
+  }
+  if (mapped == nullptr)
+    cout << "Instance ring: the buffer could not be mapped\n";
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+InstanceRing::~InstanceRing() {
+  for (GLsync fence : fences) {
+    if (fence != nullptr)
+      glDeleteSync(fence);
+  }
+  if (mapped != nullptr) {
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    glUnmapBuffer(GL_ARRAY_BUFFER);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+  }
+  glDeleteBuffers(1, &buffer);
+  if (activeRing == this)
+    activeRing = nullptr;
+}
+
+InstanceRing::Block InstanceRing::allocate(unsigned int count) {
+  Block block;
+  if (mapped == nullptr || count == 0 || count > instancesPerFrame - head) {
+    overflows += count > 0;
+    return block;
+  }
+  block.first = frame * instancesPerFrame + head;
+  block.count = count;
+  block.models = reinterpret_cast<glm::mat4 *>(mapped) + block.first;
+  block.normMats =
+      reinterpret_cast<glm::mat3 *>(mapped + normalsOffset) + block.first;
+  block.materials =
+      reinterpret_cast<unsigned int *>(mapped + materialsOffset) + block.first;
+  head += count;
+  bytesWritten +=
+      count * (sizeof(glm::mat4) + sizeof(glm::mat3) + sizeof(unsigned int));
+  return block;
+}
+
+InstanceRing::Block InstanceRing::write(unsigned int count,
+                                        const glm::mat4 *models,
+                                        const glm::mat3 *normMats,
+                                        const unsigned int *materials) {
+  Block block = allocate(count);
+  if (block.count == 0)
+    return block;
+  memcpy(block.models, models, count * sizeof(glm::mat4));
+  if (normMats != nullptr)
+    memcpy(block.normMats, normMats, count * sizeof(glm::mat3));
+  if (materials != nullptr)
+    memcpy(block.materials, materials, count * sizeof(unsigned int));
+  else
+    memset(block.materials, 0, count * sizeof(unsigned int));
+  return block;
+}
+
+void InstanceRing::bindAttributes(bool normals) const {
+  glBindBuffer(GL_ARRAY_BUFFER, buffer);
+  for (unsigned int i = 0; i < 4; i++) {
+    glEnableVertexAttribArray(MOD_LOC + i);
+    glVertexAttribPointer(MOD_LOC + i, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4),
+                          (void *)(sizeof(glm::vec4) * i));
+    glVertexAttribDivisor(MOD_LOC + i, 1);
+  }
+  if (normals) {
+    for (unsigned int i = 0; i < 3; i++) {
+      glEnableVertexAttribArray(NORM_M_LOC + i);
+      glVertexAttribPointer(NORM_M_LOC + i, 3, GL_FLOAT, GL_FALSE,
+                            sizeof(glm::mat3),
+                            (void *)(normalsOffset + sizeof(glm::vec3) * i));
+      glVertexAttribDivisor(NORM_M_LOC + i, 1);
+    }
+    glEnableVertexAttribArray(COL_LOC);
+    glVertexAttribIPointer(COL_LOC, 1, GL_UNSIGNED_INT, sizeof(unsigned int),
+                           (void *)materialsOffset);
+    glVertexAttribDivisor(COL_LOC, 1);
+  }
+}
+
+void InstanceRing::bindStorage(unsigned int modelBinding,
+                               unsigned int normalBinding,
+                               unsigned int materialBinding) const {
+  glBindBufferRange(GL_SHADER_STORAGE_BUFFER, modelBinding, buffer, 0,
+                    getCapacity() * sizeof(glm::mat4));
+  glBindBufferRange(GL_SHADER_STORAGE_BUFFER, normalBinding, buffer,
+                    normalsOffset, getCapacity() * sizeof(glm::mat3));
+  glBindBufferRange(GL_SHADER_STORAGE_BUFFER, materialBinding, buffer,
+                    materialsOffset, getCapacity() * sizeof(unsigned int));
+}
+
+unsigned int InstanceRing::getCapacity() const {
+  return NUM_FRAMES * instancesPerFrame;
+}
+
+unsigned int InstanceRing::getRoom() const {
+  return mapped != nullptr ? instancesPerFrame - head : 0;
+}
+
+void InstanceRing::recycle() {
+  if (mapped == nullptr || head == 0)
+    return;
+  GLsync fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+  glDeleteSync(fence);
+  head = 0;
+  recycles++;
+}
+
+void InstanceRing::endFrame() {
+  if (fences[frame] != nullptr)
+    glDeleteSync(fences[frame]);
+  fences[frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  frame = (frame + 1) % NUM_FRAMES;
+  head = 0;
+  frames++;
+
+  // The GPU normally finished this region frames ago, only count the times
+  // it did not.
+  GLsync fence = fences[frame];
+  if (fence == nullptr)
+    return;
+  GLenum status = glClientWaitSync(fence, 0, 0);
+  if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+    fenceWaits++;
+    glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+  }
+  glDeleteSync(fence);
+  fences[frame] = nullptr;
+}
+
+void InstanceRing::printStats() {
+  if (frames == 0)
+    return;
+  cout << "Instance ring over " << frames << " frames: "
+       << static_cast<double>(bytesWritten) / frames
+       << " bytes written and "
+       << static_cast<double>(fenceWaits) / frames
+       << " fence waits per frame";
+  if (recycles > 0)
+    cout << ", " << recycles << " regions recycled";
+  if (overflows > 0)
+    cout << ", " << overflows << " draws skipped for lack of room";
+  cout << "\n";
+  frames = 0;
+  bytesWritten = 0;
+  fenceWaits = 0;
+  recycles = 0;
+  overflows = 0;
+}
+
+InstanceRing *InstanceRing::active() { return activeRing; }
+
+void InstanceRing::setActive(InstanceRing *ring) { activeRing = ring; }
@@ -0,0 +1,52 @@
+#include "LodStats.h"
+#include <iostream>
+
+using namespace std;
+
+void LodStats::addDraw(unsigned int level, size_t triangles,
+                       size_t culled) {
+  if (level >= levels.size())
+    levels.resize(level + 1);
+  levels[level].draws++;
+  levels[level].triangles += triangles;
+  levels[level].culled += culled;
+  levels[level].drawn = true;
+}
+
+void LodStats::endFrame(double frameTime) {
+  frames++;
+  this->frameTime += frameTime;
+  for (Level &level : levels) {
+    if (level.drawn) {
+      level.frames++;
+      level.frameTime += frameTime;
+      level.drawn = false;
+    }
+  }
+}
+
+void LodStats::print() {
+  if (frames == 0)
+    return;
+  cout << "LOD statistics over " << frames << " frames, "
+       << frameTime / frames << " ms per frame\n";
+  for (size_t i = 0; i < levels.size(); ++i) {
+    const Level &level = levels[i];
+    cout << "  LOD " << i << ": "
+         << static_cast<double>(level.draws) / frames << " draws and "
+         << static_cast<double>(level.triangles) / frames
+         << " triangles per frame";
+    if (level.culled > 0) {
+      cout << " (" << 100.0 * level.culled / (level.triangles + level.culled)
+           << "% culled)";
+    }
+    if (level.frames > 0) {
+      cout << ", in " << level.frames << " frames of "
+           << level.frameTime / level.frames << " ms";
+    }
+    cout << "\n";
+  }
+  levels.clear();
+  frames = 0;
+  frameTime = 0.0;
+}
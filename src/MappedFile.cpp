@@ -0,0 +1,35 @@
+#include "MappedFile.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::MappedFile(const std::string &path)
+    : mapping(nullptr), length(0) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return;
+  struct stat info;
+  if (fstat(fd, &info) == 0 && info.st_size > 0) {
+    void *ptr = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ,
+                     MAP_PRIVATE, fd, 0);
+    if (ptr != MAP_FAILED) {
+      mapping = ptr;
+      length = static_cast<size_t>(info.st_size);
+    }
+  }
+  close(fd);
+}
+
+MappedFile::~MappedFile() {
+  if (mapping != nullptr)
+    munmap(mapping, length);
+}
+
+bool MappedFile::isOpen() const { return mapping != nullptr; }
+
+const unsigned char *MappedFile::data() const {
+  return static_cast<const unsigned char *>(mapping);
+}
+
+size_t MappedFile::size() const { return length; }
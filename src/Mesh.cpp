@@ -1,39 +1,63 @@
 #include "Mesh.h"
+#include "SubmitStats.h"
+#include "UploadQueue.h"
+#include "texture_loader.h"
+#include <algorithm>
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
+#include <glm/gtc/matrix_transform.hpp>
 #include <iostream>
 
 using namespace std;
 
 Mesh::Mesh(vector<Vertex> vertices, vector<unsigned int> indices,
-           vector<Texture> textures, Material materials)
-    : VBOs(), simpId(0) {
-  this->vertices = vertices;
-  this->indices = indices;
-  this->textures = textures;
+           vector<Texture> textures, Material materials,
+           vector<LodLevel> lods, vector<Meshlet> meshlets,
+           VertexFormat format)
+    : simpId(0), VBOs(), instanceRing(InstanceRing::active()), pool(nullptr),
+      uploadTicket(0), lods(move(lods)),
+      clusters(meshlets::prepare(meshlets)), format(format) {
+  this->vertices = move(vertices);
+  this->indices = move(indices);
+  this->textures = move(textures);
   this->material = materials;
+  if (this->lods.empty()) {
+    this->lods.push_back(
+        {0, static_cast<unsigned int>(this->indices.size()), 0.0f});
+  }
   setupMesh();
 }
 
 void Mesh::freeMesh() {
-  glDeleteVertexArrays(1, &VAO);
-  glDeleteBuffers(1, &EBO);
-  glDeleteBuffers(NUM_VBS, VBOs);
+  // The pool owns the vertex arrays and buffers of pooled meshes.
+  if (pool == nullptr) {
+    glDeleteVertexArrays(1, &VAO);
+    glDeleteVertexArrays(1, &depthVAO);
+    glDeleteBuffers(1, &EBO);
+    glDeleteBuffers(NUM_VBS, VBOs);
+  }
   for (unsigned int i = 0; i < textures.size(); i++)
-    glDeleteTextures(1, &textures[i].id);
+    releaseTexture(textures[i].id);
 }
 
-void Mesh::Draw(Shader shader, unsigned int numInstances, glm::mat4 *models,
-                glm::mat3 *normMats) const {
-  // Populate model matrices
-  glBindBuffer(GL_ARRAY_BUFFER, VBOs[MOD_VB]);
-  glBufferData(GL_ARRAY_BUFFER, numInstances * sizeof(glm::mat4), models,
-               GL_DYNAMIC_DRAW);
-  if (normMats != NULL) {
-    glBindBuffer(GL_ARRAY_BUFFER, VBOs[NORM_M_VB]);
-    glBufferData(GL_ARRAY_BUFFER, numInstances * sizeof(glm::mat3), normMats,
-                 GL_DYNAMIC_DRAW);
-  }
+size_t Mesh::Draw(Shader shader, unsigned int numInstances, glm::mat4 *models,
+                  glm::mat3 *normMats, unsigned int lod,
+                  const meshlets::View *view) const {
+  if (!isReady())
+    return 0;
+  return Draw(shader, prepareInstances(numInstances, models, normMats), lod,
+              view);
+}
+
+size_t Mesh::Draw(Shader shader, const InstanceRing::Block &instances,
+                  unsigned int lod, const meshlets::View *view) const {
+  if (!isReady() || instances.count == 0)
+    return 0;
+  // Cull the meshlets first, there is nothing to set up if none is visible.
+  size_t numIndices = collectParts(instances.count, lod, view);
+  if (numIndices == 0)
+    return 0;
+  unsigned int baseInstance = bindInstances(instances, true);
 
   if (!textures.empty()) {
     // Bind textures
@@ -55,12 +79,182 @@ void Mesh::Draw(Shader shader, unsigned int numInstances, glm::mat4 *models,
     shader.setUnif(material.shinId, material.Shininess);
   }
 
-  // draw mesh
-  glBindVertexArray(VAO);
-  glDrawElementsInstanced(GL_TRIANGLES, static_cast<GLsizei>(indices.size()),
-                          GL_UNSIGNED_INT, NULL, numInstances);
-  glBindVertexArray(0);
+  // Scale compact positions back to object space.
+  shader.setUnif(POS_SCALE_UNIF, bounds.scale);
+  shader.setUnif(POS_OFFSET_UNIF, bounds.offset);
+
+  drawParts(VAO, instances.count, baseInstance);
   glActiveTexture(GL_TEXTURE0);
+  return numIndices / 3;
+}
+
+size_t Mesh::DrawDepthOnly(const Shader &shader, unsigned int numInstances,
+                           glm::mat4 *models, unsigned int lod,
+                           const meshlets::View *view) const {
+  if (!isReady())
+    return 0;
+  return DrawDepthOnly(shader, prepareInstances(numInstances, models, nullptr),
+                       lod, view);
+}
+
+size_t Mesh::DrawDepthOnly(const Shader &shader,
+                           const InstanceRing::Block &instances,
+                           unsigned int lod,
+                           const meshlets::View *view) const {
+  if (!isReady() || instances.count == 0)
+    return 0;
+  size_t numIndices = collectParts(instances.count, lod, view);
+  if (numIndices == 0)
+    return 0;
+
+  unsigned int baseInstance = bindInstances(instances, false);
+  shader.setUnif(POS_SCALE_UNIF, bounds.scale);
+  shader.setUnif(POS_OFFSET_UNIF, bounds.offset);
+  drawParts(depthVAO, instances.count, baseInstance);
+  return numIndices / 3;
+}
+
+size_t Mesh::appendDraw(IndirectBatch &batch, unsigned int numInstances,
+                        const glm::mat4 *models, const glm::mat3 *normMats,
+                        unsigned int lod, const meshlets::View *view,
+                        const unsigned int *materials) const {
+  if (pool == nullptr || !isReady() || models == nullptr || numInstances == 0)
+    return 0;
+  size_t numIndices = collectParts(numInstances, lod, view);
+  if (numIndices == 0)
+    return 0;
+  // Every mesh has its own bounds, so its own block of instances.
+  InstanceRing::Block instances = instanceRing->allocate(numInstances);
+  if (instances.count == 0)
+    return 0;
+  glm::mat4 decode = glm::scale(glm::translate(glm::mat4(1.0f), bounds.offset),
+                                bounds.scale);
+  for (unsigned int i = 0; i < numInstances; ++i) {
+    instances.models[i] = models[i] * decode;
+    if (normMats != nullptr)
+      instances.normMats[i] = normMats[i];
+    instances.materials[i] = materials != nullptr ? materials[i] : 0;
+  }
+
+  unsigned int firstIndex = static_cast<unsigned int>(
+      allocation.indexOffset / indexLayout.indexSize());
+  for (const indexbuf::Chunk &part : parts) {
+    IndirectBatch::Command command;
+    command.count = part.numIndices;
+    command.instanceCount = numInstances;
+    command.firstIndex = firstIndex + part.firstIndex;
+    command.baseVertex =
+        static_cast<GLint>(allocation.firstVertex + part.baseVertex);
+    command.baseInstance = instances.first;
+    batch.add(format, indexLayout.shortIndices, command);
+  }
+  return numIndices / 3;
+}
+
+InstanceRing::Block
+Mesh::prepareInstances(unsigned int numInstances, glm::mat4 *models,
+                       glm::mat3 *normMats,
+                       unsigned int *materials) const {
+  InstanceRing::Block instances;
+  if (instanceRing != nullptr && models != nullptr)
+    return instanceRing->write(numInstances, models, normMats, materials);
+  // Draws without matrices read whatever is at the start of the ring.
+  instances.count = numInstances;
+  if (instanceRing == nullptr) {
+    instances.models = models;
+    instances.normMats = normMats;
+    instances.materials = materials;
+  }
+  return instances;
+}
+
+// Make the matrices of the instances visible to the vertex arrays and
+// return the base instance to draw them with.
+unsigned int Mesh::bindInstances(const InstanceRing::Block &instances,
+                                 bool normals) const {
+  if (instanceRing != nullptr)
+    return instances.first;
+  if (instances.models != nullptr) {
+    glBindBuffer(GL_ARRAY_BUFFER, VBOs[MOD_VB]);
+    glBufferData(GL_ARRAY_BUFFER, instances.count * sizeof(glm::mat4),
+                 instances.models, GL_DYNAMIC_DRAW);
+  }
+  if (normals && instances.normMats != nullptr) {
+    glBindBuffer(GL_ARRAY_BUFFER, VBOs[NORM_M_VB]);
+    glBufferData(GL_ARRAY_BUFFER, instances.count * sizeof(glm::mat3),
+                 instances.normMats, GL_DYNAMIC_DRAW);
+  }
+  if (normals) {
+    // Every instance needs a material, 0 unless they are given.
+    glBindBuffer(GL_ARRAY_BUFFER, VBOs[COL_VB]);
+    glBufferData(GL_ARRAY_BUFFER, instances.count * sizeof(unsigned int),
+                 instances.materials, GL_DYNAMIC_DRAW);
+    if (instances.materials == nullptr)
+      glClearBufferData(GL_ARRAY_BUFFER, GL_R32UI, GL_RED_INTEGER,
+                        GL_UNSIGNED_INT, nullptr);
+  }
+  return 0;
+}
+
+// Fill parts with the index ranges of a draw, cut at the chunks of the index
+// buffer. Returns the number of indices in them.
+size_t Mesh::collectParts(unsigned int numInstances, unsigned int lod,
+                          const meshlets::View *view) const {
+  size_t levelIndex = min<size_t>(lod, lods.size() - 1);
+  const LodLevel &level = lods[levelIndex];
+  bool culled = view != nullptr && levelIndex == 0 && numInstances == 1 &&
+                clusters.count > 0;
+  parts.clear();
+  if (!culled) {
+    indexbuf::splitRange(indexLayout, level.firstIndex, level.numIndices,
+                         parts);
+    return level.numIndices;
+  }
+  size_t numIndices = meshlets::cull(clusters, *view, visibleRanges);
+  for (const meshlets::Range &range : visibleRanges) {
+    indexbuf::splitRange(indexLayout, range.firstIndex, range.numIndices,
+                         parts);
+  }
+  return numIndices;
+}
+
+void Mesh::drawParts(unsigned int vao, unsigned int numInstances,
+                     unsigned int baseInstance) const {
+  GLenum indexType =
+      indexLayout.shortIndices ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+  size_t indexSize = indexLayout.indexSize();
+  // Pooled meshes start somewhere in the buffers of the pool.
+  size_t indexOffset = allocation.indexOffset;
+  GLint firstVertex = static_cast<GLint>(allocation.firstVertex);
+  glBindVertexArray(vao);
+  size_t calls;
+  // The multi draw has no base instance.
+  if (numInstances == 1 && baseInstance == 0 && parts.size() > 1) {
+    counts.clear();
+    offsets.clear();
+    baseVertices.clear();
+    for (const indexbuf::Chunk &part : parts) {
+      counts.push_back(static_cast<GLsizei>(part.numIndices));
+      offsets.push_back((void *)(indexOffset + part.firstIndex * indexSize));
+      baseVertices.push_back(firstVertex + static_cast<GLint>(part.baseVertex));
+    }
+    glMultiDrawElementsBaseVertex(GL_TRIANGLES, counts.data(), indexType,
+                                  offsets.data(),
+                                  static_cast<GLsizei>(counts.size()),
+                                  baseVertices.data());
+    calls = 1;
+  } else {
+    for (const indexbuf::Chunk &part : parts) {
+      glDrawElementsInstancedBaseVertexBaseInstance(
+          GL_TRIANGLES, static_cast<GLsizei>(part.numIndices), indexType,
+          (void *)(indexOffset + part.firstIndex * indexSize), numInstances,
+          firstVertex + static_cast<GLint>(part.baseVertex), baseInstance);
+    }
+    calls = parts.size();
+  }
+  glBindVertexArray(0);
+  if (SubmitStats *stats = SubmitStats::active())
+    stats->addCalls(calls);
 }
 
 void Mesh::getTextureLocations(Shader shader) {
@@ -104,29 +298,72 @@ void Mesh::getTextureLocations(Shader shader) {
   simpId = shader.getUnif(mat + "isSimple");
 }
 
-void Mesh::setupMesh() {
-  unsigned int err;
-  // Create vertex array object
-  glGenVertexArrays(1, &VAO);
-  // Create element buffer object
-  glGenBuffers(1, &EBO);
-  // Create several vertex buffer object
-  glGenBuffers(NUM_VBS, VBOs);
+bool Mesh::isPooled() const { return pool != nullptr; }
 
-  // Bind the objects, tell them how the data is read and bind some data
-  glBindVertexArray(VAO);
+InstanceRing *Mesh::getInstanceRing() const { return instanceRing; }
 
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-  glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int),
-               indices.data(), GL_STATIC_DRAW);
-  while ((err = glGetError()) != GL_NO_ERROR) {
-    cout << "Mesh EBO error: " << hex << err << '\n';
-  }
+bool Mesh::isReady() const {
+  UploadQueue *uploader = UploadQueue::active();
+  return uploadTicket == 0 || uploader == nullptr ||
+         uploader->isReady(uploadTicket);
+}
 
-  glBindBuffer(GL_ARRAY_BUFFER, VBOs[POS_NORM_TEX_TAN_VB]);
-  glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex),
-               vertices.data(), GL_STATIC_DRAW);
+VertexFormat Mesh::getVertexFormat() const { return format; }
+
+size_t Mesh::getVertexSize() const {
+  return format == VertexFormat::Compact ? sizeof(CompactVertex)
+                                         : sizeof(Vertex);
+}
+
+size_t Mesh::getVertexBytes() const {
+  return (vertices.size() + indexLayout.extraVertices.size()) *
+         getVertexSize();
+}
+
+size_t Mesh::getPositionBytes() const {
+  size_t positionSize = format == VertexFormat::Compact
+                            ? 4 * sizeof(uint16_t)
+                            : sizeof(glm::vec3);
+  return (vertices.size() + indexLayout.extraVertices.size()) * positionSize;
+}
 
+size_t Mesh::getIndexBytes() const {
+  return indices.size() * indexLayout.indexSize();
+}
+
+const indexbuf::Layout &Mesh::getIndexLayout() const { return indexLayout; }
+
+const compact::Error &Mesh::getCompactError() const { return compactError; }
+
+const vector<LodLevel> &Mesh::getLods() const { return lods; }
+
+size_t Mesh::getNumMeshlets() const { return clusters.count; }
+
+// Attribute layout of the compact format, see compact_vertex.h.
+static void setupCompactAttributes() {
+  glEnableVertexAttribArray(POS_LOC);
+  glVertexAttribPointer(POS_LOC, 3, GL_UNSIGNED_SHORT, GL_TRUE,
+                        sizeof(CompactVertex),
+                        (void *)offsetof(CompactVertex, position));
+  glEnableVertexAttribArray(NORM_LOC);
+  glVertexAttribPointer(NORM_LOC, 4, GL_INT_2_10_10_10_REV, GL_TRUE,
+                        sizeof(CompactVertex),
+                        (void *)offsetof(CompactVertex, normal));
+  glEnableVertexAttribArray(TEX_LOC);
+  glVertexAttribPointer(TEX_LOC, 2, GL_HALF_FLOAT, GL_FALSE,
+                        sizeof(CompactVertex),
+                        (void *)offsetof(CompactVertex, texCoord));
+  glEnableVertexAttribArray(TAN_LOC);
+  glVertexAttribPointer(TAN_LOC, 4, GL_INT_2_10_10_10_REV, GL_TRUE,
+                        sizeof(CompactVertex),
+                        (void *)offsetof(CompactVertex, tangent));
+}
+
+void setupVertexAttributes(VertexFormat format) {
+  if (format == VertexFormat::Compact) {
+    setupCompactAttributes();
+    return;
+  }
   // Location attribute
   glEnableVertexAttribArray(POS_LOC);
   glVertexAttribPointer(POS_LOC, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex),
@@ -143,44 +380,187 @@ void Mesh::setupMesh() {
   glEnableVertexAttribArray(TAN_LOC);
   glVertexAttribPointer(TAN_LOC, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex),
                         (void *)offsetof(Vertex, tangent));
+}
+
+void setupPositionAttribute(VertexFormat format) {
+  glEnableVertexAttribArray(POS_LOC);
+  if (format == VertexFormat::Compact) {
+    glVertexAttribPointer(POS_LOC, 3, GL_UNSIGNED_SHORT, GL_TRUE,
+                          4 * sizeof(uint16_t), (void *)0);
+  } else {
+    glVertexAttribPointer(POS_LOC, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3),
+                          (void *)0);
+  }
+}
+
+void Mesh::setupMesh() {
+  // 16-bit indices whenever they are smaller, the 32-bit ones are kept on
+  // the CPU.
+  vector<uint16_t> shortIndices;
+  indexLayout = indexbuf::plan(indices, vertices.size(), getVertexSize(),
+                               shortIndices);
+  const void *indexData =
+      indexLayout.shortIndices ? (const void *)shortIndices.data()
+                               : (const void *)indices.data();
+
+  // Quantize the vertices for the compact format, the full vertices are
+  // kept on the CPU. The copies made for the index chunks go last.
+  const vector<unsigned int> &extraVertices = indexLayout.extraVertices;
+  vector<CompactVertex> compactVertices;
+  vector<Vertex> extendedVertices;
+  const void *vertexData = vertices.data();
+  if (format == VertexFormat::Compact) {
+    bounds = compact::computeBounds(vertices);
+    compactVertices = compact::encode(vertices, bounds);
+    compactError = compact::measureError(vertices, compactVertices, bounds);
+    compactVertices.reserve(vertices.size() + extraVertices.size());
+    for (unsigned int vertex : extraVertices)
+      compactVertices.push_back(compactVertices[vertex]);
+    vertexData = compactVertices.data();
+  } else if (!extraVertices.empty()) {
+    extendedVertices.reserve(vertices.size() + extraVertices.size());
+    extendedVertices.assign(vertices.begin(), vertices.end());
+    for (unsigned int vertex : extraVertices)
+      extendedVertices.push_back(vertices[vertex]);
+    vertexData = extendedVertices.data();
+  }
+
+  // Tightly packed positions for the depth only passes, in the same order
+  // as the vertex buffer so the index buffer is shared.
+  size_t numGPUVertices = vertices.size() + extraVertices.size();
+  vector<glm::vec3> fullPositions;
+  vector<uint16_t> compactPositions;
+  const void *positionData;
+  if (format == VertexFormat::Compact) {
+    compactPositions.resize(4 * numGPUVertices);
+    for (size_t i = 0; i < numGPUVertices; ++i)
+      copy_n(compactVertices[i].position, 4, &compactPositions[4 * i]);
+    positionData = compactPositions.data();
+  } else {
+    const Vertex *source = static_cast<const Vertex *>(vertexData);
+    fullPositions.resize(numGPUVertices);
+    for (size_t i = 0; i < numGPUVertices; ++i)
+      fullPositions[i] = source[i].position;
+    positionData = fullPositions.data();
+  }
+
+  // The pool vertex arrays read the instance matrices from its ring.
+  GeometryPool *activePool = GeometryPool::active();
+  if (activePool != nullptr && instanceRing == &activePool->getInstanceRing() &&
+      activePool->allocate(format, numGPUVertices, getIndexBytes(),
+                           allocation)) {
+    pool = activePool;
+    VAO = pool->getVertexArray(format);
+    depthVAO = pool->getDepthVertexArray(format);
+    EBO = 0;
+    uploadTicket =
+        pool->upload(format, allocation, vertexData, positionData,
+                     numGPUVertices, indexData, getIndexBytes());
+    return;
+  }
+  setupBuffers(indexData, vertexData, positionData);
+}
+
+// Create the vertex arrays and buffers of a mesh outside of a pool.
+void Mesh::setupBuffers(const void *indexData, const void *vertexData,
+                        const void *positionData) {
+  unsigned int err;
+  // With an active upload queue only the storage is allocated here.
+  UploadQueue *uploader = UploadQueue::active();
+  // Create vertex array object
+  glGenVertexArrays(1, &VAO);
+  // Create element buffer object
+  glGenBuffers(1, &EBO);
+  // Create several vertex buffer object
+  glGenBuffers(NUM_VBS, VBOs);
+
+  // Bind the objects, tell them how the data is read and bind some data
+  glBindVertexArray(VAO);
+
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, getIndexBytes(),
+               uploader ? NULL : indexData, GL_STATIC_DRAW);
+  while ((err = glGetError()) != GL_NO_ERROR) {
+    cout << "Mesh EBO error: " << hex << err << '\n';
+  }
+
+  glBindBuffer(GL_ARRAY_BUFFER, VBOs[POS_NORM_TEX_TAN_VB]);
+  glBufferData(GL_ARRAY_BUFFER, getVertexBytes(),
+               uploader ? NULL : vertexData, GL_STATIC_DRAW);
+  setupVertexAttributes(format);
   // Check for errors.
   while ((err = glGetError()) != GL_NO_ERROR) {
     cout << "Mesh VBO error: " << hex << err << '\n';
   }
 
-  // Model matrices
-  glBindBuffer(GL_ARRAY_BUFFER, VBOs[MOD_VB]);
-  for (unsigned int i = 0; i < 4; i++) {
-    glEnableVertexAttribArray(MOD_LOC + i);
-    glVertexAttribPointer(MOD_LOC + i, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4),
-                          (void *)(sizeof(glm::vec4) * i));
-    glVertexAttribDivisor(MOD_LOC + i, 1);
+  // Model and normal matrices
+  if (instanceRing != nullptr) {
+    instanceRing->bindAttributes(true);
+  } else {
+    glBindBuffer(GL_ARRAY_BUFFER, VBOs[MOD_VB]);
+    for (unsigned int i = 0; i < 4; i++) {
+      glEnableVertexAttribArray(MOD_LOC + i);
+      glVertexAttribPointer(MOD_LOC + i, 4, GL_FLOAT, GL_FALSE,
+                            sizeof(glm::mat4), (void *)(sizeof(glm::vec4) * i));
+      glVertexAttribDivisor(MOD_LOC + i, 1);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, VBOs[NORM_M_VB]);
+    for (unsigned int i = 0; i < 3; i++) {
+      glEnableVertexAttribArray(NORM_M_LOC + i);
+      glVertexAttribPointer(NORM_M_LOC + i, 3, GL_FLOAT, GL_FALSE,
+                            sizeof(glm::mat3), (void *)(sizeof(glm::vec3) * i));
+      glVertexAttribDivisor(NORM_M_LOC + i, 1);
+    }
   }
   while ((err = glGetError()) != GL_NO_ERROR) {
-    cout << "Mesh model matrix error: " << hex << err << '\n';
+    cout << "Mesh instance matrix error: " << hex << err << '\n';
   }
 
-  // Normal matrices
-  glBindBuffer(GL_ARRAY_BUFFER, VBOs[NORM_M_VB]);
-  for (unsigned int i = 0; i < 3; i++) {
-    glEnableVertexAttribArray(NORM_M_LOC + i);
-    glVertexAttribPointer(NORM_M_LOC + i, 3, GL_FLOAT, GL_FALSE,
-                          sizeof(glm::mat3), (void *)(sizeof(glm::vec3) * i));
-    glVertexAttribDivisor(NORM_M_LOC + i, 1);
+  // Material indices, from the ring with the matrices if there is one.
+  if (instanceRing == nullptr) {
+    glBindBuffer(GL_ARRAY_BUFFER, VBOs[COL_VB]);
+    glEnableVertexAttribArray(COL_LOC);
+    glVertexAttribIPointer(COL_LOC, 1, GL_UNSIGNED_INT, sizeof(unsigned int),
+                           (void *)0);
+    glVertexAttribDivisor(COL_LOC, 1);
   }
   while ((err = glGetError()) != GL_NO_ERROR) {
-    cout << "Mesh normal matrix error: " << hex << err << '\n';
+    cout << "Mesh material buffer error: " << hex << err << '\n';
   }
 
-  // Colors if they are supplied.
-  glBindBuffer(GL_ARRAY_BUFFER, VBOs[COL_VB]);
-  glEnableVertexAttribArray(COL_LOC);
-  glVertexAttribPointer(COL_LOC, 4, GL_FLOAT, GL_FALSE, sizeof(glm::vec4),
-                        (void *)0);
-  glVertexAttribDivisor(COL_LOC, 1);
+  glBindVertexArray(0);
+
+  glGenVertexArrays(1, &depthVAO);
+  glBindVertexArray(depthVAO);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+  glBindBuffer(GL_ARRAY_BUFFER, VBOs[POS_VB]);
+  glBufferData(GL_ARRAY_BUFFER, getPositionBytes(),
+               uploader ? NULL : positionData, GL_STATIC_DRAW);
+  setupPositionAttribute(format);
+  // Model matrices for instanced depth only draws.
+  if (instanceRing != nullptr) {
+    instanceRing->bindAttributes(false);
+  } else {
+    glBindBuffer(GL_ARRAY_BUFFER, VBOs[MOD_VB]);
+    for (unsigned int i = 0; i < 4; i++) {
+      glEnableVertexAttribArray(MOD_LOC + i);
+      glVertexAttribPointer(MOD_LOC + i, 4, GL_FLOAT, GL_FALSE,
+                            sizeof(glm::mat4), (void *)(sizeof(glm::vec4) * i));
+      glVertexAttribDivisor(MOD_LOC + i, 1);
+    }
+  }
   while ((err = glGetError()) != GL_NO_ERROR) {
-    cout << "Mesh color buffer error: " << hex << err << '\n';
+    cout << "Mesh position buffer error: " << hex << err << '\n';
   }
-
   glBindVertexArray(0);
+
+  if (uploader != nullptr) {
+    uint64_t indexTicket =
+        uploader->queueBuffer(EBO, 0, indexData, getIndexBytes());
+    uint64_t vertexTicket = uploader->queueBuffer(
+        VBOs[POS_NORM_TEX_TAN_VB], 0, vertexData, getVertexBytes());
+    uint64_t positionTicket = uploader->queueBuffer(
+        VBOs[POS_VB], 0, positionData, getPositionBytes());
+    uploadTicket = max(max(indexTicket, vertexTicket), positionTicket);
+  }
 }
@@ -1,8 +1,16 @@
 #include "Model.h"
+#include "ThreadPool.h"
+#include "hashing.h"
+#include "mesh_cache.h"
+#include "mesh_import.h"
+#include "mesh_optimizer.h"
+#include "meshlets.h"
 #include "plane_normals.h"
 #include "texture_loader.h"
+#include "vertex_weld.h"
 #include <assimp/Importer.hpp>
 #include <assimp/postprocess.h>
+#include <chrono>
 #include <iostream>
 
 using namespace std;
@@ -12,7 +20,17 @@ unsigned int aiProcessSteps =
     aiProcess_CalcTangentSpace | aiProcess_OptimizeGraph |
     aiProcess_OptimizeMeshes;
 
-Model::Model(string path, bool bSRGB, vector<string> cubeMapPaths) {
+// Screen space error in pixels selectLod allows, and by how much less a
+// coarser level has to stay below it before switching to that level.
+const float LOD_PIXEL_ERROR = 1.0f;
+const float LOD_HYSTERESIS = 0.25f;
+
+// Attribute differences below which imported vertices are merged.
+const weld::Epsilons WELD_EPSILONS;
+
+Model::Model(string path, bool bSRGB, vector<string> cubeMapPaths,
+             VertexFormat vertexFormat, meshlod::Settings lodSettings)
+    : vertexFormat(vertexFormat), lodSettings(lodSettings), lodStats(nullptr) {
   if (!cubeMapPaths.empty()) {
     cubeTex.id = loadCubeMap(cubeMapPaths, false);
     cubeTex.location = 0;
@@ -22,6 +40,8 @@ Model::Model(string path, bool bSRGB, vector<string> cubeMapPaths) {
   } else {
     cubeTex.id = 0;
   }
+  cubeMapID = cubeTex.id;
+  cubeMapLoc = 0;
   this->bSRGB = bSRGB;
   loadModel(path);
 }
@@ -29,17 +49,100 @@ Model::Model(string path, bool bSRGB, vector<string> cubeMapPaths) {
 Model::~Model() {
   for (unsigned int i = 0; i < meshes.size(); i++)
     meshes[i].freeMesh();
+  releaseTexture(cubeTex.id);
 }
 
 void Model::Draw(const Shader &shader, unsigned int numInstances,
-                 glm::mat4 *models, glm::mat3 *normMats) const {
+                 glm::mat4 *models, glm::mat3 *normMats, unsigned int lod,
+                 const meshlets::View *view) const {
+  // The meshes share the ring, the matrices are written once for all.
+  if (meshes.empty())
+    return;
+  Draw(shader, meshes[0].prepareInstances(numInstances, models, normMats), lod,
+       view);
+}
+
+void Model::Draw(const Shader &shader, const InstanceRing::Block &instances,
+                 unsigned int lod, const meshlets::View *view) const {
   if (cubeMapID != 0) {
     glActiveTexture(GL_TEXTURE0);
     shader.setUnif(cubeMapLoc, 0);
     glBindTexture(GL_TEXTURE_CUBE_MAP, cubeMapID);
   }
+  size_t triangles = 0;
   for (unsigned int i = 0; i < meshes.size(); i++)
-    meshes[i].Draw(shader, numInstances, models, normMats);
+    triangles += meshes[i].Draw(shader, instances, lod, view);
+  recordDraw(instances.count, lod, triangles);
+}
+
+void Model::DrawDepthOnly(const Shader &shader, unsigned int numInstances,
+                          glm::mat4 *models, unsigned int lod,
+                          const meshlets::View *view) const {
+  if (meshes.empty())
+    return;
+  DrawDepthOnly(shader, meshes[0].prepareInstances(numInstances, models,
+                                                   nullptr),
+                lod, view);
+}
+
+void Model::DrawDepthOnly(const Shader &shader,
+                          const InstanceRing::Block &instances,
+                          unsigned int lod,
+                          const meshlets::View *view) const {
+  size_t triangles = 0;
+  for (const Mesh &mesh : meshes)
+    triangles += mesh.DrawDepthOnly(shader, instances, lod, view);
+  recordDraw(instances.count, lod, triangles);
+}
+
+void Model::appendDraw(IndirectBatch &batch, const Shader &shader,
+                       bool depthOnly, unsigned int numInstances,
+                       glm::mat4 *models, glm::mat3 *normMats,
+                       unsigned int lod, const meshlets::View *view,
+                       unsigned int *materials) const {
+  if (!depthOnly && cubeMapID != 0) {
+    glActiveTexture(GL_TEXTURE0);
+    shader.setUnif(cubeMapLoc, 0);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, cubeMapID);
+  }
+  size_t triangles = 0;
+  for (const Mesh &mesh : meshes) {
+    if (mesh.isPooled()) {
+      triangles += mesh.appendDraw(batch, numInstances, models, normMats,
+                                   lod, view, materials);
+    } else if (depthOnly) {
+      triangles += mesh.DrawDepthOnly(shader, numInstances, models, lod, view);
+    } else {
+      triangles += mesh.Draw(
+          shader,
+          mesh.prepareInstances(numInstances, models, normMats, materials),
+          lod, view);
+    }
+  }
+  recordDraw(numInstances, lod, triangles);
+}
+
+InstanceRing::Block Model::prepareInstances(unsigned int numInstances,
+                                            glm::mat4 *models,
+                                            glm::mat3 *normMats,
+                                            unsigned int *materials) const {
+  // The meshes share the ring, the matrices are written once for all.
+  if (meshes.empty())
+    return InstanceRing::Block();
+  return meshes[0].prepareInstances(numInstances, models, normMats,
+                                    materials);
+}
+
+// Count a draw of triangles per instance in the statistics.
+void Model::recordDraw(unsigned int numInstances, unsigned int lod,
+                       size_t triangles) const {
+  // Meshes still streaming draw nothing, which is not culling.
+  if (lodStats != nullptr && isReady()) {
+    triangles *= numInstances;
+    size_t total = getTriangleCount(lod) * numInstances;
+    lodStats->addDraw(min(lod, getNumLods() - 1), triangles,
+                      total - min(total, triangles));
+  }
 }
 
 void Model::getTextureLocations(Shader shader) {
@@ -48,27 +151,131 @@ void Model::getTextureLocations(Shader shader) {
     meshes[i].getTextureLocations(shader);
 }
 
+// True once every mesh has finished streaming to the GPU.
+bool Model::isReady() const {
+  for (const Mesh &mesh : meshes) {
+    if (!mesh.isReady())
+      return false;
+  }
+  return true;
+}
+
+bool Model::isPooled() const {
+  for (const Mesh &mesh : meshes) {
+    if (!mesh.isPooled())
+      return false;
+  }
+  return true;
+}
+
+InstanceRing *Model::getInstanceRing() const {
+  return meshes.empty() ? nullptr : meshes[0].getInstanceRing();
+}
+
+size_t Model::getNumMeshes() const { return meshes.size(); }
+
 // Approximation of the maximum distance of vertices in the model.
 float Model::getApproxWidth() const { return approxWidth; }
 
+unsigned int Model::selectLod(LodState &state, const glm::mat4 &projection,
+                              const glm::mat4 &view, const glm::mat4 &model,
+                              float viewportHeight, float bias) const {
+  state.level = min(state.level, getNumLods() - 1);
+  if (lodErrors.size() <= 1)
+    return state.level;
+
+  // Projected size of the model in pixels at the center of its bounding
+  // volume. Perspective projections divide by the distance in w,
+  // orthographic ones keep w at 1.
+  glm::vec3 center(boundingVolumeBounds[0] + boundingVolumeBounds[1],
+                   boundingVolumeBounds[2] + boundingVolumeBounds[3],
+                   boundingVolumeBounds[4] + boundingVolumeBounds[5]);
+  glm::vec4 clip = projection * view * model * glm::vec4(0.5f * center, 1.0f);
+  if (clip.w <= 0.0f) {
+    state.level = 0;
+    return 0;
+  }
+  float scale = max(glm::length(glm::vec3(model[0])),
+                    max(glm::length(glm::vec3(model[1])),
+                        glm::length(glm::vec3(model[2]))));
+  float screenSize = approxWidth * scale * projection[1][1] * 0.5f *
+                     viewportHeight / clip.w;
+
+  auto coarsest = [&](float pixels) {
+    unsigned int level = 0;
+    while (level + 1 < lodErrors.size() &&
+           lodErrors[level + 1] * screenSize <= pixels)
+      ++level;
+    return level;
+  };
+  float allowed = LOD_PIXEL_ERROR * bias;
+  unsigned int level = coarsest(allowed);
+  // Only move to a coarser level once it is well within the allowed error,
+  // so the level does not flicker around the threshold.
+  if (level > state.level)
+    level = max(state.level, coarsest(allowed * (1.0f - LOD_HYSTERESIS)));
+  state.level = level;
+  return level;
+}
+
+unsigned int Model::getNumLods() const {
+  return max(1u, static_cast<unsigned int>(lodErrors.size()));
+}
+
+size_t Model::getTriangleCount(unsigned int lod) const {
+  size_t triangles = 0;
+  for (const Mesh &mesh : meshes) {
+    const vector<LodLevel> &lods = mesh.getLods();
+    triangles += lods[min<size_t>(lod, lods.size() - 1)].numIndices / 3;
+  }
+  return triangles;
+}
+
+size_t Model::getNumMeshlets() const {
+  size_t count = 0;
+  for (const Mesh &mesh : meshes)
+    count += mesh.getNumMeshlets();
+  return count;
+}
+
+void Model::setLodStats(LodStats *stats) { lodStats = stats; }
+
+// The error of a level of the model is the largest of its meshes.
+void Model::buildLodErrors() {
+  lodErrors.clear();
+  for (const Mesh &mesh : meshes) {
+    const vector<LodLevel> &lods = mesh.getLods();
+    if (lods.size() > lodErrors.size())
+      lodErrors.resize(lods.size(), 0.0f);
+  }
+  for (const Mesh &mesh : meshes) {
+    const vector<LodLevel> &lods = mesh.getLods();
+    for (size_t i = 0; i < lodErrors.size(); ++i) {
+      float error = lods[min(i, lods.size() - 1)].error;
+      if (approxWidth > 0.0f)
+        lodErrors[i] = max(lodErrors[i], error / approxWidth);
+    }
+  }
+}
+
 /*
     Calculates the bounding volume of the model using the plane normals
     in plane_normals.h.
 */
-void Model::buildBoundingVolume() {
+void Model::buildBoundingVolume(const vector<MeshData> &meshData) {
   float dMin, dMax;
   for (unsigned int i = 0; i < boundingVolumeBounds.size() / 2; ++i) {
     glm::vec3 normal = planeNormals[i];
-    dMin = glm::dot(meshes[0].vertices[0].position, normal);
+    dMin = glm::dot(meshData[0].vertices[0].position, normal);
     dMax = dMin;
-    for (const auto &mesh : meshes) {
+    for (const auto &mesh : meshData) {
       for (const auto &vertex : mesh.vertices) {
         dMin = min(dMin, glm::dot(vertex.position, normal));
         dMax = max(dMax, glm::dot(vertex.position, normal));
       }
     }
-    boundingVolumeBounds[i] = (dMin);
-    boundingVolumeBounds[i + 1] = (dMax);
+    boundingVolumeBounds[2 * i] = (dMin);
+    boundingVolumeBounds[2 * i + 1] = (dMax);
   }
 }
 
@@ -82,147 +289,161 @@ void Model::approximateWidth() {
 }
 
 void Model::loadModel(string path) {
-  Assimp::Importer importer;
-  const aiScene *scene = importer.ReadFile(path, aiProcessSteps);
-  if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE ||
-      !scene->mRootNode) {
-    cout << "ERROR::ASSIMP::" << importer.GetErrorString() << endl;
-    return;
-  }
+  auto start = chrono::steady_clock::now();
   directory = path.substr(0, path.find_last_of('/'));
 
-  processNode(scene->mRootNode, scene);
+  vector<MeshData> meshData;
+  uint64_t cacheKey = meshcache::computeKey(path, aiProcessSteps);
+  if (cacheKey != 0) {
+    // The texture references cached with the meshes keep their colour space.
+    cacheKey = hashValue(bSRGB, cacheKey);
+    cacheKey = hashValue(lodSettings.numLevels, cacheKey);
+    cacheKey = hashValue(lodSettings.reduction, cacheKey);
+    cacheKey = hashValue(lodSettings.maxError, cacheKey);
+    cacheKey = hashValue(WELD_EPSILONS, cacheKey);
+  }
+  bool cached = cacheKey != 0 &&
+                meshcache::read(path, cacheKey, meshData, boundingVolumeBounds);
+  if (!cached) {
+    if (!importModel(path, meshData))
+      return;
+  }
 
-  buildBoundingVolume();
+  if (meshData.empty())
+    return;
+  if (!cached) {
+    buildBoundingVolume(meshData);
+    if (cacheKey != 0)
+      meshcache::write(path, cacheKey, meshData, boundingVolumeBounds);
+  }
   approximateWidth();
+  createMeshes(meshData);
+  buildLodErrors();
+
+  chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+  cout << "Loaded " << path << (cached ? " from mesh cache" : " with Assimp")
+       << " in " << elapsed.count() << " ms\n";
+  cout << "  LODs (triangles, error):";
+  for (unsigned int i = 0; i < getNumLods(); ++i)
+    cout << " " << getTriangleCount(i) << " (" << lodErrors[i] * 100.0f << "%)";
+  cout << "\n  Meshlets: " << getNumMeshlets() << "\n";
+  reportMemory();
+  if (vertexFormat == VertexFormat::Compact)
+    reportVertexFormat();
 }
 
-void Model::processNode(aiNode *node, const aiScene *scene) {
-  // process all the node's meshes (if any)
-  for (unsigned int i = 0; i < node->mNumMeshes; i++) {
-    aiMesh *mesh = scene->mMeshes[node->mMeshes[i]];
-    meshes.push_back(processMesh(mesh, scene));
-  }
-  // then do the same for each of its children
-  for (unsigned int i = 0; i < node->mNumChildren; i++) {
-    processNode(node->mChildren[i], scene);
+// Print the size of the vertex and index buffers.
+void Model::reportMemory() const {
+  size_t vertexBytes = 0, positionBytes = 0, indexBytes = 0, numIndices = 0;
+  size_t shortMeshes = 0, numChunks = 0, numCopies = 0;
+  for (const Mesh &mesh : meshes) {
+    vertexBytes += mesh.getVertexBytes();
+    positionBytes += mesh.getPositionBytes();
+    indexBytes += mesh.getIndexBytes();
+    numIndices += mesh.indices.size();
+    const indexbuf::Layout &layout = mesh.getIndexLayout();
+    if (layout.shortIndices) {
+      shortMeshes++;
+      numChunks += layout.chunks.size();
+      numCopies += layout.extraVertices.size();
+    }
   }
+  cout << "  GPU memory: vertices " << vertexBytes / 1024.0
+       << " KB, depth only positions " << positionBytes / 1024.0
+       << " KB, indices " << numIndices * sizeof(unsigned int) / 1024.0
+       << " KB -> "
+       << indexBytes / 1024.0 << " KB (16-bit indices in " << shortMeshes
+       << " of " << meshes.size() << " meshes, " << numChunks << " chunks, "
+       << numCopies << " vertices copied)\n";
 }
 
-Mesh Model::processMesh(aiMesh *mesh, const aiScene *scene) {
-  // Data to fill
-  vector<Vertex> vertices;
-  vector<unsigned int> indices;
-  vector<Texture> textures;
-  Material myMaterial;
-
-  // Copy vertices
-  for (unsigned int i = 0; i < mesh->mNumVertices; i++) {
-    Vertex vertex;
-    glm::vec3 auxVert;
-
-    auxVert.x = mesh->mVertices[i].x;
-    auxVert.y = mesh->mVertices[i].y;
-    auxVert.z = mesh->mVertices[i].z;
-    vertex.position = auxVert;
-
-    auxVert.x = mesh->mNormals[i].x;
-    auxVert.y = mesh->mNormals[i].y;
-    auxVert.z = mesh->mNormals[i].z;
-    vertex.normal = auxVert;
-
-    if (mesh->mTextureCoords[0]) {
-      glm::vec2 auxTex;
-      auxTex.x = mesh->mTextureCoords[0][i].x;
-      auxTex.y = mesh->mTextureCoords[0][i].y;
-      vertex.texCoord = auxTex;
-
-      auxVert.x = mesh->mTangents[i].x;
-      auxVert.y = mesh->mTangents[i].y;
-      auxVert.z = mesh->mTangents[i].z;
-      vertex.tangent = auxVert;
+// Print the memory saved by the compact vertex format and its precision.
+void Model::reportVertexFormat() const {
+  size_t numVertices = 0, compactBytes = 0;
+  compact::Error error;
+  for (const Mesh &mesh : meshes) {
+    numVertices += mesh.vertices.size();
+    compactBytes += mesh.getVertexBytes();
+    error.merge(mesh.getCompactError());
+  }
+  size_t fullBytes = numVertices * sizeof(Vertex);
+  cout << "  compact vertices: " << numVertices << " vertices, "
+       << fullBytes / 1024.0 << " KB -> " << compactBytes / 1024.0 << " KB ("
+       << sizeof(Vertex) << " -> " << sizeof(CompactVertex)
+       << " bytes per vertex)\n"
+       << "  max error: position " << error.position << " ("
+       << error.relativePosition * 100.0f << "% of the size), normal "
+       << error.normalDegrees << " deg, tangent " << error.tangentDegrees
+       << " deg, uv " << error.texCoord << "\n";
+}
 
-    } else {
-      vertex.texCoord = glm::vec2(0.0f);
-      vertex.tangent = glm::vec3(0.0f);
+bool Model::importModel(const string &path, vector<MeshData> &meshData) {
+  Assimp::Importer importer;
+  const aiScene *scene = importer.ReadFile(path, aiProcessSteps);
+  if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE ||
+      !scene->mRootNode) {
+    cout << "ERROR::ASSIMP::" << importer.GetErrorString() << endl;
+    return false;
+  }
+  // Convert the meshes on the pool, the GL buffers are created afterwards
+  // by createMeshes on this thread.
+  ThreadPool &pool = ThreadPool::shared();
+  meshData = meshimport::convertScene(scene, bSRGB, &pool);
+
+  // Assimp copies vertices per face for some formats, merge them again.
+  weld::Report welded = weld::weldMeshes(meshData, WELD_EPSILONS, &pool);
+  cout << "Welded " << path << ": " << welded.verticesBefore << " -> "
+       << welded.verticesAfter << " vertices ("
+       << 100.0 * (welded.verticesBefore - welded.verticesAfter) /
+              max<size_t>(welded.verticesBefore, 1)
+       << "% fewer), " << welded.trianglesRemoved
+       << " collapsed triangles removed\n";
+
+  // Reorder the triangles and vertices of every mesh for the GPU caches,
+  // simplify it into levels of detail and split the finest level into
+  // meshlets, the result is what ends up in the mesh cache.
+  vector<meshopt::Report> reports(meshData.size());
+  pool.parallelFor(meshData.size(), [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i) {
+      reports[i] = meshopt::optimize(meshData[i]);
+      meshlod::buildChain(meshData[i], lodSettings);
+      const LodLevel &finest = meshData[i].lods[0];
+      meshData[i].meshlets =
+          meshlets::build(meshData[i].vertices, meshData[i].indices,
+                          finest.firstIndex, finest.numIndices);
     }
+  });
+  meshopt::Report report;
+  for (const meshopt::Report &meshReport : reports)
+    report.add(meshReport);
+  cout << "Optimized " << path << " for a " << meshopt::CACHE_SIZE
+       << " entry vertex cache: ACMR " << report.before.acmr() << " -> "
+       << report.after.acmr() << ", ATVR " << report.before.atvr() << " -> "
+       << report.after.atvr() << "\n";
+  return true;
+}
 
-    vertices.push_back(vertex);
-  }
-
-  // Copy indices
-  for (unsigned int i = 0; i < mesh->mNumFaces; i++) {
-    aiFace face = mesh->mFaces[i];
-    for (unsigned int j = 0; j < face.mNumIndices; j++)
-      indices.push_back(face.mIndices[j]);
-  }
-
-  // Copy textures
-  if (mesh->mMaterialIndex >= 0) {
-    aiMaterial *material = scene->mMaterials[mesh->mMaterialIndex];
-    vector<Texture> diffuseMaps =
-        loadMaterialTextures(material, aiTextureType_DIFFUSE, "diffuse", bSRGB);
-    textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
-    vector<Texture> specularMaps =
-        loadMaterialTextures(material, aiTextureType_SPECULAR, "specular");
-    textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
-    vector<Texture> reflexMaps =
-        loadMaterialTextures(material, aiTextureType_AMBIENT, "reflex");
-    textures.insert(textures.end(), reflexMaps.begin(), reflexMaps.end());
-    vector<Texture> normalMaps =
-        loadMaterialTextures(material, aiTextureType_HEIGHT, "normal");
-    myMaterial = loadMaterial(material);
-  }
-  textures.push_back(cubeTex);
-
-  Mesh newMesh(vertices, indices, textures, myMaterial);
-  return newMesh;
-}
-
-vector<Texture> Model::loadMaterialTextures(aiMaterial *mat, aiTextureType type,
-                                            string typeName, bool bSRGB) {
-  vector<Texture> textures;
-  for (unsigned int i = 0; i < mat->GetTextureCount(type); i++) {
-    aiString str;
-    mat->GetTexture(type, i, &str);
-    string path(directory + '/' + string(str.C_Str()));
-
-    unordered_map<string, Texture>::const_iterator iter =
-        loadedTextures.find(path);
-    if (iter != loadedTextures.end()) {
-      textures.push_back(iter->second);
-    } else {
-      Texture texture;
-      texture.id = loadTexture(path, bSRGB);
-      texture.location = 0;
-      texture.path = path;
-      texture.type = typeName;
-      textures.push_back(texture);
-      loadedTextures[path] = texture;
-    }
+void Model::createMeshes(vector<MeshData> &meshData) {
+  meshes.reserve(meshes.size() + meshData.size());
+  for (MeshData &data : meshData) {
+    vector<Texture> textures;
+    for (const TextureRef &ref : data.textureRefs)
+      textures.push_back(loadMaterialTexture(ref));
+    // Every mesh holds its own reference to the shared cube map.
+    retainTexture(cubeTex.id);
+    textures.push_back(cubeTex);
+    meshes.emplace_back(move(data.vertices), move(data.indices),
+                        move(textures), data.material, move(data.lods),
+                        move(data.meshlets), vertexFormat);
   }
-  return textures;
 }
 
-Material Model::loadMaterial(aiMaterial *mat) {
-  Material material;
-  aiColor3D color(0.f, 0.f, 0.f);
-  float shininess;
-
-  mat->Get(AI_MATKEY_COLOR_DIFFUSE, color);
-  material.Diffuse = glm::vec3(color.r, color.b, color.g);
-
-  mat->Get(AI_MATKEY_COLOR_AMBIENT, color);
-  material.Ambient = glm::vec3(color.r, color.b, color.g);
-
-  mat->Get(AI_MATKEY_COLOR_SPECULAR, color);
-  material.Specular = glm::vec3(color.r, color.b, color.g);
-
-  mat->Get(AI_MATKEY_COLOR_EMISSIVE, color);
-  material.Emissive = glm::vec3(color.r, color.b, color.g);
-
-  mat->Get(AI_MATKEY_SHININESS, shininess);
-  material.Shininess = shininess;
-
-  return material;
+Texture Model::loadMaterialTexture(const TextureRef &ref) {
+  // The texture registry shares textures between meshes and models.
+  Texture texture;
+  texture.path = directory + '/' + ref.path;
+  texture.id = loadTexture(texture.path, ref.srgb);
+  texture.location = 0;
+  texture.type = ref.type;
+  return texture;
 }
\ No newline at end of file
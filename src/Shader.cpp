@@ -1,13 +1,17 @@
 #include <glad/glad.h>
-#include <glm/gtc/type_ptr.hpp>
 
-#include <fstream>
 #include <iostream>
-#include <sstream>
-#include <stdexcept>
 #include <string>
 
 #include "Shader.h"
+#include "gl_extensions.h"
+#include "program_cache.h"
+#include "shader_source.h"
+
+// Stages of a program, in the order of their paths.
+static const GLenum STAGE_TYPES[3] = {GL_VERTEX_SHADER, GL_FRAGMENT_SHADER,
+                                      GL_GEOMETRY_SHADER};
+static const char *const STAGE_NAMES[3] = {"VERTEX", "FRAGMENT", "GEOMETRY"};
 
 Shader::Shader(const char *vertexPath, const char *fragmentPath,
                const char *geometryPath) {
@@ -18,149 +22,235 @@ Shader::Shader() : ID(0){};
 
 void Shader::initVals(const char *vertexPath, const char *fragmentPath,
                       const char *geometryPath) {
-  // 1. Retrieve the vertex and fragment codes from the paths
-  std::string vertexCode;
-  std::string fragmentCode;
-  std::string geometryCode;
-  std::ifstream vShaderFile;
-  std::ifstream fShaderFile;
-  std::ifstream gShaderFile;
-  // ensure ifstream objects can throw exceptions:
-  vShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-  fShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-  gShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-  try {
-    // open files
-    vShaderFile.open(vertexPath);
-    fShaderFile.open(fragmentPath);
-    std::stringstream vShaderStream, fShaderStream, gShaderStream;
-    // read file's buffer contents into streams
-    vShaderStream << vShaderFile.rdbuf();
-    fShaderStream << fShaderFile.rdbuf();
-    // close file streams
-    vShaderFile.close();
-    fShaderFile.close();
-    // copy stream content into string
-    vertexCode = vShaderStream.str();
-    fragmentCode = fShaderStream.str();
-
-    if (geometryPath != nullptr) {
-      gShaderFile.open(geometryPath);
-      gShaderStream << gShaderFile.rdbuf();
-      gShaderFile.close();
-      geometryCode = gShaderStream.str();
+  ShaderBatch batch;
+  batch.add(*this, vertexPath, fragmentPath, geometryPath);
+  batch.finish();
+}
+
+ShaderBatch::ShaderBatch() {
+  // Let the driver use as many compiler threads as it wants.
+  if (glext::parallelShaderCompile)
+    glext::MaxShaderCompilerThreads(0xFFFFFFFF);
+}
+
+ShaderBatch::~ShaderBatch() {
+  if (!programs.empty())
+    finish();
+}
+
+void ShaderBatch::add(Shader &shader, const char *vertexPath,
+                      const char *fragmentPath, const char *geometryPath,
+                      const std::vector<std::string> &defines) {
+  auto submitStart = std::chrono::steady_clock::now();
+  if (programs.empty())
+    start = submitStart;
+  Program program;
+  program.shader = &shader;
+  // Copies of the old program keep its table.
+  shader.uniforms = std::make_shared<UniformTable>();
+  program.paths = {vertexPath, fragmentPath};
+  if (geometryPath != nullptr)
+    program.paths.push_back(geometryPath);
+
+  program.defines = defines;
+
+  // 1. Retrieve the code of every stage from the paths, with the includes
+  // expanded and the defines inserted
+  std::vector<std::string> sources;
+  bool complete = true;
+  for (const std::string &path : program.paths) {
+    shadersource::Source source = shadersource::load(path, defines);
+    if (!source.complete) {
+      // The file that could not be read was reported by the loader.
+      std::cout << "ERROR::SHADER::INCOMPLETE_SOURCE: " << path << std::endl;
+      complete = false;
+    }
+    sources.push_back(std::move(source.code));
+    program.files.push_back(std::move(source.files));
+  }
+  // Nothing is compiled from a partial source, the program stays 0.
+  if (!complete) {
+    shader.ID = 0;
+    return;
+  }
+
+  // Programs linked before with the same sources and driver are loaded from
+  // the program cache instead.
+  program.cachePath = programcache::cachePath(program.paths, defines);
+  program.cacheKey = programcache::computeKey(sources);
+  shader.ID = program.cacheKey != 0
+                  ? programcache::read(program.cachePath, program.cacheKey)
+                  : 0;
+  program.cached = shader.ID != 0;
+
+  // 2. Compile and link the shaders, the results are checked by finish
+  if (!program.cached) {
+    shader.ID = glCreateProgram();
+    if (program.cacheKey != 0)
+      glProgramParameteri(shader.ID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT,
+                          GL_TRUE);
+    for (size_t i = 0; i < sources.size(); ++i) {
+      const char *code = sources[i].c_str();
+      unsigned int stage = glCreateShader(STAGE_TYPES[i]);
+      glShaderSource(stage, 1, &code, NULL);
+      glCompileShader(stage);
+      glAttachShader(shader.ID, stage);
+      program.stages.push_back(stage);
     }
-  } catch (std::ifstream::failure e) {
-    std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
+    glLinkProgram(shader.ID);
   }
+  program.submitTime = std::chrono::steady_clock::now() - submitStart;
+  programs.push_back(program);
+}
 
-  const char *vShaderCode = vertexCode.c_str();
-  const char *fShaderCode = fragmentCode.c_str();
-  const char *gShaderCode = geometryCode.c_str();
+bool ShaderBatch::isReady() const {
+  if (!glext::parallelShaderCompile)
+    return true;
+  for (const Program &program : programs) {
+    if (program.cached)
+      continue;
+    int done = 0;
+    glGetProgramiv(program.shader->ID, glext::COMPLETION_STATUS, &done);
+    if (!done)
+      return false;
+  }
+  return true;
+}
 
-  // 2. Compile and link the shaders
-  unsigned int vertex, fragment, geometry;
+void ShaderBatch::finish() {
+  auto waitStart = std::chrono::steady_clock::now();
   int success;
   char infoLog[512];
-
-  // vertex shader
-  vertex = glCreateShader(GL_VERTEX_SHADER);
-  glShaderSource(vertex, 1, &vShaderCode, NULL);
-  glCompileShader(vertex);
-  // check for compile errors
-  glGetShaderiv(vertex, GL_COMPILE_STATUS, &success);
-  if (!success) {
-    glGetShaderInfoLog(vertex, 512, NULL, infoLog);
-    std::cout << "ERROR::SHADER::VERTEX::COMPILATION_FAILED\n"
-              << infoLog << std::endl;
+  for (const Program &program : programs) {
+    unsigned int ID = program.shader->ID;
+    if (!program.cached) {
+      // check for compile errors
+      for (size_t i = 0; i < program.stages.size(); ++i) {
+        glGetShaderiv(program.stages[i], GL_COMPILE_STATUS, &success);
+        if (!success) {
+          glGetShaderInfoLog(program.stages[i], 512, NULL, infoLog);
+          std::cout << "ERROR::SHADER::" << STAGE_NAMES[i]
+                    << "::COMPILATION_FAILED\n"
+                    << infoLog << std::endl;
+          // The source string numbers of the errors.
+          for (size_t f = 0; f < program.files[i].size(); ++f)
+            std::cout << "  " << f << ": " << program.files[i][f] << "\n";
+        }
+        // delete the shaders, freed with the program
+        glDeleteShader(program.stages[i]);
+      }
+      // check for link errors
+      glGetProgramiv(ID, GL_LINK_STATUS, &success);
+      if (!success) {
+        glGetProgramInfoLog(ID, 512, NULL, infoLog);
+        std::cout << "ERROR::SHADER::LINKING_FAILED\n"
+                  << infoLog << std::endl;
+      } else if (program.cacheKey != 0) {
+        programcache::write(program.cachePath, program.cacheKey, ID);
+      }
+    }
+    program.shader->uniforms->build(ID);
+
+    std::cout << (program.cached ? "Loaded " : "Compiled ") << program.paths[0];
+    for (size_t i = 1; i < program.paths.size(); ++i)
+      std::cout << ", " << program.paths[i];
+    for (const std::string &define : program.defines)
+      std::cout << " " << define;
+    std::cout << (program.cached ? " from program cache in "
+                                 : ", submitted in ")
+              << program.submitTime.count() << " ms\n";
   }
 
-  // fragment shader
-  fragment = glCreateShader(GL_FRAGMENT_SHADER);
-  glShaderSource(fragment, 1, &fShaderCode, NULL);
-  glCompileShader(fragment);
-  // check for compile errors
-  glGetShaderiv(fragment, GL_COMPILE_STATUS, &success);
-  if (!success) {
-    glGetShaderInfoLog(fragment, 512, NULL, infoLog);
-    std::cout << "ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n"
-              << infoLog << std::endl;
-  }
+  auto end = std::chrono::steady_clock::now();
+  std::chrono::duration<double, std::milli> total = end - start;
+  std::chrono::duration<double, std::milli> waited = end - waitStart;
+  std::cout << "Built " << programs.size() << " shader programs in "
+            << total.count() << " ms, " << waited.count()
+            << " ms of it waiting for the driver\n";
+  programs.clear();
+}
 
-  // geometry shader
-  if (geometryPath != nullptr) {
-    geometry = glCreateShader(GL_GEOMETRY_SHADER);
-    glShaderSource(geometry, 1, &gShaderCode, NULL);
-    glCompileShader(geometry);
-    // check for compile errors
-    glGetShaderiv(geometry, GL_COMPILE_STATUS, &success);
-    if (!success) {
-      glGetShaderInfoLog(geometry, 512, NULL, infoLog);
-      std::cout << "ERROR::SHADER::GEOMETRY::COMPILATION_FAILED\n"
-                << infoLog << std::endl;
-    }
+ShaderVariants::ShaderVariants(const char *vertexPath,
+                               const char *fragmentPath,
+                               const std::vector<std::string> &options)
+    : vertexPath(vertexPath), fragmentPath(fragmentPath), options(options) {}
+
+unsigned int ShaderVariants::bit(const std::string &option) const {
+  for (size_t i = 0; i < options.size(); ++i) {
+    if (options[i] == option)
+      return 1u << i;
   }
+  std::cout << "ERROR::SHADER::UNKNOWN_OPTION " << option << std::endl;
+  return 0;
+}
 
-  // Link them in a shader program
-  ID = glCreateProgram();
-  glAttachShader(ID, vertex);
-  glAttachShader(ID, fragment);
-  if (geometryPath != nullptr)
-    glAttachShader(ID, geometry);
-  glLinkProgram(ID);
-  // check for link errors
-  glGetProgramiv(ID, GL_LINK_STATUS, &success);
-  if (!success) {
-    glGetProgramInfoLog(ID, 512, NULL, infoLog);
-    std::cout << "ERROR::SHADER::LINKING_FAILED\n" << infoLog << std::endl;
+void ShaderVariants::setInit(Init init) { this->init = init; }
+
+void ShaderVariants::request(ShaderBatch &batch, unsigned int key) {
+  auto inserted = variants.emplace(key, Variant());
+  if (inserted.second)
+    batch.add(inserted.first->second.shader, vertexPath.c_str(),
+              fragmentPath.c_str(), nullptr, definesOf(key));
+}
+
+Shader &ShaderVariants::get(unsigned int key) {
+  if (variants.find(key) == variants.end()) {
+    ShaderBatch batch;
+    request(batch, key);
+    batch.finish();
+  }
+  Variant &variant = variants[key];
+  if (!variant.initialized) {
+    if (init)
+      init(variant.shader);
+    variant.initialized = true;
   }
+  return variant.shader;
+}
 
-  // delete the shaders
-  glDeleteShader(vertex);
-  glDeleteShader(fragment);
-  if (geometryPath != nullptr)
-    glDeleteShader(geometry);
+size_t ShaderVariants::size() const { return variants.size(); }
+
+std::string ShaderVariants::describe(unsigned int key) const {
+  std::string description;
+  for (const std::string &define : definesOf(key))
+    description += (description.empty() ? "" : " ") + define;
+  return description.empty() ? "no options" : description;
 }
 
-void Shader::use() const { glUseProgram(ID); }
+std::vector<std::string> ShaderVariants::definesOf(unsigned int key) const {
+  std::vector<std::string> defines;
+  for (size_t i = 0; i < options.size(); ++i) {
+    if (key & (1u << i))
+      defines.push_back(options[i]);
+  }
+  return defines;
+}
 
-void Shader::setLight(Light light) {
-  this->use();
-  const std::string &name = light.name;
-  setUnifS(name + ".directional", light.directional);
-  setUnifS(name + ".width", light.width);
-  setUnifS(name + ".len", light.length);
-  setUnifS(name + ".constant", light.falloffConstant);
-  setUnifS(name + ".linear", light.falloffLinear);
-  setUnifS(name + ".quadratic", light.falloffQuadratic);
-  setUnifS(name + ".cutOff", light.cutOff);
-  setUnifS(name + ".outerCutOff", light.outerCutOff);
-  setUnifS(name + ".cLight", light.cLight);
+void Shader::use() const { glUseProgram(ID); }
 
-  std::array<int, 2> &IDs = lightIDs[name];
-  IDs[POS_ID] = getUnif(name + ".position");
-  IDs[DIR_ID] = getUnif(name + ".direction");
+void Shader::setLight(const Light &light) const {
+  UniformID name(light.name);
+  setUnifS(name.append(".directional"), light.directional);
+  setUnifS(name.append(".width"), light.width);
+  setUnifS(name.append(".len"), light.length);
+  setUnifS(name.append(".constant"), light.falloffConstant);
+  setUnifS(name.append(".linear"), light.falloffLinear);
+  setUnifS(name.append(".quadratic"), light.falloffQuadratic);
+  setUnifS(name.append(".cutOff"), light.cutOff);
+  setUnifS(name.append(".outerCutOff"), light.outerCutOff);
+  setUnifS(name.append(".cLight"), light.cLight);
 }
 
 void Shader::setLightPos(const Light &light, const glm::mat4 &transform) const {
   glm::vec4 aux = transform * glm::vec4(light.position, 1.0);
   glm::vec3 finalPos = glm::vec3(aux / aux.w);
-  try {
-    const std::array<int, 2> &IDs = lightIDs.at(light.name);
-    setUnif(IDs[POS_ID], finalPos);
-  } catch (const std::out_of_range &oor) {
-    std::cerr << "Setting light position before calling setLight()\n";
-  }
+  setUnifS(UniformID(light.name).append(".position"), finalPos);
 }
 
 void Shader::setLightDir(const Light &light,
                          const glm::mat3 &dirNormMatrix) const {
-  try {
-    const std::array<int, 2> &IDs = lightIDs.at(light.name);
-    setUnif(IDs[DIR_ID], dirNormMatrix * light.direction);
-  } catch (const std::out_of_range &oor) {
-    std::cerr << "Setting light direction before calling setLight()\n";
-  }
+  setUnifS(UniformID(light.name).append(".direction"),
+           dirNormMatrix * light.direction);
 }
 
 int Shader::getUnif(const std::string name) const {
@@ -168,112 +258,109 @@ int Shader::getUnif(const std::string name) const {
 }
 
 void Shader::setUnif(const int location, bool value) const {
-  glUniform1i(location, static_cast<int>(value));
+  uniforms->setLocation(location, static_cast<int>(value));
 }
 
 void Shader::setUnif(const int location, int value) const {
-  glUniform1i(location, value);
+  uniforms->setLocation(location, value);
 }
 
 void Shader::setUnif(const int location, unsigned int value) const {
-  glUniform1i(location, value);
+  uniforms->setLocation(location, static_cast<int>(value));
 }
 
 void Shader::setUnif(const int location, float value) const {
-  glUniform1f(location, value);
+  uniforms->setLocation(location, value);
 }
 
 void Shader::setUnif(const int location, float xVal, float yVal) const {
-  glUniform2f(location, xVal, yVal);
+  uniforms->setLocation(location, glm::vec2(xVal, yVal));
 }
 
 void Shader::setUnif(const int location, float xVal, float yVal,
                      float zVal) const {
-  glUniform3f(location, xVal, yVal, zVal);
+  uniforms->setLocation(location, glm::vec3(xVal, yVal, zVal));
 }
 
 void Shader::setUnif(const int location, float xVal, float yVal, float zVal,
                      float wVal) const {
-  glUniform4f(location, xVal, yVal, zVal, wVal);
+  uniforms->setLocation(location, glm::vec4(xVal, yVal, zVal, wVal));
 }
 
 void Shader::setUnif(const int location, glm::vec2 vec) const {
-  glUniform2fv(location, 1, glm::value_ptr(vec));
+  uniforms->setLocation(location, vec);
 }
 
 void Shader::setUnif(const int location, glm::vec3 vec) const {
-  glUniform3fv(location, 1, glm::value_ptr(vec));
+  uniforms->setLocation(location, vec);
 }
 
 void Shader::setUnif(const int location, glm::vec4 vec) const {
-  glUniform4fv(location, 1, glm::value_ptr(vec));
+  uniforms->setLocation(location, vec);
 }
 
 void Shader::setUnif(const int location, glm::mat2 mat) const {
-  glUniformMatrix2fv(location, 1, GL_FALSE, glm::value_ptr(mat));
+  uniforms->setLocation(location, mat);
 }
 
 void Shader::setUnif(const int location, glm::mat3 mat) const {
-  glUniformMatrix3fv(location, 1, GL_FALSE, glm::value_ptr(mat));
+  uniforms->setLocation(location, mat);
 }
 
 void Shader::setUnif(const int location, glm::mat4 mat) const {
-  glUniformMatrix4fv(location, 1, GL_FALSE, glm::value_ptr(mat));
+  uniforms->setLocation(location, mat);
 }
 
-void Shader::setUnifS(const std::string &name, bool value) const {
-  glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+void Shader::setUnifS(UniformID name, bool value) const {
+  uniforms->set(uniforms->find(name), static_cast<int>(value));
 }
 
-void Shader::setUnifS(const std::string &name, int value) const {
-  glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+void Shader::setUnifS(UniformID name, int value) const {
+  uniforms->set(uniforms->find(name), value);
 }
 
-void Shader::setUnifS(const std::string &name, unsigned int value) const {
-  glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+void Shader::setUnifS(UniformID name, unsigned int value) const {
+  uniforms->set(uniforms->find(name), static_cast<int>(value));
 }
 
-void Shader::setUnifS(const std::string &name, float value) const {
-  glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+void Shader::setUnifS(UniformID name, float value) const {
+  uniforms->set(uniforms->find(name), value);
 }
 
-void Shader::setUnifS(const std::string &name, float xVal, float yVal) const {
-  glUniform2f(glGetUniformLocation(ID, name.c_str()), xVal, yVal);
+void Shader::setUnifS(UniformID name, float xVal, float yVal) const {
+  uniforms->set(uniforms->find(name), glm::vec2(xVal, yVal));
 }
 
-void Shader::setUnifS(const std::string &name, float xVal, float yVal,
+void Shader::setUnifS(UniformID name, float xVal, float yVal,
                       float zVal) const {
-  glUniform3f(glGetUniformLocation(ID, name.c_str()), xVal, yVal, zVal);
+  uniforms->set(uniforms->find(name), glm::vec3(xVal, yVal, zVal));
 }
 
-void Shader::setUnifS(const std::string &name, float xVal, float yVal,
-                      float zVal, float wVal) const {
-  glUniform4f(glGetUniformLocation(ID, name.c_str()), xVal, yVal, zVal, wVal);
+void Shader::setUnifS(UniformID name, float xVal, float yVal, float zVal,
+                      float wVal) const {
+  uniforms->set(uniforms->find(name), glm::vec4(xVal, yVal, zVal, wVal));
 }
 
-void Shader::setUnifS(const std::string &name, glm::vec2 vec) const {
-  glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, glm::value_ptr(vec));
+void Shader::setUnifS(UniformID name, glm::vec2 vec) const {
+  uniforms->set(uniforms->find(name), vec);
 }
 
-void Shader::setUnifS(const std::string &name, glm::vec3 vec) const {
-  glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, glm::value_ptr(vec));
+void Shader::setUnifS(UniformID name, glm::vec3 vec) const {
+  uniforms->set(uniforms->find(name), vec);
 }
 
-void Shader::setUnifS(const std::string &name, glm::vec4 vec) const {
-  glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, glm::value_ptr(vec));
+void Shader::setUnifS(UniformID name, glm::vec4 vec) const {
+  uniforms->set(uniforms->find(name), vec);
 }
 
-void Shader::setUnifS(const std::string &name, glm::mat2 mat) const {
-  glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE,
-                     glm::value_ptr(mat));
+void Shader::setUnifS(UniformID name, glm::mat2 mat) const {
+  uniforms->set(uniforms->find(name), mat);
 }
 
-void Shader::setUnifS(const std::string &name, glm::mat3 mat) const {
-  glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE,
-                     glm::value_ptr(mat));
+void Shader::setUnifS(UniformID name, glm::mat3 mat) const {
+  uniforms->set(uniforms->find(name), mat);
 }
 
-void Shader::setUnifS(const std::string &name, glm::mat4 mat) const {
-  glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE,
-                     glm::value_ptr(mat));
+void Shader::setUnifS(UniformID name, glm::mat4 mat) const {
+  uniforms->set(uniforms->find(name), mat);
 }
\ No newline at end of file
@@ -1,4 +1,6 @@
 #include "SimpleMesh.h"
+#include "SubmitStats.h"
+#include "UploadQueue.h"
 #include "texture_loader.h"
 #include <GLFW/glfw3.h>
 #include <iostream>
@@ -13,6 +15,31 @@ SimpleMesh::SimpleMesh(const float *vertices, unsigned int numVertices,
 
   this->numVertices = numVertices;
   this->bSRGB = bSRGB;
+  instanceRing = InstanceRing::active();
+  pool = nullptr;
+  firstVertex = 0;
+  uploadTicket = 0;
+
+  // Vertices with normals and tangents are laid out like full Mesh vertices
+  // and can share the vertex array of the pool.
+  GeometryPool *activePool = GeometryPool::active();
+  GeometryPool::Allocation allocation;
+  if (hasNormals && hasTangents && activePool != nullptr &&
+      instanceRing == &activePool->getInstanceRing() &&
+      activePool->allocate(VertexFormat::Full, numVertices, 0, allocation)) {
+    pool = activePool;
+    firstVertex = allocation.firstVertex;
+    VAO = pool->getVertexArray(VertexFormat::Full);
+    uploadTicket = pool->upload(VertexFormat::Full, allocation, vertices,
+                                nullptr, numVertices, nullptr, 0);
+    if (!cubeTexturePaths.empty())
+      textures.push_back(loadCubeMaps(cubeTexturePaths));
+    if (!texturePaths.empty()) {
+      vector<Texture> texs = loadTextures(texturePaths, texParams);
+      textures.insert(textures.end(), texs.begin(), texs.end());
+    }
+    return;
+  }
 
   // Create vertex array object
   glGenVertexArrays(1, &VAO);
@@ -35,9 +62,14 @@ SimpleMesh::SimpleMesh(const float *vertices, unsigned int numVertices,
   GLsizei totalSize =
       static_cast<GLsizei>(posSize + normSize + coordSize + tanSize);
 
+  size_t bufferSize = numVertices * static_cast<size_t>(totalSize);
+  UploadQueue *uploader = UploadQueue::active();
   glBindBuffer(GL_ARRAY_BUFFER, VBOs[POS_NORM_TEX_TAN_VB]);
-  glBufferData(GL_ARRAY_BUFFER, numVertices * static_cast<size_t>(totalSize),
-               vertices, GL_STATIC_DRAW);
+  glBufferData(GL_ARRAY_BUFFER, bufferSize, uploader ? NULL : vertices,
+               GL_STATIC_DRAW);
+  if (uploader != nullptr)
+    uploadTicket = uploader->queueBuffer(VBOs[POS_NORM_TEX_TAN_VB], 0,
+                                         vertices, bufferSize);
 
   // Location attribute
   glEnableVertexAttribArray(POS_LOC);
@@ -62,16 +94,21 @@ SimpleMesh::SimpleMesh(const float *vertices, unsigned int numVertices,
                           (void *)(posSize + normSize + coordSize));
   }
 
-  // Model matrices
-  glBindBuffer(GL_ARRAY_BUFFER, VBOs[MOD_VB]);
-  for (unsigned int i = 0; i < 4; i++) {
-    glEnableVertexAttribArray(MOD_LOC + i);
-    glVertexAttribPointer(MOD_LOC + i, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4),
-                          (void *)(sizeof(glm::vec4) * i));
-    glVertexAttribDivisor(MOD_LOC + i, 1);
+  if (instanceRing != nullptr) {
+    // Model and normal matrices from the ring.
+    instanceRing->bindAttributes(hasNormals);
+  } else {
+    // Model matrices
+    glBindBuffer(GL_ARRAY_BUFFER, VBOs[MOD_VB]);
+    for (unsigned int i = 0; i < 4; i++) {
+      glEnableVertexAttribArray(MOD_LOC + i);
+      glVertexAttribPointer(MOD_LOC + i, 4, GL_FLOAT, GL_FALSE,
+                            sizeof(glm::mat4), (void *)(sizeof(glm::vec4) * i));
+      glVertexAttribDivisor(MOD_LOC + i, 1);
+    }
   }
 
-  if (hasNormals) {
+  if (hasNormals && instanceRing == nullptr) {
     // Normal matrices
     glBindBuffer(GL_ARRAY_BUFFER, VBOs[NORM_M_VB]);
     for (unsigned int i = 0; i < 3; i++) {
@@ -101,25 +138,41 @@ SimpleMesh::SimpleMesh(const float *vertices, unsigned int numVertices,
 }
 
 SimpleMesh::~SimpleMesh() {
-  glDeleteVertexArrays(1, &VAO);
-  glDeleteBuffers(SIMP_NUM_VBS, VBOs);
+  if (pool == nullptr) {
+    glDeleteVertexArrays(1, &VAO);
+    glDeleteBuffers(SIMP_NUM_VBS, VBOs);
+  }
   for (unsigned int i = 0; i < textures.size(); i++)
-    glDeleteTextures(1, &textures[i].id);
+    releaseTexture(textures[i].id);
 }
 
 void SimpleMesh::Draw(Shader shader, unsigned int numInstances,
                       glm::mat4 *models, glm::mat3 *normMats) {
+  if (!isReady())
+    return;
+
   // Populate model matrices
-  if (models != NULL) {
-    glBindBuffer(GL_ARRAY_BUFFER, VBOs[MOD_VB]);
-    glBufferData(GL_ARRAY_BUFFER, numInstances * sizeof(glm::mat4), models,
-                 GL_DYNAMIC_DRAW);
-  }
+  unsigned int baseInstance = 0;
+  if (instanceRing != nullptr) {
+    if (models != NULL) {
+      InstanceRing::Block instances =
+          instanceRing->write(numInstances, models, normMats);
+      if (instances.count == 0)
+        return;
+      baseInstance = instances.first;
+    }
+  } else {
+    if (models != NULL) {
+      glBindBuffer(GL_ARRAY_BUFFER, VBOs[MOD_VB]);
+      glBufferData(GL_ARRAY_BUFFER, numInstances * sizeof(glm::mat4), models,
+                   GL_DYNAMIC_DRAW);
+    }
 
-  if (normMats != NULL) {
-    glBindBuffer(GL_ARRAY_BUFFER, VBOs[NORM_M_VB]);
-    glBufferData(GL_ARRAY_BUFFER, numInstances * sizeof(glm::mat3), normMats,
-                 GL_DYNAMIC_DRAW);
+    if (normMats != NULL) {
+      glBindBuffer(GL_ARRAY_BUFFER, VBOs[NORM_M_VB]);
+      glBufferData(GL_ARRAY_BUFFER, numInstances * sizeof(glm::mat3),
+                   normMats, GL_DYNAMIC_DRAW);
+    }
   }
 
   if (!textures.empty()) {
@@ -136,9 +189,18 @@ void SimpleMesh::Draw(Shader shader, unsigned int numInstances,
 
   // draw mesh
   glBindVertexArray(VAO);
-  glDrawArraysInstanced(GL_TRIANGLES, 0, numVertices, numInstances);
+  glDrawArraysInstancedBaseInstance(GL_TRIANGLES, firstVertex, numVertices,
+                                    numInstances, baseInstance);
   glBindVertexArray(0);
   glActiveTexture(GL_TEXTURE0);
+  if (SubmitStats *stats = SubmitStats::active())
+    stats->addCalls(1);
+}
+
+bool SimpleMesh::isReady() const {
+  UploadQueue *uploader = UploadQueue::active();
+  return uploadTicket == 0 || uploader == nullptr ||
+         uploader->isReady(uploadTicket);
 }
 
 void SimpleMesh::getTextureLocations(Shader shader) {
@@ -166,23 +228,27 @@ void SimpleMesh::getTextureLocations(Shader shader) {
 
 vector<Texture> SimpleMesh::loadTextures(vector<string> texturePaths,
                                          vector<GLenum> texParams) {
-  vector<Texture> textures;
+  vector<TextureRequest> requests;
   for (unsigned int i = 0; i < texturePaths.size(); i++) {
-    string path;
-    path = texturePaths[i];
-    Texture texture;
-    if (texParams.empty())
-      texture.id = loadTexture(path, bSRGB);
-    else {
-      GLenum sWrap = texParams[1];
-      GLenum tWrap = texParams[2];
-      GLenum minFilter = texParams[3];
-      GLenum magFilter = texParams[4];
-      texture.id =
-          loadTexture(path, bSRGB, true, sWrap, tWrap, minFilter, magFilter);
+    TextureRequest request;
+    request.path = texturePaths[i];
+    request.srgb = bSRGB;
+    if (!texParams.empty()) {
+      request.sWrap = texParams[1];
+      request.tWrap = texParams[2];
+      request.minFilter = texParams[3];
+      request.magFilter = texParams[4];
     }
+    requests.push_back(request);
+  }
+
+  vector<unsigned int> ids = loadTextureBatch(requests);
+  vector<Texture> textures;
+  for (unsigned int i = 0; i < ids.size(); i++) {
+    Texture texture;
+    texture.id = ids[i];
     texture.location = 0;
-    texture.path = path;
+    texture.path = texturePaths[i];
     texture.type = "diffuse";
     textures.push_back(texture);
   }
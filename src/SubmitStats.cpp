@@ -0,0 +1,29 @@
+#include "SubmitStats.h"
+#include <iostream>
+
+using namespace std;
+
+namespace {
+SubmitStats *activeStats = nullptr;
+} // namespace
+
+void SubmitStats::addCalls(size_t calls) { this->calls += calls; }
+
+void SubmitStats::addTime(double time) { this->time += time; }
+
+void SubmitStats::endFrame() { frames++; }
+
+void SubmitStats::print(const char *path) {
+  if (frames == 0)
+    return;
+  cout << "Draw submission (" << path << ") over " << frames
+       << " frames: " << static_cast<double>(calls) / frames
+       << " draw calls and " << time / frames << " ms of CPU time per frame\n";
+  frames = 0;
+  calls = 0;
+  time = 0.0;
+}
+
+SubmitStats *SubmitStats::active() { return activeStats; }
+
+void SubmitStats::setActive(SubmitStats *stats) { activeStats = stats; }
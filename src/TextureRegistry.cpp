@@ -0,0 +1,169 @@
+#include "TextureRegistry.h"
+#include "MappedFile.h"
+#include "ThreadPool.h"
+#include "hashing.h"
+#include <filesystem>
+#include <future>
+#include <sstream>
+
+using namespace std;
+namespace fs = std::filesystem;
+
+namespace {
+
+string normalizePath(const string &path) {
+  error_code ec;
+  fs::path normalized = fs::weakly_canonical(path, ec);
+  if (ec)
+    normalized = fs::path(path).lexically_normal();
+  return normalized.string();
+}
+
+// Hash of the file contents combined with the load parameters, 0 on failure.
+uint64_t hashContents(const TextureRequest &request) {
+  MappedFile file(request.path);
+  if (!file.isOpen())
+    return 0;
+  string key = TextureRegistry::makeKey(request);
+  string params = key.substr(key.find('|'));
+  uint64_t hash = fnv1a64(params.data(), params.size());
+  return fnv1a64(file.data(), file.size(), hash);
+}
+
+} // namespace
+
+TextureRegistry::TextureRegistry()
+    : contentHashing(false), numHits(0), numMisses(0) {}
+
+TextureRegistry &TextureRegistry::instance() {
+  static TextureRegistry registry;
+  return registry;
+}
+
+string TextureRegistry::makeKey(const TextureRequest &request) {
+  ostringstream key;
+  key << normalizePath(request.path) << '|' << request.srgb << request.flip
+      << request.flipGreen << request.normalMap << request.channel << '|'
+      << hex << request.sWrap << ',' << request.tWrap << ','
+      << request.minFilter << ',' << request.magFilter;
+  return key.str();
+}
+
+unsigned int TextureRegistry::acquire(const TextureRequest &request) {
+  return acquire(vector<TextureRequest>{request})[0];
+}
+
+vector<unsigned int>
+TextureRegistry::acquire(const vector<TextureRequest> &requests) {
+  vector<unsigned int> ids(requests.size(), 0);
+  vector<string> keys(requests.size());
+  ThreadPool &pool = ThreadPool::shared();
+
+  // Resolve what is already loaded, and gather the first request of every
+  // missing key.
+  vector<size_t> missing;
+  unordered_map<string, size_t> missingByKey;
+  for (size_t i = 0; i < requests.size(); ++i) {
+    keys[i] = makeKey(requests[i]);
+    auto iter = byKey.find(keys[i]);
+    if (iter != byKey.end())
+      ids[i] = addReference(iter->second, keys[i]);
+    else if (missingByKey.emplace(keys[i], i).second)
+      missing.push_back(i);
+  }
+
+  vector<uint64_t> contentHashes(missing.size(), 0);
+  if (contentHashing) {
+    vector<future<uint64_t>> hashes;
+    for (size_t i : missing)
+      hashes.push_back(
+          pool.submit([&requests, i]() { return hashContents(requests[i]); }));
+    for (size_t j = 0; j < missing.size(); ++j)
+      contentHashes[j] = hashes[j].get();
+  }
+
+  // Alias identical contents loaded under another path, create the rest.
+  vector<TextureRequest> toCreate;
+  vector<size_t> created;
+  for (size_t j = 0; j < missing.size(); ++j) {
+    size_t i = missing[j];
+    auto iter = byContent.find(contentHashes[j]);
+    if (contentHashes[j] != 0 && iter != byContent.end()) {
+      ids[i] = addReference(iter->second, keys[i]);
+    } else {
+      toCreate.push_back(requests[i]);
+      created.push_back(j);
+    }
+  }
+  vector<unsigned int> newIDs = createTextures(toCreate);
+  for (size_t k = 0; k < created.size(); ++k) {
+    size_t i = missing[created[k]];
+    ids[i] = newIDs[k];
+    insert(newIDs[k], keys[i], contentHashes[created[k]]);
+    ++numMisses;
+  }
+
+  // Duplicates inside the batch share the texture of their first request.
+  for (size_t i = 0; i < requests.size(); ++i) {
+    if (ids[i] == 0)
+      ids[i] = addReference(ids[missingByKey[keys[i]]], keys[i]);
+  }
+  return ids;
+}
+
+unsigned int TextureRegistry::acquire(const string &key,
+                                      const function<unsigned int()> &create) {
+  auto iter = byKey.find(key);
+  if (iter != byKey.end())
+    return addReference(iter->second, key);
+  unsigned int id = create();
+  insert(id, key, 0);
+  ++numMisses;
+  return id;
+}
+
+void TextureRegistry::retain(unsigned int id) {
+  auto iter = entries.find(id);
+  if (iter != entries.end())
+    ++iter->second.refCount;
+}
+
+void TextureRegistry::release(unsigned int id) {
+  auto iter = entries.find(id);
+  if (iter == entries.end() || --iter->second.refCount > 0)
+    return;
+  for (const string &key : iter->second.keys)
+    byKey.erase(key);
+  if (iter->second.contentHash != 0)
+    byContent.erase(iter->second.contentHash);
+  entries.erase(iter);
+  glDeleteTextures(1, &id);
+}
+
+void TextureRegistry::setContentHashing(bool enabled) {
+  contentHashing = enabled;
+}
+
+size_t TextureRegistry::size() const { return entries.size(); }
+
+unsigned int TextureRegistry::hits() const { return numHits; }
+
+unsigned int TextureRegistry::misses() const { return numMisses; }
+
+unsigned int TextureRegistry::addReference(unsigned int id,
+                                           const string &key) {
+  Entry &entry = entries[id];
+  ++entry.refCount;
+  if (byKey.emplace(key, id).second)
+    entry.keys.push_back(key);
+  ++numHits;
+  return id;
+}
+
+void TextureRegistry::insert(unsigned int id, const string &key,
+                             uint64_t contentHash) {
+  entries[id] = Entry{1, {key}, contentHash};
+  byKey[key] = id;
+  if (contentHash != 0)
+    byContent[contentHash] = id;
+}
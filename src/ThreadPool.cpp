@@ -0,0 +1,61 @@
+#include "ThreadPool.h"
+#include <algorithm>
+
+using namespace std;
+
+ThreadPool::ThreadPool(unsigned int numThreads) : stopping(false) {
+  numThreads = max(numThreads, 1u);
+  for (unsigned int i = 0; i < numThreads; ++i)
+    workers.emplace_back(&ThreadPool::workerLoop, this);
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    lock_guard<mutex> lock(queueMutex);
+    stopping = true;
+  }
+  condition.notify_all();
+  for (thread &worker : workers)
+    worker.join();
+}
+
+void ThreadPool::parallelFor(size_t count,
+                             const function<void(size_t, size_t)> &body) {
+  if (count == 0)
+    return;
+  size_t numChunks = min(count, static_cast<size_t>(workers.size()) * 4);
+  size_t chunkSize = (count + numChunks - 1) / numChunks;
+  vector<future<void>> pending;
+  for (size_t begin = chunkSize; begin < count; begin += chunkSize) {
+    size_t end = min(count, begin + chunkSize);
+    pending.push_back(submit([&body, begin, end]() { body(begin, end); }));
+  }
+  // The calling thread works on the first chunk instead of idling.
+  body(0, min(count, chunkSize));
+  for (future<void> &f : pending)
+    f.get();
+}
+
+unsigned int ThreadPool::size() const {
+  return static_cast<unsigned int>(workers.size());
+}
+
+ThreadPool &ThreadPool::shared() {
+  static ThreadPool pool;
+  return pool;
+}
+
+void ThreadPool::workerLoop() {
+  while (true) {
+    function<void()> task;
+    {
+      unique_lock<mutex> lock(queueMutex);
+      condition.wait(lock, [this]() { return stopping || !tasks.empty(); });
+      if (stopping && tasks.empty())
+        return;
+      task = move(tasks.front());
+      tasks.pop();
+    }
+    task();
+  }
+}
@@ -0,0 +1,36 @@
+#include "UniformBlock.h"
+#include "UniformStats.h"
+#include <glad/glad.h>
+
+#include <cstring>
+#include <iostream>
+
+using namespace std;
+
+UniformBlock::UniformBlock(unsigned int binding, size_t size)
+    : binding(binding), size(size) {
+  glGenBuffers(1, &buffer);
+  glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+  glBufferData(GL_UNIFORM_BUFFER, size, nullptr, GL_STREAM_DRAW);
+  glBindBuffer(GL_UNIFORM_BUFFER, 0);
+  glBindBufferBase(GL_UNIFORM_BUFFER, binding, buffer);
+}
+
+UniformBlock::~UniformBlock() { glDeleteBuffers(1, &buffer); }
+
+void UniformBlock::write(const void *data) {
+  glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+  // Invalidating the whole buffer lets the driver hand out new storage.
+  void *mapped =
+      glMapBufferRange(GL_UNIFORM_BUFFER, 0, size,
+                       GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+  if (mapped != nullptr) {
+    memcpy(mapped, data, size);
+    glUnmapBuffer(GL_UNIFORM_BUFFER);
+    if (UniformStats *stats = UniformStats::active())
+      stats->addBlockWrite(size);
+  } else {
+    cout << "Uniform block " << binding << ": the buffer could not be mapped\n";
+  }
+  glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
@@ -0,0 +1,30 @@
+#include "UniformStats.h"
+#include <iostream>
+
+using namespace std;
+
+namespace {
+UniformStats *activeStats = nullptr;
+} // namespace
+
+void UniformStats::endFrame() { frames++; }
+
+void UniformStats::print() {
+  if (frames == 0)
+    return;
+  cout << "Uniforms over " << frames
+       << " frames: " << static_cast<double>(uploads) / frames
+       << " uploads and " << static_cast<double>(skipped) / frames
+       << " redundant ones skipped, "
+       << static_cast<double>(blockWrites) / frames << " block writes ("
+       << static_cast<double>(blockBytes) / frames << " bytes) per frame\n";
+  frames = 0;
+  uploads = 0;
+  skipped = 0;
+  blockWrites = 0;
+  blockBytes = 0;
+}
+
+UniformStats *UniformStats::active() { return activeStats; }
+
+void UniformStats::setActive(UniformStats *stats) { activeStats = stats; }
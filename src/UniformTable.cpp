@@ -0,0 +1,203 @@
+#include "UniformTable.h"
+#include <glad/glad.h>
+#include <glm/gtc/type_ptr.hpp>
+
+#include <algorithm>
+#include <iostream>
+
+using namespace std;
+
+void UniformTable::build(unsigned int program) {
+  this->program = program;
+  entries.clear();
+  locations.clear();
+  values.clear();
+
+  GLint count = 0, maxLength = 0;
+  glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &count);
+  glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+  vector<char> nameBuffer(max(maxLength, 1));
+  auto add = [&](const string &name, int location, GLenum type) {
+    Entry entry;
+    entry.hash = fnv1a64(name.data(), name.size());
+    entry.location = location;
+    entry.type = type;
+    entry.offset = values.size();
+    entry.size = typeSize(type);
+    entry.name = name;
+    entries.push_back(entry);
+  };
+  for (GLint i = 0; i < count; ++i) {
+    GLint size = 0;
+    GLenum type = 0;
+    glGetActiveUniform(program, i, static_cast<GLsizei>(nameBuffer.size()),
+                       nullptr, &size, &type, nameBuffer.data());
+    string name(nameBuffer.data());
+    size_t bracket = name.rfind("[0]");
+    bool array = bracket != string::npos && bracket + 3 == name.size();
+    if (array)
+      name.erase(bracket);
+    for (GLint element = 0; element < (array ? size : 1); ++element) {
+      string elementName =
+          array ? name + "[" + to_string(element) + "]" : name;
+      // Uniforms of blocks have no location.
+      int location = glGetUniformLocation(program, elementName.c_str());
+      if (location < 0)
+        continue;
+      // The first element is also "name", with the same value.
+      if (array)
+        add(elementName, location, type);
+      if (element == 0)
+        add(name, location, type);
+      size_t valueSize = typeSize(type);
+      values.resize(values.size() + valueSize);
+      if (valueSize == 0)
+        continue;
+      // The initial value, zero unless the shader sets one.
+      void *copy = values.data() + entries.back().offset;
+      switch (type) {
+      case GL_UNSIGNED_INT:
+      case GL_UNSIGNED_INT_VEC2:
+      case GL_UNSIGNED_INT_VEC3:
+      case GL_UNSIGNED_INT_VEC4:
+        glGetUniformuiv(program, location, static_cast<GLuint *>(copy));
+        break;
+      case GL_FLOAT:
+      case GL_FLOAT_VEC2:
+      case GL_FLOAT_VEC3:
+      case GL_FLOAT_VEC4:
+      case GL_FLOAT_MAT2:
+      case GL_FLOAT_MAT3:
+      case GL_FLOAT_MAT4:
+        glGetUniformfv(program, location, static_cast<GLfloat *>(copy));
+        break;
+      default:
+        glGetUniformiv(program, location, static_cast<GLint *>(copy));
+      }
+    }
+  }
+
+  sort(entries.begin(), entries.end(),
+       [](const Entry &a, const Entry &b) { return a.hash < b.hash; });
+  for (size_t i = 0; i < entries.size(); ++i) {
+    int location = entries[i].location;
+    if (location >= static_cast<int>(locations.size()))
+      locations.resize(location + 1, -1);
+    locations[location] = static_cast<int>(i);
+  }
+}
+
+int UniformTable::find(UniformID name) const {
+  auto it = lower_bound(
+      entries.begin(), entries.end(), name.hash,
+      [](const Entry &entry, uint64_t hash) { return entry.hash < hash; });
+  if (it == entries.end() || it->hash != name.hash)
+    return -1;
+  return static_cast<int>(it - entries.begin());
+}
+
+int UniformTable::findLocation(int location) const {
+  if (location < 0 || location >= static_cast<int>(locations.size()))
+    return -1;
+  return locations[location];
+}
+
+void UniformTable::upload(unsigned int program, int location, int value) {
+  glProgramUniform1i(program, location, value);
+}
+
+void UniformTable::upload(unsigned int program, int location, float value) {
+  glProgramUniform1f(program, location, value);
+}
+
+void UniformTable::upload(unsigned int program, int location,
+                          const glm::vec2 &vec) {
+  glProgramUniform2fv(program, location, 1, glm::value_ptr(vec));
+}
+
+void UniformTable::upload(unsigned int program, int location,
+                          const glm::vec3 &vec) {
+  glProgramUniform3fv(program, location, 1, glm::value_ptr(vec));
+}
+
+void UniformTable::upload(unsigned int program, int location,
+                          const glm::vec4 &vec) {
+  glProgramUniform4fv(program, location, 1, glm::value_ptr(vec));
+}
+
+void UniformTable::upload(unsigned int program, int location,
+                          const glm::mat2 &mat) {
+  glProgramUniformMatrix2fv(program, location, 1, GL_FALSE,
+                            glm::value_ptr(mat));
+}
+
+void UniformTable::upload(unsigned int program, int location,
+                          const glm::mat3 &mat) {
+  glProgramUniformMatrix3fv(program, location, 1, GL_FALSE,
+                            glm::value_ptr(mat));
+}
+
+void UniformTable::upload(unsigned int program, int location,
+                          const glm::mat4 &mat) {
+  glProgramUniformMatrix4fv(program, location, 1, GL_FALSE,
+                            glm::value_ptr(mat));
+}
+
+size_t UniformTable::typeSize(unsigned int type) {
+  switch (type) {
+  case GL_FLOAT:
+    return sizeof(float);
+  case GL_FLOAT_VEC2:
+    return sizeof(glm::vec2);
+  case GL_FLOAT_VEC3:
+    return sizeof(glm::vec3);
+  case GL_FLOAT_VEC4:
+    return sizeof(glm::vec4);
+  case GL_FLOAT_MAT2:
+    return sizeof(glm::mat2);
+  case GL_FLOAT_MAT3:
+    return sizeof(glm::mat3);
+  case GL_FLOAT_MAT4:
+    return sizeof(glm::mat4);
+  case GL_INT_VEC2:
+  case GL_BOOL_VEC2:
+  case GL_UNSIGNED_INT_VEC2:
+    return 2 * sizeof(int);
+  case GL_INT_VEC3:
+  case GL_BOOL_VEC3:
+  case GL_UNSIGNED_INT_VEC3:
+    return 3 * sizeof(int);
+  case GL_INT_VEC4:
+  case GL_BOOL_VEC4:
+  case GL_UNSIGNED_INT_VEC4:
+    return 4 * sizeof(int);
+  case GL_FLOAT_MAT2x3:
+  case GL_FLOAT_MAT2x4:
+  case GL_FLOAT_MAT3x2:
+  case GL_FLOAT_MAT3x4:
+  case GL_FLOAT_MAT4x2:
+  case GL_FLOAT_MAT4x3:
+  case GL_DOUBLE:
+  case GL_DOUBLE_VEC2:
+  case GL_DOUBLE_VEC3:
+  case GL_DOUBLE_VEC4:
+  case GL_DOUBLE_MAT2:
+  case GL_DOUBLE_MAT3:
+  case GL_DOUBLE_MAT4:
+  case GL_DOUBLE_MAT2x3:
+  case GL_DOUBLE_MAT2x4:
+  case GL_DOUBLE_MAT3x2:
+  case GL_DOUBLE_MAT3x4:
+  case GL_DOUBLE_MAT4x2:
+  case GL_DOUBLE_MAT4x3:
+    // No setter takes these.
+    return 0;
+  default:
+    // int, bool, unsigned int and the samplers and images.
+    return sizeof(int);
+  }
+}
+
+void UniformTable::typeMismatch(const string &name) {
+  cout << "ERROR::SHADER::UNIFORM_TYPE_MISMATCH " << name << endl;
+}
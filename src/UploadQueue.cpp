@@ -0,0 +1,294 @@
+#include "UploadQueue.h"
+#include "gl_extensions.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+using namespace std;
+
+namespace {
+UploadQueue *activeQueue = nullptr;
+const size_t STAGING_ALIGNMENT = 16;
+
+size_t alignUp(size_t value, size_t alignment) {
+  return (value + alignment - 1) / alignment * alignment;
+}
+} // namespace
+
+UploadQueue::UploadQueue(size_t stagingSize, size_t frameBudget)
+    : mapped(nullptr), capacity(alignUp(stagingSize, STAGING_ALIGNMENT)),
+      head(0), tail(0), used(0), frameBudget(max<size_t>(frameBudget, 1)),
+      frameBytes(0), nextTicket(1), completedTicket(0), submittedTicket(0) {
+  glGenBuffers(1, &staging);
+  // GL has no empty buffer storage, every upload of the queue is rejected.
+  if (capacity == 0)
+    return;
+  glBindBuffer(GL_COPY_READ_BUFFER, staging);
+  if (glext::bufferStorage) {
+    GLbitfield flags =
+        GL_MAP_WRITE_BIT | glext::MAP_PERSISTENT_BIT | glext::MAP_COHERENT_BIT;
+    glext::BufferStorage(GL_COPY_READ_BUFFER, capacity, nullptr, flags);
+    mapped = static_cast<unsigned char *>(
+        glMapBufferRange(GL_COPY_READ_BUFFER, 0, capacity, flags));
+  } else {
+    glBufferData(GL_COPY_READ_BUFFER, capacity, nullptr, GL_STREAM_DRAW);
+  }
+  glBindBuffer(GL_COPY_READ_BUFFER, 0);
+}
+
+UploadQueue::~UploadQueue() {
+  for (Frame &frame : frames)
+    glDeleteSync(frame.fence);
+  if (mapped != nullptr) {
+    glBindBuffer(GL_COPY_READ_BUFFER, staging);
+    glUnmapBuffer(GL_COPY_READ_BUFFER);
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+  }
+  glDeleteBuffers(1, &staging);
+  if (activeQueue == this)
+    activeQueue = nullptr;
+}
+
+uint64_t UploadQueue::queueTexture(unsigned int texture, GLint level,
+                                   int width, int height, GLenum format,
+                                   int nrComponents,
+                                   shared_ptr<const unsigned char> pixels,
+                                   bool generateMips) {
+  size_t rowSize = static_cast<size_t>(width) * nrComponents;
+  if (rowSize == 0 || height <= 0)
+    return 0;
+  Job job{};
+  job.ticket = nextTicket++;
+  job.isTexture = true;
+  job.object = texture;
+  job.level = level;
+  job.width = width;
+  job.height = height;
+  job.format = format;
+  job.rowSize = rowSize;
+  job.generateMips = generateMips;
+  job.data = move(pixels);
+  job.size = rowSize * height;
+  textureTickets[texture] = job.ticket;
+  jobs.push_back(move(job));
+  return jobs.back().ticket;
+}
+
+uint64_t UploadQueue::queueBuffer(unsigned int buffer, size_t offset,
+                                  const void *data, size_t size) {
+  if (size == 0)
+    return 0;
+  unsigned char *copy = new unsigned char[size];
+  memcpy(copy, data, size);
+  Job job{};
+  job.ticket = nextTicket++;
+  job.isTexture = false;
+  job.object = buffer;
+  job.dstOffset = offset;
+  job.data.reset(copy, default_delete<unsigned char[]>());
+  job.size = size;
+  jobs.push_back(move(job));
+  return jobs.back().ticket;
+}
+
+void UploadQueue::processFrame() {
+  retireFrames(false);
+
+  frameBytes = 0;
+  size_t frameStart = used;
+  while (!jobs.empty() && frameBytes < frameBudget) {
+    Job &job = jobs.front();
+    if (!submitChunk(job, frameBudget - frameBytes)) {
+      // Nothing is in flight, the chunk is larger than the whole ring.
+      if (used == 0) {
+        rejectJob();
+        continue;
+      }
+      break;
+    }
+    if (job.submitted == job.size)
+      jobs.pop_front();
+  }
+
+  if (used != frameStart) {
+    GLsync fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    // Jobs are submitted in ticket order, so every ticket before the first
+    // unfinished job is covered by this fence.
+    uint64_t ticket = jobs.empty() ? nextTicket - 1 : jobs.front().ticket - 1;
+    frames.push_back({fence, ticket, head, used - frameStart});
+    submittedTicket = max(submittedTicket, ticket);
+  }
+}
+
+void UploadQueue::finish() {
+  while (!jobs.empty()) {
+    processFrame();
+    // Free the ring if the queue is stalled on staging space.
+    if (!jobs.empty())
+      retireFrames(true);
+  }
+  retireFrames(true);
+}
+
+bool UploadQueue::isReady(uint64_t ticket) {
+  if (ticket <= completedTicket)
+    return true;
+  if (ticket <= submittedTicket)
+    retireFrames(false);
+  return ticket <= completedTicket;
+}
+
+bool UploadQueue::isTextureReady(unsigned int texture) {
+  auto iter = textureTickets.find(texture);
+  if (iter == textureTickets.end())
+    return true;
+  if (!isReady(iter->second))
+    return false;
+  textureTickets.erase(iter);
+  return true;
+}
+
+size_t UploadQueue::pendingBytes() const {
+  size_t pending = 0;
+  for (const Job &job : jobs)
+    pending += job.size - job.submitted;
+  return pending;
+}
+
+UploadQueue *UploadQueue::active() { return activeQueue; }
+
+void UploadQueue::setActive(UploadQueue *queue) { activeQueue = queue; }
+
+void UploadQueue::retireFrames(bool wait) {
+  while (!frames.empty()) {
+    Frame &frame = frames.front();
+    GLuint64 timeout = wait ? GL_TIMEOUT_IGNORED : 0;
+    GLenum status =
+        glClientWaitSync(frame.fence, GL_SYNC_FLUSH_COMMANDS_BIT, timeout);
+    if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+      return;
+    glDeleteSync(frame.fence);
+    completedTicket = max(completedTicket, frame.lastTicket);
+    tail = frame.end;
+    used -= frame.bytes;
+    frames.pop_front();
+  }
+}
+
+bool UploadQueue::submitChunk(Job &job, size_t budget) {
+  size_t remaining = job.size - job.submitted;
+  size_t chunk = min(remaining, min(budget, capacity / 2));
+  size_t column = 0;
+  if (job.isTexture && job.rowSize <= capacity / 2) {
+    // Textures are copied in whole rows, at least one row per frame.
+    size_t rows = max<size_t>(chunk / job.rowSize, 1);
+    chunk = min(remaining, rows * job.rowSize);
+  } else if (job.isTexture) {
+    // Rows too wide for the ring go in pieces of a row, at least a pixel.
+    size_t pixelSize = job.rowSize / job.width;
+    column = job.submitted % job.rowSize;
+    chunk = max(min(chunk, job.rowSize - column) / pixelSize * pixelSize,
+                pixelSize);
+  }
+  if (chunk == 0)
+    return false;
+
+  size_t offset;
+  if (!allocateStaging(alignUp(chunk, STAGING_ALIGNMENT), offset))
+    return false;
+  writeStaging(offset, job.data.get() + job.submitted, chunk);
+
+  if (job.isTexture) {
+    size_t pixelSize = job.rowSize / job.width;
+    GLint x = static_cast<GLint>(column / pixelSize);
+    GLint firstRow = static_cast<GLint>(job.submitted / job.rowSize);
+    GLsizei width = job.width;
+    GLsizei numRows = static_cast<GLsizei>(chunk / job.rowSize);
+    if (chunk < job.rowSize) {
+      width = static_cast<GLsizei>(chunk / pixelSize);
+      numRows = 1;
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, staging);
+    glBindTexture(GL_TEXTURE_2D, job.object);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexSubImage2D(GL_TEXTURE_2D, job.level, x, firstRow, width, numRows,
+                    job.format, GL_UNSIGNED_BYTE,
+                    reinterpret_cast<void *>(offset));
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    if (job.submitted + chunk == job.size && job.generateMips)
+      glGenerateMipmap(GL_TEXTURE_2D);
+  } else {
+    glBindBuffer(GL_COPY_READ_BUFFER, staging);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, job.object);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, offset,
+                        job.dstOffset + job.submitted, chunk);
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+  }
+
+  job.submitted += chunk;
+  frameBytes += chunk;
+  // Drop the source data as soon as it has been copied to the ring.
+  if (job.submitted == job.size)
+    job.data.reset();
+  return true;
+}
+
+void UploadQueue::rejectJob() {
+  Job &job = jobs.front();
+  cout << "ERROR::UPLOAD_QUEUE::CHUNK_TOO_LARGE: " << job.size - job.submitted
+       << " bytes left of upload " << job.ticket << " do not fit in "
+       << capacity << " bytes of staging\n";
+  // Every ticket before it is complete, nothing is in flight. Waiting for
+  // it would never end, so it counts as done with its data dropped.
+  completedTicket = max(completedTicket, job.ticket);
+  submittedTicket = max(submittedTicket, job.ticket);
+  jobs.pop_front();
+}
+
+bool UploadQueue::allocateStaging(size_t size, size_t &offset) {
+  if (size > capacity - used)
+    return false;
+  if (used == 0)
+    head = tail = 0;
+
+  if (head >= tail) {
+    // Free space is [head, capacity) followed by [0, tail).
+    if (capacity - head >= size) {
+      offset = head;
+    } else if (tail >= size) {
+      // Wrap around, the skipped end of the ring counts as used until the
+      // frame that skipped it retires.
+      used += capacity - head;
+      offset = 0;
+    } else {
+      return false;
+    }
+  } else if (tail - head >= size) {
+    offset = head;
+  } else {
+    return false;
+  }
+  head = offset + size;
+  used += size;
+  return true;
+}
+
+void UploadQueue::writeStaging(size_t offset, const unsigned char *src,
+                               size_t size) {
+  if (mapped != nullptr) {
+    memcpy(mapped + offset, src, size);
+    return;
+  }
+  // The range is guaranteed free by the fences, so skip synchronization.
+  glBindBuffer(GL_COPY_READ_BUFFER, staging);
+  void *dst = glMapBufferRange(GL_COPY_READ_BUFFER, offset, size,
+                               GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT |
+                                   GL_MAP_INVALIDATE_RANGE_BIT);
+  if (dst != nullptr) {
+    memcpy(dst, src, size);
+    glUnmapBuffer(GL_COPY_READ_BUFFER);
+  }
+  glBindBuffer(GL_COPY_READ_BUFFER, 0);
+}
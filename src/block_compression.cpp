@@ -0,0 +1,310 @@
+#include "block_compression.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+using namespace std;
+
+namespace {
+
+const int BC7_WEIGHTS[16] = {0,  4,  9,  13, 17, 21, 26, 30,
+                             34, 38, 43, 47, 51, 55, 60, 64};
+
+// Fit a line through the pixels of a block (using the first numChannels
+// channels) and return the extreme points of its projection.
+void fitEndpoints(const unsigned char *block, int numChannels, float *start,
+                  float *end) {
+  float mean[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+  for (int i = 0; i < 16; ++i)
+    for (int c = 0; c < numChannels; ++c)
+      mean[c] += block[i * 4 + c];
+  for (int c = 0; c < numChannels; ++c)
+    mean[c] /= 16.0f;
+
+  float cov[4][4] = {};
+  for (int i = 0; i < 16; ++i) {
+    float d[4];
+    for (int c = 0; c < numChannels; ++c)
+      d[c] = block[i * 4 + c] - mean[c];
+    for (int a = 0; a < numChannels; ++a)
+      for (int b = 0; b < numChannels; ++b)
+        cov[a][b] += d[a] * d[b];
+  }
+
+  // Power iteration for the principal axis.
+  float axis[4] = {1.0f, 1.0f, 1.0f, 1.0f};
+  for (int iter = 0; iter < 8; ++iter) {
+    float next[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+    float length = 0.0f;
+    for (int a = 0; a < numChannels; ++a) {
+      for (int b = 0; b < numChannels; ++b)
+        next[a] += cov[a][b] * axis[b];
+      length = max(length, fabs(next[a]));
+    }
+    if (length == 0.0f)
+      break;
+    for (int a = 0; a < numChannels; ++a)
+      axis[a] = next[a] / length;
+  }
+
+  float minT = 0.0f, maxT = 0.0f;
+  float axisLength2 = 0.0f;
+  for (int c = 0; c < numChannels; ++c)
+    axisLength2 += axis[c] * axis[c];
+  for (int i = 0; i < 16; ++i) {
+    float t = 0.0f;
+    for (int c = 0; c < numChannels; ++c)
+      t += (block[i * 4 + c] - mean[c]) * axis[c];
+    t /= axisLength2;
+    minT = min(minT, t);
+    maxT = max(maxT, t);
+  }
+  for (int c = 0; c < numChannels; ++c) {
+    start[c] = min(max(mean[c] + minT * axis[c], 0.0f), 255.0f);
+    end[c] = min(max(mean[c] + maxT * axis[c], 0.0f), 255.0f);
+  }
+}
+
+uint16_t packRGB565(const float *color) {
+  int r = static_cast<int>(lround(color[0] * 31.0f / 255.0f));
+  int g = static_cast<int>(lround(color[1] * 63.0f / 255.0f));
+  int b = static_cast<int>(lround(color[2] * 31.0f / 255.0f));
+  return static_cast<uint16_t>((r << 11) | (g << 5) | b);
+}
+
+void unpackRGB565(uint16_t packed, int *color) {
+  int r = (packed >> 11) & 31, g = (packed >> 5) & 63, b = packed & 31;
+  color[0] = (r << 3) | (r >> 2);
+  color[1] = (g << 2) | (g >> 4);
+  color[2] = (b << 3) | (b >> 2);
+}
+
+int squaredDistance(const unsigned char *pixel, const int *color,
+                    int numChannels) {
+  int dist = 0;
+  for (int c = 0; c < numChannels; ++c) {
+    int d = pixel[c] - color[c];
+    dist += d * d;
+  }
+  return dist;
+}
+
+void writeLE16(unsigned char *out, uint16_t value) {
+  out[0] = static_cast<unsigned char>(value);
+  out[1] = static_cast<unsigned char>(value >> 8);
+}
+
+class BitWriter {
+public:
+  BitWriter(unsigned char *out, size_t size) : out(out), pos(0) {
+    memset(out, 0, size);
+  }
+
+  void write(uint32_t value, unsigned int numBits) {
+    for (unsigned int i = 0; i < numBits; ++i, ++pos)
+      out[pos >> 3] |= ((value >> i) & 1) << (pos & 7);
+  }
+
+private:
+  unsigned char *out;
+  unsigned int pos;
+};
+
+// Quantize an endpoint to 7 bits per channel plus a shared p-bit, picking the
+// p-bit with the lowest error.
+void quantizeBC7Endpoint(const float *color, int *quantized, int &pBit) {
+  float bestError = -1.0f;
+  for (int p = 0; p < 2; ++p) {
+    int candidate[4];
+    float error = 0.0f;
+    for (int c = 0; c < 4; ++c) {
+      int q = static_cast<int>(lround((color[c] - p) / 2.0f));
+      candidate[c] = min(max(q, 0), 127);
+      float d = color[c] - (candidate[c] * 2 + p);
+      error += d * d;
+    }
+    if (bestError < 0.0f || error < bestError) {
+      bestError = error;
+      pBit = p;
+      copy(candidate, candidate + 4, quantized);
+    }
+  }
+}
+
+} // namespace
+
+void bc::encodeBC1(const unsigned char *block, unsigned char *out) {
+  float start[3], end[3];
+  fitEndpoints(block, 3, start, end);
+  uint16_t c0 = packRGB565(end);
+  uint16_t c1 = packRGB565(start);
+  // c0 > c1 selects the opaque four color mode.
+  if (c0 < c1)
+    swap(c0, c1);
+  writeLE16(out, c0);
+  writeLE16(out + 2, c1);
+
+  uint32_t indices = 0;
+  if (c0 != c1) {
+    int palette[4][3];
+    unpackRGB565(c0, palette[0]);
+    unpackRGB565(c1, palette[1]);
+    for (int c = 0; c < 3; ++c) {
+      palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+      palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+    }
+    for (int i = 0; i < 16; ++i) {
+      int best = 0;
+      int bestDist = squaredDistance(block + i * 4, palette[0], 3);
+      for (int j = 1; j < 4; ++j) {
+        int dist = squaredDistance(block + i * 4, palette[j], 3);
+        if (dist < bestDist) {
+          best = j;
+          bestDist = dist;
+        }
+      }
+      indices |= static_cast<uint32_t>(best) << (2 * i);
+    }
+  }
+  for (int i = 0; i < 4; ++i)
+    out[4 + i] = static_cast<unsigned char>(indices >> (8 * i));
+}
+
+void bc::encodeBC4(const unsigned char *block, int channel,
+                   unsigned char *out) {
+  int lo = 255, hi = 0;
+  for (int i = 0; i < 16; ++i) {
+    lo = min(lo, static_cast<int>(block[i * 4 + channel]));
+    hi = max(hi, static_cast<int>(block[i * 4 + channel]));
+  }
+  // r0 > r1 selects the eight value mode, with equal endpoints every index
+  // is 0 and decodes to r0 in either mode.
+  out[0] = static_cast<unsigned char>(hi);
+  out[1] = static_cast<unsigned char>(lo);
+
+  uint64_t indices = 0;
+  if (hi != lo) {
+    float palette[8];
+    palette[0] = static_cast<float>(hi);
+    palette[1] = static_cast<float>(lo);
+    for (int j = 2; j < 8; ++j)
+      palette[j] = ((8 - j) * hi + (j - 1) * lo) / 7.0f;
+    for (int i = 0; i < 16; ++i) {
+      float value = block[i * 4 + channel];
+      int best = 0;
+      for (int j = 1; j < 8; ++j) {
+        if (fabs(palette[j] - value) < fabs(palette[best] - value))
+          best = j;
+      }
+      indices |= static_cast<uint64_t>(best) << (3 * i);
+    }
+  }
+  for (int i = 0; i < 6; ++i)
+    out[2 + i] = static_cast<unsigned char>(indices >> (8 * i));
+}
+
+void bc::encodeBC5(const unsigned char *block, unsigned char *out) {
+  encodeBC4(block, 0, out);
+  encodeBC4(block, 1, out + 8);
+}
+
+void bc::encodeBC7(const unsigned char *block, unsigned char *out) {
+  float start[4], end[4];
+  fitEndpoints(block, 4, start, end);
+  int endpoints[2][4];
+  int pBits[2];
+  quantizeBC7Endpoint(start, endpoints[0], pBits[0]);
+  quantizeBC7Endpoint(end, endpoints[1], pBits[1]);
+
+  int palette[16][4];
+  for (int j = 0; j < 16; ++j) {
+    for (int c = 0; c < 4; ++c) {
+      int e0 = endpoints[0][c] * 2 + pBits[0];
+      int e1 = endpoints[1][c] * 2 + pBits[1];
+      palette[j][c] =
+          ((64 - BC7_WEIGHTS[j]) * e0 + BC7_WEIGHTS[j] * e1 + 32) >> 6;
+    }
+  }
+  int indices[16];
+  for (int i = 0; i < 16; ++i) {
+    int best = 0;
+    int bestDist = squaredDistance(block + i * 4, palette[0], 4);
+    for (int j = 1; j < 16; ++j) {
+      int dist = squaredDistance(block + i * 4, palette[j], 4);
+      if (dist < bestDist) {
+        best = j;
+        bestDist = dist;
+      }
+    }
+    indices[i] = best;
+  }
+  // The most significant bit of the first index is implicitly 0.
+  if (indices[0] >= 8) {
+    swap(endpoints[0], endpoints[1]);
+    swap(pBits[0], pBits[1]);
+    for (int i = 0; i < 16; ++i)
+      indices[i] = 15 - indices[i];
+  }
+
+  BitWriter bits(out, 16);
+  bits.write(1 << 6, 7);
+  for (int c = 0; c < 4; ++c) {
+    bits.write(endpoints[0][c], 7);
+    bits.write(endpoints[1][c], 7);
+  }
+  bits.write(pBits[0], 1);
+  bits.write(pBits[1], 1);
+  bits.write(indices[0], 3);
+  for (int i = 1; i < 16; ++i)
+    bits.write(indices[i], 4);
+}
+
+size_t bc::blockSize(Format format) {
+  return format == Format::BC1 || format == Format::BC4 ? 8 : 16;
+}
+
+size_t bc::compressedSize(Format format, int width, int height) {
+  size_t blocksX = (width + 3) / 4, blocksY = (height + 3) / 4;
+  return blocksX * blocksY * blockSize(format);
+}
+
+vector<unsigned char> bc::compressImage(const unsigned char *rgba, int width,
+                                        int height, Format format) {
+  size_t blocksX = (width + 3) / 4, blocksY = (height + 3) / 4;
+  size_t size = blockSize(format);
+  vector<unsigned char> blocks(blocksX * blocksY * size);
+
+  ThreadPool::shared().parallelFor(blocksY, [&](size_t begin, size_t end) {
+    unsigned char block[64];
+    for (size_t by = begin; by < end; ++by) {
+      for (size_t bx = 0; bx < blocksX; ++bx) {
+        for (int y = 0; y < 4; ++y) {
+          int py = min(static_cast<int>(by * 4) + y, height - 1);
+          for (int x = 0; x < 4; ++x) {
+            int px = min(static_cast<int>(bx * 4) + x, width - 1);
+            memcpy(block + (y * 4 + x) * 4,
+                   rgba + (static_cast<size_t>(py) * width + px) * 4, 4);
+          }
+        }
+        unsigned char *out = blocks.data() + (by * blocksX + bx) * size;
+        switch (format) {
+        case Format::BC1:
+          encodeBC1(block, out);
+          break;
+        case Format::BC4:
+          encodeBC4(block, 0, out);
+          break;
+        case Format::BC5:
+          encodeBC5(block, out);
+          break;
+        case Format::BC7:
+          encodeBC7(block, out);
+          break;
+        }
+      }
+    }
+  });
+  return blocks;
+}
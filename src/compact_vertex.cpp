@@ -0,0 +1,154 @@
+#include "compact_vertex.h"
+#include <algorithm>
+#include <cmath>
+#include <glm/gtc/packing.hpp>
+
+using namespace std;
+
+namespace {
+
+const float UNORM16_MAX = 65535.0f;
+
+// Octahedral projection of a unit vector onto [-1, 1]^2.
+glm::vec2 toOctahedron(glm::vec3 v) {
+  v /= fabs(v.x) + fabs(v.y) + fabs(v.z);
+  glm::vec2 p(v.x, v.y);
+  if (v.z < 0.0f) {
+    p = glm::vec2((1.0f - fabs(v.y)) * (v.x >= 0.0f ? 1.0f : -1.0f),
+                  (1.0f - fabs(v.x)) * (v.y >= 0.0f ? 1.0f : -1.0f));
+  }
+  return p;
+}
+
+glm::vec3 fromOctahedron(glm::vec2 p) {
+  glm::vec3 v(p.x, p.y, 1.0f - fabs(p.x) - fabs(p.y));
+  float t = max(-v.z, 0.0f);
+  v.x += v.x >= 0.0f ? -t : t;
+  v.y += v.y >= 0.0f ? -t : t;
+  return glm::normalize(v);
+}
+
+float angleDegrees(glm::vec3 a, glm::vec3 b) {
+  float cosine = glm::dot(glm::normalize(a), glm::normalize(b));
+  return glm::degrees(acos(min(max(cosine, -1.0f), 1.0f)));
+}
+
+} // namespace
+
+compact::Bounds compact::computeBounds(const vector<Vertex> &vertices) {
+  Bounds bounds;
+  if (vertices.empty())
+    return bounds;
+  glm::vec3 lower = vertices[0].position, upper = vertices[0].position;
+  for (const Vertex &vertex : vertices) {
+    lower = glm::min(lower, vertex.position);
+    upper = glm::max(upper, vertex.position);
+  }
+  bounds.offset = lower;
+  bounds.scale = upper - lower;
+  // Flat meshes still need a non-zero scale on every axis.
+  for (int i = 0; i < 3; ++i) {
+    if (bounds.scale[i] <= 0.0f)
+      bounds.scale[i] = 1.0f;
+  }
+  return bounds;
+}
+
+uint32_t compact::encodeDirection(glm::vec3 direction) {
+  if (glm::dot(direction, direction) == 0.0f)
+    direction = glm::vec3(1.0f, 0.0f, 0.0f);
+  direction = glm::normalize(direction);
+
+  // Try both roundings of each coordinate and keep the closest, this halves
+  // the error of plain rounding.
+  glm::vec2 p = toOctahedron(direction) * 511.0f;
+  uint32_t best = 0;
+  float bestCosine = -2.0f;
+  for (int i = 0; i < 4; ++i) {
+    glm::vec2 q((i & 1) ? ceil(p.x) : floor(p.x),
+                (i & 2) ? ceil(p.y) : floor(p.y));
+    q = glm::clamp(q / 511.0f, -1.0f, 1.0f);
+    uint32_t packed = glm::packSnorm3x10_1x2(glm::vec4(q, 0.0f, 0.0f));
+    float cosine = glm::dot(decodeDirection(packed), direction);
+    if (cosine > bestCosine) {
+      bestCosine = cosine;
+      best = packed;
+    }
+  }
+  return best;
+}
+
+glm::vec3 compact::decodeDirection(uint32_t packed) {
+  glm::vec4 v = glm::unpackSnorm3x10_1x2(packed);
+  return fromOctahedron(glm::vec2(v.x, v.y));
+}
+
+CompactVertex compact::encode(const Vertex &vertex, const Bounds &bounds) {
+  CompactVertex result;
+  glm::vec3 normalized = (vertex.position - bounds.offset) / bounds.scale;
+  for (int i = 0; i < 3; ++i) {
+    float value = min(max(normalized[i], 0.0f), 1.0f);
+    result.position[i] = static_cast<uint16_t>(value * UNORM16_MAX + 0.5f);
+  }
+  result.position[3] = 0;
+  result.normal = encodeDirection(vertex.normal);
+  result.texCoord[0] = glm::packHalf1x16(vertex.texCoord.x);
+  result.texCoord[1] = glm::packHalf1x16(vertex.texCoord.y);
+  result.tangent = encodeDirection(vertex.tangent);
+  return result;
+}
+
+Vertex compact::decode(const CompactVertex &vertex, const Bounds &bounds) {
+  Vertex result;
+  glm::vec3 normalized(vertex.position[0], vertex.position[1],
+                       vertex.position[2]);
+  result.position = bounds.offset + bounds.scale * normalized / UNORM16_MAX;
+  result.normal = decodeDirection(vertex.normal);
+  result.texCoord = glm::vec2(glm::unpackHalf1x16(vertex.texCoord[0]),
+                              glm::unpackHalf1x16(vertex.texCoord[1]));
+  result.tangent = decodeDirection(vertex.tangent);
+  return result;
+}
+
+vector<CompactVertex> compact::encode(const vector<Vertex> &vertices,
+                                      const Bounds &bounds) {
+  vector<CompactVertex> encoded(vertices.size());
+  for (size_t i = 0; i < vertices.size(); ++i)
+    encoded[i] = encode(vertices[i], bounds);
+  return encoded;
+}
+
+void compact::Error::merge(const Error &other) {
+  position = max(position, other.position);
+  relativePosition = max(relativePosition, other.relativePosition);
+  normalDegrees = max(normalDegrees, other.normalDegrees);
+  tangentDegrees = max(tangentDegrees, other.tangentDegrees);
+  texCoord = max(texCoord, other.texCoord);
+}
+
+compact::Error compact::measureError(const vector<Vertex> &vertices,
+                                     const vector<CompactVertex> &encoded,
+                                     const Bounds &bounds) {
+  Error error;
+  for (size_t i = 0; i < vertices.size() && i < encoded.size(); ++i) {
+    const Vertex &original = vertices[i];
+    Vertex decoded = decode(encoded[i], bounds);
+    glm::vec3 offset = glm::abs(decoded.position - original.position);
+    error.position =
+        max(error.position, max(offset.x, max(offset.y, offset.z)));
+    if (glm::dot(original.normal, original.normal) > 0.0f) {
+      error.normalDegrees = max(error.normalDegrees,
+                                angleDegrees(decoded.normal, original.normal));
+    }
+    if (glm::dot(original.tangent, original.tangent) > 0.0f) {
+      error.tangentDegrees =
+          max(error.tangentDegrees,
+              angleDegrees(decoded.tangent, original.tangent));
+    }
+    glm::vec2 uvOffset = glm::abs(decoded.texCoord - original.texCoord);
+    error.texCoord = max(error.texCoord, max(uvOffset.x, uvOffset.y));
+  }
+  float extent = max(bounds.scale.x, max(bounds.scale.y, bounds.scale.z));
+  error.relativePosition = error.position / extent;
+  return error;
+}
@@ -0,0 +1,209 @@
+#include "dds.h"
+#include "MappedFile.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+using namespace std;
+
+namespace {
+
+const char MAGIC[4] = {'D', 'D', 'S', ' '};
+const uint32_t FOURCC_DX10 = 0x30315844;
+// Marks a header written by the baker, stored in reserved1[0].
+const uint32_t BAKER_TAG = 0x4B42544C;
+
+const uint32_t DDSD_CAPS = 0x1;
+const uint32_t DDSD_HEIGHT = 0x2;
+const uint32_t DDSD_WIDTH = 0x4;
+const uint32_t DDSD_PITCH = 0x8;
+const uint32_t DDSD_PIXELFORMAT = 0x1000;
+const uint32_t DDSD_MIPMAPCOUNT = 0x20000;
+const uint32_t DDSD_LINEARSIZE = 0x80000;
+const uint32_t DDPF_FOURCC = 0x4;
+const uint32_t DDSCAPS_COMPLEX = 0x8;
+const uint32_t DDSCAPS_TEXTURE = 0x1000;
+const uint32_t DDSCAPS_MIPMAP = 0x400000;
+const uint32_t DIMENSION_TEXTURE2D = 3;
+
+struct PixelFormat {
+  uint32_t size;
+  uint32_t flags;
+  uint32_t fourCC;
+  uint32_t rgbBitCount;
+  uint32_t masks[4];
+};
+
+struct Header {
+  uint32_t size;
+  uint32_t flags;
+  uint32_t height;
+  uint32_t width;
+  uint32_t pitchOrLinearSize;
+  uint32_t depth;
+  uint32_t mipMapCount;
+  uint32_t reserved1[11];
+  PixelFormat pixelFormat;
+  uint32_t caps[4];
+  uint32_t reserved2;
+};
+
+struct HeaderDX10 {
+  uint32_t dxgiFormat;
+  uint32_t resourceDimension;
+  uint32_t miscFlag;
+  uint32_t arraySize;
+  uint32_t miscFlags2;
+};
+
+const size_t DATA_OFFSET =
+    sizeof(MAGIC) + sizeof(Header) + sizeof(HeaderDX10);
+
+} // namespace
+
+string dds::bakedPath(const string &source) {
+  return filesystem::path(source).replace_extension(".dds").string();
+}
+
+uint32_t dds::bakeFlags(bool flip, bool flipGreen, bool srgb, bool normalMap,
+                        bool clamp, int channel) {
+  uint32_t flags = (flip ? BAKE_FLIP : 0) | (flipGreen ? BAKE_FLIP_GREEN : 0) |
+                   (srgb ? BAKE_SRGB : 0) | (normalMap ? BAKE_NORMAL_MAP : 0) |
+                   (clamp ? BAKE_CLAMP : 0);
+  return flags | static_cast<uint32_t>(channel + 1) << BAKE_CHANNEL_SHIFT;
+}
+
+string dds::cachePath(const string &source, uint32_t flags) {
+  ostringstream path;
+  path << source << ".mips" << hex << flags << ".dds";
+  return path.str();
+}
+
+bool dds::isCompressed(uint32_t format) {
+  return format >= FORMAT_BC1_UNORM && format <= FORMAT_BC7_UNORM_SRGB;
+}
+
+size_t dds::levelSize(uint32_t format, int width, int height) {
+  size_t blocks = static_cast<size_t>((width + 3) / 4) * ((height + 3) / 4);
+  size_t pixels = static_cast<size_t>(width) * height;
+  switch (format) {
+  case FORMAT_R8_UNORM:
+    return pixels;
+  case FORMAT_RG8_UNORM:
+    return pixels * 2;
+  case FORMAT_RGBA8_UNORM:
+  case FORMAT_RGBA8_UNORM_SRGB:
+    return pixels * 4;
+  case FORMAT_BC1_UNORM:
+  case FORMAT_BC1_UNORM_SRGB:
+  case FORMAT_BC4_UNORM:
+    return blocks * 8;
+  case FORMAT_BC5_UNORM:
+  case FORMAT_BC7_UNORM:
+  case FORMAT_BC7_UNORM_SRGB:
+    return blocks * 16;
+  default:
+    return 0;
+  }
+}
+
+unsigned char *dds::read(const string &path, Description &desc) {
+  MappedFile file(path);
+  if (!file.isOpen() || file.size() < DATA_OFFSET)
+    return nullptr;
+
+  const unsigned char *ptr = file.data();
+  Header header;
+  HeaderDX10 header10;
+  memcpy(&header, ptr + sizeof(MAGIC), sizeof(header));
+  memcpy(&header10, ptr + sizeof(MAGIC) + sizeof(header), sizeof(header10));
+  if (memcmp(ptr, MAGIC, sizeof(MAGIC)) != 0 ||
+      header.size != sizeof(Header) ||
+      header.pixelFormat.fourCC != FOURCC_DX10 ||
+      levelSize(header10.dxgiFormat, 1, 1) == 0 ||
+      header10.resourceDimension != DIMENSION_TEXTURE2D ||
+      header10.arraySize > 1 || header.width == 0 || header.height == 0) {
+    cout << "Unsupported DDS file: " << path << endl;
+    return nullptr;
+  }
+
+  Description result;
+  result.format = header10.dxgiFormat;
+  result.width = static_cast<int>(header.width);
+  result.height = static_cast<int>(header.height);
+  result.bakeFlags = header.reserved1[0] == BAKER_TAG ? header.reserved1[1] : 0;
+  uint32_t numLevels = max(header.mipMapCount, 1u);
+  size_t offset = 0;
+  for (uint32_t i = 0; i < numLevels; ++i) {
+    int width = max(result.width >> i, 1);
+    int height = max(result.height >> i, 1);
+    size_t size = levelSize(result.format, width, height);
+    result.levels.push_back({width, height, offset, size});
+    offset += size;
+  }
+  if (file.size() - DATA_OFFSET < offset) {
+    cout << "Truncated DDS file: " << path << endl;
+    return nullptr;
+  }
+
+  unsigned char *data = static_cast<unsigned char *>(malloc(offset));
+  if (data == nullptr)
+    return nullptr;
+  memcpy(data, ptr + DATA_OFFSET, offset);
+  desc = move(result);
+  return data;
+}
+
+bool dds::write(const string &path, const Description &desc,
+                const unsigned char *data) {
+  Header header = {};
+  header.size = sizeof(Header);
+  header.flags = DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT |
+                 DDSD_MIPMAPCOUNT;
+  header.height = static_cast<uint32_t>(desc.height);
+  header.width = static_cast<uint32_t>(desc.width);
+  if (isCompressed(desc.format)) {
+    header.flags |= DDSD_LINEARSIZE;
+    header.pitchOrLinearSize = static_cast<uint32_t>(
+        levelSize(desc.format, desc.width, desc.height));
+  } else {
+    header.flags |= DDSD_PITCH;
+    header.pitchOrLinearSize =
+        static_cast<uint32_t>(levelSize(desc.format, desc.width, 1));
+  }
+  header.mipMapCount = static_cast<uint32_t>(desc.levels.size());
+  header.reserved1[0] = BAKER_TAG;
+  header.reserved1[1] = desc.bakeFlags;
+  header.pixelFormat.size = sizeof(PixelFormat);
+  header.pixelFormat.flags = DDPF_FOURCC;
+  header.pixelFormat.fourCC = FOURCC_DX10;
+  header.caps[0] = DDSCAPS_TEXTURE | DDSCAPS_MIPMAP | DDSCAPS_COMPLEX;
+
+  HeaderDX10 header10 = {desc.format, DIMENSION_TEXTURE2D, 0, 1, 0};
+
+  // Write to a temporary file first so a partial file is never read.
+  string tmpPath = path + ".tmp";
+  ofstream out(tmpPath, ios::binary | ios::trunc);
+  if (!out) {
+    cout << "Could not write DDS file: " << path << endl;
+    return false;
+  }
+  out.write(MAGIC, sizeof(MAGIC));
+  out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  out.write(reinterpret_cast<const char *>(&header10), sizeof(header10));
+  for (const MipLevel &level : desc.levels)
+    out.write(reinterpret_cast<const char *>(data + level.offset), level.size);
+
+  out.close();
+  if (!out || rename(tmpPath.c_str(), path.c_str()) != 0) {
+    cout << "Could not write DDS file: " << path << endl;
+    remove(tmpPath.c_str());
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,47 @@
+#include "gl_extensions.h"
+#include <cstring>
+
+bool glext::bufferStorage = false;
+glext::PFNGLBUFFERSTORAGEPROC glext::BufferStorage = nullptr;
+bool glext::textureCompressionS3TC = false;
+bool glext::parallelShaderCompile = false;
+glext::PFNGLMAXSHADERCOMPILERTHREADSPROC glext::MaxShaderCompilerThreads =
+    nullptr;
+
+void glext::load(GLADloadproc loader) {
+  if (hasVersion(4, 4) || hasExtension("GL_ARB_buffer_storage")) {
+    BufferStorage =
+        reinterpret_cast<PFNGLBUFFERSTORAGEPROC>(loader("glBufferStorage"));
+    bufferStorage = BufferStorage != nullptr;
+  }
+  textureCompressionS3TC = hasExtension("GL_EXT_texture_compression_s3tc");
+  if (hasExtension("GL_KHR_parallel_shader_compile")) {
+    MaxShaderCompilerThreads =
+        reinterpret_cast<PFNGLMAXSHADERCOMPILERTHREADSPROC>(
+            loader("glMaxShaderCompilerThreadsKHR"));
+  } else if (hasExtension("GL_ARB_parallel_shader_compile")) {
+    MaxShaderCompilerThreads =
+        reinterpret_cast<PFNGLMAXSHADERCOMPILERTHREADSPROC>(
+            loader("glMaxShaderCompilerThreadsARB"));
+  }
+  parallelShaderCompile = MaxShaderCompilerThreads != nullptr;
+}
+
+bool glext::hasExtension(const char *name) {
+  int numExtensions = 0;
+  glGetIntegerv(GL_NUM_EXTENSIONS, &numExtensions);
+  for (int i = 0; i < numExtensions; ++i) {
+    const char *ext = reinterpret_cast<const char *>(
+        glGetStringi(GL_EXTENSIONS, static_cast<GLuint>(i)));
+    if (ext != nullptr && strcmp(ext, name) == 0)
+      return true;
+  }
+  return false;
+}
+
+bool glext::hasVersion(int major, int minor) {
+  int ctxMajor = 0, ctxMinor = 0;
+  glGetIntegerv(GL_MAJOR_VERSION, &ctxMajor);
+  glGetIntegerv(GL_MINOR_VERSION, &ctxMinor);
+  return ctxMajor > major || (ctxMajor == major && ctxMinor >= minor);
+}
@@ -0,0 +1,120 @@
+#include "index_buffer.h"
+#include <algorithm>
+
+using namespace std;
+
+namespace {
+
+const unsigned int NO_CHUNK = ~0u;
+
+// End of the chunk starting at begin whose vertices span less than 16 bits,
+// lower is set to its smallest vertex.
+unsigned int growInPlace(const vector<unsigned int> &indices,
+                         unsigned int begin, unsigned int &lower) {
+  unsigned int numIndices = static_cast<unsigned int>(indices.size());
+  lower = indices[begin];
+  unsigned int upper = lower, end = begin;
+  while (end < numIndices) {
+    unsigned int triangleEnd = min(end + 3, numIndices);
+    unsigned int newLower = lower, newUpper = upper;
+    for (unsigned int i = end; i < triangleEnd; ++i) {
+      newLower = min(newLower, indices[i]);
+      newUpper = max(newUpper, indices[i]);
+    }
+    if (newUpper - newLower >= indexbuf::MAX_SHORT_VERTICES)
+      break;
+    lower = newLower;
+    upper = newUpper;
+    end = triangleEnd;
+  }
+  return end;
+}
+
+} // namespace
+
+size_t indexbuf::Layout::indexSize() const {
+  return shortIndices ? sizeof(uint16_t) : sizeof(unsigned int);
+}
+
+indexbuf::Layout indexbuf::plan(const vector<unsigned int> &indices,
+                                size_t numVertices, size_t vertexSize,
+                                vector<uint16_t> &shorts) {
+  Layout layout;
+  unsigned int numIndices = static_cast<unsigned int>(indices.size());
+  shorts.assign(indices.size(), 0);
+  if (numVertices <= MAX_SHORT_VERTICES) {
+    layout.shortIndices = true;
+    layout.chunks.push_back({0, numIndices, 0});
+    copy(indices.begin(), indices.end(), shorts.begin());
+    return layout;
+  }
+
+  // Chunk each vertex was last copied for, and its index there.
+  vector<unsigned int> copiedFor(numVertices, NO_CHUNK);
+  vector<unsigned int> local(numVertices);
+  unsigned int begin = 0;
+  while (begin < numIndices) {
+    unsigned int lower;
+    unsigned int end = growInPlace(indices, begin, lower);
+    if (end > begin &&
+        (end == numIndices || (end - begin) / 3 >= MIN_CHUNK_TRIANGLES)) {
+      layout.chunks.push_back({begin, end - begin, lower});
+      for (unsigned int i = begin; i < end; ++i)
+        shorts[i] = static_cast<uint16_t>(indices[i] - lower);
+      begin = end;
+      continue;
+    }
+
+    // Copy the vertices of the chunk, triangle by triangle while they fit.
+    unsigned int chunk = static_cast<unsigned int>(layout.chunks.size());
+    unsigned int baseVertex =
+        static_cast<unsigned int>(numVertices + layout.extraVertices.size());
+    unsigned int numCopied = 0;
+    for (end = begin; end < numIndices;) {
+      unsigned int triangleEnd = min(end + 3, numIndices);
+      unsigned int added = 0;
+      for (unsigned int i = end; i < triangleEnd; ++i)
+        added += copiedFor[indices[i]] != chunk;
+      if (numCopied + added > MAX_SHORT_VERTICES)
+        break;
+      for (unsigned int i = end; i < triangleEnd; ++i) {
+        unsigned int vertex = indices[i];
+        if (copiedFor[vertex] != chunk) {
+          copiedFor[vertex] = chunk;
+          local[vertex] = numCopied++;
+          layout.extraVertices.push_back(vertex);
+        }
+        shorts[i] = static_cast<uint16_t>(local[vertex]);
+      }
+      end = triangleEnd;
+    }
+    layout.chunks.push_back({begin, end - begin, baseVertex});
+    begin = end;
+  }
+
+  size_t savedBytes =
+      indices.size() * (sizeof(unsigned int) - sizeof(uint16_t));
+  if (layout.extraVertices.size() * vertexSize >= savedBytes) {
+    layout.chunks.assign(1, {0, numIndices, 0});
+    layout.extraVertices.clear();
+    shorts.clear();
+    return layout;
+  }
+  layout.shortIndices = true;
+  return layout;
+}
+
+void indexbuf::splitRange(const Layout &layout, unsigned int firstIndex,
+                          unsigned int numIndices, vector<Chunk> &parts) {
+  unsigned int end = firstIndex + numIndices;
+  // First chunk that ends after firstIndex.
+  auto chunk = upper_bound(layout.chunks.begin(), layout.chunks.end(),
+                           firstIndex, [](unsigned int index, const Chunk &c) {
+                             return index < c.firstIndex + c.numIndices;
+                           });
+  for (; chunk != layout.chunks.end() && chunk->firstIndex < end; ++chunk) {
+    unsigned int begin = max(firstIndex, chunk->firstIndex);
+    unsigned int partEnd = min(end, chunk->firstIndex + chunk->numIndices);
+    parts.push_back({begin, partEnd - begin, chunk->baseVertex});
+  }
+}
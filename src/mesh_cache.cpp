@@ -0,0 +1,230 @@
+#include "mesh_cache.h"
+#include "MappedFile.h"
+#include "hashing.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+using namespace std;
+
+namespace {
+
+const char MAGIC[4] = {'L', 'T', 'M', 'C'};
+
+struct FileHeader {
+  char magic[4];
+  uint32_t version;
+  uint64_t key;
+  uint32_t vertexSize;
+  uint32_t numMeshes;
+  float bounds[14];
+};
+
+struct MeshHeader {
+  uint32_t numVertices;
+  uint32_t numIndices;
+  uint32_t numTextures;
+  uint32_t numLods;
+  uint32_t numMeshlets;
+  float ambient[3];
+  float diffuse[3];
+  float specular[3];
+  float emissive[3];
+  float shininess;
+};
+
+struct TextureHeader {
+  uint32_t typeLength;
+  uint32_t pathLength;
+  uint32_t srgb;
+};
+
+// Sequential reader over the mapped cache that refuses to run past the end.
+class Cursor {
+public:
+  Cursor(const unsigned char *data, size_t size)
+      : data(data), size(size), offset(0) {}
+
+  bool read(void *dst, size_t bytes) {
+    const void *src = take(bytes);
+    if (src == nullptr)
+      return false;
+    memcpy(dst, src, bytes);
+    return true;
+  }
+
+  const void *take(size_t bytes) {
+    if (bytes > size - offset)
+      return nullptr;
+    const void *ptr = data + offset;
+    offset += bytes;
+    return ptr;
+  }
+
+  void align(size_t alignment) {
+    offset = min(size, (offset + alignment - 1) / alignment * alignment);
+  }
+
+private:
+  const unsigned char *data;
+  size_t size;
+  size_t offset;
+};
+
+void writePadding(ofstream &out) {
+  const char zeros[4] = {0, 0, 0, 0};
+  streamoff pos = out.tellp();
+  if (pos % 4 != 0)
+    out.write(zeros, 4 - pos % 4);
+}
+
+} // namespace
+
+string meshcache::cachePath(const string &sourcePath) {
+  return sourcePath + ".meshcache";
+}
+
+uint64_t meshcache::computeKey(const string &sourcePath, uint32_t importFlags) {
+  MappedFile source(sourcePath);
+  if (!source.isOpen())
+    return 0;
+  uint64_t key = hashValue(VERSION, FNV_OFFSET_BASIS);
+  key = hashValue(importFlags, key);
+  key = hashValue(static_cast<uint32_t>(sizeof(Vertex)), key);
+  return fnv1a64(source.data(), source.size(), key);
+}
+
+bool meshcache::read(const string &sourcePath, uint64_t key,
+                     vector<MeshData> &meshes, array<float, 14> &bounds) {
+  MappedFile file(cachePath(sourcePath));
+  if (!file.isOpen())
+    return false;
+
+  Cursor cursor(file.data(), file.size());
+  FileHeader header;
+  if (!cursor.read(&header, sizeof(header)) ||
+      memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 ||
+      header.version != VERSION || header.key != key ||
+      header.vertexSize != sizeof(Vertex))
+    return false;
+
+  vector<MeshData> result(header.numMeshes);
+  for (MeshData &mesh : result) {
+    MeshHeader meshHeader;
+    if (!cursor.read(&meshHeader, sizeof(meshHeader)))
+      return false;
+    Material &mat = mesh.material;
+    mat.Ambient = glm::vec3(meshHeader.ambient[0], meshHeader.ambient[1],
+                            meshHeader.ambient[2]);
+    mat.Diffuse = glm::vec3(meshHeader.diffuse[0], meshHeader.diffuse[1],
+                            meshHeader.diffuse[2]);
+    mat.Specular = glm::vec3(meshHeader.specular[0], meshHeader.specular[1],
+                             meshHeader.specular[2]);
+    mat.Emissive = glm::vec3(meshHeader.emissive[0], meshHeader.emissive[1],
+                             meshHeader.emissive[2]);
+    mat.Shininess = meshHeader.shininess;
+
+    for (uint32_t i = 0; i < meshHeader.numTextures; ++i) {
+      TextureHeader texHeader;
+      if (!cursor.read(&texHeader, sizeof(texHeader)))
+        return false;
+      const char *type =
+          static_cast<const char *>(cursor.take(texHeader.typeLength));
+      const char *path =
+          static_cast<const char *>(cursor.take(texHeader.pathLength));
+      if (type == nullptr || path == nullptr)
+        return false;
+      mesh.textureRefs.push_back({string(type, texHeader.typeLength),
+                                  string(path, texHeader.pathLength),
+                                  texHeader.srgb != 0});
+    }
+    cursor.align(4);
+
+    // Bulk copies straight out of the mapping, no per-vertex conversion.
+    const LodLevel *lods = static_cast<const LodLevel *>(
+        cursor.take(meshHeader.numLods * sizeof(LodLevel)));
+    const Meshlet *meshlets = static_cast<const Meshlet *>(
+        cursor.take(meshHeader.numMeshlets * sizeof(Meshlet)));
+    const Vertex *vertices = static_cast<const Vertex *>(
+        cursor.take(meshHeader.numVertices * sizeof(Vertex)));
+    const unsigned int *indices = static_cast<const unsigned int *>(
+        cursor.take(meshHeader.numIndices * sizeof(unsigned int)));
+    if (lods == nullptr || meshlets == nullptr || vertices == nullptr ||
+        indices == nullptr)
+      return false;
+    mesh.lods.assign(lods, lods + meshHeader.numLods);
+    mesh.meshlets.assign(meshlets, meshlets + meshHeader.numMeshlets);
+    mesh.vertices.assign(vertices, vertices + meshHeader.numVertices);
+    mesh.indices.assign(indices, indices + meshHeader.numIndices);
+  }
+
+  meshes = move(result);
+  copy(begin(header.bounds), end(header.bounds), bounds.begin());
+  return true;
+}
+
+bool meshcache::write(const string &sourcePath, uint64_t key,
+                      const vector<MeshData> &meshes,
+                      const array<float, 14> &bounds) {
+  // Write to a temporary file first so a partial cache is never read.
+  string path = cachePath(sourcePath);
+  string tmpPath = path + ".tmp";
+  ofstream out(tmpPath, ios::binary | ios::trunc);
+  if (!out) {
+    cout << "Could not write mesh cache: " << path << endl;
+    return false;
+  }
+
+  FileHeader header;
+  memcpy(header.magic, MAGIC, sizeof(MAGIC));
+  header.version = VERSION;
+  header.key = key;
+  header.vertexSize = sizeof(Vertex);
+  header.numMeshes = static_cast<uint32_t>(meshes.size());
+  copy(bounds.begin(), bounds.end(), header.bounds);
+  out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+  for (const MeshData &mesh : meshes) {
+    const Material &mat = mesh.material;
+    MeshHeader meshHeader{static_cast<uint32_t>(mesh.vertices.size()),
+                          static_cast<uint32_t>(mesh.indices.size()),
+                          static_cast<uint32_t>(mesh.textureRefs.size()),
+                          static_cast<uint32_t>(mesh.lods.size()),
+                          static_cast<uint32_t>(mesh.meshlets.size()),
+                          {mat.Ambient.x, mat.Ambient.y, mat.Ambient.z},
+                          {mat.Diffuse.x, mat.Diffuse.y, mat.Diffuse.z},
+                          {mat.Specular.x, mat.Specular.y, mat.Specular.z},
+                          {mat.Emissive.x, mat.Emissive.y, mat.Emissive.z},
+                          mat.Shininess};
+    out.write(reinterpret_cast<const char *>(&meshHeader), sizeof(meshHeader));
+
+    for (const TextureRef &ref : mesh.textureRefs) {
+      TextureHeader texHeader{static_cast<uint32_t>(ref.type.size()),
+                              static_cast<uint32_t>(ref.path.size()),
+                              ref.srgb ? 1u : 0u};
+      out.write(reinterpret_cast<const char *>(&texHeader), sizeof(texHeader));
+      out.write(ref.type.data(), ref.type.size());
+      out.write(ref.path.data(), ref.path.size());
+    }
+    writePadding(out);
+
+    out.write(reinterpret_cast<const char *>(mesh.lods.data()),
+              mesh.lods.size() * sizeof(LodLevel));
+    out.write(reinterpret_cast<const char *>(mesh.meshlets.data()),
+              mesh.meshlets.size() * sizeof(Meshlet));
+    out.write(reinterpret_cast<const char *>(mesh.vertices.data()),
+              mesh.vertices.size() * sizeof(Vertex));
+    out.write(reinterpret_cast<const char *>(mesh.indices.data()),
+              mesh.indices.size() * sizeof(unsigned int));
+  }
+
+  out.close();
+  if (!out || rename(tmpPath.c_str(), path.c_str()) != 0) {
+    cout << "Could not write mesh cache: " << path << endl;
+    remove(tmpPath.c_str());
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,120 @@
+#include "mesh_import.h"
+#include "ThreadPool.h"
+#include <algorithm>
+
+using namespace std;
+
+namespace {
+
+void collectMeshes(const aiNode *node, const aiScene *scene,
+                   vector<const aiMesh *> &meshes) {
+  // process all the node's meshes (if any)
+  for (unsigned int i = 0; i < node->mNumMeshes; i++)
+    meshes.push_back(scene->mMeshes[node->mMeshes[i]]);
+  // then do the same for each of its children
+  for (unsigned int i = 0; i < node->mNumChildren; i++)
+    collectMeshes(node->mChildren[i], scene, meshes);
+}
+
+void addMaterialTextures(const aiMaterial *mat, aiTextureType type,
+                         const string &typeName, bool srgb,
+                         vector<TextureRef> &refs) {
+  for (unsigned int i = 0; i < mat->GetTextureCount(type); i++) {
+    aiString str;
+    mat->GetTexture(type, i, &str);
+    refs.push_back({typeName, string(str.C_Str()), srgb});
+  }
+}
+
+Material convertMaterial(const aiMaterial *mat) {
+  Material material;
+  aiColor3D color(0.f, 0.f, 0.f);
+  float shininess = 0.0f;
+
+  mat->Get(AI_MATKEY_COLOR_DIFFUSE, color);
+  material.Diffuse = glm::vec3(color.r, color.b, color.g);
+
+  mat->Get(AI_MATKEY_COLOR_AMBIENT, color);
+  material.Ambient = glm::vec3(color.r, color.b, color.g);
+
+  mat->Get(AI_MATKEY_COLOR_SPECULAR, color);
+  material.Specular = glm::vec3(color.r, color.b, color.g);
+
+  mat->Get(AI_MATKEY_COLOR_EMISSIVE, color);
+  material.Emissive = glm::vec3(color.r, color.b, color.g);
+
+  mat->Get(AI_MATKEY_SHININESS, shininess);
+  material.Shininess = shininess;
+
+  return material;
+}
+
+glm::vec3 toVec3(const aiVector3D &v) { return glm::vec3(v.x, v.y, v.z); }
+
+} // namespace
+
+MeshData meshimport::convertMesh(const aiMesh *mesh, const aiScene *scene,
+                                 bool srgb) {
+  MeshData data;
+
+  // Copy vertices into the preallocated array.
+  data.vertices.resize(mesh->mNumVertices);
+  Vertex *vertices = data.vertices.data();
+  const aiVector3D *texCoords = mesh->mTextureCoords[0];
+  for (unsigned int i = 0; i < mesh->mNumVertices; i++) {
+    Vertex &vertex = vertices[i];
+    vertex.position = toVec3(mesh->mVertices[i]);
+    vertex.normal = toVec3(mesh->mNormals[i]);
+    if (texCoords != nullptr) {
+      vertex.texCoord = glm::vec2(texCoords[i].x, texCoords[i].y);
+      vertex.tangent = toVec3(mesh->mTangents[i]);
+    } else {
+      vertex.texCoord = glm::vec2(0.0f);
+      vertex.tangent = glm::vec3(0.0f);
+    }
+  }
+
+  // Copy indices, the faces are read in place instead of copied.
+  size_t numIndices = 0;
+  for (unsigned int i = 0; i < mesh->mNumFaces; i++)
+    numIndices += mesh->mFaces[i].mNumIndices;
+  data.indices.resize(numIndices);
+  unsigned int *indices = data.indices.data();
+  for (unsigned int i = 0; i < mesh->mNumFaces; i++) {
+    const aiFace &face = mesh->mFaces[i];
+    indices = copy(face.mIndices, face.mIndices + face.mNumIndices, indices);
+  }
+
+  // Collect texture references, they are loaded when the mesh is created.
+  if (mesh->mMaterialIndex < scene->mNumMaterials) {
+    const aiMaterial *material = scene->mMaterials[mesh->mMaterialIndex];
+    addMaterialTextures(material, aiTextureType_DIFFUSE, "diffuse", srgb,
+                        data.textureRefs);
+    addMaterialTextures(material, aiTextureType_SPECULAR, "specular", false,
+                        data.textureRefs);
+    addMaterialTextures(material, aiTextureType_AMBIENT, "reflex", false,
+                        data.textureRefs);
+    data.material = convertMaterial(material);
+  }
+
+  return data;
+}
+
+vector<MeshData> meshimport::convertScene(const aiScene *scene, bool srgb,
+                                          ThreadPool *pool) {
+  vector<const aiMesh *> meshes;
+  collectMeshes(scene->mRootNode, scene, meshes);
+
+  // Every mesh is written to its own slot, so the order does not depend on
+  // which thread finishes first.
+  vector<MeshData> meshData(meshes.size());
+  auto convertRange = [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i)
+      meshData[i] = convertMesh(meshes[i], scene, srgb);
+  };
+  if (pool != nullptr)
+    pool->parallelFor(meshes.size(), convertRange);
+  else
+    convertRange(0, meshes.size());
+  return meshData;
+}
@@ -0,0 +1,315 @@
+#include "mesh_lod.h"
+#include "mesh_optimizer.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <numeric>
+#include <unordered_map>
+
+using namespace std;
+
+namespace {
+
+const unsigned int NO_VERTEX = ~0u;
+
+// Symmetric 4x4 matrix of the squared distances to a set of planes, with
+// the total area of the planes to turn sums into averages.
+struct Quadric {
+  double a00 = 0, a01 = 0, a02 = 0, a11 = 0, a12 = 0, a22 = 0;
+  double b0 = 0, b1 = 0, b2 = 0, c = 0;
+  double weight = 0;
+
+  void addPlane(const glm::dvec3 &n, double d, double w) {
+    a00 += w * n.x * n.x;
+    a01 += w * n.x * n.y;
+    a02 += w * n.x * n.z;
+    a11 += w * n.y * n.y;
+    a12 += w * n.y * n.z;
+    a22 += w * n.z * n.z;
+    b0 += w * n.x * d;
+    b1 += w * n.y * d;
+    b2 += w * n.z * d;
+    c += w * d * d;
+    weight += w;
+  }
+
+  void add(const Quadric &q) {
+    a00 += q.a00;
+    a01 += q.a01;
+    a02 += q.a02;
+    a11 += q.a11;
+    a12 += q.a12;
+    a22 += q.a22;
+    b0 += q.b0;
+    b1 += q.b1;
+    b2 += q.b2;
+    c += q.c;
+    weight += q.weight;
+  }
+
+  // Average squared distance of p to the planes.
+  double error(const glm::vec3 &p) const {
+    double x = p.x, y = p.y, z = p.z;
+    double e = a00 * x * x + a11 * y * y + a22 * z * z +
+               2.0 * (a01 * x * y + a02 * x * z + a12 * y * z) +
+               2.0 * (b0 * x + b1 * y + b2 * z) + c;
+    return weight > 0.0 ? max(e, 0.0) / weight : 0.0;
+  }
+};
+
+struct PositionHash {
+  size_t operator()(const glm::vec3 &p) const {
+    uint32_t bits[3];
+    memcpy(bits, &p, sizeof(bits));
+    return (bits[0] * 73856093u) ^ (bits[1] * 19349663u) ^
+           (bits[2] * 83492791u);
+  }
+};
+
+struct Collapse {
+  unsigned int from;
+  unsigned int to;
+  double cost;
+};
+
+uint64_t edgeKey(unsigned int a, unsigned int b) {
+  return a < b ? (static_cast<uint64_t>(a) << 32) | b
+               : (static_cast<uint64_t>(b) << 32) | a;
+}
+
+// True if moving vertex from onto to would turn a triangle around.
+bool flipsTriangle(const vector<Vertex> &vertices,
+                   const vector<unsigned int> &corners, unsigned int triangle,
+                   unsigned int from, unsigned int to) {
+  const unsigned int *t = &corners[3 * triangle];
+  glm::vec3 before[3], after[3];
+  for (int i = 0; i < 3; ++i) {
+    before[i] = vertices[t[i]].position;
+    after[i] = t[i] == from ? vertices[to].position : before[i];
+  }
+  glm::vec3 n0 = glm::cross(before[1] - before[0], before[2] - before[0]);
+  glm::vec3 n1 = glm::cross(after[1] - after[0], after[2] - after[0]);
+  return glm::dot(n0, n1) <= 0.0f;
+}
+
+} // namespace
+
+vector<unsigned int> meshlod::simplify(const vector<Vertex> &vertices,
+                                       const vector<unsigned int> &indices,
+                                       size_t targetIndexCount, float maxError,
+                                       float *error) {
+  if (error != nullptr)
+    *error = 0.0f;
+  size_t numVertices = vertices.size();
+  size_t numTriangles = indices.size() / 3;
+  if (numTriangles == 0 || indices.size() <= targetIndexCount)
+    return indices;
+
+  // Vertices split for their attributes share one position, the first of
+  // them stands for the group in the topology.
+  vector<unsigned int> group(numVertices), nextInGroup(numVertices, NO_VERTEX);
+  vector<unsigned int> groupSize(numVertices, 0);
+  unordered_map<glm::vec3, unsigned int, PositionHash> firstAt;
+  for (unsigned int v = 0; v < numVertices; ++v) {
+    auto inserted = firstAt.emplace(vertices[v].position, v);
+    unsigned int first = inserted.first->second;
+    group[v] = first;
+    if (first != v) {
+      nextInGroup[v] = nextInGroup[first];
+      nextInGroup[first] = v;
+    }
+    ++groupSize[first];
+  }
+
+  // corners holds the indices that are output, topology the group of each.
+  vector<unsigned int> corners(indices.begin(),
+                               indices.begin() + 3 * numTriangles);
+  vector<unsigned int> topology(corners.size());
+  for (size_t i = 0; i < corners.size(); ++i)
+    topology[i] = group[corners[i]];
+
+  vector<Quadric> quadrics(numVertices);
+  unordered_map<uint64_t, unsigned int> edgeUses;
+  for (size_t t = 0; t < numTriangles; ++t) {
+    const unsigned int *g = &topology[3 * t];
+    glm::dvec3 p0 = vertices[g[0]].position, p1 = vertices[g[1]].position,
+               p2 = vertices[g[2]].position;
+    glm::dvec3 n = glm::cross(p1 - p0, p2 - p0);
+    double length = glm::length(n);
+    if (length > 0.0) {
+      n /= length;
+      for (int i = 0; i < 3; ++i)
+        quadrics[g[i]].addPlane(n, -glm::dot(n, p0), 0.5 * length);
+    }
+    for (int i = 0; i < 3; ++i)
+      ++edgeUses[edgeKey(g[i], g[(i + 1) % 3])];
+  }
+
+  // Seams, open borders and non-manifold edges keep their vertices.
+  vector<bool> locked(numVertices, false);
+  for (unsigned int v = 0; v < numVertices; ++v)
+    locked[v] = groupSize[group[v]] > 1;
+  for (const auto &edge : edgeUses) {
+    if (edge.second != 2) {
+      locked[edge.first >> 32] = true;
+      locked[edge.first & 0xffffffffu] = true;
+    }
+  }
+
+  size_t targetTriangles = targetIndexCount / 3;
+  size_t liveTriangles = numTriangles;
+  vector<bool> dead(numTriangles, false);
+  double maxCost = static_cast<double>(maxError) * maxError;
+  double worstCost = 0.0;
+  vector<unsigned int> offsets(numVertices + 1), adjacent;
+  vector<Collapse> collapses;
+  vector<bool> touched(numVertices);
+
+  while (liveTriangles > targetTriangles) {
+    // Triangles around every vertex, rebuilt once per pass.
+    fill(offsets.begin(), offsets.end(), 0);
+    for (size_t t = 0; t < numTriangles; ++t) {
+      if (dead[t])
+        continue;
+      for (int i = 0; i < 3; ++i)
+        ++offsets[topology[3 * t + i] + 1];
+    }
+    partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+    adjacent.resize(offsets.back());
+    vector<unsigned int> fillAt(offsets.begin(), offsets.end() - 1);
+    for (size_t t = 0; t < numTriangles; ++t) {
+      if (dead[t])
+        continue;
+      for (int i = 0; i < 3; ++i)
+        adjacent[fillAt[topology[3 * t + i]]++] = static_cast<unsigned int>(t);
+    }
+
+    // Every edge can collapse in both directions, onto the other vertex.
+    collapses.clear();
+    for (size_t t = 0; t < numTriangles; ++t) {
+      if (dead[t])
+        continue;
+      for (int i = 0; i < 3; ++i) {
+        unsigned int from = topology[3 * t + i];
+        unsigned int to = topology[3 * t + (i + 1) % 3];
+        if (locked[from])
+          continue;
+        Quadric merged = quadrics[from];
+        merged.add(quadrics[to]);
+        double cost = merged.error(vertices[to].position);
+        if (cost <= maxCost)
+          collapses.push_back({from, to, cost});
+      }
+    }
+    sort(collapses.begin(), collapses.end(),
+         [](const Collapse &a, const Collapse &b) { return a.cost < b.cost; });
+
+    // Collapse the cheapest edges whose neighbourhoods were not changed in
+    // this pass yet.
+    fill(touched.begin(), touched.end(), false);
+    size_t done = 0;
+    for (const Collapse &collapse : collapses) {
+      if (liveTriangles <= targetTriangles)
+        break;
+      unsigned int from = collapse.from, to = collapse.to;
+      if (touched[from] || touched[to])
+        continue;
+      bool flips = false;
+      for (unsigned int i = offsets[from]; i < offsets[from + 1] && !flips;
+           ++i) {
+        unsigned int t = adjacent[i];
+        const unsigned int *g = &topology[3 * t];
+        if (g[0] != to && g[1] != to && g[2] != to)
+          flips = flipsTriangle(vertices, topology, t, from, to);
+      }
+      if (flips)
+        continue;
+
+      // Of the split vertices at the target, keep the one whose texture
+      // coordinates are closest to those of the removed vertex.
+      unsigned int target = to;
+      float best = glm::length(vertices[to].texCoord - vertices[from].texCoord);
+      for (unsigned int v = nextInGroup[to]; v != NO_VERTEX;
+           v = nextInGroup[v]) {
+        float distance =
+            glm::length(vertices[v].texCoord - vertices[from].texCoord);
+        if (distance < best) {
+          best = distance;
+          target = v;
+        }
+      }
+
+      for (unsigned int i = offsets[from]; i < offsets[from + 1]; ++i) {
+        unsigned int t = adjacent[i];
+        unsigned int *g = &topology[3 * t];
+        for (int j = 0; j < 3; ++j) {
+          if (g[j] == from) {
+            g[j] = to;
+            corners[3 * t + j] = target;
+          }
+          touched[g[j]] = true;
+        }
+        if (g[0] == g[1] || g[1] == g[2] || g[0] == g[2]) {
+          dead[t] = true;
+          --liveTriangles;
+        }
+      }
+      quadrics[to].add(quadrics[from]);
+      touched[from] = true;
+      worstCost = max(worstCost, collapse.cost);
+      ++done;
+    }
+    if (done == 0)
+      break;
+  }
+
+  vector<unsigned int> result;
+  result.reserve(3 * liveTriangles);
+  for (size_t t = 0; t < numTriangles; ++t) {
+    if (!dead[t])
+      result.insert(result.end(), &corners[3 * t], &corners[3 * t] + 3);
+  }
+  if (error != nullptr)
+    *error = static_cast<float>(sqrt(worstCost));
+  return result;
+}
+
+void meshlod::buildChain(MeshData &mesh, const Settings &settings) {
+  size_t numIndices = mesh.indices.size();
+  mesh.lods.clear();
+  mesh.lods.push_back({0, static_cast<unsigned int>(numIndices), 0.0f});
+  if (settings.numLevels <= 1 || numIndices == 0 || numIndices % 3 != 0)
+    return;
+
+  glm::vec3 lower = mesh.vertices[0].position, upper = lower;
+  for (const Vertex &vertex : mesh.vertices) {
+    lower = glm::min(lower, vertex.position);
+    upper = glm::max(upper, vertex.position);
+  }
+  glm::vec3 size = upper - lower;
+  float maxError = settings.maxError * max(size.x, max(size.y, size.z));
+
+  // Every level is simplified from the original so the errors are not
+  // accumulated over the chain.
+  vector<unsigned int> original(mesh.indices);
+  size_t previous = numIndices;
+  float fraction = 1.0f;
+  for (unsigned int level = 1; level < settings.numLevels; ++level) {
+    fraction *= settings.reduction;
+    size_t target = static_cast<size_t>(numIndices / 3 * fraction) * 3;
+    float error;
+    vector<unsigned int> lod =
+        meshlod::simplify(mesh.vertices, original, target, maxError, &error);
+    // Stop when less than half of the reduction aimed for was reached.
+    float aimed = previous * settings.reduction;
+    if (lod.empty() || lod.size() > (previous + aimed) / 2.0f)
+      break;
+    meshopt::optimizeVertexCache(lod, mesh.vertices.size());
+    error = max(error, mesh.lods.back().error);
+    mesh.lods.push_back({static_cast<unsigned int>(mesh.indices.size()),
+                         static_cast<unsigned int>(lod.size()), error});
+    mesh.indices.insert(mesh.indices.end(), lod.begin(), lod.end());
+    previous = lod.size();
+  }
+}
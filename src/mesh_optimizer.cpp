@@ -0,0 +1,330 @@
+#include "mesh_optimizer.h"
+#include <algorithm>
+#include <numeric>
+
+using namespace std;
+
+namespace {
+
+const unsigned int NO_VERTEX = ~0u;
+
+/*
+    FIFO cache emulated with timestamps: a vertex is in the cache while
+    fewer than cacheSize vertices were added after it. Advancing the
+    timestamp by more than cacheSize empties the cache.
+*/
+struct VertexCache {
+  vector<unsigned int> addedAt;
+  unsigned int timestamp;
+  unsigned int size;
+
+  VertexCache(size_t numVertices, unsigned int size)
+      : addedAt(numVertices, 0), timestamp(size + 1), size(size) {}
+
+  bool contains(unsigned int vertex) const {
+    return timestamp - addedAt[vertex] <= size;
+  }
+
+  // Returns the number of misses of the triangle.
+  unsigned int process(const unsigned int *triangle) {
+    unsigned int misses = 0;
+    for (int i = 0; i < 3; ++i) {
+      if (!contains(triangle[i])) {
+        addedAt[triangle[i]] = timestamp++;
+        ++misses;
+      }
+    }
+    return misses;
+  }
+
+  void flush() { timestamp += size + 1; }
+};
+
+// Triangles using each vertex, stored as one array with per vertex offsets.
+struct Adjacency {
+  vector<unsigned int> offsets;
+  vector<unsigned int> triangles;
+
+  Adjacency(const vector<unsigned int> &indices, size_t numVertices)
+      : offsets(numVertices + 1, 0), triangles(indices.size()) {
+    for (unsigned int index : indices)
+      ++offsets[index + 1];
+    partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+    vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+    for (size_t i = 0; i < indices.size(); ++i)
+      triangles[fill[indices[i]]++] = static_cast<unsigned int>(i / 3);
+  }
+
+  unsigned int count(unsigned int vertex) const {
+    return offsets[vertex + 1] - offsets[vertex];
+  }
+};
+
+// Split the clusters further wherever the miss ratio of the part before the
+// split, starting from an empty cache, is within the threshold of the ratio
+// of the whole cluster.
+vector<size_t> splitClusters(const vector<unsigned int> &indices,
+                             size_t numVertices,
+                             const vector<size_t> &clusters, float threshold,
+                             unsigned int cacheSize) {
+  size_t numTriangles = indices.size() / 3;
+  VertexCache cache(numVertices, cacheSize);
+  vector<size_t> result;
+  for (size_t c = 0; c < clusters.size(); ++c) {
+    size_t begin = clusters[c];
+    size_t end = c + 1 < clusters.size() ? clusters[c + 1] : numTriangles;
+    if (begin >= end)
+      continue;
+
+    cache.flush();
+    size_t clusterMisses = 0;
+    for (size_t t = begin; t < end; ++t)
+      clusterMisses += cache.process(&indices[3 * t]);
+    float allowed = threshold * clusterMisses / (end - begin);
+
+    result.push_back(begin);
+    cache.flush();
+    size_t start = begin, misses = 0;
+    for (size_t t = begin; t < end; ++t) {
+      misses += cache.process(&indices[3 * t]);
+      if (t + 1 < end && misses <= allowed * (t + 1 - start)) {
+        result.push_back(t + 1);
+        start = t + 1;
+        misses = 0;
+        cache.flush();
+      }
+    }
+  }
+  return result;
+}
+
+} // namespace
+
+float meshopt::CacheStats::acmr() const {
+  return triangles > 0 ? static_cast<float>(misses) / triangles : 0.0f;
+}
+
+float meshopt::CacheStats::atvr() const {
+  return vertices > 0 ? static_cast<float>(misses) / vertices : 0.0f;
+}
+
+void meshopt::CacheStats::add(const CacheStats &other) {
+  triangles += other.triangles;
+  vertices += other.vertices;
+  misses += other.misses;
+}
+
+void meshopt::Report::add(const Report &other) {
+  before.add(other.before);
+  after.add(other.after);
+}
+
+meshopt::CacheStats meshopt::simulateCache(const vector<unsigned int> &indices,
+                                           size_t numVertices,
+                                           unsigned int cacheSize) {
+  CacheStats stats;
+  stats.triangles = indices.size() / 3;
+  VertexCache cache(numVertices, cacheSize);
+  vector<bool> used(numVertices, false);
+  for (size_t t = 0; t < stats.triangles; ++t) {
+    const unsigned int *triangle = &indices[3 * t];
+    stats.misses += cache.process(triangle);
+    for (int i = 0; i < 3; ++i) {
+      if (!used[triangle[i]]) {
+        used[triangle[i]] = true;
+        ++stats.vertices;
+      }
+    }
+  }
+  return stats;
+}
+
+/*
+    Tipsify: emit all remaining triangles around a fanning vertex, then move
+    on to the vertex of the emitted triangles that will still be in the
+    cache once its own triangles are emitted. Without such a vertex the most
+    recently used vertex with triangles left is taken from the dead end
+    stack, or failing that the next one in index order.
+*/
+void meshopt::optimizeVertexCache(vector<unsigned int> &indices,
+                                  size_t numVertices, vector<size_t> *clusters,
+                                  unsigned int cacheSize) {
+  size_t numTriangles = indices.size() / 3;
+  if (clusters != nullptr)
+    clusters->clear();
+  if (numTriangles == 0)
+    return;
+
+  Adjacency adjacency(indices, numVertices);
+  vector<unsigned int> liveTriangles(numVertices);
+  for (size_t v = 0; v < numVertices; ++v)
+    liveTriangles[v] = adjacency.count(static_cast<unsigned int>(v));
+  vector<bool> emitted(numTriangles, false);
+  vector<unsigned int> deadEnd;
+  VertexCache cache(numVertices, cacheSize);
+
+  vector<unsigned int> result;
+  result.reserve(numTriangles * 3);
+  unsigned int cursor = 0;
+  unsigned int fanning = NO_VERTEX;
+  while (true) {
+    if (fanning == NO_VERTEX) {
+      // Dead end, pick a new vertex and start a new cluster there.
+      while (!deadEnd.empty() && fanning == NO_VERTEX) {
+        unsigned int vertex = deadEnd.back();
+        deadEnd.pop_back();
+        if (liveTriangles[vertex] > 0)
+          fanning = vertex;
+      }
+      while (cursor < numVertices && fanning == NO_VERTEX) {
+        if (liveTriangles[cursor] > 0)
+          fanning = cursor;
+        ++cursor;
+      }
+      if (fanning == NO_VERTEX)
+        break;
+      if (clusters != nullptr)
+        clusters->push_back(result.size() / 3);
+    }
+
+    size_t candidates = deadEnd.size();
+    for (unsigned int i = adjacency.offsets[fanning];
+         i < adjacency.offsets[fanning + 1]; ++i) {
+      unsigned int triangle = adjacency.triangles[i];
+      if (emitted[triangle])
+        continue;
+      emitted[triangle] = true;
+      const unsigned int *corners = &indices[3 * triangle];
+      result.insert(result.end(), corners, corners + 3);
+      for (int j = 0; j < 3; ++j) {
+        deadEnd.push_back(corners[j]);
+        --liveTriangles[corners[j]];
+      }
+      cache.process(corners);
+    }
+
+    // Prefer the candidate that entered the cache first, as long as its
+    // remaining triangles do not push it out.
+    unsigned int next = NO_VERTEX;
+    int bestPriority = -1;
+    for (size_t i = candidates; i < deadEnd.size(); ++i) {
+      unsigned int vertex = deadEnd[i];
+      if (liveTriangles[vertex] == 0)
+        continue;
+      int priority = 0;
+      unsigned int age = cache.timestamp - cache.addedAt[vertex];
+      if (age + 2 * liveTriangles[vertex] <= cacheSize)
+        priority = static_cast<int>(age);
+      if (priority > bestPriority) {
+        bestPriority = priority;
+        next = vertex;
+      }
+    }
+    fanning = next;
+  }
+  indices.swap(result);
+}
+
+/*
+    Sorts the clusters by their occlusion potential (Sander et al. 2007),
+    the distance of the cluster centroid from the mesh centroid along the
+    average cluster normal. Clusters on the outside facing away from the
+    center come first since they tend to hide the rest of the mesh.
+*/
+void meshopt::optimizeOverdraw(vector<unsigned int> &indices,
+                               const vector<Vertex> &vertices,
+                               const vector<size_t> &clusters, float threshold,
+                               unsigned int cacheSize) {
+  size_t numTriangles = indices.size() / 3;
+  if (numTriangles == 0 || clusters.empty())
+    return;
+  vector<size_t> split =
+      splitClusters(indices, vertices.size(), clusters, threshold, cacheSize);
+
+  // Area weighted centroids and normals of the triangles.
+  vector<glm::vec3> centroids(numTriangles), normals(numTriangles);
+  vector<float> areas(numTriangles);
+  glm::vec3 meshCentroid(0.0f);
+  float meshArea = 0.0f;
+  for (size_t t = 0; t < numTriangles; ++t) {
+    const glm::vec3 &a = vertices[indices[3 * t]].position;
+    const glm::vec3 &b = vertices[indices[3 * t + 1]].position;
+    const glm::vec3 &c = vertices[indices[3 * t + 2]].position;
+    normals[t] = glm::cross(b - a, c - a);
+    areas[t] = 0.5f * glm::length(normals[t]);
+    centroids[t] = (a + b + c) / 3.0f;
+    meshCentroid += centroids[t] * areas[t];
+    meshArea += areas[t];
+  }
+  if (meshArea > 0.0f)
+    meshCentroid /= meshArea;
+
+  vector<float> potential(split.size());
+  for (size_t c = 0; c < split.size(); ++c) {
+    size_t end = c + 1 < split.size() ? split[c + 1] : numTriangles;
+    glm::vec3 centroid(0.0f), normal(0.0f);
+    float area = 0.0f;
+    for (size_t t = split[c]; t < end; ++t) {
+      centroid += centroids[t] * areas[t];
+      normal += normals[t];
+      area += areas[t];
+    }
+    float length = glm::length(normal);
+    if (area > 0.0f && length > 0.0f) {
+      potential[c] = glm::dot(centroid / area - meshCentroid, normal / length);
+    } else {
+      potential[c] = 0.0f;
+    }
+  }
+
+  vector<size_t> order(split.size());
+  iota(order.begin(), order.end(), 0);
+  stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+    return potential[a] > potential[b];
+  });
+
+  vector<unsigned int> result;
+  result.reserve(indices.size());
+  for (size_t c : order) {
+    size_t end = c + 1 < split.size() ? split[c + 1] : numTriangles;
+    result.insert(result.end(), indices.begin() + 3 * split[c],
+                  indices.begin() + 3 * end);
+  }
+  indices.swap(result);
+}
+
+void meshopt::optimizeVertexFetch(vector<Vertex> &vertices,
+                                  vector<unsigned int> &indices) {
+  vector<unsigned int> remap(vertices.size(), NO_VERTEX);
+  unsigned int next = 0;
+  for (unsigned int &index : indices) {
+    if (remap[index] == NO_VERTEX)
+      remap[index] = next++;
+    index = remap[index];
+  }
+  for (unsigned int &target : remap) {
+    if (target == NO_VERTEX)
+      target = next++;
+  }
+
+  vector<Vertex> reordered(vertices.size());
+  for (size_t v = 0; v < vertices.size(); ++v)
+    reordered[remap[v]] = vertices[v];
+  vertices.swap(reordered);
+}
+
+meshopt::Report meshopt::optimize(MeshData &mesh) {
+  Report report;
+  report.before = simulateCache(mesh.indices, mesh.vertices.size());
+  if (mesh.indices.empty() || mesh.indices.size() % 3 != 0) {
+    report.after = report.before;
+    return report;
+  }
+
+  vector<size_t> clusters;
+  optimizeVertexCache(mesh.indices, mesh.vertices.size(), &clusters);
+  optimizeOverdraw(mesh.indices, mesh.vertices, clusters);
+  optimizeVertexFetch(mesh.vertices, mesh.indices);
+  report.after = simulateCache(mesh.indices, mesh.vertices.size());
+  return report;
+}
@@ -0,0 +1,340 @@
+#include "meshlets.h"
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define MESHLETS_X86 1
+#include <immintrin.h>
+#else
+#define MESHLETS_X86 0
+#endif
+
+using namespace std;
+
+namespace {
+
+const unsigned int NO_MESHLET = ~0u;
+const size_t NO_TRIANGLE = ~size_t(0);
+
+// Triangles around every vertex.
+struct Adjacency {
+  vector<unsigned int> offsets;
+  vector<unsigned int> triangles;
+
+  Adjacency(const unsigned int *indices, size_t numTriangles,
+            size_t numVertices)
+      : offsets(numVertices + 1, 0), triangles(numTriangles * 3) {
+    for (size_t i = 0; i < numTriangles * 3; ++i)
+      ++offsets[indices[i] + 1];
+    partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+    vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+    for (size_t i = 0; i < numTriangles * 3; ++i)
+      triangles[fill[indices[i]]++] = static_cast<unsigned int>(i / 3);
+  }
+};
+
+// Bounding sphere and normal cone of the triangles [begin, end).
+Meshlet makeMeshlet(const vector<Vertex> &vertices,
+                    const vector<unsigned int> &indices, size_t begin,
+                    size_t end) {
+  Meshlet meshlet;
+  meshlet.firstIndex = static_cast<unsigned int>(begin);
+  meshlet.numIndices = static_cast<unsigned int>(end - begin);
+
+  glm::vec3 lower = vertices[indices[begin]].position, upper = lower;
+  for (size_t i = begin; i < end; ++i) {
+    lower = glm::min(lower, vertices[indices[i]].position);
+    upper = glm::max(upper, vertices[indices[i]].position);
+  }
+  meshlet.center = 0.5f * (lower + upper);
+  meshlet.radius = 0.0f;
+  for (size_t i = begin; i < end; ++i) {
+    meshlet.radius = max(meshlet.radius,
+                         glm::length(vertices[indices[i]].position -
+                                     meshlet.center));
+  }
+
+  vector<glm::vec3> normals;
+  glm::vec3 axis(0.0f);
+  bool degenerate = false;
+  for (size_t i = begin; i + 2 < end; i += 3) {
+    const glm::vec3 &a = vertices[indices[i]].position;
+    const glm::vec3 &b = vertices[indices[i + 1]].position;
+    const glm::vec3 &c = vertices[indices[i + 2]].position;
+    glm::vec3 normal = glm::cross(b - a, c - a);
+    float length = glm::length(normal);
+    if (length == 0.0f) {
+      degenerate = true;
+      continue;
+    }
+    normals.push_back(normal / length);
+    axis += normals.back();
+  }
+
+  // Degenerate triangles have no orientation, so the cone cannot be used.
+  float axisLength = glm::length(axis);
+  meshlet.coneAxis = axisLength > 0.0f ? axis / axisLength : glm::vec3(0.0f);
+  float minDot = axisLength > 0.0f && !degenerate ? 1.0f : -1.0f;
+  for (const glm::vec3 &normal : normals)
+    minDot = min(minDot, glm::dot(normal, meshlet.coneAxis));
+  meshlet.coneCutoff = minDot > 0.0f ? sqrt(1.0f - minDot * minDot) : 1.0f;
+  return meshlet;
+}
+
+void addRange(vector<meshlets::Range> &ranges, unsigned int firstIndex,
+              unsigned int numIndices) {
+  if (!ranges.empty() &&
+      ranges.back().firstIndex + ranges.back().numIndices == firstIndex)
+    ranges.back().numIndices += numIndices;
+  else
+    ranges.push_back({firstIndex, numIndices});
+}
+
+bool visible(const meshlets::Clusters &clusters, size_t i,
+             const meshlets::View &view) {
+  glm::vec3 center(clusters.centerX[i], clusters.centerY[i],
+                   clusters.centerZ[i]);
+  float radius = clusters.radius[i];
+  for (const glm::vec4 &plane : view.planes) {
+    if (glm::dot(glm::vec3(plane), center) + plane.w < -radius)
+      return false;
+  }
+  if (view.cones) {
+    glm::vec3 axis(clusters.axisX[i], clusters.axisY[i], clusters.axisZ[i]);
+    glm::vec3 offset = center - view.eye;
+    if (glm::dot(offset, axis) >=
+        clusters.cutoff[i] * glm::length(offset) + radius)
+      return false;
+  }
+  return true;
+}
+
+} // namespace
+
+vector<Meshlet> meshlets::build(const vector<Vertex> &vertices,
+                                vector<unsigned int> &indices,
+                                size_t firstIndex, size_t numIndices) {
+  size_t numTriangles = numIndices / 3;
+  const unsigned int *triangles = indices.data() + firstIndex;
+  Adjacency adjacency(triangles, numTriangles, vertices.size());
+  vector<glm::vec3> normals(numTriangles);
+  for (size_t t = 0; t < numTriangles; ++t) {
+    const glm::vec3 &a = vertices[triangles[3 * t]].position;
+    const glm::vec3 &b = vertices[triangles[3 * t + 1]].position;
+    const glm::vec3 &c = vertices[triangles[3 * t + 2]].position;
+    glm::vec3 normal = glm::cross(b - a, c - a);
+    float length = glm::length(normal);
+    normals[t] = length > 0.0f ? normal / length : glm::vec3(0.0f);
+  }
+
+  vector<bool> used(numTriangles, false);
+  // Meshlet each vertex was last added to.
+  vector<unsigned int> addedTo(vertices.size(), NO_MESHLET);
+  vector<unsigned int> result;
+  result.reserve(numTriangles * 3);
+  vector<unsigned int> meshletVertices;
+  vector<size_t> ends;
+  unsigned int current = 0, numMeshletTriangles = 0;
+  glm::vec3 axis(0.0f);
+  size_t cursor = 0;
+  while (true) {
+    // Grow the meshlet by the neighbouring triangle that adds the fewest
+    // vertices, then the one closest to its average normal.
+    size_t best = NO_TRIANGLE;
+    unsigned int bestAdded = 4;
+    float bestDot = -2.0f;
+    glm::vec3 direction =
+        glm::length(axis) > 0.0f ? glm::normalize(axis) : axis;
+    for (unsigned int vertex : meshletVertices) {
+      for (unsigned int i = adjacency.offsets[vertex];
+           i < adjacency.offsets[vertex + 1]; ++i) {
+        unsigned int t = adjacency.triangles[i];
+        if (used[t])
+          continue;
+        unsigned int added = 0;
+        for (int k = 0; k < 3; ++k)
+          added += addedTo[triangles[3 * t + k]] != current;
+        float dot = glm::dot(normals[t], direction);
+        if (added < bestAdded || (added == bestAdded && dot > bestDot)) {
+          best = t;
+          bestAdded = added;
+          bestDot = dot;
+        }
+      }
+    }
+
+    if (best == NO_TRIANGLE ||
+        meshletVertices.size() + bestAdded > MAX_VERTICES ||
+        numMeshletTriangles + 1 > MAX_TRIANGLES) {
+      if (numMeshletTriangles > 0) {
+        ends.push_back(result.size());
+        ++current;
+        numMeshletTriangles = 0;
+        meshletVertices.clear();
+        axis = glm::vec3(0.0f);
+      }
+      // Start the next meshlet at the first triangle left in the original
+      // order, which keeps the order picked for overdraw roughly intact.
+      while (cursor < numTriangles && used[cursor])
+        ++cursor;
+      if (cursor == numTriangles)
+        break;
+      best = cursor;
+    }
+
+    used[best] = true;
+    ++numMeshletTriangles;
+    axis += normals[best];
+    for (int k = 0; k < 3; ++k) {
+      unsigned int vertex = triangles[3 * best + k];
+      result.push_back(vertex);
+      if (addedTo[vertex] != current) {
+        addedTo[vertex] = current;
+        meshletVertices.push_back(vertex);
+      }
+    }
+  }
+
+  copy(result.begin(), result.end(), indices.begin() + firstIndex);
+  vector<Meshlet> meshlets;
+  size_t begin = 0;
+  for (size_t end : ends) {
+    meshlets.push_back(makeMeshlet(vertices, indices, firstIndex + begin,
+                                   firstIndex + end));
+    begin = end;
+  }
+  return meshlets;
+}
+
+meshlets::Clusters meshlets::prepare(const vector<Meshlet> &meshlets) {
+  Clusters clusters;
+  clusters.count = meshlets.size();
+  size_t padded = (meshlets.size() + 3) / 4 * 4;
+  for (vector<float> *array :
+       {&clusters.centerX, &clusters.centerY, &clusters.centerZ,
+        &clusters.radius, &clusters.axisX, &clusters.axisY, &clusters.axisZ,
+        &clusters.cutoff})
+    array->assign(padded, 0.0f);
+  clusters.firstIndex.assign(padded, 0);
+  clusters.numIndices.assign(padded, 0);
+  for (size_t i = 0; i < meshlets.size(); ++i) {
+    const Meshlet &meshlet = meshlets[i];
+    clusters.centerX[i] = meshlet.center.x;
+    clusters.centerY[i] = meshlet.center.y;
+    clusters.centerZ[i] = meshlet.center.z;
+    clusters.radius[i] = meshlet.radius;
+    clusters.axisX[i] = meshlet.coneAxis.x;
+    clusters.axisY[i] = meshlet.coneAxis.y;
+    clusters.axisZ[i] = meshlet.coneAxis.z;
+    clusters.cutoff[i] = meshlet.coneCutoff;
+    clusters.firstIndex[i] = meshlet.firstIndex;
+    clusters.numIndices[i] = meshlet.numIndices;
+  }
+  return clusters;
+}
+
+meshlets::View meshlets::makeView(const glm::mat4 &projection,
+                                  const glm::mat4 &view,
+                                  const glm::mat4 &model, bool cones) {
+  // Planes from the rows of the matrix to clip space (Gribb and Hartmann).
+  View result;
+  glm::mat4 toClip = projection * view * model;
+  glm::vec4 rows[4];
+  for (int i = 0; i < 4; ++i)
+    rows[i] = glm::vec4(toClip[0][i], toClip[1][i], toClip[2][i], toClip[3][i]);
+  for (int i = 0; i < 3; ++i) {
+    result.planes[2 * i] = rows[3] + rows[i];
+    result.planes[2 * i + 1] = rows[3] - rows[i];
+  }
+  for (glm::vec4 &plane : result.planes) {
+    float length = glm::length(glm::vec3(plane));
+    if (length > 0.0f)
+      plane /= length;
+  }
+  result.eye = glm::vec3(glm::inverse(view * model) * glm::vec4(0, 0, 0, 1));
+  result.cones = cones;
+  return result;
+}
+
+size_t meshlets::cullScalar(const Clusters &clusters, const View &view,
+                            vector<Range> &ranges) {
+  ranges.clear();
+  size_t kept = 0;
+  for (size_t i = 0; i < clusters.count; ++i) {
+    if (visible(clusters, i, view)) {
+      addRange(ranges, clusters.firstIndex[i], clusters.numIndices[i]);
+      kept += clusters.numIndices[i];
+    }
+  }
+  return kept;
+}
+
+#if MESHLETS_X86
+
+size_t meshlets::cull(const Clusters &clusters, const View &view,
+                      vector<Range> &ranges) {
+  ranges.clear();
+  size_t kept = 0;
+  __m128 planeX[6], planeY[6], planeZ[6], planeW[6];
+  for (int p = 0; p < 6; ++p) {
+    planeX[p] = _mm_set1_ps(view.planes[p].x);
+    planeY[p] = _mm_set1_ps(view.planes[p].y);
+    planeZ[p] = _mm_set1_ps(view.planes[p].z);
+    planeW[p] = _mm_set1_ps(view.planes[p].w);
+  }
+  const __m128 eyeX = _mm_set1_ps(view.eye.x);
+  const __m128 eyeY = _mm_set1_ps(view.eye.y);
+  const __m128 eyeZ = _mm_set1_ps(view.eye.z);
+  const __m128 zero = _mm_setzero_ps();
+
+  for (size_t i = 0; i < clusters.count; i += 4) {
+    __m128 x = _mm_loadu_ps(&clusters.centerX[i]);
+    __m128 y = _mm_loadu_ps(&clusters.centerY[i]);
+    __m128 z = _mm_loadu_ps(&clusters.centerZ[i]);
+    __m128 radius = _mm_loadu_ps(&clusters.radius[i]);
+    __m128 negRadius = _mm_sub_ps(zero, radius);
+
+    __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+    for (int p = 0; p < 6; ++p) {
+      __m128 distance = _mm_add_ps(
+          _mm_add_ps(_mm_mul_ps(planeX[p], x), _mm_mul_ps(planeY[p], y)),
+          _mm_add_ps(_mm_mul_ps(planeZ[p], z), planeW[p]));
+      inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, negRadius));
+    }
+
+    if (view.cones) {
+      __m128 dx = _mm_sub_ps(x, eyeX);
+      __m128 dy = _mm_sub_ps(y, eyeY);
+      __m128 dz = _mm_sub_ps(z, eyeZ);
+      __m128 length = _mm_sqrt_ps(_mm_add_ps(
+          _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)),
+          _mm_mul_ps(dz, dz)));
+      __m128 along = _mm_add_ps(
+          _mm_add_ps(_mm_mul_ps(dx, _mm_loadu_ps(&clusters.axisX[i])),
+                     _mm_mul_ps(dy, _mm_loadu_ps(&clusters.axisY[i]))),
+          _mm_mul_ps(dz, _mm_loadu_ps(&clusters.axisZ[i])));
+      __m128 limit = _mm_add_ps(
+          _mm_mul_ps(_mm_loadu_ps(&clusters.cutoff[i]), length), radius);
+      inside = _mm_andnot_ps(_mm_cmpge_ps(along, limit), inside);
+    }
+
+    int mask = _mm_movemask_ps(inside);
+    for (size_t j = i; mask != 0 && j < min(i + 4, clusters.count); ++j) {
+      if (mask & (1 << (j - i))) {
+        addRange(ranges, clusters.firstIndex[j], clusters.numIndices[j]);
+        kept += clusters.numIndices[j];
+      }
+    }
+  }
+  return kept;
+}
+
+#else
+
+size_t meshlets::cull(const Clusters &clusters, const View &view,
+                      vector<Range> &ranges) {
+  return cullScalar(clusters, view, ranges);
+}
+
+#endif
@@ -0,0 +1,280 @@
+#include "mip_generator.h"
+#include "ThreadPool.h"
+#include "pixel_kernels.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+
+using namespace std;
+
+namespace {
+
+const float PI = 3.14159265358979f;
+// Support of the Kaiser windowed sinc in destination pixels, and the
+// window's shape parameter.
+const float KAISER_RADIUS = 1.5f;
+const float KAISER_ALPHA = 4.0f;
+
+// Zeroth order modified Bessel function of the first kind.
+float besselI0(float x) {
+  float sum = 1.0f, term = 1.0f;
+  for (int k = 1; k < 20; ++k) {
+    term *= (x / (2.0f * k)) * (x / (2.0f * k));
+    sum += term;
+  }
+  return sum;
+}
+
+float kaiser(float d) {
+  float t = d / KAISER_RADIUS;
+  if (fabs(t) >= 1.0f)
+    return 0.0f;
+  float sinc = d == 0.0f ? 1.0f : sin(PI * d) / (PI * d);
+  return sinc * besselI0(KAISER_ALPHA * sqrt(1.0f - t * t)) /
+         besselI0(KAISER_ALPHA);
+}
+
+float box(float d) {
+  d = fabs(d);
+  return d < 0.5f ? 1.0f : (d == 0.5f ? 0.5f : 0.0f);
+}
+
+// Source pixels and weights of every destination pixel along one axis. All
+// destination pixels have the same number of taps, unused ones weigh 0.
+struct Axis {
+  int numTaps;
+  vector<int> indices;
+  vector<float> weights;
+};
+
+Axis computeAxis(int srcSize, int dstSize, const mips::Options &options) {
+  float scale = static_cast<float>(srcSize) / dstSize;
+  float radius = options.filter == mips::Filter::Box ? 0.5f : KAISER_RADIUS;
+  Axis axis;
+  axis.numTaps = static_cast<int>(ceil(2.0f * radius * scale)) + 1;
+  axis.indices.assign(static_cast<size_t>(dstSize) * axis.numTaps, 0);
+  axis.weights.assign(static_cast<size_t>(dstSize) * axis.numTaps, 0.0f);
+
+  for (int x = 0; x < dstSize; ++x) {
+    float center = (x + 0.5f) * scale;
+    int first = static_cast<int>(floor(center - radius * scale));
+    float sum = 0.0f;
+    for (int t = 0; t < axis.numTaps; ++t) {
+      int s = first + t;
+      // Distance in destination pixels.
+      float d = (s + 0.5f - center) / scale;
+      float weight = options.filter == mips::Filter::Box ? box(d) : kaiser(d);
+      if (options.wrap)
+        s = ((s % srcSize) + srcSize) % srcSize;
+      else
+        s = min(max(s, 0), srcSize - 1);
+      axis.indices[x * axis.numTaps + t] = s;
+      axis.weights[x * axis.numTaps + t] = weight;
+      sum += weight;
+    }
+    for (int t = 0; t < axis.numTaps; ++t)
+      axis.weights[x * axis.numTaps + t] /= sum;
+  }
+  return axis;
+}
+
+void forRows(ThreadPool *pool, size_t count,
+             const function<void(size_t, size_t)> &body) {
+  if (pool != nullptr)
+    pool->parallelFor(count, body);
+  else
+    body(0, count);
+}
+
+void toFloat(const unsigned char *src, float *dst, size_t numPixels,
+             int nrComponents, const mips::Options &options) {
+  size_t count = numPixels * nrComponents;
+  if (options.srgb) {
+    pixels::srgbToLinear(src, dst, count);
+    if (nrComponents == 4) {
+      for (size_t i = 3; i < count; i += 4)
+        dst[i] = src[i] / 255.0f;
+    }
+  } else {
+    for (size_t i = 0; i < count; ++i)
+      dst[i] = src[i] / 255.0f;
+  }
+  if (options.normalMap) {
+    int numAxes = min(nrComponents, 3);
+    for (size_t i = 0; i < numPixels; ++i)
+      for (int c = 0; c < numAxes; ++c)
+        dst[i * nrComponents + c] = dst[i * nrComponents + c] * 2.0f - 1.0f;
+  }
+}
+
+unsigned char unorm8(float v) {
+  return static_cast<unsigned char>(min(max(v, 0.0f), 1.0f) * 255.0f + 0.5f);
+}
+
+void toBytes(const float *src, unsigned char *dst, size_t numPixels,
+             int nrComponents, const mips::Options &options) {
+  size_t count = numPixels * nrComponents;
+  if (options.normalMap) {
+    int numAxes = min(nrComponents, 3);
+    for (size_t i = 0; i < numPixels; ++i) {
+      for (int c = 0; c < numAxes; ++c) {
+        size_t j = i * nrComponents + c;
+        dst[j] = unorm8(src[j] * 0.5f + 0.5f);
+      }
+      for (int c = numAxes; c < nrComponents; ++c)
+        dst[i * nrComponents + c] = unorm8(src[i * nrComponents + c]);
+    }
+    return;
+  }
+  if (options.srgb) {
+    pixels::linearToSrgb(src, dst, count);
+    if (nrComponents == 4) {
+      for (size_t i = 3; i < count; i += 4)
+        dst[i] = unorm8(src[i]);
+    }
+    return;
+  }
+  for (size_t i = 0; i < count; ++i)
+    dst[i] = unorm8(src[i]);
+}
+
+void renormalize(float *pixels, size_t numPixels, int nrComponents) {
+  if (nrComponents < 3)
+    return;
+  for (size_t i = 0; i < numPixels; ++i) {
+    float *n = pixels + i * nrComponents;
+    float length = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+    if (length > 0.0f) {
+      n[0] /= length;
+      n[1] /= length;
+      n[2] /= length;
+    }
+  }
+}
+
+// dst += weight * src over count floats, written so the compiler vectorizes
+// it.
+void addScaled(float *__restrict dst, const float *__restrict src,
+               float weight, size_t count) {
+  for (size_t i = 0; i < count; ++i)
+    dst[i] += weight * src[i];
+}
+
+// Horizontal pass over rows [begin, end), unrolled for the channel count.
+template <int N>
+void filterRows(const float *src, size_t srcRow, float *dst, size_t dstRow,
+                int newWidth, const Axis &axis, size_t begin, size_t end) {
+  for (size_t y = begin; y < end; ++y) {
+    const float *in = src + y * srcRow;
+    float *out = dst + y * dstRow;
+    const int *indices = axis.indices.data();
+    const float *weights = axis.weights.data();
+    for (int x = 0; x < newWidth; ++x) {
+      float sum[N] = {};
+      for (int t = 0; t < axis.numTaps; ++t, ++indices, ++weights) {
+        const float *pixel = in + *indices * N;
+        for (int c = 0; c < N; ++c)
+          sum[c] += *weights * pixel[c];
+      }
+      copy(sum, sum + N, out + x * N);
+    }
+  }
+}
+
+// Filter one level down from src, both in floating point.
+void downsample(const float *src, int width, int height, float *dst,
+                int newWidth, int newHeight, int nrComponents,
+                const mips::Options &options) {
+  Axis horizontal = computeAxis(width, newWidth, options);
+  Axis vertical = computeAxis(height, newHeight, options);
+  size_t srcRow = static_cast<size_t>(width) * nrComponents;
+  size_t dstRow = static_cast<size_t>(newWidth) * nrComponents;
+  vector<float> tmp(dstRow * height);
+
+  forRows(options.pool, height, [&](size_t begin, size_t end) {
+    switch (nrComponents) {
+    case 1:
+      filterRows<1>(src, srcRow, tmp.data(), dstRow, newWidth, horizontal,
+                    begin, end);
+      break;
+    case 2:
+      filterRows<2>(src, srcRow, tmp.data(), dstRow, newWidth, horizontal,
+                    begin, end);
+      break;
+    case 3:
+      filterRows<3>(src, srcRow, tmp.data(), dstRow, newWidth, horizontal,
+                    begin, end);
+      break;
+    default:
+      filterRows<4>(src, srcRow, tmp.data(), dstRow, newWidth, horizontal,
+                    begin, end);
+      break;
+    }
+  });
+
+  forRows(options.pool, newHeight, [&](size_t begin, size_t end) {
+    for (size_t y = begin; y < end; ++y) {
+      float *out = dst + y * dstRow;
+      fill(out, out + dstRow, 0.0f);
+      for (int t = 0; t < vertical.numTaps; ++t) {
+        size_t row = vertical.indices[y * vertical.numTaps + t];
+        addScaled(out, tmp.data() + row * dstRow,
+                  vertical.weights[y * vertical.numTaps + t], dstRow);
+      }
+    }
+  });
+}
+
+} // namespace
+
+int mips::numLevels(int width, int height) {
+  int levels = 1;
+  while (width > 1 || height > 1) {
+    width = max(width / 2, 1);
+    height = max(height / 2, 1);
+    ++levels;
+  }
+  return levels;
+}
+
+unsigned char *mips::generate(const unsigned char *image, int width,
+                              int height, int nrComponents,
+                              const Options &options,
+                              vector<dds::MipLevel> &levels) {
+  levels.clear();
+  size_t total = 0;
+  for (int w = width, h = height;; w = max(w / 2, 1), h = max(h / 2, 1)) {
+    size_t size = static_cast<size_t>(w) * h * nrComponents;
+    levels.push_back({w, h, total, size});
+    total += size;
+    if (w == 1 && h == 1)
+      break;
+  }
+  unsigned char *data = static_cast<unsigned char *>(malloc(total));
+  if (data == nullptr) {
+    levels.clear();
+    return nullptr;
+  }
+  memcpy(data, image, levels[0].size);
+
+  size_t numPixels = static_cast<size_t>(width) * height;
+  vector<float> current(numPixels * nrComponents);
+  toFloat(image, current.data(), numPixels, nrComponents, options);
+  vector<float> next;
+  for (size_t i = 1; i < levels.size(); ++i) {
+    const dds::MipLevel &prev = levels[i - 1];
+    const dds::MipLevel &level = levels[i];
+    size_t levelPixels = static_cast<size_t>(level.width) * level.height;
+    next.resize(levelPixels * nrComponents);
+    downsample(current.data(), prev.width, prev.height, next.data(),
+               level.width, level.height, nrComponents, options);
+    if (options.normalMap)
+      renormalize(next.data(), levelPixels, nrComponents);
+    toBytes(next.data(), data + level.offset, levelPixels, nrComponents,
+            options);
+    swap(current, next);
+  }
+  return data;
+}
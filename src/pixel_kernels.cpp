@@ -0,0 +1,440 @@
+#include "pixel_kernels.h"
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define PIXELS_X86 1
+#include <immintrin.h>
+#else
+#define PIXELS_X86 0
+#endif
+
+using namespace std;
+
+namespace {
+
+// Resolution of the linear to sRGB table, fine enough that every 8-bit sRGB
+// value survives the round trip through linear.
+const int LINEAR_STEPS = 4095;
+
+struct Tables {
+  float toLinear[256];
+  int32_t toSrgb[LINEAR_STEPS + 1];
+
+  Tables() {
+    for (int i = 0; i < 256; ++i) {
+      float c = i / 255.0f;
+      toLinear[i] = c <= 0.04045f ? c / 12.92f
+                                  : powf((c + 0.055f) / 1.055f, 2.4f);
+    }
+    for (int i = 0; i <= LINEAR_STEPS; ++i) {
+      float l = static_cast<float>(i) / LINEAR_STEPS;
+      float c = l <= 0.0031308f ? l * 12.92f
+                                : 1.055f * powf(l, 1.0f / 2.4f) - 0.055f;
+      toSrgb[i] = static_cast<int32_t>(lroundf(c * 255.0f));
+    }
+  }
+};
+
+const Tables &tables() {
+  static const Tables instance;
+  return instance;
+}
+
+int linearIndex(float value) {
+  // Also maps NaN to 0.
+  float clamped = value > 0.0f ? (value < 1.0f ? value : 1.0f) : 0.0f;
+  return static_cast<int>(clamped * LINEAR_STEPS + 0.5f);
+}
+
+// Scalar kernels, also used for the tails of the vector kernels.
+
+void flipChannelScalar(unsigned char *data, size_t numPixels,
+                       int nrComponents, int channel) {
+  for (size_t i = 0; i < numPixels; ++i)
+    data[i * nrComponents + channel] = 255 - data[i * nrComponents + channel];
+}
+
+void expandRGBToRGBAScalar(const unsigned char *src, unsigned char *dst,
+                           size_t numPixels) {
+  for (size_t i = 0; i < numPixels; ++i) {
+    dst[i * 4] = src[i * 3];
+    dst[i * 4 + 1] = src[i * 3 + 1];
+    dst[i * 4 + 2] = src[i * 3 + 2];
+    dst[i * 4 + 3] = 255;
+  }
+}
+
+void swizzleRGBAScalar(const unsigned char *src, unsigned char *dst,
+                       size_t numPixels, const int order[4]) {
+  for (size_t i = 0; i < numPixels; ++i) {
+    unsigned char pixel[4];
+    memcpy(pixel, src + i * 4, 4);
+    for (int c = 0; c < 4; ++c)
+      dst[i * 4 + c] = pixel[order[c]];
+  }
+}
+
+void extractChannelScalar(const unsigned char *src, unsigned char *dst,
+                          size_t numPixels, int nrComponents, int channel) {
+  for (size_t i = 0; i < numPixels; ++i)
+    dst[i] = src[i * nrComponents + channel];
+}
+
+void srgbToLinearScalar(const unsigned char *src, float *dst, size_t count) {
+  const float *table = tables().toLinear;
+  for (size_t i = 0; i < count; ++i)
+    dst[i] = table[src[i]];
+}
+
+void linearToSrgbScalar(const float *src, unsigned char *dst, size_t count) {
+  const int32_t *table = tables().toSrgb;
+  for (size_t i = 0; i < count; ++i)
+    dst[i] = static_cast<unsigned char>(table[linearIndex(src[i])]);
+}
+
+#if PIXELS_X86
+
+// XOR mask covering a whole number of pixels of up to 4 channels.
+void fillFlipMask(unsigned char *mask, size_t size, int nrComponents,
+                  int channel) {
+  for (size_t i = 0; i < size; ++i)
+    mask[i] = i % nrComponents == static_cast<size_t>(channel) ? 0xFF : 0;
+}
+
+void flipChannelSSE2(unsigned char *data, size_t numPixels, int nrComponents,
+                     int channel) {
+  alignas(16) unsigned char maskBytes[48];
+  fillFlipMask(maskBytes, sizeof(maskBytes), nrComponents, channel);
+  __m128i mask[3];
+  for (int j = 0; j < 3; ++j)
+    mask[j] = _mm_load_si128(reinterpret_cast<const __m128i *>(maskBytes) + j);
+
+  size_t size = numPixels * nrComponents;
+  size_t i = 0;
+  for (; i + 48 <= size; i += 48) {
+    for (int j = 0; j < 3; ++j) {
+      __m128i *ptr = reinterpret_cast<__m128i *>(data + i) + j;
+      _mm_storeu_si128(ptr, _mm_xor_si128(_mm_loadu_si128(ptr), mask[j]));
+    }
+  }
+  // 48 bytes always hold whole pixels, so the tail starts on a pixel.
+  flipChannelScalar(data + i, (size - i) / nrComponents, nrComponents,
+                    channel);
+}
+
+void expandRGBToRGBASSE2(const unsigned char *src, unsigned char *dst,
+                         size_t numPixels) {
+  // SSE2 has no byte shuffle, so gather 4 pixels with 32-bit loads (the
+  // fourth byte is the next pixel's red and gets replaced by alpha).
+  const __m128i alpha = _mm_set1_epi32(static_cast<int>(0xFF000000u));
+  size_t i = 0;
+  for (; i + 5 <= numPixels; i += 4) {
+    int32_t words[4];
+    memcpy(words, src + i * 3, 4);
+    memcpy(words + 1, src + i * 3 + 3, 4);
+    memcpy(words + 2, src + i * 3 + 6, 4);
+    memcpy(words + 3, src + i * 3 + 9, 4);
+    __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i *>(words));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i * 4),
+                     _mm_or_si128(pixels, alpha));
+  }
+  expandRGBToRGBAScalar(src + i * 3, dst + i * 4, numPixels - i);
+}
+
+void extractChannelSSE2(const unsigned char *src, unsigned char *dst,
+                        size_t numPixels, int nrComponents, int channel) {
+  size_t i = 0;
+  const __m128i shift = _mm_cvtsi32_si128(8 * channel);
+  if (nrComponents == 4) {
+    const __m128i low = _mm_set1_epi32(0xFF);
+    const __m128i *in = reinterpret_cast<const __m128i *>(src);
+    for (; i + 16 <= numPixels; i += 16, in += 4) {
+      __m128i a = _mm_and_si128(_mm_srl_epi32(_mm_loadu_si128(in), shift), low);
+      __m128i b = _mm_and_si128(
+          _mm_srl_epi32(_mm_loadu_si128(in + 1), shift), low);
+      __m128i c = _mm_and_si128(
+          _mm_srl_epi32(_mm_loadu_si128(in + 2), shift), low);
+      __m128i d = _mm_and_si128(
+          _mm_srl_epi32(_mm_loadu_si128(in + 3), shift), low);
+      __m128i packed =
+          _mm_packus_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d));
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), packed);
+    }
+  } else if (nrComponents == 2) {
+    const __m128i low = _mm_set1_epi16(0xFF);
+    const __m128i *in = reinterpret_cast<const __m128i *>(src);
+    for (; i + 16 <= numPixels; i += 16, in += 2) {
+      __m128i a = _mm_and_si128(_mm_srl_epi16(_mm_loadu_si128(in), shift), low);
+      __m128i b = _mm_and_si128(
+          _mm_srl_epi16(_mm_loadu_si128(in + 1), shift), low);
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i),
+                       _mm_packus_epi16(a, b));
+    }
+  }
+  extractChannelScalar(src + i * nrComponents, dst + i, numPixels - i,
+                       nrComponents, channel);
+}
+
+void linearToSrgbSSE2(const float *src, unsigned char *dst, size_t count) {
+  // Compute the table indices 4 at a time, only the lookups are scalar.
+  const int32_t *table = tables().toSrgb;
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 one = _mm_set1_ps(1.0f);
+  const __m128 scale = _mm_set1_ps(static_cast<float>(LINEAR_STEPS));
+  const __m128 half = _mm_set1_ps(0.5f);
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    // max returns its second operand for NaN inputs.
+    __m128 x = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(src + i), zero), one);
+    alignas(16) int32_t index[4];
+    _mm_store_si128(reinterpret_cast<__m128i *>(index),
+                    _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(x, scale), half)));
+    for (int j = 0; j < 4; ++j)
+      dst[i + j] = static_cast<unsigned char>(table[index[j]]);
+  }
+  linearToSrgbScalar(src + i, dst + i, count - i);
+}
+
+__attribute__((target("avx2"))) void
+flipChannelAVX2(unsigned char *data, size_t numPixels, int nrComponents,
+                int channel) {
+  alignas(32) unsigned char maskBytes[96];
+  fillFlipMask(maskBytes, sizeof(maskBytes), nrComponents, channel);
+  __m256i mask[3];
+  for (int j = 0; j < 3; ++j)
+    mask[j] =
+        _mm256_load_si256(reinterpret_cast<const __m256i *>(maskBytes) + j);
+
+  size_t size = numPixels * nrComponents;
+  size_t i = 0;
+  for (; i + 96 <= size; i += 96) {
+    for (int j = 0; j < 3; ++j) {
+      __m256i *ptr = reinterpret_cast<__m256i *>(data + i) + j;
+      _mm256_storeu_si256(ptr,
+                          _mm256_xor_si256(_mm256_loadu_si256(ptr), mask[j]));
+    }
+  }
+  flipChannelSSE2(data + i, (size - i) / nrComponents, nrComponents, channel);
+}
+
+__attribute__((target("avx2"))) void
+expandRGBToRGBAAVX2(const unsigned char *src, unsigned char *dst,
+                    size_t numPixels) {
+  // Each 128-bit lane gets 4 pixels (12 of its 16 bytes) and spreads them.
+  const __m256i shuffle = _mm256_setr_epi8(
+      0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1, 0, 1, 2, -1, 3, 4,
+      5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+  const __m256i alpha = _mm256_set1_epi32(static_cast<int>(0xFF000000u));
+  size_t i = 0;
+  // The second load reads 4 bytes past the 8 pixels.
+  for (; i + 10 <= numPixels; i += 8) {
+    __m128i lo =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i * 3));
+    __m128i hi =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i * 3 + 12));
+    __m256i pixels = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+    pixels = _mm256_or_si256(_mm256_shuffle_epi8(pixels, shuffle), alpha);
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i * 4), pixels);
+  }
+  expandRGBToRGBASSE2(src + i * 3, dst + i * 4, numPixels - i);
+}
+
+__attribute__((target("avx2"))) void
+swizzleRGBAAVX2(const unsigned char *src, unsigned char *dst,
+                size_t numPixels, const int order[4]) {
+  alignas(32) char shuffleBytes[32];
+  for (int i = 0; i < 32; ++i)
+    shuffleBytes[i] = static_cast<char>((i % 16) / 4 * 4 + order[i % 4]);
+  const __m256i shuffle =
+      _mm256_load_si256(reinterpret_cast<const __m256i *>(shuffleBytes));
+  size_t i = 0;
+  for (; i + 8 <= numPixels; i += 8) {
+    __m256i pixels =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i * 4));
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i * 4),
+                        _mm256_shuffle_epi8(pixels, shuffle));
+  }
+  swizzleRGBAScalar(src + i * 4, dst + i * 4, numPixels - i, order);
+}
+
+__attribute__((target("avx2"))) void
+extractChannelAVX2(const unsigned char *src, unsigned char *dst,
+                   size_t numPixels, int nrComponents, int channel) {
+  size_t i = 0;
+  if (nrComponents == 4) {
+    const __m256i low = _mm256_set1_epi32(0xFF);
+    // The packs interleave the two lanes, this puts the pixels back in order.
+    const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+    const __m128i shift = _mm_cvtsi32_si128(8 * channel);
+    const __m256i *in = reinterpret_cast<const __m256i *>(src);
+    for (; i + 32 <= numPixels; i += 32, in += 4) {
+      __m256i a = _mm256_and_si256(
+          _mm256_srl_epi32(_mm256_loadu_si256(in), shift), low);
+      __m256i b = _mm256_and_si256(
+          _mm256_srl_epi32(_mm256_loadu_si256(in + 1), shift), low);
+      __m256i c = _mm256_and_si256(
+          _mm256_srl_epi32(_mm256_loadu_si256(in + 2), shift), low);
+      __m256i d = _mm256_and_si256(
+          _mm256_srl_epi32(_mm256_loadu_si256(in + 3), shift), low);
+      __m256i packed = _mm256_packus_epi16(_mm256_packs_epi32(a, b),
+                                           _mm256_packs_epi32(c, d));
+      _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i),
+                          _mm256_permutevar8x32_epi32(packed, order));
+    }
+  }
+  extractChannelSSE2(src + i * nrComponents, dst + i, numPixels - i,
+                     nrComponents, channel);
+}
+
+__attribute__((target("avx2"))) void
+srgbToLinearAVX2(const unsigned char *src, float *dst, size_t count) {
+  const float *table = tables().toLinear;
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    __m128i bytes =
+        _mm_loadl_epi64(reinterpret_cast<const __m128i *>(src + i));
+    __m256i index = _mm256_cvtepu8_epi32(bytes);
+    _mm256_storeu_ps(dst + i, _mm256_i32gather_ps(table, index, 4));
+  }
+  srgbToLinearScalar(src + i, dst + i, count - i);
+}
+
+__attribute__((target("avx2"))) void
+linearToSrgbAVX2(const float *src, unsigned char *dst, size_t count) {
+  const int32_t *table = tables().toSrgb;
+  const __m256 zero = _mm256_setzero_ps();
+  const __m256 one = _mm256_set1_ps(1.0f);
+  const __m256 scale = _mm256_set1_ps(static_cast<float>(LINEAR_STEPS));
+  const __m256 half = _mm256_set1_ps(0.5f);
+  size_t i = 0;
+  for (; i + 16 <= count; i += 16) {
+    __m256i values[2];
+    for (int j = 0; j < 2; ++j) {
+      __m256 x = _mm256_min_ps(
+          _mm256_max_ps(_mm256_loadu_ps(src + i + 8 * j), zero), one);
+      __m256i index = _mm256_cvttps_epi32(
+          _mm256_add_ps(_mm256_mul_ps(x, scale), half));
+      values[j] = _mm256_i32gather_epi32(table, index, 4);
+    }
+    // Narrow 16 values to bytes, the packs interleave the lanes.
+    __m256i words = _mm256_permute4x64_epi64(
+        _mm256_packs_epi32(values[0], values[1]), 0xD8);
+    __m128i bytes = _mm_packus_epi16(_mm256_castsi256_si128(words),
+                                     _mm256_extracti128_si256(words, 1));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), bytes);
+  }
+  linearToSrgbSSE2(src + i, dst + i, count - i);
+}
+
+#endif
+
+struct Kernels {
+  void (*flipChannel)(unsigned char *, size_t, int, int);
+  void (*expandRGBToRGBA)(const unsigned char *, unsigned char *, size_t);
+  void (*swizzleRGBA)(const unsigned char *, unsigned char *, size_t,
+                      const int *);
+  void (*extractChannel)(const unsigned char *, unsigned char *, size_t, int,
+                         int);
+  void (*srgbToLinear)(const unsigned char *, float *, size_t);
+  void (*linearToSrgb)(const float *, unsigned char *, size_t);
+};
+
+const Kernels SCALAR_KERNELS = {flipChannelScalar,  expandRGBToRGBAScalar,
+                                swizzleRGBAScalar,  extractChannelScalar,
+                                srgbToLinearScalar, linearToSrgbScalar};
+#if PIXELS_X86
+// SSE2 has no byte shuffle and no gather, those kernels stay scalar.
+const Kernels SSE2_KERNELS = {flipChannelSSE2,    expandRGBToRGBASSE2,
+                              swizzleRGBAScalar,  extractChannelSSE2,
+                              srgbToLinearScalar, linearToSrgbSSE2};
+const Kernels AVX2_KERNELS = {flipChannelAVX2,  expandRGBToRGBAAVX2,
+                              swizzleRGBAAVX2,  extractChannelAVX2,
+                              srgbToLinearAVX2, linearToSrgbAVX2};
+#endif
+
+const Kernels &kernelsFor(pixels::Isa isa) {
+#if PIXELS_X86
+  if (isa == pixels::Isa::AVX2)
+    return AVX2_KERNELS;
+  if (isa == pixels::Isa::SSE2)
+    return SSE2_KERNELS;
+#endif
+  return SCALAR_KERNELS;
+}
+
+atomic<int> selectedIsa{-1};
+
+const Kernels &kernels() {
+  return kernelsFor(pixels::activeIsa());
+}
+
+} // namespace
+
+pixels::Isa pixels::bestIsa() {
+#if PIXELS_X86
+  if (__builtin_cpu_supports("avx2"))
+    return Isa::AVX2;
+  if (__builtin_cpu_supports("sse2"))
+    return Isa::SSE2;
+#endif
+  return Isa::Scalar;
+}
+
+pixels::Isa pixels::activeIsa() {
+  int isa = selectedIsa.load(memory_order_relaxed);
+  if (isa < 0) {
+    isa = static_cast<int>(bestIsa());
+    selectedIsa.store(isa, memory_order_relaxed);
+  }
+  return static_cast<Isa>(isa);
+}
+
+bool pixels::setIsa(Isa isa) {
+  if (static_cast<int>(isa) > static_cast<int>(bestIsa()))
+    return false;
+  selectedIsa.store(static_cast<int>(isa), memory_order_relaxed);
+  return true;
+}
+
+const char *pixels::isaName(Isa isa) {
+  switch (isa) {
+  case Isa::Scalar:
+    return "scalar";
+  case Isa::SSE2:
+    return "SSE2";
+  case Isa::AVX2:
+    return "AVX2";
+  }
+  return "";
+}
+
+void pixels::flipChannel(unsigned char *data, size_t numPixels,
+                         int nrComponents, int channel) {
+  kernels().flipChannel(data, numPixels, nrComponents, channel);
+}
+
+void pixels::expandRGBToRGBA(const unsigned char *src, unsigned char *dst,
+                             size_t numPixels) {
+  kernels().expandRGBToRGBA(src, dst, numPixels);
+}
+
+void pixels::swizzleRGBA(const unsigned char *src, unsigned char *dst,
+                         size_t numPixels, const int order[4]) {
+  kernels().swizzleRGBA(src, dst, numPixels, order);
+}
+
+void pixels::extractChannel(const unsigned char *src, unsigned char *dst,
+                            size_t numPixels, int nrComponents, int channel) {
+  kernels().extractChannel(src, dst, numPixels, nrComponents, channel);
+}
+
+void pixels::srgbToLinear(const unsigned char *src, float *dst, size_t count) {
+  kernels().srgbToLinear(src, dst, count);
+}
+
+void pixels::linearToSrgb(const float *src, unsigned char *dst, size_t count) {
+  kernels().linearToSrgb(src, dst, count);
+}
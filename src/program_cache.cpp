@@ -0,0 +1,122 @@
+#include "program_cache.h"
+#include "MappedFile.h"
+#include "hashing.h"
+#include <glad/glad.h>
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+using namespace std;
+
+namespace {
+
+const char MAGIC[4] = {'L', 'T', 'P', 'C'};
+
+struct FileHeader {
+  char magic[4];
+  uint32_t version;
+  uint64_t key;
+  uint32_t format;
+  uint32_t size;
+};
+
+uint64_t hashString(const char *str, uint64_t seed) {
+  if (str == nullptr)
+    return seed;
+  return fnv1a64(str, strlen(str) + 1, seed);
+}
+
+string fileName(const string &path) {
+  size_t slash = path.find_last_of("/\\");
+  return slash == string::npos ? path : path.substr(slash + 1);
+}
+
+} // namespace
+
+string programcache::cachePath(const vector<string> &paths,
+                               const vector<string> &defines) {
+  string path = paths.front();
+  for (size_t i = 1; i < paths.size(); ++i)
+    path += "+" + fileName(paths[i]);
+  for (const string &define : defines)
+    path += "-" + define;
+  return path + ".programcache";
+}
+
+uint64_t programcache::computeKey(const vector<string> &sources) {
+  GLint numFormats = 0;
+  glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &numFormats);
+  if (numFormats <= 0)
+    return 0;
+  uint64_t key = hashValue(VERSION, FNV_OFFSET_BASIS);
+  for (GLenum name : {GL_VENDOR, GL_RENDERER, GL_VERSION})
+    key = hashString(reinterpret_cast<const char *>(glGetString(name)), key);
+  for (const string &source : sources) {
+    // The size separates the stages.
+    key = hashValue(static_cast<uint64_t>(source.size()), key);
+    key = fnv1a64(source.data(), source.size(), key);
+  }
+  return key;
+}
+
+unsigned int programcache::read(const string &path, uint64_t key) {
+  MappedFile file(path);
+  if (!file.isOpen() || file.size() < sizeof(FileHeader))
+    return 0;
+  FileHeader header;
+  memcpy(&header, file.data(), sizeof(header));
+  if (memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 ||
+      header.version != VERSION || header.key != key ||
+      header.size > file.size() - sizeof(header))
+    return 0;
+
+  unsigned int program = glCreateProgram();
+  glProgramBinary(program, header.format, file.data() + sizeof(header),
+                  header.size);
+  GLint success = 0;
+  glGetProgramiv(program, GL_LINK_STATUS, &success);
+  if (!success) {
+    // Usually a driver update that kept the version string.
+    cout << "Program cache rejected by the driver: " << path << endl;
+    glDeleteProgram(program);
+    return 0;
+  }
+  return program;
+}
+
+bool programcache::write(const string &path, uint64_t key,
+                         unsigned int program) {
+  GLint length = 0;
+  glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+  if (length <= 0)
+    return false;
+  vector<char> binary(length);
+  GLenum format = 0;
+  glGetProgramBinary(program, length, &length, &format, binary.data());
+
+  // Write to a temporary file first so a partial cache is never read.
+  string tmpPath = path + ".tmp";
+  ofstream out(tmpPath, ios::binary | ios::trunc);
+  if (!out) {
+    cout << "Could not write program cache: " << path << endl;
+    return false;
+  }
+  FileHeader header;
+  memcpy(header.magic, MAGIC, sizeof(MAGIC));
+  header.version = VERSION;
+  header.key = key;
+  header.format = format;
+  header.size = static_cast<uint32_t>(length);
+  out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  out.write(binary.data(), length);
+
+  out.close();
+  if (!out || rename(tmpPath.c_str(), path.c_str()) != 0) {
+    cout << "Could not write program cache: " << path << endl;
+    remove(tmpPath.c_str());
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,109 @@
+#include "shader_source.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+using namespace std;
+
+namespace {
+
+string readFile(const string &path, bool &read) {
+  ifstream file;
+  // ensure ifstream objects can throw exceptions:
+  file.exceptions(ifstream::failbit | ifstream::badbit);
+  try {
+    file.open(path);
+    stringstream stream;
+    stream << file.rdbuf();
+    read = true;
+    return stream.str();
+  } catch (const ifstream::failure &e) {
+    cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ: " << path << endl;
+  }
+  read = false;
+  return string();
+}
+
+bool startsWith(const string &line, const char *directive) {
+  size_t first = line.find_first_not_of(" \t");
+  return first != string::npos && line.compare(first, strlen(directive),
+                                               directive) == 0;
+}
+
+// The quoted file name of an #include line.
+bool parseInclude(const string &line, string &name) {
+  if (!startsWith(line, "#include"))
+    return false;
+  size_t open = line.find('"');
+  size_t close = open == string::npos ? open : line.find('"', open + 1);
+  if (close == string::npos)
+    return false;
+  name = line.substr(open + 1, close - open - 1);
+  return true;
+}
+
+string directoryOf(const string &path) {
+  size_t slash = path.find_last_of("/\\");
+  return slash == string::npos ? string() : path.substr(0, slash + 1);
+}
+
+// Append the file at path to the code of source with its includes expanded.
+// defines is inserted after the #version line of the stage and cleared.
+void expand(const string &path, shadersource::Source &source,
+            string &defines) {
+  size_t index = source.files.size();
+  source.files.push_back(path);
+  bool read;
+  istringstream lines(readFile(path, read));
+  if (!read)
+    source.complete = false;
+
+  string line, name;
+  size_t lineNumber = 0;
+  while (getline(lines, line)) {
+    ++lineNumber;
+    if (!parseInclude(line, name)) {
+      source.code += line;
+      source.code += '\n';
+      if (index == 0 && !defines.empty() && startsWith(line, "#version")) {
+        source.code += defines;
+        source.code += "#line " + to_string(lineNumber + 1) + " 0\n";
+        defines.clear();
+      }
+      continue;
+    }
+    string includePath = directoryOf(path) + name;
+    if (find(source.files.begin(), source.files.end(), includePath) !=
+        source.files.end()) {
+      // Already included, the line is kept blank.
+      source.code += '\n';
+      continue;
+    }
+    source.code += "#line 1 " + to_string(source.files.size()) + "\n";
+    expand(includePath, source, defines);
+    source.code +=
+        "#line " + to_string(lineNumber + 1) + " " + to_string(index) + "\n";
+  }
+}
+
+} // namespace
+
+shadersource::Source shadersource::load(const string &path,
+                                        const vector<string> &defines) {
+  string defineLines;
+  for (const string &define : defines) {
+    string line = define;
+    size_t equals = line.find('=');
+    if (equals != string::npos)
+      line[equals] = ' ';
+    defineLines += "#define " + line + "\n";
+  }
+  Source source;
+  expand(path, source, defineLines);
+  // Stages without a #version line get the defines first.
+  if (!defineLines.empty())
+    source.code = defineLines + "#line 1 0\n" + source.code;
+  return source;
+}
@@ -1,103 +1,538 @@
 #include "texture_loader.h"
+#include "TextureRegistry.h"
+#include "ThreadPool.h"
+#include "UploadQueue.h"
+#include "gl_extensions.h"
+#include "mip_generator.h"
+#include "pixel_kernels.h"
 #include "stb_image.h"
+#include <filesystem>
+#include <future>
 #include <iostream>
 #include <vector>
 
 using namespace std;
+namespace fs = std::filesystem;
+
+// GL formats of an uncompressed image with nrComponents channels.
+static void setFormats(DecodedImage &image, bool srgb) {
+  int nrComponents = image.nrComponents;
+  GLenum eformat = GL_RGB;
+  if (nrComponents == 1)
+    eformat = GL_RED;
+  else if (nrComponents == 2)
+    eformat = GL_RG;
+  else if (nrComponents == 3)
+    eformat = GL_RGB;
+  else if (nrComponents == 4)
+    eformat = GL_RGBA;
+  image.format = eformat;
+
+  // Sized internal formats, so the textures can be copied into immutable
+  // storage (see createTextureArray).
+  if (nrComponents == 1)
+    image.internalFormat = GL_R8;
+  else if (nrComponents == 2)
+    image.internalFormat = GL_RG8;
+  else if (nrComponents == 4)
+    image.internalFormat = srgb ? GL_SRGB8_ALPHA8 : GL_RGBA8;
+  else
+    image.internalFormat = srgb ? GL_SRGB8 : GL_RGB8;
+}
+
+// GL formats of a DXGI format read from a .dds file, false if the driver
+// can't sample it.
+static bool setDDSFormats(uint32_t format, bool srgb, DecodedImage &image) {
+  image.compressed = dds::isCompressed(format);
+  GLenum compressed = 0;
+  switch (format) {
+  case dds::FORMAT_R8_UNORM:
+    image.nrComponents = 1;
+    break;
+  case dds::FORMAT_RG8_UNORM:
+    image.nrComponents = 2;
+    break;
+  case dds::FORMAT_RGBA8_UNORM:
+  case dds::FORMAT_RGBA8_UNORM_SRGB:
+    image.nrComponents = 4;
+    break;
+  case dds::FORMAT_BC1_UNORM:
+  case dds::FORMAT_BC1_UNORM_SRGB:
+    image.nrComponents = 3;
+    if (!glext::textureCompressionS3TC)
+      return false;
+    compressed = srgb ? glext::COMPRESSED_SRGB_S3TC_DXT1
+                      : glext::COMPRESSED_RGB_S3TC_DXT1;
+    break;
+  case dds::FORMAT_BC4_UNORM:
+    image.nrComponents = 1;
+    compressed = GL_COMPRESSED_RED_RGTC1;
+    break;
+  case dds::FORMAT_BC5_UNORM:
+    image.nrComponents = 2;
+    compressed = GL_COMPRESSED_RG_RGTC2;
+    break;
+  case dds::FORMAT_BC7_UNORM:
+  case dds::FORMAT_BC7_UNORM_SRGB:
+    image.nrComponents = 4;
+    compressed = srgb ? GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM
+                      : GL_COMPRESSED_RGBA_BPTC_UNORM;
+    break;
+  default:
+    return false;
+  }
+  if (image.compressed) {
+    image.internalFormat = compressed;
+    image.format = compressed;
+  } else {
+    setFormats(image, srgb);
+  }
+  return true;
+}
+
+static bool isMipmapFilter(GLenum filter) {
+  return filter == GL_NEAREST_MIPMAP_NEAREST ||
+         filter == GL_LINEAR_MIPMAP_NEAREST ||
+         filter == GL_NEAREST_MIPMAP_LINEAR ||
+         filter == GL_LINEAR_MIPMAP_LINEAR;
+}
+
+static bool isClamped(const TextureRequest &request) {
+  return request.sWrap != GL_REPEAT || request.tWrap != GL_REPEAT;
+}
+
+static uint32_t bakeFlags(const TextureRequest &request) {
+  return dds::bakeFlags(request.flip, request.flipGreen, request.srgb,
+                        request.normalMap, isClamped(request), request.channel);
+}
+
+// Read the mip chain of a .dds file made from the source image with the
+// flags of the request. Fails if it is missing, older than the source or
+// made with other flags.
+static bool decodeDDS(const string &ddsPath, const TextureRequest &request,
+                      DecodedImage &image) {
+  error_code ec;
+  fs::file_time_type ddsTime = fs::last_write_time(ddsPath, ec);
+  if (ec)
+    return false;
+  fs::file_time_type sourceTime = fs::last_write_time(request.path, ec);
+  if (!ec && sourceTime > ddsTime)
+    return false;
+
+  dds::Description desc;
+  unsigned char *data = dds::read(ddsPath, desc);
+  if (data == nullptr)
+    return false;
+  image.data.reset(data);
+
+  if (desc.bakeFlags != bakeFlags(request) ||
+      !setDDSFormats(desc.format, request.srgb, image)) {
+    std::cout << "Baked texture does not match the load parameters: "
+              << ddsPath << std::endl;
+    image.data.reset();
+    return false;
+  }
+  image.width = desc.width;
+  image.height = desc.height;
+  image.levels = move(desc.levels);
+  return true;
+}
+
+// Replace level 0 by the full mip chain and store it in the mip cache.
+static void generateMips(const TextureRequest &request, DecodedImage &image) {
+  uint32_t format;
+  if (image.nrComponents == 1)
+    format = dds::FORMAT_R8_UNORM;
+  else if (image.nrComponents == 2)
+    format = dds::FORMAT_RG8_UNORM;
+  else if (image.nrComponents == 4)
+    format = request.srgb ? dds::FORMAT_RGBA8_UNORM_SRGB
+                          : dds::FORMAT_RGBA8_UNORM;
+  else
+    return;
+
+  // Decodes already run one image per pool thread, so the levels are not
+  // split any further.
+  mips::Options options;
+  options.srgb = request.srgb;
+  options.normalMap = request.normalMap;
+  options.wrap = !isClamped(request);
+  vector<dds::MipLevel> levels;
+  unsigned char *data =
+      mips::generate(image.data.get(), image.width, image.height,
+                     image.nrComponents, options, levels);
+  if (data == nullptr)
+    return;
+  image.data.reset(data);
+  image.levels = move(levels);
+
+  dds::Description desc;
+  desc.format = format;
+  desc.width = image.width;
+  desc.height = image.height;
+  desc.bakeFlags = bakeFlags(request);
+  desc.levels = image.levels;
+  dds::write(dds::cachePath(request.path, desc.bakeFlags), desc, data);
+}
+
+DecodedImage decodeImage(const TextureRequest &request) {
+  DecodedImage image;
+  const string &path = request.path;
+  if (decodeDDS(dds::bakedPath(path), request, image))
+    return image;
+  bool mipmapped = isMipmapFilter(request.minFilter);
+  if (mipmapped && decodeDDS(dds::cachePath(path, bakeFlags(request)),
+                             request, image))
+    return image;
 
-// utility function for loading a 2D texture from file (generates the texture)
-unsigned int loadTexture(string path, bool srgb, bool flip, bool flipGreen,
-                         GLenum sWrap, GLenum tWrap, GLenum minFilter,
-                         GLenum magFilter) {
   // tell stb_image to flip images on load (the image y axis tends to start from
-  // the top)
-  stbi_set_flip_vertically_on_load(flip);
+  // the top). The setting is thread local, so concurrent decodes don't clash.
+  stbi_set_flip_vertically_on_load_thread(request.flip);
+
+  image.data.reset(stbi_load(path.c_str(), &image.width, &image.height,
+                             &image.nrComponents, 0));
+  if (!image.data) {
+    std::cout << "Texture failed to load at path: " << path << std::endl;
+    return image;
+  }
+  size_t numPixels = static_cast<size_t>(image.width) * image.height;
+
+  // Flip green channel, useful for normal maps defined for DirectX.
+  if (request.flipGreen && image.nrComponents >= 2)
+    pixels::flipChannel(image.data.get(), numPixels, image.nrComponents, 1);
+
+  int channel = request.channel;
+  if (channel >= 0 && channel < image.nrComponents && image.nrComponents > 1) {
+    // Keep only the requested channel, e.g. of grayscale maps saved as RGB.
+    unsigned char *single = static_cast<unsigned char *>(malloc(numPixels));
+    if (single != nullptr) {
+      pixels::extractChannel(image.data.get(), single, numPixels,
+                             image.nrComponents, channel);
+      image.data.reset(single);
+      image.nrComponents = 1;
+    }
+  } else if (image.nrComponents == 3) {
+    // GL stores RGB8 textures as RGBA8, expanding here spares the driver a
+    // conversion and keeps the rows 4-byte aligned.
+    unsigned char *rgba = static_cast<unsigned char *>(malloc(numPixels * 4));
+    if (rgba != nullptr) {
+      pixels::expandRGBToRGBA(image.data.get(), rgba, numPixels);
+      image.data.reset(rgba);
+      image.nrComponents = 4;
+    }
+  }
+  setFormats(image, request.srgb);
+
+  if (mipmapped)
+    generateMips(request, image);
+  return image;
+}
 
+// Upload every level of a decoded mip chain to target.
+static void uploadLevels(GLenum target, const DecodedImage &image) {
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  for (size_t i = 0; i < image.levels.size(); ++i) {
+    const dds::MipLevel &level = image.levels[i];
+    const unsigned char *pixels = image.data.get() + level.offset;
+    if (image.compressed) {
+      glCompressedTexImage2D(target, static_cast<GLint>(i),
+                             image.internalFormat, level.width, level.height,
+                             0, static_cast<GLsizei>(level.size), pixels);
+    } else {
+      glTexImage2D(target, static_cast<GLint>(i), image.internalFormat,
+                   level.width, level.height, 0, image.format,
+                   GL_UNSIGNED_BYTE, pixels);
+    }
+  }
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+}
+
+unsigned int uploadTexture(DecodedImage image, const TextureRequest &request) {
   unsigned int textureID;
   glGenTextures(1, &textureID);
+  if (!image.data)
+    return textureID;
 
-  int width, height, nrComponents;
-  unsigned char *data =
-      stbi_load(path.c_str(), &width, &height, &nrComponents, 0);
+  glBindTexture(GL_TEXTURE_2D, textureID);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, request.sWrap);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, request.tWrap);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, request.minFilter);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, request.magFilter);
+  if (!image.levels.empty()) {
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL,
+                    static_cast<GLint>(image.levels.size() - 1));
+  }
 
-  // Flip green channel, useful for normal maps defined for DirectX.
-  if (flipGreen) {
-    for (int i = 0; i < width * height; ++i)
-      data[i * nrComponents + 1] = 255 - data[i * nrComponents + 1];
-  }
-
-  if (data) {
-    GLenum iformat = GL_RGB;
-    GLenum eformat = GL_RGB;
-    if (nrComponents == 1)
-      eformat = GL_RED;
-    else if (nrComponents == 3)
-      eformat = GL_RGB;
-    else if (nrComponents == 4)
-      eformat = GL_RGBA;
-
-    // override the format with a user-defined format
-    if (srgb) {
-      if (nrComponents == 3)
-        iformat = GL_SRGB;
-      else if (nrComponents == 4)
-        iformat = GL_SRGB_ALPHA;
-    } else
-      iformat = eformat;
-
-    glBindTexture(GL_TEXTURE_2D, textureID);
-    glTexImage2D(GL_TEXTURE_2D, 0, iformat, width, height, 0, eformat,
-                 GL_UNSIGNED_BYTE, data);
-    glGenerateMipmap(GL_TEXTURE_2D);
-
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, sWrap);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, tWrap);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, minFilter);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, magFilter);
-  } else {
-    std::cout << "Texture failed to load at path: " << path << std::endl;
+  UploadQueue *uploader = UploadQueue::active();
+  if (uploader != nullptr && !image.compressed) {
+    // Allocate the storage now and let the queue stream the pixels in.
+    auto deleter = image.data.get_deleter();
+    shared_ptr<const unsigned char> pixels(
+        image.data.release(), [deleter](const unsigned char *ptr) {
+          deleter(const_cast<unsigned char *>(ptr));
+        });
+    if (image.levels.empty()) {
+      glTexImage2D(GL_TEXTURE_2D, 0, image.internalFormat, image.width,
+                   image.height, 0, image.format, GL_UNSIGNED_BYTE, NULL);
+      uploader->queueTexture(textureID, 0, image.width, image.height,
+                             image.format, image.nrComponents, move(pixels),
+                             true);
+      return textureID;
+    }
+    for (size_t i = 0; i < image.levels.size(); ++i) {
+      const dds::MipLevel &level = image.levels[i];
+      glTexImage2D(GL_TEXTURE_2D, static_cast<GLint>(i), image.internalFormat,
+                   level.width, level.height, 0, image.format,
+                   GL_UNSIGNED_BYTE, NULL);
+      // Every level shares ownership of the whole chain.
+      shared_ptr<const unsigned char> levelPixels(pixels,
+                                                  pixels.get() + level.offset);
+      uploader->queueTexture(textureID, static_cast<GLint>(i), level.width,
+                             level.height, image.format, image.nrComponents,
+                             move(levelPixels), false);
+    }
+    return textureID;
   }
-  stbi_image_free(data);
+
+  if (!image.levels.empty()) {
+    // Mip chains from .dds files or the CPU generator are uploaded directly
+    // and need no mipmap generation.
+    uploadLevels(GL_TEXTURE_2D, image);
+    return textureID;
+  }
+
+  // Rows of RGB and single channel images are not 4-byte aligned.
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  glTexImage2D(GL_TEXTURE_2D, 0, image.internalFormat, image.width,
+               image.height, 0, image.format, GL_UNSIGNED_BYTE,
+               image.data.get());
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  glGenerateMipmap(GL_TEXTURE_2D);
 
   return textureID;
 }
 
-unsigned int loadCubeMap(vector<string> paths, bool flip, GLenum sWrap,
-                         GLenum tWrap, GLenum rWrap, GLenum minFilter,
+bool isTextureReady(unsigned int texture) {
+  UploadQueue *uploader = UploadQueue::active();
+  return uploader == nullptr || uploader->isTextureReady(texture);
+}
+
+struct TextureShape {
+  GLint width = 0;
+  GLint height = 0;
+  GLint internalFormat = 0;
+  GLint levels = 0;
+
+  bool operator==(const TextureShape &other) const {
+    return width == other.width && height == other.height &&
+           internalFormat == other.internalFormat && levels == other.levels;
+  }
+};
+
+// Size, format and number of defined mip levels of the bound 2D texture.
+static TextureShape boundTextureShape() {
+  TextureShape shape;
+  glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &shape.width);
+  glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT,
+                           &shape.height);
+  glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_INTERNAL_FORMAT,
+                           &shape.internalFormat);
+  GLint maxLevel = 0;
+  glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, &maxLevel);
+  for (GLint level = 0; level <= maxLevel; ++level) {
+    GLint width = 0;
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_WIDTH, &width);
+    if (width == 0)
+      break;
+    shape.levels++;
+  }
+  return shape;
+}
+
+// Sized format with the channels of an unsized one, glTexStorage3D only
+// takes sized formats.
+static GLenum sizedFormat(GLint internalFormat) {
+  switch (internalFormat) {
+  case GL_RED:
+    return GL_R8;
+  case GL_RG:
+    return GL_RG8;
+  case GL_RGB:
+    return GL_RGB8;
+  case GL_RGBA:
+    return GL_RGBA8;
+  case GL_SRGB:
+    return GL_SRGB8;
+  case GL_SRGB_ALPHA:
+    return GL_SRGB8_ALPHA8;
+  default:
+    return static_cast<GLenum>(internalFormat);
+  }
+}
+
+// Print the pending GL errors of a texture array, true if there were any.
+static bool textureArrayErrors() {
+  bool failed = false;
+  unsigned int err;
+  while ((err = glGetError()) != GL_NO_ERROR) {
+    cout << "Texture array error: " << hex << err << dec << '\n';
+    failed = true;
+  }
+  return failed;
+}
+
+unsigned int createTextureArray(const vector<unsigned int> &textures) {
+  if (textures.empty())
+    return 0;
+  TextureShape shape;
+  GLint sWrap = GL_REPEAT, tWrap = GL_REPEAT;
+  GLint minFilter = GL_LINEAR_MIPMAP_LINEAR, magFilter = GL_LINEAR;
+  for (size_t i = 0; i < textures.size(); ++i) {
+    glBindTexture(GL_TEXTURE_2D, textures[i]);
+    TextureShape layerShape = boundTextureShape();
+    if (i == 0) {
+      shape = layerShape;
+      glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, &sWrap);
+      glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, &tWrap);
+      glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, &minFilter);
+      glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, &magFilter);
+    } else if (!(layerShape == shape)) {
+      cout << "Texture " << textures[i]
+           << " does not match the other layers of its texture array\n";
+      glBindTexture(GL_TEXTURE_2D, 0);
+      return 0;
+    }
+  }
+  glBindTexture(GL_TEXTURE_2D, 0);
+  if (shape.levels == 0)
+    return 0;
+
+  unsigned int array;
+  glGenTextures(1, &array);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, array);
+  glTexStorage3D(GL_TEXTURE_2D_ARRAY, shape.levels,
+                 sizedFormat(shape.internalFormat), shape.width, shape.height,
+                 static_cast<GLsizei>(textures.size()));
+  if (textureArrayErrors()) {
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    glDeleteTextures(1, &array);
+    return 0;
+  }
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, sWrap);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, tWrap);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, minFilter);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, magFilter);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+  for (size_t i = 0; i < textures.size(); ++i) {
+    for (GLint level = 0; level < shape.levels; ++level) {
+      glCopyImageSubData(textures[i], GL_TEXTURE_2D, level, 0, 0, 0, array,
+                         GL_TEXTURE_2D_ARRAY, level, 0, 0,
+                         static_cast<GLint>(i), max(shape.width >> level, 1),
+                         max(shape.height >> level, 1), 1);
+    }
+  }
+  if (textureArrayErrors()) {
+    glDeleteTextures(1, &array);
+    return 0;
+  }
+  return array;
+}
+
+// utility function for loading a 2D texture from file (generates the texture)
+unsigned int loadTexture(string path, bool srgb, bool flip, bool flipGreen,
+                         GLenum sWrap, GLenum tWrap, GLenum minFilter,
                          GLenum magFilter) {
-  // tell stb_image to flip images on load (the image y axis tends to start from
-  // the top)
-  stbi_set_flip_vertically_on_load(flip);
+  TextureRequest request{path,  srgb,  flip,      flipGreen,
+                         sWrap, tWrap, minFilter, magFilter, -1};
+  return TextureRegistry::instance().acquire(request);
+}
+
+vector<unsigned int> loadTextureBatch(const vector<TextureRequest> &requests) {
+  return TextureRegistry::instance().acquire(requests);
+}
+
+void retainTexture(unsigned int texture) {
+  TextureRegistry::instance().retain(texture);
+}
+
+void releaseTexture(unsigned int texture) {
+  TextureRegistry::instance().release(texture);
+}
+
+vector<unsigned int> createTextures(const vector<TextureRequest> &requests) {
+  ThreadPool &pool = ThreadPool::shared();
+  vector<future<DecodedImage>> decoded;
+  decoded.reserve(requests.size());
+  for (const TextureRequest &request : requests) {
+    decoded.push_back(pool.submit([&request]() {
+      return decodeImage(request);
+    }));
+  }
+
+  // Upload in request order while the remaining images are still decoding.
+  vector<unsigned int> textureIDs;
+  textureIDs.reserve(requests.size());
+  for (size_t i = 0; i < requests.size(); ++i)
+    textureIDs.push_back(uploadTexture(decoded[i].get(), requests[i]));
+  return textureIDs;
+}
+
+static unsigned int createCubeMap(const vector<TextureRequest> &requests,
+                                  GLenum rWrap) {
+  // Decode the faces in parallel, each decode sets its own flip flag.
+  ThreadPool &pool = ThreadPool::shared();
+  vector<future<DecodedImage>> faces;
+  for (const TextureRequest &request : requests) {
+    faces.push_back(pool.submit([&request]() { return decodeImage(request); }));
+  }
 
   unsigned int textureID;
   glGenTextures(1, &textureID);
   glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
 
-  int width, height, nrComponents;
-  for (unsigned int i = 0; i < paths.size(); i++) {
-    unsigned char *data =
-        stbi_load(paths[i].c_str(), &width, &height, &nrComponents, 0);
-    if (data) {
-      GLenum format = GL_RGB;
-      if (nrComponents == 1)
-        format = GL_RED;
-      if (nrComponents == 3)
-        format = GL_RGB;
-      else if (nrComponents == 4)
-        format = GL_RGBA;
-
-      glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, format, width, height,
-                   0, format, GL_UNSIGNED_BYTE, data);
-    } else {
-      std::cout << "Texture failed to load at path: " << paths[i] << std::endl;
+  for (unsigned int i = 0; i < faces.size(); i++) {
+    DecodedImage face = faces[i].get();
+    if (!face.levels.empty()) {
+      uploadLevels(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, face);
+      glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL,
+                      static_cast<GLint>(face.levels.size() - 1));
+    } else if (face.data) {
+      glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+      glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, face.format,
+                   face.width, face.height, 0, face.format, GL_UNSIGNED_BYTE,
+                   face.data.get());
+      glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
     }
-    stbi_image_free(data);
   }
-  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, sWrap);
-  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, tWrap);
+  const TextureRequest &request = requests.front();
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, request.sWrap);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, request.tWrap);
   glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, rWrap);
-  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, minFilter);
-  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, magFilter);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER,
+                  request.minFilter);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER,
+                  request.magFilter);
 
   return textureID;
 }
+
+unsigned int loadCubeMap(vector<string> paths, bool flip, GLenum sWrap,
+                         GLenum tWrap, GLenum rWrap, GLenum minFilter,
+                         GLenum magFilter) {
+  string key = "cubeMap";
+  vector<TextureRequest> faces;
+  for (const string &path : paths) {
+    TextureRequest face;
+    face.path = path;
+    face.flip = flip;
+    face.sWrap = sWrap;
+    face.tWrap = tWrap;
+    face.minFilter = minFilter;
+    face.magFilter = magFilter;
+    key += '#' + TextureRegistry::makeKey(face);
+    faces.push_back(face);
+  }
+  key += '|' + to_string(rWrap);
+  return TextureRegistry::instance().acquire(
+      key, [&]() { return createCubeMap(faces, rWrap); });
+}
@@ -0,0 +1,183 @@
+#include "vertex_weld.h"
+#include "ThreadPool.h"
+#include "hashing.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <functional>
+
+using namespace std;
+
+namespace {
+
+const unsigned int NO_VERTEX = ~0u;
+// Buckets of the hash table per thread of the pool.
+const size_t BUCKETS_PER_THREAD = 4;
+
+// Rounded attributes of a vertex.
+typedef array<int32_t, 11> Key;
+
+struct Scales {
+  float position, normal, texCoord, tangent;
+};
+
+int32_t roundTo(float value, float scale) {
+  return static_cast<int32_t>(lround(value * scale));
+}
+
+Key makeKey(const Vertex &vertex, const Scales &scales) {
+  return {roundTo(vertex.position.x, scales.position),
+          roundTo(vertex.position.y, scales.position),
+          roundTo(vertex.position.z, scales.position),
+          roundTo(vertex.normal.x, scales.normal),
+          roundTo(vertex.normal.y, scales.normal),
+          roundTo(vertex.normal.z, scales.normal),
+          roundTo(vertex.texCoord.x, scales.texCoord),
+          roundTo(vertex.texCoord.y, scales.texCoord),
+          roundTo(vertex.tangent.x, scales.tangent),
+          roundTo(vertex.tangent.y, scales.tangent),
+          roundTo(vertex.tangent.z, scales.tangent)};
+}
+
+Scales makeScales(const vector<Vertex> &vertices,
+                  const weld::Epsilons &epsilons) {
+  glm::vec3 lower(0.0f), upper(0.0f);
+  if (!vertices.empty())
+    lower = upper = vertices[0].position;
+  for (const Vertex &vertex : vertices) {
+    lower = glm::min(lower, vertex.position);
+    upper = glm::max(upper, vertex.position);
+  }
+  glm::vec3 extent = upper - lower;
+  float size = max(max(extent.x, extent.y), max(extent.z, 1e-30f));
+  return {1.0f / (epsilons.position * size), 1.0f / epsilons.normal,
+          1.0f / epsilons.texCoord, 1.0f / epsilons.tangent};
+}
+
+// Run body(begin, end) over [0, count), on the pool if there is one.
+void forRange(ThreadPool *pool, size_t count,
+              const function<void(size_t, size_t)> &body) {
+  if (pool != nullptr)
+    pool->parallelFor(count, body);
+  else
+    body(0, count);
+}
+
+} // namespace
+
+void weld::Report::add(const Report &other) {
+  verticesBefore += other.verticesBefore;
+  verticesAfter += other.verticesAfter;
+  trianglesRemoved += other.trianglesRemoved;
+}
+
+weld::Report weld::weldMesh(MeshData &mesh, const Epsilons &epsilons,
+                            ThreadPool *pool) {
+  vector<Vertex> &vertices = mesh.vertices;
+  size_t numVertices = vertices.size();
+  Report report;
+  report.verticesBefore = numVertices;
+  if (numVertices < PARALLEL_VERTICES)
+    pool = nullptr;
+
+  Scales scales = makeScales(vertices, epsilons);
+  vector<Key> keys(numVertices);
+  vector<size_t> hashes(numVertices);
+  forRange(pool, numVertices, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i) {
+      keys[i] = makeKey(vertices[i], scales);
+      hashes[i] = static_cast<size_t>(fnv1a64(keys[i].data(), sizeof(Key)));
+    }
+  });
+
+  // Sort the vertices into buckets by hash, keeping them in order within a
+  // bucket so the first of equal vertices is found first.
+  size_t numBuckets = pool != nullptr ? pool->size() * BUCKETS_PER_THREAD : 1;
+  vector<unsigned int> bucketStart(numBuckets + 1, 0);
+  for (size_t i = 0; i < numVertices; ++i)
+    ++bucketStart[hashes[i] % numBuckets + 1];
+  for (size_t b = 0; b < numBuckets; ++b)
+    bucketStart[b + 1] += bucketStart[b];
+  vector<unsigned int> sorted(numVertices);
+  vector<unsigned int> fill(bucketStart.begin(), bucketStart.end() - 1);
+  for (size_t i = 0; i < numVertices; ++i)
+    sorted[fill[hashes[i] % numBuckets]++] = static_cast<unsigned int>(i);
+
+  // First vertex equal to every vertex, from an open addressing table per
+  // bucket.
+  vector<unsigned int> first(numVertices);
+  forRange(pool, numBuckets, [&](size_t begin, size_t end) {
+    vector<unsigned int> table;
+    for (size_t b = begin; b < end; ++b) {
+      size_t tableSize = 1;
+      while (tableSize < 2 * (bucketStart[b + 1] - bucketStart[b]))
+        tableSize *= 2;
+      table.assign(tableSize, NO_VERTEX);
+      for (unsigned int i = bucketStart[b]; i < bucketStart[b + 1]; ++i) {
+        unsigned int vertex = sorted[i];
+        // The low bits picked the bucket, probe with the others.
+        size_t slot = (hashes[vertex] / numBuckets) & (tableSize - 1);
+        while (table[slot] != NO_VERTEX && keys[table[slot]] != keys[vertex])
+          slot = (slot + 1) & (tableSize - 1);
+        if (table[slot] == NO_VERTEX)
+          table[slot] = vertex;
+        first[vertex] = table[slot];
+      }
+    }
+  });
+
+  // Keep the first vertices in their order.
+  vector<unsigned int> remap(numVertices, NO_VERTEX);
+  unsigned int numWelded = 0;
+  for (size_t i = 0; i < numVertices; ++i) {
+    if (first[i] == i) {
+      vertices[numWelded] = vertices[i];
+      remap[i] = numWelded++;
+    }
+  }
+  for (size_t i = 0; i < numVertices; ++i)
+    remap[i] = remap[first[i]];
+  vertices.resize(numWelded);
+  vertices.shrink_to_fit();
+  report.verticesAfter = numWelded;
+
+  vector<unsigned int> &indices = mesh.indices;
+  forRange(pool, indices.size(), [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i)
+      indices[i] = remap[indices[i]];
+  });
+  // Drop the triangles collapsed by welding.
+  size_t kept = 0;
+  for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+    unsigned int a = indices[i], b = indices[i + 1], c = indices[i + 2];
+    if (a == b || b == c || c == a)
+      continue;
+    indices[kept++] = a;
+    indices[kept++] = b;
+    indices[kept++] = c;
+  }
+  report.trianglesRemoved = (indices.size() - kept) / 3;
+  indices.resize(kept);
+  return report;
+}
+
+weld::Report weld::weldMeshes(vector<MeshData> &meshes,
+                              const Epsilons &epsilons, ThreadPool *pool) {
+  vector<Report> reports(meshes.size());
+  vector<size_t> small;
+  for (size_t i = 0; i < meshes.size(); ++i) {
+    if (pool != nullptr && meshes[i].vertices.size() >= PARALLEL_VERTICES)
+      reports[i] = weldMesh(meshes[i], epsilons, pool);
+    else
+      small.push_back(i);
+  }
+  forRange(pool, small.size(), [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i)
+      reports[small[i]] = weldMesh(meshes[small[i]], epsilons, nullptr);
+  });
+
+  Report report;
+  for (const Report &meshReport : reports)
+    report.add(meshReport);
+  return report;
+}
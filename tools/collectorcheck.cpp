@@ -0,0 +1,151 @@
+/*
+    Check that the DrawCollector draws every instance of runs far larger
+    than the InstanceRing holds per frame. Many instances of one model are
+    added and flushed through every path of the collector, vertex arrays
+    and indirect batches, full and depth only, with the primitives the GPU
+    generated counted by a query and compared with the triangles of the
+    model times the instances. The rasterizer is off, only the vertex stage
+    runs. Runs in a hidden window from the repository root, so the shaders
+    and the model are found, and exits with 1 if an instance is missing or
+    GL raised an error.
+
+      collectorcheck [instances] [model]
+*/
+#include "DrawCollector.h"
+#include "GeometryPool.h"
+#include "InstanceRing.h"
+#include "Model.h"
+#include "Shader.h"
+#include "gl_extensions.h"
+#include <glad/glad.h>
+
+#include <GLFW/glfw3.h>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+using namespace std;
+
+namespace {
+
+struct Case {
+  const char *name;
+  bool pooled;
+  bool depthOnly;
+  bool indirect;
+  bool pullVertices;
+};
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  unsigned int numInstances = 100000;
+  string path = "resources/sphere.obj";
+  if (argc > 1)
+    numInstances = max(atoi(argv[1]), 1);
+  if (argc > 2)
+    path = argv[2];
+
+  glfwInit();
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+  glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+  glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+  GLFWwindow *window =
+      glfwCreateWindow(800, 600, "collectorcheck", NULL, NULL);
+  if (!window) {
+    cout << "Failed to create GLFW window\n";
+    glfwTerminate();
+    return 1;
+  }
+  glfwMakeContextCurrent(window);
+  if (!gladLoadGL()) {
+    cout << "Failed to initialize GLAD\n";
+    return 1;
+  }
+  glext::load(reinterpret_cast<GLADloadproc>(glfwGetProcAddress));
+  if (!glext::bufferStorage) {
+    cout << "The instance ring needs ARB_buffer_storage\n";
+    glfwTerminate();
+    return 1;
+  }
+
+  bool failed = false;
+  {
+    // The default size, a few times smaller than the runs.
+    InstanceRing ring;
+    InstanceRing::setActive(&ring);
+    GeometryPool pool(ring);
+    Model loose(path);
+    GeometryPool::setActive(&pool);
+    Model pooled(path);
+    GeometryPool::setActive(nullptr);
+    if (!loose.isReady() || !pooled.isReady() || !pooled.isPooled()) {
+      cout << "Could not load " << path << " into the pool\n";
+      glfwTerminate();
+      return 1;
+    }
+
+    Shader litProg("shaders/object.vs", "shaders/object.fs");
+    loose.getTextureLocations(litProg);
+    pooled.getTextureLocations(litProg);
+    Shader depthProg("shaders/shadow_map.vs", "shaders/shadow_map.fs");
+    Shader depthPullProg("shaders/shadow_map_pull.vs",
+                         "shaders/shadow_map.fs");
+    const Case cases[] = {
+        {"vertex arrays", false, false, false, false},
+        {"vertex arrays, depth only", false, true, false, false},
+        {"indirect", true, false, true, false},
+        {"indirect, depth only", true, true, true, false},
+        {"vertex pulling, depth only", true, true, true, true},
+    };
+
+    glEnable(GL_RASTERIZER_DISCARD);
+    GLuint query;
+    glGenQueries(1, &query);
+    DrawCollector collector;
+    IndirectBatch batch;
+    for (const Case &test : cases) {
+      const Model &model = test.pooled ? pooled : loose;
+      const Shader &prog = !test.depthOnly     ? litProg
+                           : test.pullVertices ? depthPullProg
+                                               : depthProg;
+      prog.use();
+      for (unsigned int i = 0; i < numInstances; ++i) {
+        glm::vec3 position(float(i % 1000), 0.0f, float(i / 1000));
+        collector.add(model, glm::translate(glm::mat4(1.0f), position),
+                      i % 4);
+      }
+      glBeginQuery(GL_PRIMITIVES_GENERATED, query);
+      size_t draws =
+          test.indirect ? collector.flush(batch, pool, prog, test.depthOnly,
+                                          test.pullVertices)
+                        : collector.flush(prog, test.depthOnly);
+      glEndQuery(GL_PRIMITIVES_GENERATED);
+      GLenum error = glGetError();
+      ring.endFrame();
+      GLuint64 primitives = 0;
+      glGetQueryObjectui64v(query, GL_QUERY_RESULT, &primitives);
+      GLuint64 expected =
+          static_cast<GLuint64>(model.getTriangleCount(0)) * numInstances;
+      bool passed = primitives == expected && error == GL_NO_ERROR;
+      failed = failed || !passed;
+      cout << "  " << test.name << ": " << draws << " draws, " << primitives
+           << " of " << expected << " triangles";
+      if (error != GL_NO_ERROR)
+        cout << ", GL error " << error;
+      cout << (passed ? "" : ", FAILED") << "\n";
+    }
+    glDeleteQueries(1, &query);
+    glDisable(GL_RASTERIZER_DISCARD);
+    ring.printStats();
+    InstanceRing::setActive(nullptr);
+  }
+
+  glfwDestroyWindow(window);
+  glfwTerminate();
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,197 @@
+/*
+    Benchmark of the conversion of imported Assimp scenes into MeshData. A
+    synthetic scene of grid meshes spread over a node tree is converted with
+    the loop Model::processMesh used before (per vertex push_back, copied
+    faces) and with meshimport on one thread and on the shared thread pool.
+    The outputs are checked against each other.
+
+      meshbench [meshes] [vertices per mesh] [iterations]
+*/
+#include "ThreadPool.h"
+#include "mesh_import.h"
+#include <algorithm>
+#include <assimp/scene.h>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+int iterations = 5;
+
+// Best time of a number of runs in milliseconds.
+double timeRuns(const function<void()> &run) {
+  double best = 1e30;
+  for (int i = 0; i < iterations; ++i) {
+    auto start = chrono::steady_clock::now();
+    run();
+    chrono::duration<double, milli> time = chrono::steady_clock::now() - start;
+    best = min(best, time.count());
+  }
+  return best;
+}
+
+// A size x size vertex grid, allocated the way Assimp owns its meshes.
+aiMesh *makeGrid(unsigned int size, float offset) {
+  aiMesh *mesh = new aiMesh();
+  mesh->mNumVertices = size * size;
+  mesh->mVertices = new aiVector3D[mesh->mNumVertices];
+  mesh->mNormals = new aiVector3D[mesh->mNumVertices];
+  mesh->mTangents = new aiVector3D[mesh->mNumVertices];
+  mesh->mBitangents = new aiVector3D[mesh->mNumVertices];
+  mesh->mTextureCoords[0] = new aiVector3D[mesh->mNumVertices];
+  mesh->mNumUVComponents[0] = 2;
+  for (unsigned int y = 0; y < size; ++y) {
+    for (unsigned int x = 0; x < size; ++x) {
+      unsigned int i = y * size + x;
+      float u = static_cast<float>(x) / (size - 1);
+      float v = static_cast<float>(y) / (size - 1);
+      mesh->mVertices[i] = aiVector3D(u + offset, sin(u * 6.0f) * 0.1f, v);
+      mesh->mNormals[i] = aiVector3D(0.0f, 1.0f, 0.0f);
+      mesh->mTangents[i] = aiVector3D(1.0f, 0.0f, 0.0f);
+      mesh->mBitangents[i] = aiVector3D(0.0f, 0.0f, 1.0f);
+      mesh->mTextureCoords[0][i] = aiVector3D(u, v, 0.0f);
+    }
+  }
+
+  mesh->mNumFaces = 2 * (size - 1) * (size - 1);
+  mesh->mFaces = new aiFace[mesh->mNumFaces];
+  unsigned int face = 0;
+  for (unsigned int y = 0; y + 1 < size; ++y) {
+    for (unsigned int x = 0; x + 1 < size; ++x) {
+      unsigned int i = y * size + x;
+      const unsigned int corners[2][3] = {{i, i + size, i + 1},
+                                          {i + 1, i + size, i + size + 1}};
+      for (const unsigned int *triangle : corners) {
+        aiFace &f = mesh->mFaces[face++];
+        f.mNumIndices = 3;
+        f.mIndices = new unsigned int[3];
+        copy(triangle, triangle + 3, f.mIndices);
+      }
+    }
+  }
+  return mesh;
+}
+
+// Scene with numMeshes meshes, ten per child of the root node.
+aiScene *makeScene(unsigned int numMeshes, unsigned int verticesPerMesh) {
+  unsigned int size =
+      max(2u, static_cast<unsigned int>(ceil(sqrt(verticesPerMesh))));
+  aiScene *scene = new aiScene();
+  scene->mNumMaterials = 1;
+  scene->mMaterials = new aiMaterial *[1];
+  scene->mMaterials[0] = new aiMaterial();
+  scene->mNumMeshes = numMeshes;
+  scene->mMeshes = new aiMesh *[numMeshes];
+  for (unsigned int i = 0; i < numMeshes; ++i)
+    scene->mMeshes[i] = makeGrid(size, static_cast<float>(i));
+
+  const unsigned int meshesPerNode = 10;
+  aiNode *root = new aiNode();
+  root->mNumChildren = (numMeshes + meshesPerNode - 1) / meshesPerNode;
+  root->mChildren = new aiNode *[root->mNumChildren];
+  for (unsigned int i = 0; i < root->mNumChildren; ++i) {
+    aiNode *node = new aiNode();
+    node->mParent = root;
+    unsigned int first = i * meshesPerNode;
+    node->mNumMeshes = min(meshesPerNode, numMeshes - first);
+    node->mMeshes = new unsigned int[node->mNumMeshes];
+    for (unsigned int j = 0; j < node->mNumMeshes; ++j)
+      node->mMeshes[j] = first + j;
+    root->mChildren[i] = node;
+  }
+  scene->mRootNode = root;
+  return scene;
+}
+
+// The conversion Model::processNode and processMesh did before.
+MeshData legacyMesh(aiMesh *mesh) {
+  MeshData data;
+  for (unsigned int i = 0; i < mesh->mNumVertices; i++) {
+    Vertex vertex;
+    vertex.position = glm::vec3(mesh->mVertices[i].x, mesh->mVertices[i].y,
+                                mesh->mVertices[i].z);
+    vertex.normal = glm::vec3(mesh->mNormals[i].x, mesh->mNormals[i].y,
+                              mesh->mNormals[i].z);
+    if (mesh->mTextureCoords[0]) {
+      vertex.texCoord = glm::vec2(mesh->mTextureCoords[0][i].x,
+                                  mesh->mTextureCoords[0][i].y);
+      vertex.tangent = glm::vec3(mesh->mTangents[i].x, mesh->mTangents[i].y,
+                                 mesh->mTangents[i].z);
+    } else {
+      vertex.texCoord = glm::vec2(0.0f);
+      vertex.tangent = glm::vec3(0.0f);
+    }
+    data.vertices.push_back(vertex);
+  }
+  for (unsigned int i = 0; i < mesh->mNumFaces; i++) {
+    aiFace face = mesh->mFaces[i];
+    for (unsigned int j = 0; j < face.mNumIndices; j++)
+      data.indices.push_back(face.mIndices[j]);
+  }
+  return data;
+}
+
+void legacyNode(aiNode *node, const aiScene *scene, vector<MeshData> &out) {
+  for (unsigned int i = 0; i < node->mNumMeshes; i++)
+    out.push_back(legacyMesh(scene->mMeshes[node->mMeshes[i]]));
+  for (unsigned int i = 0; i < node->mNumChildren; i++)
+    legacyNode(node->mChildren[i], scene, out);
+}
+
+bool sameGeometry(const vector<MeshData> &a, const vector<MeshData> &b) {
+  if (a.size() != b.size())
+    return false;
+  for (size_t i = 0; i < a.size(); ++i) {
+    if (a[i].indices != b[i].indices ||
+        a[i].vertices.size() != b[i].vertices.size() ||
+        memcmp(a[i].vertices.data(), b[i].vertices.data(),
+               a[i].vertices.size() * sizeof(Vertex)) != 0)
+      return false;
+  }
+  return true;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  unsigned int numMeshes = argc > 1 ? max(atoi(argv[1]), 1) : 100;
+  unsigned int verticesPerMesh = argc > 2 ? max(atoi(argv[2]), 4) : 10000;
+  if (argc > 3)
+    iterations = max(atoi(argv[3]), 1);
+
+  aiScene *scene = makeScene(numMeshes, verticesPerMesh);
+  const aiMesh *first = scene->mMeshes[0];
+  cout << numMeshes << " meshes of " << first->mNumVertices << " vertices and "
+       << first->mNumFaces << " triangles, best of " << iterations
+       << " runs" << endl;
+
+  ThreadPool &pool = ThreadPool::shared();
+  vector<MeshData> legacy, serial, parallel;
+  double legacyTime = timeRuns([&]() {
+    legacy.clear();
+    legacyNode(scene->mRootNode, scene, legacy);
+  });
+  double serialTime = timeRuns(
+      [&]() { serial = meshimport::convertScene(scene, false, nullptr); });
+  double parallelTime = timeRuns(
+      [&]() { parallel = meshimport::convertScene(scene, false, &pool); });
+
+  cout << "push_back loop: " << legacyTime << " ms" << endl;
+  cout << "meshimport, 1 thread: " << serialTime << " ms ("
+       << legacyTime / serialTime << "x)" << endl;
+  cout << "meshimport, pool of " << pool.size() << ": " << parallelTime
+       << " ms (" << legacyTime / parallelTime << "x)" << endl;
+
+  bool match = sameGeometry(legacy, serial) && sameGeometry(legacy, parallel);
+  if (!match)
+    cout << "Converted meshes differ from the push_back loop" << endl;
+  delete scene;
+  return match ? 0 : 1;
+}
@@ -0,0 +1,216 @@
+/*
+    Culled triangle ratio and speed of the meshlet culling. The meshes of a
+    model (a UV sphere if no path is given) are optimized and split into
+    meshlets like Model does at import, then culled from a few fixed camera
+    poses around them, with the frustum only and with the normal cones too.
+    The SSE and scalar culling are timed and checked against each other, and
+    no triangle that faces the camera inside the frustum may be culled.
+
+      meshletbench [model] [iterations]
+*/
+#include "mesh_import.h"
+#include "mesh_optimizer.h"
+#include "meshlets.h"
+#include <algorithm>
+#include <assimp/Importer.hpp>
+#include <assimp/postprocess.h>
+#include <assimp/scene.h>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <functional>
+#include <glm/gtc/matrix_transform.hpp>
+#include <iostream>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+int iterations = 1000;
+
+// Best time of a number of runs in microseconds.
+double timeRuns(const function<void()> &run) {
+  double best = 1e30;
+  for (int i = 0; i < iterations; ++i) {
+    auto start = chrono::steady_clock::now();
+    run();
+    chrono::duration<double, micro> time = chrono::steady_clock::now() - start;
+    best = min(best, time.count());
+  }
+  return best;
+}
+
+// Unit sphere with a texture seam, wound counter-clockwise from outside.
+MeshData makeSphere(unsigned int columns, unsigned int rows) {
+  MeshData mesh;
+  const float pi = 3.14159265f;
+  for (unsigned int y = 0; y <= rows; ++y) {
+    for (unsigned int x = 0; x <= columns; ++x) {
+      float u = static_cast<float>(x) / columns;
+      float v = static_cast<float>(y) / rows;
+      Vertex vertex;
+      float angle = u * 2.0f * pi;
+      vertex.position = glm::vec3(sin(v * pi) * cos(angle), cos(v * pi),
+                                  sin(v * pi) * sin(angle));
+      vertex.normal = vertex.position;
+      vertex.texCoord = glm::vec2(u, v);
+      vertex.tangent = glm::vec3(-sin(angle), 0.0f, cos(angle));
+      mesh.vertices.push_back(vertex);
+    }
+  }
+  for (unsigned int y = 0; y < rows; ++y) {
+    for (unsigned int x = 0; x < columns; ++x) {
+      unsigned int i = y * (columns + 1) + x, down = i + columns + 1;
+      const unsigned int quad[6] = {i, i + 1, down, i + 1, down + 1, down};
+      mesh.indices.insert(mesh.indices.end(), quad, quad + 6);
+    }
+  }
+  return mesh;
+}
+
+bool loadMeshes(const char *path, vector<MeshData> &meshes) {
+  Assimp::Importer importer;
+  const aiScene *scene = importer.ReadFile(
+      path, aiProcess_Triangulate | aiProcess_GenSmoothNormals |
+                aiProcess_CalcTangentSpace | aiProcess_OptimizeMeshes);
+  if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE ||
+      !scene->mRootNode) {
+    cout << "ERROR::ASSIMP::" << importer.GetErrorString() << endl;
+    return false;
+  }
+  meshes = meshimport::convertScene(scene, false, nullptr);
+  return true;
+}
+
+struct Prepared {
+  const MeshData *mesh;
+  meshlets::Clusters clusters;
+};
+
+// Triangles facing the eye with a corner inside the frustum that are not in
+// any of the ranges.
+size_t missedTriangles(const MeshData &mesh,
+                       const vector<meshlets::Range> &ranges,
+                       const glm::mat4 &toClip, const glm::vec3 &eye) {
+  vector<bool> kept(mesh.indices.size(), false);
+  for (const meshlets::Range &range : ranges)
+    fill_n(kept.begin() + range.firstIndex, range.numIndices, true);
+  size_t missed = 0;
+  for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3) {
+    if (kept[i])
+      continue;
+    const glm::vec3 &a = mesh.vertices[mesh.indices[i]].position;
+    const glm::vec3 &b = mesh.vertices[mesh.indices[i + 1]].position;
+    const glm::vec3 &c = mesh.vertices[mesh.indices[i + 2]].position;
+    if (glm::dot(glm::cross(b - a, c - a), eye - a) <= 0.0f)
+      continue;
+    for (const glm::vec3 &corner : {a, b, c}) {
+      glm::vec4 clip = toClip * glm::vec4(corner, 1.0f);
+      if (abs(clip.x) <= clip.w && abs(clip.y) <= clip.w &&
+          abs(clip.z) <= clip.w) {
+        ++missed;
+        break;
+      }
+    }
+  }
+  return missed;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  vector<MeshData> meshes;
+  if (argc > 1 && string(argv[1]) != "-") {
+    if (!loadMeshes(argv[1], meshes))
+      return 1;
+  } else {
+    meshes.push_back(makeSphere(120, 60));
+  }
+  if (argc > 2)
+    iterations = max(atoi(argv[2]), 1);
+
+  // Same processing as Model::importModel, without the levels of detail.
+  vector<Prepared> prepared;
+  size_t numTriangles = 0, numMeshlets = 0;
+  glm::vec3 lower(1e30f), upper(-1e30f);
+  for (MeshData &mesh : meshes) {
+    meshopt::optimize(mesh);
+    vector<Meshlet> built =
+        meshlets::build(mesh.vertices, mesh.indices, 0, mesh.indices.size());
+    prepared.push_back({&mesh, meshlets::prepare(built)});
+    numTriangles += mesh.indices.size() / 3;
+    numMeshlets += built.size();
+    for (const Vertex &vertex : mesh.vertices) {
+      lower = glm::min(lower, vertex.position);
+      upper = glm::max(upper, vertex.position);
+    }
+  }
+  cout << meshes.size() << " meshes, " << numTriangles << " triangles in "
+       << numMeshlets << " meshlets ("
+       << static_cast<double>(numTriangles) / max<size_t>(numMeshlets, 1)
+       << " triangles per meshlet), best of " << iterations << " runs"
+       << endl;
+
+  // Poses around the bounds: far, close, from above and inside.
+  glm::vec3 center = 0.5f * (lower + upper);
+  glm::vec3 extent = 0.5f * (upper - lower);
+  float size = max(max(extent.x, extent.y), max(extent.z, 1e-6f));
+  struct Pose {
+    const char *name;
+    glm::vec3 eye;
+    glm::vec3 target;
+  };
+  const Pose poses[] = {
+      {"far", center + glm::vec3(0.0f, 0.0f, 4.0f * size), center},
+      {"close", center + glm::vec3(0.0f, 0.0f, 1.5f * size),
+       center + glm::vec3(0.3f * size, 0.0f, 0.0f)},
+      {"above", center + glm::vec3(1.0f, 2.0f, 1.0f) * size, center},
+      {"inside", center, center + glm::vec3(1.0f, 0.0f, 0.0f)},
+  };
+  glm::mat4 projection =
+      glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.01f * size,
+                       100.0f * size);
+
+  bool ok = true;
+  vector<meshlets::Range> ranges, scalarRanges;
+  for (const Pose &pose : poses) {
+    glm::mat4 view = glm::lookAt(pose.eye, pose.target, glm::vec3(0, 1, 0));
+    cout << pose.name << ":";
+    for (bool cones : {false, true}) {
+      meshlets::View cullView =
+          meshlets::makeView(projection, view, glm::mat4(1.0f), cones);
+      size_t kept = 0, missed = 0;
+      for (const Prepared &p : prepared) {
+        size_t simd = meshlets::cull(p.clusters, cullView, ranges);
+        size_t scalar =
+            meshlets::cullScalar(p.clusters, cullView, scalarRanges);
+        if (simd != scalar || ranges.size() != scalarRanges.size()) {
+          cout << " SSE and scalar culling differ";
+          ok = false;
+        }
+        kept += simd / 3;
+        missed += missedTriangles(*p.mesh, ranges, projection * view, pose.eye);
+      }
+      double simdTime = timeRuns([&]() {
+        for (const Prepared &p : prepared)
+          meshlets::cull(p.clusters, cullView, ranges);
+      });
+      double scalarTime = timeRuns([&]() {
+        for (const Prepared &p : prepared)
+          meshlets::cullScalar(p.clusters, cullView, scalarRanges);
+      });
+      cout << (cones ? " frustum and cones " : " frustum ")
+           << 100.0 * (numTriangles - kept) / max<size_t>(numTriangles, 1)
+           << "% culled, " << simdTime << " us (scalar " << scalarTime
+           << " us)";
+      if (missed > 0) {
+        cout << ", " << missed << " visible triangles culled";
+        ok = false;
+      }
+      cout << ";";
+    }
+    cout << endl;
+  }
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,198 @@
+/*
+    Micro-benchmark of the pixel kernels. Every kernel runs on a 2048x2048
+    image with each instruction set the CPU supports, the times are compared
+    with the scalar loops the loader used before and the outputs are checked
+    against the scalar kernels.
+
+      pixelbench [iterations]
+*/
+#include "pixel_kernels.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+const size_t WIDTH = 2048;
+const size_t HEIGHT = 2048;
+const size_t NUM_PIXELS = WIDTH * HEIGHT;
+
+int iterations = 20;
+
+// Best time of a number of runs in milliseconds.
+double timeRuns(const function<void()> &run) {
+  double best = 1e30;
+  for (int i = 0; i < iterations; ++i) {
+    auto start = chrono::steady_clock::now();
+    run();
+    chrono::duration<double, milli> time = chrono::steady_clock::now() - start;
+    best = min(best, time.count());
+  }
+  return best;
+}
+
+struct Benchmark {
+  string name;
+  // The scalar loop from before the kernels existed.
+  function<void()> baseline;
+  function<void()> kernel;
+  // Output of the last run, compared between instruction sets.
+  function<vector<unsigned char>()> output;
+};
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  if (argc > 1)
+    iterations = max(atoi(argv[1]), 1);
+
+  mt19937 rng(42);
+  vector<unsigned char> rgb(NUM_PIXELS * 3), rgba(NUM_PIXELS * 4);
+  for (unsigned char &c : rgb)
+    c = static_cast<unsigned char>(rng());
+  for (unsigned char &c : rgba)
+    c = static_cast<unsigned char>(rng());
+  vector<float> linear(NUM_PIXELS * 4);
+  pixels::srgbToLinear(rgba.data(), linear.data(), linear.size());
+
+  vector<unsigned char> work(NUM_PIXELS * 4), out(NUM_PIXELS * 4);
+  vector<float> floats(NUM_PIXELS * 4);
+  const int bgra[4] = {2, 1, 0, 3};
+
+  vector<Benchmark> benchmarks = {
+      {"flip green (RGB)",
+       [&]() {
+         for (size_t i = 0; i < NUM_PIXELS; ++i)
+           work[i * 3 + 1] = 255 - work[i * 3 + 1];
+       },
+       [&]() { pixels::flipChannel(work.data(), NUM_PIXELS, 3, 1); },
+       [&]() {
+         copy(rgb.begin(), rgb.end(), work.begin());
+         pixels::flipChannel(work.data(), NUM_PIXELS, 3, 1);
+         return vector<unsigned char>(work.begin(), work.begin() + rgb.size());
+       }},
+      {"flip green (RGBA)",
+       [&]() {
+         for (size_t i = 0; i < NUM_PIXELS; ++i)
+           work[i * 4 + 1] = 255 - work[i * 4 + 1];
+       },
+       [&]() { pixels::flipChannel(work.data(), NUM_PIXELS, 4, 1); },
+       [&]() {
+         copy(rgba.begin(), rgba.end(), work.begin());
+         pixels::flipChannel(work.data(), NUM_PIXELS, 4, 1);
+         return work;
+       }},
+      {"expand RGB to RGBA",
+       [&]() {
+         for (size_t i = 0; i < NUM_PIXELS; ++i) {
+           for (int c = 0; c < 3; ++c)
+             out[i * 4 + c] = rgb[i * 3 + c];
+           out[i * 4 + 3] = 255;
+         }
+       },
+       [&]() { pixels::expandRGBToRGBA(rgb.data(), out.data(), NUM_PIXELS); },
+       [&]() {
+         pixels::expandRGBToRGBA(rgb.data(), out.data(), NUM_PIXELS);
+         return out;
+       }},
+      {"swizzle BGRA to RGBA",
+       [&]() {
+         for (size_t i = 0; i < NUM_PIXELS; ++i)
+           for (int c = 0; c < 4; ++c)
+             out[i * 4 + c] = rgba[i * 4 + bgra[c]];
+       },
+       [&]() {
+         pixels::swizzleRGBA(rgba.data(), out.data(), NUM_PIXELS, bgra);
+       },
+       [&]() {
+         pixels::swizzleRGBA(rgba.data(), out.data(), NUM_PIXELS, bgra);
+         return out;
+       }},
+      {"extract red (RGBA)",
+       [&]() {
+         for (size_t i = 0; i < NUM_PIXELS; ++i)
+           out[i] = rgba[i * 4];
+       },
+       [&]() {
+         pixels::extractChannel(rgba.data(), out.data(), NUM_PIXELS, 4, 0);
+       },
+       [&]() {
+         pixels::extractChannel(rgba.data(), out.data(), NUM_PIXELS, 4, 0);
+         return vector<unsigned char>(out.begin(), out.begin() + NUM_PIXELS);
+       }},
+      {"sRGB to linear",
+       [&]() {
+         for (size_t i = 0; i < rgba.size(); ++i) {
+           float c = rgba[i] / 255.0f;
+           floats[i] = c <= 0.04045f ? c / 12.92f
+                                     : powf((c + 0.055f) / 1.055f, 2.4f);
+         }
+       },
+       [&]() {
+         pixels::srgbToLinear(rgba.data(), floats.data(), rgba.size());
+       },
+       [&]() {
+         pixels::srgbToLinear(rgba.data(), floats.data(), rgba.size());
+         vector<unsigned char> bytes(floats.size() * sizeof(float));
+         memcpy(bytes.data(), floats.data(), bytes.size());
+         return bytes;
+       }},
+      {"linear to sRGB",
+       [&]() {
+         for (size_t i = 0; i < linear.size(); ++i) {
+           float l = linear[i];
+           float c = l <= 0.0031308f ? l * 12.92f
+                                     : 1.055f * powf(l, 1.0f / 2.4f) - 0.055f;
+           out[i] = static_cast<unsigned char>(c * 255.0f + 0.5f);
+         }
+       },
+       [&]() {
+         pixels::linearToSrgb(linear.data(), out.data(), linear.size());
+       },
+       [&]() {
+         pixels::linearToSrgb(linear.data(), out.data(), linear.size());
+         return out;
+       }},
+  };
+
+  vector<pixels::Isa> isas = {pixels::Isa::Scalar};
+  if (pixels::setIsa(pixels::Isa::SSE2))
+    isas.push_back(pixels::Isa::SSE2);
+  if (pixels::setIsa(pixels::Isa::AVX2))
+    isas.push_back(pixels::Isa::AVX2);
+
+  cout << WIDTH << "x" << HEIGHT << " pixels, best of " << iterations
+       << " runs, times in ms (speedup over the scalar loop)" << endl;
+  bool mismatch = false;
+  for (const Benchmark &bench : benchmarks) {
+    double baseline = timeRuns(bench.baseline);
+    cout << bench.name << ": loop " << baseline;
+    vector<unsigned char> reference;
+    for (pixels::Isa isa : isas) {
+      pixels::setIsa(isa);
+      double time = timeRuns(bench.kernel);
+      cout << ", " << pixels::isaName(isa) << " " << time << " ("
+           << baseline / time << "x)";
+      vector<unsigned char> result = bench.output();
+      if (reference.empty())
+        reference = move(result);
+      else if (result != reference)
+        mismatch = true;
+    }
+    cout << endl;
+  }
+  pixels::setIsa(pixels::bestIsa());
+
+  if (mismatch)
+    cout << "Kernel outputs differ between instruction sets" << endl;
+  return mismatch ? 1 : 0;
+}
@@ -0,0 +1,240 @@
+/*
+    Benchmark of the draw submission paths on a synthetic scene of many
+    small meshes, half of them in the full and half in the compact vertex
+    format, all suballocated from one GeometryPool. Every frame draws a lit
+    and a depth only pass of all the meshes:
+
+      direct          one draw per mesh through the vertex arrays
+      indirect        multi draw indirect, one draw per format and index type
+      vertex pulling  multi draw indirect with object_pull.vs and
+                      shadow_map_pull.vs, one draw per index type
+
+    and the CPU time spent submitting is compared with the time until the
+    GPU has finished. Runs in a hidden window from the repository root, so
+    the shaders are found.
+
+      pullbench [meshes] [frames]
+*/
+#include "GeometryPool.h"
+#include "InstanceRing.h"
+#include "Mesh.h"
+#include "Shader.h"
+#include "UniformBlock.h"
+#include "gl_extensions.h"
+#include "structures.h"
+#include "uniform_blocks.h"
+#include <glad/glad.h>
+
+#include <GLFW/glfw3.h>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+// Rings and segments of the synthetic spheres.
+const unsigned int RINGS = 8;
+const unsigned int SEGMENTS = 8;
+
+// A small UV sphere, the meshes only differ in their format.
+void makeSphere(vector<Vertex> &vertices, vector<unsigned int> &indices) {
+  const float pi = 3.14159265f;
+  for (unsigned int r = 0; r <= RINGS; ++r) {
+    float phi = pi * r / RINGS;
+    for (unsigned int s = 0; s <= SEGMENTS; ++s) {
+      float theta = 2.0f * pi * s / SEGMENTS;
+      glm::vec3 normal(sin(phi) * cos(theta), cos(phi),
+                       sin(phi) * sin(theta));
+      glm::vec3 tangent(-sin(theta), 0.0f, cos(theta));
+      vertices.push_back({0.5f * normal, normal,
+                          glm::vec2(float(s) / SEGMENTS, float(r) / RINGS),
+                          tangent});
+    }
+  }
+  for (unsigned int r = 0; r < RINGS; ++r) {
+    for (unsigned int s = 0; s < SEGMENTS; ++s) {
+      unsigned int a = r * (SEGMENTS + 1) + s;
+      unsigned int b = a + SEGMENTS + 1;
+      indices.insert(indices.end(), {a, b, a + 1, a + 1, b, b + 1});
+    }
+  }
+}
+
+enum class Path { Direct, Indirect, Pulling };
+
+struct Result {
+  const char *name;
+  double submit = 0.0;
+  double finished = 0.0;
+  size_t calls = 0;
+};
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  unsigned int numMeshes = 10000;
+  int frames = 100;
+  if (argc > 1)
+    numMeshes = max(atoi(argv[1]), 1);
+  if (argc > 2)
+    frames = max(atoi(argv[2]), 1);
+
+  glfwInit();
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+  glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+  glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+  GLFWwindow *window = glfwCreateWindow(800, 600, "pullbench", NULL, NULL);
+  if (!window) {
+    cout << "Failed to create GLFW window\n";
+    glfwTerminate();
+    return 1;
+  }
+  glfwMakeContextCurrent(window);
+  if (!gladLoadGL()) {
+    cout << "Failed to initialize GLAD\n";
+    return 1;
+  }
+  glext::load(reinterpret_cast<GLADloadproc>(glfwGetProcAddress));
+  if (!glext::bufferStorage) {
+    cout << "The geometry pool needs ARB_buffer_storage\n";
+    glfwTerminate();
+    return 1;
+  }
+  glfwSwapInterval(0);
+
+  {
+    // Every mesh is drawn once in each of the two passes of a frame.
+    InstanceRing ring(2 * numMeshes);
+    InstanceRing::setActive(&ring);
+    GeometryPool pool(ring);
+    GeometryPool::setActive(&pool);
+
+    vector<Vertex> vertices;
+    vector<unsigned int> indices;
+    makeSphere(vertices, indices);
+    vector<Mesh> meshes;
+    meshes.reserve(numMeshes);
+    vector<glm::mat4> models(numMeshes);
+    vector<glm::mat3> normMats(numMeshes, glm::mat3(1.0f));
+    unsigned int side =
+        static_cast<unsigned int>(ceil(sqrt(static_cast<double>(numMeshes))));
+    for (unsigned int i = 0; i < numMeshes; ++i) {
+      VertexFormat format = i % 2 == 0 ? VertexFormat::Full
+                                       : VertexFormat::Compact;
+      meshes.emplace_back(vertices, indices, vector<Texture>(), Material(),
+                          vector<LodLevel>(), vector<Meshlet>(), format);
+      glm::vec3 position(float(i % side) - side / 2.0f, 0.0f,
+                         float(i / side) - side / 2.0f);
+      models[i] = glm::translate(glm::mat4(1.0f), position);
+    }
+    size_t numPooled =
+        count_if(meshes.begin(), meshes.end(),
+                 [](const Mesh &mesh) { return mesh.isPooled(); });
+    pool.printUsage();
+    if (numPooled < meshes.size()) {
+      cout << meshes.size() - numPooled
+           << " meshes did not fit in the pool, use fewer\n";
+      glfwTerminate();
+      return 1;
+    }
+
+    Shader objectProg("shaders/object.vs", "shaders/object.fs");
+    Shader depthProg("shaders/shadow_map.vs", "shaders/shadow_map.fs");
+    Shader objectPullProg("shaders/object_pull.vs", "shaders/object.fs");
+    Shader depthPullProg("shaders/shadow_map_pull.vs",
+                         "shaders/shadow_map.fs");
+    glm::mat4 projection =
+        glm::perspective(glm::radians(45.0f), 800.0f / 600.0f, 0.1f, 500.0f);
+    glm::vec3 cameraPos(0.0f, side * 0.5f, side * 0.7f);
+    glm::mat4 view = glm::lookAt(cameraPos, glm::vec3(0.0f),
+                                 glm::vec3(0.0f, 1.0f, 0.0f));
+    // The lit programs read the camera from the frame block. The lights
+    // stay off, only the submission is measured.
+    UniformBlock frameBlock(FRAME_UBO, sizeof(FrameBlock));
+    FrameBlock frame;
+    frame.view = view;
+    frame.projection = projection;
+    frame.viewPos = glm::vec4(cameraPos, 1.0f);
+    frameBlock.write(&frame);
+    UniformBlock lightBlock(LIGHT_UBO, sizeof(LightBlock));
+    LightBlock lights;
+    lightBlock.write(&lights);
+    for (const Shader *prog : {&depthProg, &depthPullProg}) {
+      prog->use();
+      prog->setUnifS("lightSpaceMatrix", projection * view);
+    }
+
+    glEnable(GL_DEPTH_TEST);
+    IndirectBatch batch;
+    vector<Result> results = {{"direct"}, {"indirect"}, {"vertex pulling"}};
+    for (Path path : {Path::Direct, Path::Indirect, Path::Pulling}) {
+      Result &result = results[static_cast<size_t>(path)];
+      bool pulling = path == Path::Pulling;
+      const Shader &lit = pulling ? objectPullProg : objectProg;
+      const Shader &depth = pulling ? depthPullProg : depthProg;
+      // The first frames warm up the driver and are not counted.
+      for (int frame = -3; frame < frames; ++frame) {
+        size_t calls = 0;
+        auto start = chrono::steady_clock::now();
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        depth.use();
+        for (unsigned int i = 0; i < numMeshes; ++i) {
+          if (path == Path::Direct)
+            meshes[i].DrawDepthOnly(depth, 1, &models[i]);
+          else
+            meshes[i].appendDraw(batch, 1, &models[i], nullptr);
+        }
+        if (path != Path::Direct)
+          calls += batch.submit(depth, pool, true, pulling);
+        lit.use();
+        for (unsigned int i = 0; i < numMeshes; ++i) {
+          if (path == Path::Direct)
+            meshes[i].Draw(lit, 1, &models[i], &normMats[i]);
+          else
+            meshes[i].appendDraw(batch, 1, &models[i], &normMats[i]);
+        }
+        if (path != Path::Direct)
+          calls += batch.submit(lit, pool, false, pulling);
+        else
+          calls += 2 * numMeshes;
+        chrono::duration<double, milli> submit =
+            chrono::steady_clock::now() - start;
+        glFinish();
+        chrono::duration<double, milli> finished =
+            chrono::steady_clock::now() - start;
+        ring.endFrame();
+        if (frame < 0)
+          continue;
+        result.submit += submit.count();
+        result.finished += finished.count();
+        result.calls += calls;
+      }
+    }
+
+    cout << numMeshes << " meshes, " << indices.size() / 3
+         << " triangles each, averages over " << frames << " frames\n";
+    for (const Result &result : results) {
+      cout << "  " << result.name << ": "
+           << static_cast<double>(result.calls) / frames << " draw calls, "
+           << result.submit / frames << " ms submitting, "
+           << result.finished / frames << " ms until finished\n";
+    }
+    ring.printStats();
+    for (Mesh &mesh : meshes)
+      mesh.freeMesh();
+    GeometryPool::setActive(nullptr);
+    InstanceRing::setActive(nullptr);
+  }
+
+  glfwDestroyWindow(window);
+  glfwTerminate();
+  return 0;
+}
@@ -0,0 +1,285 @@
+/*
+    Offline texture baker. Converts source images into .dds files holding a
+    block compressed mip chain, which loadTexture picks up instead of the
+    source image. Run it with the same flips the image is loaded with:
+
+      texbaker [--format auto|bc1|bc4|bc5|bc7|rgba8] [--no-flip]
+               [--flip-green] [--srgb] [--normal] [--box] [--force]
+               <image>...
+
+    With --format auto (the default) images with "normal" in their name are
+    baked to BC5, grayscale images to BC4 (their red channel), images with
+    alpha to BC7 and the rest to BC1. Images named like albedo, base color,
+    diffuse or color maps are treated as sRGB and normal maps have their mips
+    renormalized, --srgb and --normal force it for other names. The mip
+    chain is made with the Kaiser filter of the mip generator, or a box
+    filter with --box.
+*/
+#include "ThreadPool.h"
+#include "block_compression.h"
+#include "dds.h"
+#include "mip_generator.h"
+#include "pixel_kernels.h"
+#include "stb_image.h"
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+namespace fs = std::filesystem;
+
+namespace {
+
+struct Options {
+  string format = "auto";
+  bool flip = true;
+  bool flipGreen = false;
+  bool srgb = false;
+  bool normalMap = false;
+  bool box = false;
+  bool force = false;
+};
+
+struct Stats {
+  size_t sourceBytes = 0;
+  size_t bakedBytes = 0;
+};
+
+string lowerName(const string &path) {
+  string name = fs::path(path).filename().string();
+  transform(name.begin(), name.end(), name.begin(),
+            [](unsigned char c) { return tolower(c); });
+  return name;
+}
+
+bool containsAny(const string &name, const vector<string> &words) {
+  for (const string &word : words) {
+    if (name.find(word) != string::npos)
+      return true;
+  }
+  return false;
+}
+
+bool isNormalMap(const string &path, const Options &options) {
+  return options.normalMap || lowerName(path).find("normal") != string::npos;
+}
+
+bool isColorMap(const string &path, const Options &options) {
+  return options.srgb ||
+         containsAny(lowerName(path),
+                     {"albedo", "basecolor", "diffuse", "color"});
+}
+
+bc::Format chooseFormat(const string &path, const Options &options,
+                        const unsigned char *rgba, int width, int height,
+                        int nrComponents) {
+  if (options.format == "bc1")
+    return bc::Format::BC1;
+  if (options.format == "bc4")
+    return bc::Format::BC4;
+  if (options.format == "bc5")
+    return bc::Format::BC5;
+  if (options.format == "bc7")
+    return bc::Format::BC7;
+
+  if (isNormalMap(path, options))
+    return bc::Format::BC5;
+
+  bool grayscale = nrComponents <= 2;
+  bool alpha = false;
+  size_t numPixels = static_cast<size_t>(width) * height;
+  if (!grayscale) {
+    grayscale = true;
+    for (size_t i = 0; i < numPixels && grayscale; ++i) {
+      const unsigned char *p = rgba + i * 4;
+      grayscale = p[0] == p[1] && p[1] == p[2];
+    }
+  }
+  if (nrComponents == 4) {
+    for (size_t i = 0; i < numPixels && !alpha; ++i)
+      alpha = rgba[i * 4 + 3] != 255;
+  }
+  if (alpha)
+    return bc::Format::BC7;
+  return grayscale ? bc::Format::BC4 : bc::Format::BC1;
+}
+
+uint32_t dxgiFormat(bc::Format format, bool srgb) {
+  switch (format) {
+  case bc::Format::BC1:
+    return srgb ? dds::FORMAT_BC1_UNORM_SRGB : dds::FORMAT_BC1_UNORM;
+  case bc::Format::BC4:
+    return dds::FORMAT_BC4_UNORM;
+  case bc::Format::BC5:
+    return dds::FORMAT_BC5_UNORM;
+  case bc::Format::BC7:
+    return srgb ? dds::FORMAT_BC7_UNORM_SRGB : dds::FORMAT_BC7_UNORM;
+  }
+  return 0;
+}
+
+const char *formatName(bc::Format format) {
+  switch (format) {
+  case bc::Format::BC1:
+    return "BC1";
+  case bc::Format::BC4:
+    return "BC4";
+  case bc::Format::BC5:
+    return "BC5";
+  case bc::Format::BC7:
+    return "BC7";
+  }
+  return "";
+}
+
+bool bake(const string &path, const Options &options, Stats &stats) {
+  string bakedPath = dds::bakedPath(path);
+  error_code ec;
+  if (!options.force && fs::exists(bakedPath, ec) &&
+      fs::last_write_time(bakedPath, ec) >= fs::last_write_time(path, ec)) {
+    cout << path << ": up to date" << endl;
+    return true;
+  }
+
+  auto start = chrono::steady_clock::now();
+  int width, height, nrComponents;
+  stbi_set_flip_vertically_on_load(options.flip);
+  unsigned char *image = stbi_load(path.c_str(), &width, &height,
+                                    &nrComponents, STBI_rgb_alpha);
+  if (image == nullptr) {
+    cout << path << ": failed to load image" << endl;
+    return false;
+  }
+  size_t numPixels = static_cast<size_t>(width) * height;
+
+  // Flip green channel, useful for normal maps defined for DirectX.
+  if (options.flipGreen)
+    pixels::flipChannel(image, numPixels, 4, 1);
+
+  bool normalMap = isNormalMap(path, options);
+  bool srgb = !normalMap && isColorMap(path, options);
+  bool rgba8 = options.format == "rgba8";
+  bc::Format format =
+      chooseFormat(path, options, image, width, height, nrComponents);
+  // Grayscale maps are loaded as their red channel, which BC4 stores.
+  int channel = !rgba8 && format == bc::Format::BC4 ? 0 : -1;
+
+  mips::Options mipOptions;
+  mipOptions.filter = options.box ? mips::Filter::Box : mips::Filter::Kaiser;
+  mipOptions.srgb = srgb;
+  mipOptions.normalMap = normalMap;
+  mipOptions.pool = &ThreadPool::shared();
+  vector<dds::MipLevel> mipLevels;
+  unsigned char *mipData =
+      mips::generate(image, width, height, 4, mipOptions, mipLevels);
+  stbi_image_free(image);
+  if (mipData == nullptr) {
+    cout << path << ": out of memory" << endl;
+    return false;
+  }
+
+  dds::Description desc;
+  desc.width = width;
+  desc.height = height;
+  desc.bakeFlags = dds::bakeFlags(options.flip, options.flipGreen, srgb,
+                                  normalMap, false, channel);
+
+  // Compress the whole mip chain down to 1x1.
+  vector<unsigned char> data;
+  size_t sourceBytes = 0;
+  for (const dds::MipLevel &level : mipLevels) {
+    const unsigned char *rgba = mipData + level.offset;
+    if (rgba8) {
+      desc.levels.push_back({level.width, level.height, data.size(),
+                             level.size});
+      data.insert(data.end(), rgba, rgba + level.size);
+    } else {
+      vector<unsigned char> blocks =
+          bc::compressImage(rgba, level.width, level.height, format);
+      desc.levels.push_back(
+          {level.width, level.height, data.size(), blocks.size()});
+      data.insert(data.end(), blocks.begin(), blocks.end());
+    }
+    sourceBytes += static_cast<size_t>(level.width) * level.height *
+                   min(nrComponents, 4);
+  }
+  free(mipData);
+  if (rgba8)
+    desc.format = srgb ? dds::FORMAT_RGBA8_UNORM_SRGB : dds::FORMAT_RGBA8_UNORM;
+  else
+    desc.format = dxgiFormat(format, srgb);
+
+  if (!dds::write(bakedPath, desc, data.data()))
+    return false;
+
+  chrono::duration<double, milli> time = chrono::steady_clock::now() - start;
+  cout << path << ": " << width << "x" << height << " "
+       << (rgba8 ? "RGBA8" : formatName(format)) << (srgb ? " sRGB" : "")
+       << (normalMap ? " normal map" : "") << ", " << sourceBytes / 1024
+       << " KB -> " << data.size() / 1024 << " KB ("
+       << static_cast<double>(sourceBytes) / data.size() << ":1) in "
+       << time.count() << " ms" << endl;
+  stats.sourceBytes += sourceBytes;
+  stats.bakedBytes += data.size();
+  return true;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  Options options;
+  vector<string> paths;
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "--format") == 0 && i + 1 < argc)
+      options.format = argv[++i];
+    else if (strcmp(argv[i], "--no-flip") == 0)
+      options.flip = false;
+    else if (strcmp(argv[i], "--flip-green") == 0)
+      options.flipGreen = true;
+    else if (strcmp(argv[i], "--srgb") == 0)
+      options.srgb = true;
+    else if (strcmp(argv[i], "--normal") == 0)
+      options.normalMap = true;
+    else if (strcmp(argv[i], "--box") == 0)
+      options.box = true;
+    else if (strcmp(argv[i], "--force") == 0)
+      options.force = true;
+    else
+      paths.push_back(argv[i]);
+  }
+  const vector<string> formats = {"auto", "bc1", "bc4",
+                                  "bc5",  "bc7", "rgba8"};
+  if (paths.empty() || find(formats.begin(), formats.end(), options.format) ==
+                           formats.end()) {
+    cout << "Usage: texbaker [--format auto|bc1|bc4|bc5|bc7|rgba8] "
+            "[--no-flip] [--flip-green] [--srgb] [--normal] [--box] "
+            "[--force] <image>..."
+         << endl;
+    return 1;
+  }
+
+  cout << "Baking " << paths.size() << " images on "
+       << ThreadPool::shared().size() << " threads" << endl;
+  auto start = chrono::steady_clock::now();
+  Stats stats;
+  int failed = 0;
+  for (const string &path : paths) {
+    if (!bake(path, options, stats))
+      ++failed;
+  }
+
+  chrono::duration<double> time = chrono::steady_clock::now() - start;
+  // Source sizes are the uncompressed mip chains that were uploaded before.
+  if (stats.bakedBytes > 0) {
+    cout << "Total: " << stats.sourceBytes / (1024.0 * 1024.0) << " MB -> "
+         << stats.bakedBytes / (1024.0 * 1024.0) << " MB ("
+         << static_cast<double>(stats.sourceBytes) / stats.bakedBytes
+         << ":1) in " << time.count() << " s" << endl;
+  }
+  return failed == 0 ? 0 : 1;
+}
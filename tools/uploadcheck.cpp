@@ -0,0 +1,230 @@
+/*
+    Check of the UploadQueue on small staging rings. Buffers larger than
+    the ring, textures of many rows and textures whose rows are wider than
+    the ring are streamed frame by frame or with finish, through the
+    persistently mapped ring and through the one mapped per chunk, and read
+    back from the GPU. A queue without staging space has to drop its
+    uploads instead of waiting for them forever. Every upload has a frame
+    limit, so a stalled queue fails instead of hanging.
+
+    The context comes from EGL with a pbuffer, on the surfaceless platform
+    of Mesa when it is there, so no display is needed and it runs headless
+    under a software implementation:
+
+      LIBGL_ALWAYS_SOFTWARE=1 uploadcheck
+
+    It exits with 1 if a check failed.
+*/
+#include "UploadQueue.h"
+#include "gl_extensions.h"
+#include <glad/glad.h>
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+// Frames after which an upload counts as stalled.
+const int MAX_FRAMES = 100000;
+
+struct Case {
+  const char *name;
+  size_t stagingSize;
+  size_t frameBudget;
+  bool texture;
+  // Width and height of textures, RGBA, the size of buffers in width.
+  int width;
+  int height;
+  // Wait with finish instead of processing frames.
+  bool finish;
+  // The queue has no room for the upload, which has to be dropped.
+  bool dropped;
+};
+
+vector<unsigned char> randomBytes(size_t size, unsigned int seed) {
+  mt19937 rng(seed);
+  uniform_int_distribution<int> byte(0, 255);
+  vector<unsigned char> bytes(size);
+  for (unsigned char &value : bytes)
+    value = static_cast<unsigned char>(byte(rng));
+  return bytes;
+}
+
+// Upload the data of a case through queue, read it back and compare.
+bool runCase(const Case &test, UploadQueue &queue, unsigned int seed,
+             int &frames) {
+  size_t size = test.texture ? static_cast<size_t>(test.width) * test.height *
+                                   4
+                             : static_cast<size_t>(test.width);
+  vector<unsigned char> data = randomBytes(size, seed);
+
+  unsigned int object;
+  uint64_t ticket;
+  if (test.texture) {
+    glGenTextures(1, &object);
+    glBindTexture(GL_TEXTURE_2D, object);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, test.width, test.height, 0,
+                 GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    unsigned char *pixels = new unsigned char[size];
+    copy(data.begin(), data.end(), pixels);
+    ticket = queue.queueTexture(
+        object, 0, test.width, test.height, GL_RGBA, 4,
+        shared_ptr<const unsigned char>(pixels,
+                                        default_delete<unsigned char[]>()),
+        false);
+  } else {
+    glGenBuffers(1, &object);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, object);
+    glBufferData(GL_COPY_WRITE_BUFFER, size, nullptr, GL_STATIC_DRAW);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    ticket = queue.queueBuffer(object, 0, data.data(), size);
+  }
+
+  frames = 0;
+  if (test.finish) {
+    queue.finish();
+  } else {
+    while (!queue.isReady(ticket) && frames < MAX_FRAMES) {
+      queue.processFrame();
+      frames++;
+    }
+  }
+  bool passed = queue.isReady(ticket) && queue.pendingBytes() == 0;
+
+  vector<unsigned char> result(size);
+  if (test.texture) {
+    glBindTexture(GL_TEXTURE_2D, object);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, result.data());
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glDeleteTextures(1, &object);
+  } else {
+    glBindBuffer(GL_COPY_WRITE_BUFFER, object);
+    glGetBufferSubData(GL_COPY_WRITE_BUFFER, 0, size, result.data());
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    glDeleteBuffers(1, &object);
+  }
+  // Dropped uploads leave the destination as it was, only the queue has
+  // to move on.
+  if (!test.dropped)
+    passed = passed && result == data;
+  return passed;
+}
+
+// Display of the surfaceless platform of Mesa if the client supports it,
+// the default one otherwise.
+EGLDisplay getDisplay() {
+  const char *extensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+  auto getPlatformDisplay = reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(
+      eglGetProcAddress("eglGetPlatformDisplayEXT"));
+  if (extensions != nullptr && getPlatformDisplay != nullptr &&
+      strstr(extensions, "EGL_MESA_platform_surfaceless") != nullptr)
+    return getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA,
+                              EGL_DEFAULT_DISPLAY, nullptr);
+  return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+}
+
+void *getProcAddress(const char *name) {
+  return reinterpret_cast<void *>(eglGetProcAddress(name));
+}
+
+} // namespace
+
+int main() {
+  EGLDisplay display = getDisplay();
+  if (display == EGL_NO_DISPLAY || !eglInitialize(display, NULL, NULL)) {
+    cout << "Failed to initialize EGL\n";
+    return 1;
+  }
+  const EGLint configAttribs[] = {EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+                                  EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+                                  EGL_NONE};
+  EGLConfig config;
+  EGLint numConfigs = 0;
+  const EGLint surfaceAttribs[] = {EGL_WIDTH, 64, EGL_HEIGHT, 64, EGL_NONE};
+  const EGLint contextAttribs[] = {
+      EGL_CONTEXT_MAJOR_VERSION, 4, EGL_CONTEXT_MINOR_VERSION, 3,
+      EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+      EGL_NONE};
+  EGLSurface surface = EGL_NO_SURFACE;
+  EGLContext context = EGL_NO_CONTEXT;
+  if (eglBindAPI(EGL_OPENGL_API) &&
+      eglChooseConfig(display, configAttribs, &config, 1, &numConfigs) &&
+      numConfigs > 0) {
+    surface = eglCreatePbufferSurface(display, config, surfaceAttribs);
+    context = eglCreateContext(display, config, EGL_NO_CONTEXT,
+                               contextAttribs);
+  }
+  if (surface == EGL_NO_SURFACE || context == EGL_NO_CONTEXT ||
+      !eglMakeCurrent(display, surface, surface, context)) {
+    cout << "Failed to create an OpenGL 4.3 context with EGL\n";
+    eglTerminate(display);
+    return 1;
+  }
+  if (!gladLoadGLLoader(getProcAddress)) {
+    cout << "Failed to initialize GLAD\n";
+    eglTerminate(display);
+    return 1;
+  }
+  glext::load(getProcAddress);
+  cout << "Uploading through " << glGetString(GL_RENDERER) << "\n";
+
+  const Case cases[] = {
+      {"buffer larger than the ring", 64 << 10, 16 << 10, false, 1 << 20, 0,
+       false, false},
+      {"buffer larger than the ring, finish", 64 << 10, 16 << 10, false,
+       1 << 20, 0, true, false},
+      {"texture of many rows", 64 << 10, 16 << 10, true, 300, 200, false,
+       false},
+      {"texture rows wider than the ring", 16 << 10, 16 << 10, true, 8192, 3,
+       false, false},
+      {"texture rows wider than the ring, finish", 16 << 10, 1 << 20, true,
+       8192, 3, true, false},
+      {"texture rows wider than the budget", 1 << 20, 1000, true, 1000, 5,
+       false, false},
+      {"no staging space, finish", 0, 16 << 10, false, 4096, 0, true, true},
+  };
+
+  bool failed = false;
+  bool hasBufferStorage = glext::bufferStorage;
+  for (bool persistent : {true, false}) {
+    if (persistent && !hasBufferStorage)
+      continue;
+    // The queue maps the ring per chunk without ARB_buffer_storage.
+    glext::bufferStorage = persistent;
+    cout << (persistent ? "Persistently mapped ring:\n"
+                        : "Ring mapped per chunk:\n");
+    unsigned int seed = 1;
+    for (const Case &test : cases) {
+      int frames = 0;
+      bool passed;
+      {
+        UploadQueue queue(test.stagingSize, test.frameBudget);
+        passed = runCase(test, queue, seed++, frames);
+      }
+      passed = passed && glGetError() == GL_NO_ERROR;
+      failed = failed || !passed;
+      cout << "  " << test.name << ": ";
+      if (!test.finish)
+        cout << frames << " frames, ";
+      cout << (passed ? "passed" : "FAILED") << "\n";
+    }
+  }
+  glext::bufferStorage = hasBufferStorage;
+
+  eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+  eglDestroyContext(display, context);
+  eglDestroySurface(display, surface);
+  eglTerminate(display);
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,247 @@
+/*
+    Benchmark of the fragment cost of the variants of object.fs. Every
+    combination of its options is built with floor.vs and draws a quad
+    covering an offscreen framebuffer, with random maps, random shadow maps
+    (so part of the pixels find blockers) and the PCSS settings of the
+    demo. The GPU time of every pass is measured with timer queries. Runs in
+    a hidden window from the repository root, so the shaders are found.
+
+      variantbench [width] [height] [frames]
+*/
+#include "Light.h"
+#include "Shader.h"
+#include "SimpleMesh.h"
+#include "UniformBlock.h"
+#include "gl_extensions.h"
+#include "misc_sources.h"
+#include "structures.h"
+#include "uniform_blocks.h"
+#include <glad/glad.h>
+
+#include <GLFW/glfw3.h>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+// Shadow settings of renders/shadows.cpp.
+const unsigned int SHADOW_SIZE = 2048;
+const float SHADOW_MULT = 0.5f;
+const int NUM_SEARCH_SAMPLES = 16;
+const int NUM_PCF_SAMPLES = 32;
+const unsigned int MAP_SIZE = 512;
+
+mt19937 randGenerator(7);
+
+vector<float> randomValues(size_t count) {
+  uniform_real_distribution<float> distribution(0.0f, 1.0f);
+  vector<float> values(count);
+  for (float &value : values)
+    value = distribution(randGenerator);
+  return values;
+}
+
+unsigned int createRandomMap(GLenum target, GLenum internalFormat,
+                             GLenum format, unsigned int size,
+                             unsigned int channels, unsigned int layers = 1) {
+  unsigned int texture;
+  glGenTextures(1, &texture);
+  glBindTexture(target, texture);
+  vector<float> values = randomValues(size * size * channels * layers);
+  if (target == GL_TEXTURE_2D_ARRAY)
+    glTexImage3D(target, 0, internalFormat, size, size, layers, 0, format,
+                 GL_FLOAT, values.data());
+  else
+    glTexImage2D(target, 0, internalFormat, size, size, 0, format, GL_FLOAT,
+                 values.data());
+  if (format == GL_DEPTH_COMPONENT) {
+    glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  } else {
+    glGenerateMipmap(target);
+    glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+  }
+  glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_REPEAT);
+  glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_REPEAT);
+  return texture;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  int width = 1920;
+  int height = 1080;
+  int frames = 100;
+  if (argc > 1)
+    width = max(atoi(argv[1]), 1);
+  if (argc > 2)
+    height = max(atoi(argv[2]), 1);
+  if (argc > 3)
+    frames = max(atoi(argv[3]), 1);
+
+  glfwInit();
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+  glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+  glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+  GLFWwindow *window = glfwCreateWindow(800, 600, "variantbench", NULL, NULL);
+  if (!window) {
+    cout << "Failed to create GLFW window\n";
+    glfwTerminate();
+    return 1;
+  }
+  glfwMakeContextCurrent(window);
+  if (!gladLoadGL()) {
+    cout << "Failed to initialize GLAD\n";
+    return 1;
+  }
+  glext::load(reinterpret_cast<GLADloadproc>(glfwGetProcAddress));
+
+  {
+    // Offscreen target, so the size does not depend on the window.
+    unsigned int fbo, colorBuffer, depthBuffer;
+    glGenFramebuffers(1, &fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glGenRenderbuffers(1, &colorBuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, colorBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                              GL_RENDERBUFFER, colorBuffer);
+    glGenRenderbuffers(1, &depthBuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT,
+                              GL_RENDERBUFFER, depthBuffer);
+    glViewport(0, 0, width, height);
+
+    // Units as in renders/shadows.cpp: shadow maps on 0 to 2, the random
+    // angles on 3, the maps on 4 to 9 and the map arrays on the array targets
+    // of 4 to 8.
+    vector<unsigned int> textures;
+    for (GLenum unit = 0; unit < 3; ++unit) {
+      glActiveTexture(GL_TEXTURE0 + unit);
+      textures.push_back(createRandomMap(GL_TEXTURE_2D, GL_DEPTH_COMPONENT32F,
+                                         GL_DEPTH_COMPONENT, SHADOW_SIZE, 1));
+    }
+    glActiveTexture(GL_TEXTURE3);
+    textures.push_back(createRandomMap(GL_TEXTURE_2D, GL_RG16F, GL_RG, 32, 2));
+    for (GLenum unit = 4; unit < 10; ++unit) {
+      glActiveTexture(GL_TEXTURE0 + unit);
+      textures.push_back(
+          createRandomMap(GL_TEXTURE_2D, GL_RGBA8, GL_RGBA, MAP_SIZE, 4));
+      if (unit < 9)
+        textures.push_back(createRandomMap(GL_TEXTURE_2D_ARRAY, GL_RGBA8,
+                                           GL_RGBA, MAP_SIZE, 4, 4));
+    }
+    glActiveTexture(GL_TEXTURE0);
+
+    // The shadowBlock of object.fs, std140.
+    unsigned int shadowUBO;
+    glGenBuffers(1, &shadowUBO);
+    glBindBuffer(GL_UNIFORM_BUFFER, shadowUBO);
+    vector<float> block(32 * 4 + 4, 0.0f);
+    for (unsigned int i = 0; i < 32; ++i) {
+      block[4 * i] = sources::poissonDisk[i].x;
+      block[4 * i + 1] = sources::poissonDisk[i].y;
+    }
+    block[128] = 1.0f / SHADOW_SIZE;
+    block[129] = 1.0f / SHADOW_SIZE;
+    memcpy(&block[130], &NUM_SEARCH_SAMPLES, 4);
+    memcpy(&block[131], &NUM_PCF_SAMPLES, 4);
+    block.push_back(SHADOW_MULT);
+    glBufferData(GL_UNIFORM_BUFFER, block.size() * sizeof(float),
+                 block.data(), GL_STATIC_DRAW);
+    glBindBufferBase(GL_UNIFORM_BUFFER, SHADOW_UBO, shadowUBO);
+
+    // The lights face the quad, the light spaces map it onto the shadow
+    // maps.
+    Light spotLight("spotLight", false, 0.3f, 0.0f, 1.0f, 0.14f, 0.07f);
+    spotLight.position = glm::vec3(0.0f, 0.0f, 2.0f);
+    spotLight.direction = glm::vec3(0.0f, 0.0f, -1.0f);
+    spotLight.cLight = glm::vec3(10.0f);
+    Light tubeLight("tubeLight", false, 0.15f, 3.0f);
+    tubeLight.position = spotLight.position;
+    tubeLight.cLight = glm::vec3(10.0f);
+    Light dirLight("dirLight", true);
+    glm::mat4 model = glm::scale(glm::mat4(1.0f), glm::vec3(2.0f));
+
+    // Identity camera and light spaces.
+    UniformBlock frameBlock(FRAME_UBO, sizeof(FrameBlock));
+    FrameBlock frame;
+    frame.viewPos = glm::vec4(0.0f, 0.0f, 2.0f, 1.0f);
+    frameBlock.write(&frame);
+    UniformBlock lightBlock(LIGHT_UBO, sizeof(LightBlock));
+    LightBlock lights;
+    lights.dirLight = LightData(dirLight);
+    lights.spotLight = LightData(spotLight);
+    lights.tubeLight = LightData(tubeLight);
+    lights.tubeP0 = glm::vec4(-1.5f, 0.0f, 2.0f, 1.0f);
+    lights.tubeP1 = glm::vec4(1.5f, 0.0f, 2.0f, 1.0f);
+    lightBlock.write(&lights);
+
+    ShaderVariants variants(
+        "shaders/floor.vs", "shaders/object.fs",
+        {"AREA_LIGHTS", "TUBE_LIGHT", "MATERIAL_ARRAYS", "PARALLAX_OCCLUSION"});
+    variants.setInit([&](Shader &prog) {
+      const char *samplers[] = {"shadowMap",   "spotShadowMap", "tubeShadowMap",
+                                "randomAngles", "albedoMap",    "normalMap",
+                                "metallicMap", "roughnessMap",  "aoMap",
+                                "heightMap"};
+      for (int unit = 0; unit < 10; ++unit)
+        prog.setUnifS(samplers[unit], unit);
+      prog.setUnifS("heightScale", 0.05f);
+      prog.setUnifS("model", model);
+      prog.setUnifS("normMat", glm::mat3(1.0f));
+    });
+    const unsigned int numVariants = 1u << 4;
+    ShaderBatch batch;
+    for (unsigned int key = 0; key < numVariants; ++key)
+      variants.request(batch, key);
+    batch.finish();
+
+    SimpleMesh quad(sources::quadVertices, 6, vector<string>(), false, true);
+    glEnable(GL_DEPTH_TEST);
+    unsigned int query;
+    glGenQueries(1, &query);
+    cout << width << "x" << height << ", averages over " << frames
+         << " frames\n";
+    for (unsigned int key = 0; key < numVariants; ++key) {
+      Shader &prog = variants.get(key);
+      prog.use();
+      double total = 0.0;
+      // The first frames warm up the driver and are not counted.
+      for (int frame = -3; frame < frames; ++frame) {
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        glBeginQuery(GL_TIME_ELAPSED, query);
+        quad.Draw(prog, 1, nullptr, nullptr);
+        glEndQuery(GL_TIME_ELAPSED);
+        GLuint64 elapsed = 0;
+        glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed);
+        if (frame >= 0)
+          total += elapsed / 1e6;
+      }
+      double perPass = total / frames;
+      cout << "  " << variants.describe(key) << ": " << perPass << " ms, "
+           << perPass * 1e6 / (double(width) * height) << " ns per pixel\n";
+    }
+    glDeleteQueries(1, &query);
+    glDeleteBuffers(1, &shadowUBO);
+    glDeleteTextures(static_cast<GLsizei>(textures.size()), textures.data());
+    glDeleteRenderbuffers(1, &colorBuffer);
+    glDeleteRenderbuffers(1, &depthBuffer);
+    glDeleteFramebuffers(1, &fbo);
+  }
+
+  glfwDestroyWindow(window);
+  glfwTerminate();
+  return 0;
+}